@@ -0,0 +1,58 @@
+#ifndef FACEINDEXTABLE_H
+#define FACEINDEXTABLE_H
+/*
+FaceIndexTable.h
+
+The candidate faces of each voxel of a narrow band (the face index map of a
+.fids file) in compressed sparse rows, over the sorted linear voxel indices,
+with an open addressing hash from voxel index to row for the lookups.
+
+The rows are kept in a single buffer that is also the binary file: a 32 byte
+header (magic, version, number of voxels, number of faces), the row offsets
+(uint64, voxels + 1), the voxel indices (int32) and the faces (int32). Load
+reads it in one go and only rebuilds the hash.
+*/
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+class FaceIndexTable {
+public:
+    typedef int KeyType;    // TriMesh::VoxelIndexType
+
+    FaceIndexTable();
+
+    void Clear();
+    void Build(const std::map<KeyType, std::vector<int> > &faceIndexMap);
+
+    bool Write(const char *filename) const;
+
+    // read a file written by Write; false if it is not one or is damaged
+    bool Load(const char *filename);
+
+    // true if the file starts like one written by Write
+    static bool IsBinaryFile(const char *filename);
+
+    bool Empty() const { return Voxels() == 0; }
+    size_t Voxels() const;
+    size_t Faces() const;
+
+    // the i-th voxel index, in increasing order
+    KeyType Key(size_t i) const { return Keys()[i]; }
+
+    // the faces of the voxel, false if the voxel is not in the table
+    bool Find(KeyType key, const int *&begin, const int *&end) const;
+
+private:
+    const unsigned long long *Offsets() const;
+    const KeyType *Keys() const;
+    const int *FaceData() const;
+    void BuildSlots();
+
+    std::vector<unsigned long long> m_data;     // header and rows, as in the file
+    std::vector<int> m_slots;                   // row of each hash slot, -1 if empty
+    unsigned int m_shift;                       // 64 - log2 of the number of slots
+};
+
+#endif
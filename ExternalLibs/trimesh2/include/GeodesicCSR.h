@@ -0,0 +1,72 @@
+#ifndef GEODESICCSR_H
+#define GEODESICCSR_H
+/*
+GeodesicCSR.h
+
+Geodesic distances between the vertices of a mesh, truncated at a stop
+distance, in compressed sparse rows. Row i holds the vertices j < i that are
+within the stop distance, sorted by j.
+
+The binary file is a 32 byte header (magic, version, number of rows, stop
+distance, number of entries) followed by the row offsets (uint64, rows + 1),
+the column indices (uint32) and the distances (float32). Load maps the file
+instead of reading it where the platform allows.
+*/
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+class GeodesicCSR {
+public:
+    typedef std::pair<unsigned int, float> Entry;   // column and distance
+
+    GeodesicCSR();
+    ~GeodesicCSR();
+
+    // start an empty set of rows
+    void Clear(float stopDistance);
+
+    // append the next row, sorted by column
+    void AppendRow(const std::vector<Entry> &row);
+
+    bool Write(const char *filename) const;
+
+    // map a file written by Write; false if it is not one or is damaged
+    bool Load(const char *filename);
+
+    // true if the file starts like one written by Write
+    static bool IsCSRFile(const char *filename);
+
+    unsigned int Rows() const { return m_rows; }
+    unsigned long long Entries() const { return m_offsets ? m_offsets[m_rows] : 0; }
+    float StopDistance() const { return m_stopDistance; }
+
+    // distance between vertex row and vertex col < row, if stored
+    bool Find(unsigned int row, unsigned int col, float &d) const;
+
+private:
+    GeodesicCSR(const GeodesicCSR &);             // not implemented
+    GeodesicCSR &operator=(const GeodesicCSR &);  // not implemented
+
+    void Unmap();
+    void UpdateViews();
+
+    float m_stopDistance;
+    unsigned int m_rows;
+
+    // storage while building, or when the file can not be mapped
+    std::vector<unsigned long long> m_offsetData;
+    std::vector<unsigned int> m_colData;
+    std::vector<float> m_distData;
+
+    // the rows, in the storage above or in the mapped file
+    const unsigned long long *m_offsets;
+    const unsigned int *m_cols;
+    const float *m_dists;
+
+    void *m_map;
+    size_t m_mapSize;
+};
+
+#endif
@@ -18,8 +18,11 @@ Class for triangle meshes.
 #include "Vec.h"
 #include "Color.h"
 #include "KDtree.h"
+#include "GeodesicCSR.h"
+#include "FaceIndexTable.h"
 #include "math.h"
 #include <vector>
+#include <memory>
 #include <list>
 #include <map>
 #include <limits>
@@ -387,7 +390,8 @@ public:
 
     // Face Index Map -- PM
     typedef int VoxelIndexType;
-    map<VoxelIndexType, vector<int> > faceIndexMap;
+    map<VoxelIndexType, vector<int> > faceIndexMap;     // filled while generating, then moved to faceIndexTable
+    FaceIndexTable faceIndexTable;                       // used by the lookups, read and written as .fids
     // map< face, ...> didnot work
     //map<Face, double > areaInvPerTri;
     //map<Face, double > areaPerTri; // shireen
@@ -431,6 +435,7 @@ public:
     KDtree *kd;
     double maxEdgeLength;
     vector< map<unsigned int, float> > geodesicMap;
+    std::shared_ptr<GeodesicCSR> geodesicCSR;   // all-pairs distances, see meshFIM::GenerateReducedData
     float *geodesic;
 
     vector< vector<float> > features;
@@ -830,17 +835,26 @@ public:
 
 
     /* Prateep */
-    void WriteFaceIndexMap(const char* outfilename)
+    // binary by default, see FaceIndexTable.h; the text format is "voxel: face face ..." per line
+    void WriteFaceIndexMap(const char* outfilename, bool binary = true)
     {
-        std::ofstream fout(outfilename, std::ios::out);
-        map<VoxelIndexType, vector<int> >::iterator faceIndexMapIt;
-        vector<int>::iterator faceIndexIt;
+        if(binary)
+        {
+            if(!this->faceIndexTable.Write(outfilename))
+                std::cout << "Could not write " << outfilename << std::endl;
+            return;
+        }
 
-        for(faceIndexMapIt = this->faceIndexMap.begin(); faceIndexMapIt != this->faceIndexMap.end(); faceIndexMapIt++)
+        std::ofstream fout(outfilename, std::ios::out);
+        for(size_t i = 0; i < this->faceIndexTable.Voxels(); i++)
         {
-            fout << (int) (*faceIndexMapIt).first << ": ";
-            for(faceIndexIt = faceIndexMapIt->second.begin(); faceIndexIt != faceIndexMapIt->second.end(); faceIndexIt++) {
-                fout << (*faceIndexIt) << " ";
+            VoxelIndexType index = this->faceIndexTable.Key(i);
+            const int *faceIt, *faceEnd;
+            this->faceIndexTable.Find(index, faceIt, faceEnd);
+
+            fout << (int) index << ": ";
+            for(; faceIt != faceEnd; faceIt++) {
+                fout << (*faceIt) << " ";
             }
             fout << std::endl;
         }
@@ -858,6 +872,15 @@ public:
         else
         {
             std::cout << "reading face indices from " << infilename << std::endl;
+            this->ClearFaceIndexMap();
+
+            if(FaceIndexTable::IsBinaryFile(infilename))
+            {
+                infile.close();
+                if(!this->faceIndexTable.Load(infilename))
+                    std::cout << "Damaged face index file:" << infilename << std::endl;
+                return;
+            }
 
 //            map<VoxelIndexType, set<int> > tmpFaceIndexMap;
             std::string line;
@@ -882,12 +905,16 @@ public:
 
             //            tmpFaceIndexMap.clear(); // clear memory
             infile.close();
+
+            this->faceIndexTable.Build(this->faceIndexMap);
+            this->faceIndexMap.clear();
         }
     }
 
     void ClearFaceIndexMap()
     {
         this->faceIndexMap.clear();
+        this->faceIndexTable.Clear();
     }
 
     /* Prateep */
@@ -1422,6 +1449,8 @@ public:
         }
 
         std::cout << "\nLength of face Index Map " << this->faceIndexMap.size() << std::endl;
+        this->faceIndexTable.Build(this->faceIndexMap);
+        this->faceIndexMap.clear();
 
         if(debug_prefix.compare("") > 0)
         {
@@ -1759,6 +1788,8 @@ public:
 
         std::cout << "Done";
         std::cout << "\nLength of face Index Map " << this->faceIndexMap.size() << std::endl;
+        this->faceIndexTable.Build(this->faceIndexMap);
+        this->faceIndexMap.clear();
 
         if(debug_prefix.compare("") > 0)
         {
@@ -2048,6 +2079,8 @@ public:
         }
 
         std::cout << "\nLength of face Index Map " << this->faceIndexMap.size() << std::endl;
+        this->faceIndexTable.Build(this->faceIndexMap);
+        this->faceIndexMap.clear();
     }
 
 
@@ -2055,22 +2088,20 @@ public:
     {
         int faceID;
 
-        if(this->faceIndexMap.size() > 0) // there is a generated face index map so used it
+        if(!this->faceIndexTable.Empty()) // there is a generated face index map so used it
         {
             // Physical point to Image Index
             VoxelIndexType linearIndX = this->physicalPointToLinearIndex(x);
 
             // collect face indices for this voxel
-            std::map<VoxelIndexType, vector<int> >::iterator it = this->faceIndexMap.find(linearIndX);
-            if(it != this->faceIndexMap.end()) // see if the linearIndX already exist in the face index map
+            const int *faceBegin, *faceEnd;
+            if(this->faceIndexTable.Find(linearIndX, faceBegin, faceEnd)) // see if the linearIndX already exist in the face index map
             {
 //                std::cout << "WOW, fids will be used ... \n" ;
-                vector<int> faceList = this->faceIndexMap[linearIndX];
-
                 double minDist = LARGENUM;
                 int winnerIndex;
 
-                for(vector<int>::iterator it = faceList.begin();  it != faceList.end(); ++it)
+                for(const int *it = faceBegin;  it != faceEnd; ++it)
                 {
                     triangleX = this->faces[(*it)];
 
@@ -2172,22 +2203,20 @@ public:
         Face triangleX;
         float alphaX, betaX, gammaX;
 
-        if(this->faceIndexMap.size() > 0) // there is a generated face index map so used it
+        if(!this->faceIndexTable.Empty()) // there is a generated face index map so used it
         {
             //std::cout << "WOW, fids will be used ... \n" ;
             // Physical point to Image Index
             VoxelIndexType linearIndX = this->physicalPointToLinearIndex(x);
 
             // collect face indices for this voxel
-            std::map<VoxelIndexType, vector<int> >::iterator it = this->faceIndexMap.find(linearIndX);
-            if(it != this->faceIndexMap.end())
+            const int *faceBegin, *faceEnd;
+            if(this->faceIndexTable.Find(linearIndX, faceBegin, faceEnd))
             {
-                vector<int> faceList = this->faceIndexMap[linearIndX];
-
                 double minDist = LARGENUM;
                 int winnerIndex;
 
-                for(vector<int>::iterator it = faceList.begin();  it != faceList.end(); ++it)
+                for(const int *it = faceBegin;  it != faceEnd; ++it)
                 {
                     triangleX = this->faces[(*it)];
 
@@ -2315,6 +2344,12 @@ public:
             key = v1;
         }
 
+        if (this->geodesicCSR && this->geodesicCSR->Find(vert, key, gDist))
+            return gDist;
+
+        if ((size_t)vert >= this->geodesicMap.size())
+            return LARGENUM;
+
         std::map<unsigned int,float>::iterator geoIter = this->geodesicMap[vert].find(key);
         if (geoIter != this->geodesicMap[vert].end())
         {
@@ -0,0 +1,222 @@
+/*
+FaceIndexTable.cc
+
+Face index map of a .fids file in compressed sparse rows, see FaceIndexTable.h.
+*/
+
+#include "FaceIndexTable.h"
+#include <stdint.h>
+#include <string.h>
+#include <fstream>
+
+namespace {
+
+const char FIDS_MAGIC[8] = { 'S', 'W', 'F', 'I', 'D', 'S', 'B', 'N' };
+const uint32_t FIDS_VERSION = 1;
+
+struct FidsHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t voxels;
+    uint64_t faces;
+    uint64_t reserved;
+};
+
+// bytes of the header and rows
+size_t DataSize(uint64_t voxels, uint64_t faces)
+{
+    return sizeof(FidsHeader) + size_t(voxels + 1) * sizeof(uint64_t) +
+           size_t(voxels) * sizeof(int32_t) + size_t(faces) * sizeof(int32_t);
+}
+
+const FidsHeader *Header(const std::vector<unsigned long long> &data)
+{
+    return reinterpret_cast<const FidsHeader *>(&data[0]);
+}
+
+} // namespace
+
+FaceIndexTable::FaceIndexTable() : m_shift(0)
+{
+}
+
+void FaceIndexTable::Clear()
+{
+    m_data.clear();
+    m_slots.clear();
+    m_shift = 0;
+}
+
+size_t FaceIndexTable::Voxels() const
+{
+    return m_data.empty() ? 0 : Header(m_data)->voxels;
+}
+
+size_t FaceIndexTable::Faces() const
+{
+    return m_data.empty() ? 0 : size_t(Header(m_data)->faces);
+}
+
+const unsigned long long *FaceIndexTable::Offsets() const
+{
+    return &m_data[0] + sizeof(FidsHeader) / sizeof(uint64_t);
+}
+
+const FaceIndexTable::KeyType *FaceIndexTable::Keys() const
+{
+    return reinterpret_cast<const KeyType *>(Offsets() + Voxels() + 1);
+}
+
+const int *FaceIndexTable::FaceData() const
+{
+    return Keys() + Voxels();
+}
+
+void FaceIndexTable::Build(const std::map<KeyType, std::vector<int> > &faceIndexMap)
+{
+    Clear();
+
+    uint64_t faces = 0;
+    std::map<KeyType, std::vector<int> >::const_iterator it;
+    for (it = faceIndexMap.begin(); it != faceIndexMap.end(); it++)
+        faces += it->second.size();
+
+    FidsHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, FIDS_MAGIC, sizeof(FIDS_MAGIC));
+    h.version = FIDS_VERSION;
+    h.voxels = uint32_t(faceIndexMap.size());
+    h.faces = faces;
+
+    size_t size = DataSize(h.voxels, h.faces);
+    m_data.assign((size + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+    memcpy(&m_data[0], &h, sizeof(h));
+
+    unsigned long long *offsets = &m_data[0] + sizeof(FidsHeader) / sizeof(uint64_t);
+    KeyType *keys = reinterpret_cast<KeyType *>(offsets + h.voxels + 1);
+    int *faceData = keys + h.voxels;
+
+    size_t row = 0;
+    uint64_t offset = 0;
+    for (it = faceIndexMap.begin(); it != faceIndexMap.end(); it++, row++) {
+        offsets[row] = offset;
+        keys[row] = it->first;
+        for (size_t j = 0; j < it->second.size(); j++)
+            faceData[offset++] = it->second[j];
+    }
+    offsets[row] = offset;
+
+    BuildSlots();
+}
+
+void FaceIndexTable::BuildSlots()
+{
+    size_t voxels = Voxels();
+    m_slots.clear();
+    if (voxels == 0)
+        return;
+
+    // at most half full
+    unsigned int bits = 1;
+    while ((size_t(1) << bits) < 2 * voxels)
+        bits++;
+    m_shift = 64 - bits;
+    m_slots.assign(size_t(1) << bits, -1);
+
+    const KeyType *keys = Keys();
+    size_t mask = m_slots.size() - 1;
+    for (size_t row = 0; row < voxels; row++) {
+        size_t s = size_t((uint64_t(uint32_t(keys[row])) * 0x9E3779B97F4A7C15ull) >> m_shift);
+        while (m_slots[s] >= 0)
+            s = (s + 1) & mask;
+        m_slots[s] = int(row);
+    }
+}
+
+bool FaceIndexTable::Find(KeyType key, const int *&begin, const int *&end) const
+{
+    if (m_slots.empty())
+        return false;
+
+    const KeyType *keys = Keys();
+    size_t mask = m_slots.size() - 1;
+    size_t s = size_t((uint64_t(uint32_t(key)) * 0x9E3779B97F4A7C15ull) >> m_shift);
+    for (;;) {
+        int row = m_slots[s];
+        if (row < 0)
+            return false;
+        if (keys[row] == key) {
+            const unsigned long long *offsets = Offsets();
+            begin = FaceData() + offsets[row];
+            end = FaceData() + offsets[row + 1];
+            return true;
+        }
+        s = (s + 1) & mask;
+    }
+}
+
+bool FaceIndexTable::Write(const char *filename) const
+{
+    if (m_data.empty()) {
+        FaceIndexTable empty;
+        empty.Build(std::map<KeyType, std::vector<int> >());
+        return empty.Write(filename);
+    }
+
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open())
+        return false;
+    out.write(reinterpret_cast<const char *>(&m_data[0]), DataSize(Voxels(), Faces()));
+    return out.good();
+}
+
+bool FaceIndexTable::IsBinaryFile(const char *filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    char magic[sizeof(FIDS_MAGIC)];
+    if (!in.read(magic, sizeof(magic)))
+        return false;
+    return memcmp(magic, FIDS_MAGIC, sizeof(FIDS_MAGIC)) == 0;
+}
+
+bool FaceIndexTable::Load(const char *filename)
+{
+    Clear();
+
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (!in.is_open())
+        return false;
+    size_t size = size_t(in.tellg());
+    in.seekg(0);
+    if (size < sizeof(FidsHeader))
+        return false;
+
+    m_data.assign((size + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+    if (!in.read(reinterpret_cast<char *>(&m_data[0]), size)) {
+        Clear();
+        return false;
+    }
+
+    const FidsHeader *h = Header(m_data);
+    if (memcmp(h->magic, FIDS_MAGIC, sizeof(FIDS_MAGIC)) != 0 || h->version != FIDS_VERSION ||
+        size != DataSize(h->voxels, h->faces)) {
+        Clear();
+        return false;
+    }
+
+    // offsets increasing up to the number of faces, voxel indices increasing
+    const unsigned long long *offsets = Offsets();
+    const KeyType *keys = Keys();
+    size_t voxels = Voxels();
+    bool valid = (offsets[0] == 0) && (offsets[voxels] == h->faces);
+    for (size_t i = 0; valid && i < voxels; i++) {
+        valid = (offsets[i] <= offsets[i + 1]) && (i == 0 || keys[i - 1] < keys[i]);
+    }
+    if (!valid) {
+        Clear();
+        return false;
+    }
+
+    BuildSlots();
+    return true;
+}
@@ -0,0 +1,231 @@
+/*
+GeodesicCSR.cc
+
+Compressed sparse rows of truncated geodesic distances, see GeodesicCSR.h.
+*/
+
+#include "GeodesicCSR.h"
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char CSR_MAGIC[8] = { 'S', 'W', 'G', 'E', 'O', 'C', 'S', 'R' };
+const uint32_t CSR_VERSION = 1;
+
+struct CSRHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t rows;
+    float stopDistance;
+    uint32_t reserved;
+    uint64_t entries;
+};
+
+// size of a file with the given header
+size_t FileSize(const CSRHeader &h)
+{
+    return sizeof(CSRHeader) + (size_t(h.rows) + 1) * sizeof(uint64_t) +
+           size_t(h.entries) * (sizeof(uint32_t) + sizeof(float));
+}
+
+bool ValidHeader(const CSRHeader &h, size_t size)
+{
+    return memcmp(h.magic, CSR_MAGIC, sizeof(CSR_MAGIC)) == 0 &&
+           h.version == CSR_VERSION && size == FileSize(h);
+}
+
+} // namespace
+
+GeodesicCSR::GeodesicCSR() :
+    m_stopDistance(0), m_rows(0), m_offsets(0), m_cols(0), m_dists(0), m_map(0), m_mapSize(0)
+{
+}
+
+GeodesicCSR::~GeodesicCSR()
+{
+    Unmap();
+}
+
+void GeodesicCSR::Unmap()
+{
+#ifndef _WIN32
+    if (m_map)
+        munmap(m_map, m_mapSize);
+#endif
+    m_map = 0;
+    m_mapSize = 0;
+}
+
+void GeodesicCSR::UpdateViews()
+{
+    m_offsets = m_offsetData.empty() ? 0 : &m_offsetData[0];
+    m_cols = m_colData.empty() ? 0 : &m_colData[0];
+    m_dists = m_distData.empty() ? 0 : &m_distData[0];
+}
+
+void GeodesicCSR::Clear(float stopDistance)
+{
+    Unmap();
+    m_stopDistance = stopDistance;
+    m_rows = 0;
+    m_offsetData.assign(1, 0);
+    m_colData.clear();
+    m_distData.clear();
+    UpdateViews();
+}
+
+void GeodesicCSR::AppendRow(const std::vector<Entry> &row)
+{
+    if (m_map || m_offsetData.empty())
+        Clear(m_stopDistance);
+
+    for (size_t i = 0; i < row.size(); i++) {
+        m_colData.push_back(row[i].first);
+        m_distData.push_back(row[i].second);
+    }
+    m_offsetData.push_back(m_colData.size());
+    m_rows++;
+    UpdateViews();
+}
+
+bool GeodesicCSR::Find(unsigned int row, unsigned int col, float &d) const
+{
+    if (row >= m_rows)
+        return false;
+
+    const unsigned int *begin = m_cols + m_offsets[row];
+    const unsigned int *end = m_cols + m_offsets[row + 1];
+    const unsigned int *it = std::lower_bound(begin, end, col);
+    if (it == end || *it != col)
+        return false;
+
+    d = m_dists[it - m_cols];
+    return true;
+}
+
+bool GeodesicCSR::Write(const char *filename) const
+{
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open())
+        return false;
+
+    CSRHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CSR_MAGIC, sizeof(CSR_MAGIC));
+    h.version = CSR_VERSION;
+    h.rows = m_rows;
+    h.stopDistance = m_stopDistance;
+    h.entries = Entries();
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+
+    if (m_offsets) {
+        for (unsigned int i = 0; i <= m_rows; i++) {
+            uint64_t offset = m_offsets[i];
+            out.write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+        }
+    } else {
+        uint64_t offset = 0;
+        out.write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+    }
+    if (h.entries) {
+        out.write(reinterpret_cast<const char *>(m_cols), h.entries * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char *>(m_dists), h.entries * sizeof(float));
+    }
+    return out.good();
+}
+
+bool GeodesicCSR::IsCSRFile(const char *filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    char magic[sizeof(CSR_MAGIC)];
+    if (!in.read(magic, sizeof(magic)))
+        return false;
+    return memcmp(magic, CSR_MAGIC, sizeof(CSR_MAGIC)) == 0;
+}
+
+bool GeodesicCSR::Load(const char *filename)
+{
+    Clear(0);
+    uint64_t entries = 0;
+
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(CSRHeader))
+        map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    const CSRHeader *h = static_cast<const CSRHeader *>(map);
+    if (!ValidHeader(*h, st.st_size)) {
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    m_offsetData.clear();
+    m_map = map;
+    m_mapSize = st.st_size;
+    m_stopDistance = h->stopDistance;
+    m_rows = h->rows;
+    const char *data = static_cast<const char *>(map) + sizeof(CSRHeader);
+    m_offsets = reinterpret_cast<const unsigned long long *>(data);
+    m_cols = reinterpret_cast<const unsigned int *>(data + (size_t(m_rows) + 1) * sizeof(uint64_t));
+    m_dists = reinterpret_cast<const float *>(m_cols + h->entries);
+    entries = h->entries;
+#else
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (!in.is_open())
+        return false;
+    size_t size = size_t(in.tellg());
+    in.seekg(0);
+
+    CSRHeader h;
+    if (size < sizeof(h) || !in.read(reinterpret_cast<char *>(&h), sizeof(h)) || !ValidHeader(h, size))
+        return false;
+
+    m_offsetData.resize(size_t(h.rows) + 1);
+    m_colData.resize(h.entries);
+    m_distData.resize(h.entries);
+    in.read(reinterpret_cast<char *>(&m_offsetData[0]), m_offsetData.size() * sizeof(uint64_t));
+    if (h.entries) {
+        in.read(reinterpret_cast<char *>(&m_colData[0]), h.entries * sizeof(uint32_t));
+        in.read(reinterpret_cast<char *>(&m_distData[0]), h.entries * sizeof(float));
+    }
+    if (!in) {
+        Clear(0);
+        return false;
+    }
+    m_stopDistance = h.stopDistance;
+    m_rows = h.rows;
+    entries = h.entries;
+    UpdateViews();
+#endif
+
+    // the offsets must be increasing and end at the number of entries
+    for (unsigned int i = 0; i < m_rows; i++) {
+        if (m_offsets[i] > m_offsets[i + 1]) {
+            Clear(0);
+            return false;
+        }
+    }
+    if (m_offsets[0] != 0 || m_offsets[m_rows] != entries) {
+        Clear(0);
+        return false;
+    }
+    return true;
+}
@@ -17,6 +17,147 @@
 #include <iostream>
 #include "Procrustes3D.h"
 #include <vnl/algo/vnl_svd.h>
+#include <vnl/vnl_det.h>
+#include <vnl/vnl_det.h>
+
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Eigenvector of the largest eigenvalue of a symmetric 4x4 matrix, by cyclic
+// Jacobi rotations.
+void LargestEigenvector4(double a[4][4], double q[4])
+{
+    double v[4][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+
+    for(int sweep = 0; sweep < 50; sweep++)
+    {
+        double off = 0.0, diag = 0.0;
+        for(int p = 0; p < 4; p++)
+        {
+            diag += a[p][p] * a[p][p];
+            for(int r = p + 1; r < 4; r++)
+                off += a[p][r] * a[p][r];
+        }
+        if(off <= 1.0e-30 * diag || off == 0.0)
+            break;
+
+        for(int p = 0; p < 3; p++)
+        {
+            for(int r = p + 1; r < 4; r++)
+            {
+                if(a[p][r] == 0.0)
+                    continue;
+
+                const double theta = (a[r][r] - a[p][p]) / (2.0 * a[p][r]);
+                const double t = (theta >= 0.0 ? 1.0 : -1.0) /
+                                 (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                const double c = 1.0 / std::sqrt(t * t + 1.0);
+                const double s = t * c;
+
+                for(int k = 0; k < 4; k++)
+                {
+                    const double akp = a[k][p], akr = a[k][r];
+                    a[k][p] = c * akp - s * akr;
+                    a[k][r] = s * akp + c * akr;
+                }
+                for(int k = 0; k < 4; k++)
+                {
+                    const double apk = a[p][k], ark = a[r][k];
+                    a[p][k] = c * apk - s * ark;
+                    a[r][k] = s * apk + c * ark;
+                }
+                for(int k = 0; k < 4; k++)
+                {
+                    const double vkp = v[k][p], vkr = v[k][r];
+                    v[k][p] = c * vkp - s * vkr;
+                    v[k][r] = s * vkp + c * vkr;
+                }
+            }
+        }
+    }
+
+    int best = 0;
+    for(int k = 1; k < 4; k++)
+        if(a[k][k] > a[best][best])
+            best = k;
+    for(int k = 0; k < 4; k++)
+        q[k] = v[k][best];
+}
+
+// Rotation R maximizing sum_j target_j . (R source_j), given the cross
+// covariance h(a,b) = sum_j source_j[a] * target_j[b].  This is Horn's closed
+// form solution: the rotation is the unit quaternion that is the dominant
+// eigenvector of a symmetric 4x4 matrix built from h.  Unlike V * U^T from an
+// SVD it is always a proper rotation.
+void RotationFromCrossCovariance(const vnl_matrix_fixed<double, 3, 3> & h,
+                                 vnl_matrix_fixed<double, 3, 3> & rotation)
+{
+    const double sxx = h(0,0), sxy = h(0,1), sxz = h(0,2);
+    const double syx = h(1,0), syy = h(1,1), syz = h(1,2);
+    const double szx = h(2,0), szy = h(2,1), szz = h(2,2);
+
+    double n[4][4] = {
+        {sxx + syy + szz, syz - szy,        szx - sxz,        sxy - syx},
+        {syz - szy,       sxx - syy - szz,  sxy + syx,        szx + sxz},
+        {szx - sxz,       sxy + syx,        -sxx + syy - szz, syz + szy},
+        {sxy - syx,       szx + sxz,        syz + szy,        -sxx - syy + szz}};
+
+    double q[4];
+    LargestEigenvector4(n, q);
+    const double w = q[0], x = q[1], y = q[2], z = q[3];
+    const double norm = w * w + x * x + y * y + z * z;
+
+    rotation(0,0) = (w * w + x * x - y * y - z * z) / norm;
+    rotation(0,1) = 2.0 * (x * y - w * z) / norm;
+    rotation(0,2) = 2.0 * (x * z + w * y) / norm;
+    rotation(1,0) = 2.0 * (x * y + w * z) / norm;
+    rotation(1,1) = (w * w - x * x + y * y - z * z) / norm;
+    rotation(1,2) = 2.0 * (y * z - w * x) / norm;
+    rotation(2,0) = 2.0 * (x * z - w * y) / norm;
+    rotation(2,1) = 2.0 * (y * z + w * x) / norm;
+    rotation(2,2) = (w * w - x * x - y * y + z * z) / norm;
+}
+
+// Mean of the shapes in a 3 x numPoints x numShapes array, and the sum of
+// squares of that array as defined by Procrustes3D::ComputeSumOfSquares,
+// using sum_{s,t} |x_s - x_t|^2 = 2 numShapes sum_s |x_s - mean|^2.  Per
+// shape sums are added in shape order, so the result does not depend on
+// the number of threads.
+double ComputeMeanAndSumOfSquares(const double * points, int numShapes, int numPoints,
+                                  std::vector<double> & mean)
+{
+    const int n = 3 * numPoints;
+    mean.assign(n, 0.0);
+
+#pragma omp parallel for schedule(static)
+    for(int k = 0; k < n; k++)
+    {
+        double sum = 0.0;
+        for(int s = 0; s < numShapes; s++)
+            sum += points[static_cast<size_t>(s) * n + k];
+        mean[k] = sum / static_cast<double>(numShapes);
+    }
+
+    std::vector<double> shapeSums(numShapes);
+#pragma omp parallel for schedule(static)
+    for(int s = 0; s < numShapes; s++)
+    {
+        const double * shape = points + static_cast<size_t>(s) * n;
+        double sum = 0.0;
+        for(int k = 0; k < n; k++)
+            sum += (shape[k] - mean[k]) * (shape[k] - mean[k]);
+        shapeSums[s] = sum;
+    }
+
+    double sum = 0.0;
+    for(int s = 0; s < numShapes; s++)
+        sum += shapeSums[s];
+    return 2.0 * sum / static_cast<double>(numPoints);
+}
+
+}
 
 void
 Procrustes3D::
@@ -152,6 +293,114 @@ AlignShapes(SimilarityTransformListType & transforms, ShapeListType & shapes)
     }
 }
 
+void
+Procrustes3D::
+AlignShapes(SimilarityTransformListType & transforms, RealType * points,
+            int numShapes, int numPoints)
+{
+    const RealType SOS_EPSILON = 1.0e-8;
+    const int n = 3 * numPoints;
+
+    transforms.resize(numShapes);
+
+    // Remove translation
+#pragma omp parallel for schedule(static)
+    for(int s = 0; s < numShapes; s++)
+    {
+        RealType * shape = points + static_cast<size_t>(s) * n;
+        PointType center(0.0, 0.0, 0.0);
+        for(int j = 0; j < numPoints; j++)
+            for(int k = 0; k < 3; k++)
+                center[k] += shape[3 * j + k];
+        center /= static_cast<RealType>(numPoints);
+
+        for(int j = 0; j < numPoints; j++)
+            for(int k = 0; k < 3; k++)
+                shape[3 * j + k] -= center[k];
+
+        transforms[s].rotation.set_identity();
+        transforms[s].scale = 1.0;
+        transforms[s].translation = -center;
+    }
+
+    // Remove rotation and scale iteratively
+    std::vector<RealType> mean;
+    RealType sumOfSquares = ComputeMeanAndSumOfSquares(points, numShapes, numPoints, mean);
+    RealType diff = 1e10;
+
+    while(diff > SOS_EPSILON)
+    {
+        // Align every shape to the mean of all shapes
+#pragma omp parallel for schedule(static)
+        for(int s = 0; s < numShapes; s++)
+        {
+            RealType * shape = points + static_cast<size_t>(s) * n;
+
+            // Cross covariance of the shape with the mean, and tr(X * X^T)
+            vnl_matrix_fixed<RealType, 3, 3> h(0.0);
+            RealType scale2 = 0.0;
+            for(int j = 0; j < numPoints; j++)
+            {
+                const RealType * x = shape + 3 * j;
+                const RealType * m = &mean[3 * j];
+                for(int a = 0; a < 3; a++)
+                {
+                    h(a, 0) += x[a] * m[0];
+                    h(a, 1) += x[a] * m[1];
+                    h(a, 2) += x[a] * m[2];
+                    scale2 += x[a] * x[a];
+                }
+            }
+
+            vnl_matrix_fixed<RealType, 3, 3> rotation;
+            RotationFromCrossCovariance(h, rotation);
+
+            // tr(mean * (R X)^T) = tr(R * h)
+            RealType scale1 = 0.0;
+            for(int a = 0; a < 3; a++)
+                for(int b = 0; b < 3; b++)
+                    scale1 += rotation(a, b) * h(b, a);
+            const RealType scale = scale1 / scale2;
+
+            transforms[s].rotation = rotation * transforms[s].rotation;
+            transforms[s].scale *= scale;
+
+            for(int j = 0; j < numPoints; j++)
+            {
+                RealType * x = shape + 3 * j;
+                const RealType x0 = x[0], x1 = x[1], x2 = x[2];
+                for(int a = 0; a < 3; a++)
+                    x[a] = scale * (rotation(a, 0) * x0 + rotation(a, 1) * x1 + rotation(a, 2) * x2);
+            }
+        }
+
+        // Fix scalings so geometric average = 1
+        RealType scaleAve = 0.0;
+        for(int s = 0; s < numShapes; s++)
+            scaleAve += log(transforms[s].scale);
+        scaleAve = exp(scaleAve / static_cast<RealType>(numShapes));
+
+        const size_t total = static_cast<size_t>(numShapes) * n;
+#pragma omp parallel for schedule(static)
+        for(long i = 0; i < static_cast<long>(total); i++)
+            points[i] /= scaleAve;
+
+        for(int s = 0; s < numShapes; s++)
+        {
+            if (m_Scaling)
+                transforms[s].scale /= scaleAve;
+            else
+                transforms[s].scale = 1;
+        }
+
+        // The mean computed here is the one the next pass aligns to
+        RealType newSumOfSquares = ComputeMeanAndSumOfSquares(points, numShapes, numPoints, mean);
+        diff = sumOfSquares - newSumOfSquares;
+
+        sumOfSquares = newSumOfSquares;
+    }
+}
+
 void
 Procrustes3D::
 TransformShape(ShapeType & shape, SimilarityTransform3D & transform)
@@ -336,9 +585,17 @@ AlignTwoShapes(SimilarityTransform3D & transform, ShapeType & shape1,
         shapeIt2++;
     }
 
-    // Rotation from SVD
+    // Rotation from SVD.  If V * U^T is a reflection, the axis of the
+    // smallest singular value is flipped, so a mirrored or nearly planar shape
+    // is rotated rather than mirrored, as in the buffer version.
     vnl_svd<RealType> svd(shapeMat.transpose());
     newTransform.rotation = svd.V() * svd.U().transpose();
+    if(vnl_det(newTransform.rotation) < 0.0)
+    {
+        vnl_matrix<RealType> v = svd.V();
+        v.scale_column(2, -1.0);
+        newTransform.rotation = v * svd.U().transpose();
+    }
     transform.rotation = newTransform.rotation * transform.rotation;
 
     TransformShape(shape2, newTransform);
@@ -70,6 +70,16 @@ public:
     void AlignShapes(SimilarityTransformListType & transforms,
                      ShapeListType & shapes);
 
+    // Align numShapes shapes of numPoints points each, stored contiguously as
+    // a 3 x numPoints x numShapes array (coordinate fastest, then point, then
+    // shape) and modified in place.  Computes the same alignment as the
+    // ShapeListType version, but the shapes are aligned to the mean in
+    // parallel, each rotation comes from a closed form quaternion solution
+    // rather than an SVD, and the sum of squares is computed against the
+    // mean instead of over all pairs of shapes.
+    void AlignShapes(SimilarityTransformListType & transforms,
+                     RealType * points, int numShapes, int numPoints);
+
     void RemoveTranslation(SimilarityTransformListType & transforms,
                            ShapeListType & shapes);
 
@@ -18,6 +18,9 @@
 #define _itkCompactlySupportedRBFSparseKernelTransform_txx
 #include "itkCompactlySupportedRBFSparseKernelTransform.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace itk
 {
   template<class TScalarType, unsigned int NDimensions>
@@ -51,35 +54,161 @@ ComputeG(const InputVectorType & x) const
 }
 
 
+template <class TScalarType, unsigned int NDimensions>
+void
+CompactlySupportedRBFSparseKernelTransform<TScalarType, NDimensions>::
+SetSourceLandmarks(PointSetType * landmarks)
+{
+    Superclass::SetSourceLandmarks(landmarks);
+    this->BuildLandmarkIndex();
+}
+
+
+template <class TScalarType, unsigned int NDimensions>
+void
+CompactlySupportedRBFSparseKernelTransform<TScalarType, NDimensions>::
+SetFixedParameters(const ParametersType & parameters)
+{
+    // replaces the points of the source landmarks in place
+    Superclass::SetFixedParameters(parameters);
+    this->BuildLandmarkIndex();
+}
+
+
+template <class TScalarType, unsigned int NDimensions>
+void
+CompactlySupportedRBFSparseKernelTransform<TScalarType, NDimensions>::
+BuildLandmarkIndex()
+{
+    m_CellStart.clear();
+    m_CellLandmarks.clear();
+    m_CellPoints.clear();
+
+    const unsigned long numberOfLandmarks = this->m_SourceLandmarks->GetNumberOfPoints();
+    if (numberOfLandmarks == 0)
+        return;
+
+    InputPointType lower, upper;
+    this->m_SourceLandmarks->GetPoint(0, &lower);
+    upper = lower;
+    for (PointsIterator sp = this->m_SourceLandmarks->GetPoints()->Begin();
+         sp != this->m_SourceLandmarks->GetPoints()->End(); ++sp)
+    {
+        for (unsigned int d = 0; d < NDimensions; d++)
+        {
+            lower[d] = std::min(lower[d], sp->Value()[d]);
+            upper[d] = std::max(upper[d], sp->Value()[d]);
+        }
+    }
+
+    // cells smaller than the support would miss landmarks, larger ones only
+    // cost time; grow them when a tiny sigma would make the grid huge
+    m_CellSize = std::max(this->GetSupport(), 1e-12);
+    while (true)
+    {
+        double numberOfCells = 1;
+        for (unsigned int d = 0; d < NDimensions; d++)
+            numberOfCells *= std::floor((upper[d] - lower[d]) / m_CellSize) + 1;
+        if (numberOfCells <= 8.0 * numberOfLandmarks)
+            break;
+        m_CellSize *= 2;
+    }
+    unsigned long numberOfCells = 1;
+    for (unsigned int d = 0; d < NDimensions; d++)
+    {
+        m_GridSize[d] = static_cast<unsigned long>(std::floor((upper[d] - lower[d]) / m_CellSize)) + 1;
+        numberOfCells *= m_GridSize[d];
+    }
+    m_GridOrigin = lower;
+
+    // counting sort of the landmarks by cell
+    std::vector<unsigned long> cellOfLandmark(numberOfLandmarks);
+    m_CellStart.assign(numberOfCells + 1, 0);
+    unsigned long lnd = 0;
+    for (PointsIterator sp = this->m_SourceLandmarks->GetPoints()->Begin();
+         sp != this->m_SourceLandmarks->GetPoints()->End(); ++sp, ++lnd)
+    {
+        unsigned long index = 0;
+        for (int d = NDimensions - 1; d >= 0; d--)
+        {
+            unsigned long cell = static_cast<unsigned long>((sp->Value()[d] - lower[d]) / m_CellSize);
+            index = index * m_GridSize[d] + std::min(cell, m_GridSize[d] - 1);
+        }
+        cellOfLandmark[lnd] = index;
+        m_CellStart[index + 1]++;
+    }
+    for (unsigned long c = 0; c < numberOfCells; c++)
+        m_CellStart[c + 1] += m_CellStart[c];
+
+    std::vector<unsigned long> next(m_CellStart.begin(), m_CellStart.end() - 1);
+    m_CellLandmarks.resize(numberOfLandmarks);
+    m_CellPoints.resize(numberOfLandmarks);
+    lnd = 0;
+    for (PointsIterator sp = this->m_SourceLandmarks->GetPoints()->Begin();
+         sp != this->m_SourceLandmarks->GetPoints()->End(); ++sp, ++lnd)
+    {
+        const unsigned long k = next[cellOfLandmark[lnd]]++;
+        m_CellLandmarks[k] = lnd;
+        m_CellPoints[k] = sp->Value();
+    }
+}
+
+
 template <class TScalarType, unsigned int NDimensions>
 void
 CompactlySupportedRBFSparseKernelTransform<TScalarType, NDimensions>::
 ComputeDeformationContribution( const InputPointType  & thisPoint,
                                 OutputPointType & result     ) const
 {
+    if (m_CellStart.empty())
+        return;
 
-    double a = 3.0 * sqrt(3.14/2.0) * this->Sigma;
-
-    unsigned long numberOfLandmarks = this->m_SourceLandmarks->GetNumberOfPoints();
+    double a = this->GetSupport();
 
-    PointsIterator sp  = this->m_SourceLandmarks->GetPoints()->Begin();
+    // range of cells around the point, nothing to do if it is outside the grid
+    // by more than a cell
+    long lo[NDimensions], hi[NDimensions], cell[NDimensions];
+    for (unsigned int d = 0; d < NDimensions; d++)
+    {
+        const double c = std::floor((thisPoint[d] - m_GridOrigin[d]) / m_CellSize);
+        if (c < -1 || c > m_GridSize[d])
+            return;
+        lo[d] = std::max(static_cast<long>(c) - 1, 0L);
+        hi[d] = std::min(static_cast<long>(c) + 1, static_cast<long>(m_GridSize[d]) - 1);
+        cell[d] = lo[d];
+    }
 
-    for(unsigned int lnd=0; lnd < numberOfLandmarks; lnd++ )
+    while (true)
     {
-        InputVectorType position = thisPoint - sp->Value();
-        const TScalarType r = (position.GetNorm())/a; // the support of the basis is only defined till 2.5*sigma
+        unsigned long index = 0;
+        for (int d = NDimensions - 1; d >= 0; d--)
+            index = index * m_GridSize[d] + cell[d];
 
-        TScalarType val = 0.0;
-        if(r <= 1)
-            val = pow(1-r, 4.0) * (4.0*r + 1);
+        for (unsigned long k = m_CellStart[index]; k < m_CellStart[index + 1]; k++)
+        {
+            InputVectorType position = thisPoint - m_CellPoints[k];
+            const TScalarType r = (position.GetNorm())/a; // the support of the basis is only defined till 2.5*sigma
+            if (r > 1)
+                continue;
+
+            const TScalarType s = 1 - r;
+            const TScalarType val = s * s * s * s * (4.0*r + 1);
+            const unsigned long lnd = m_CellLandmarks[k];
+            for(unsigned int odim=0; odim < NDimensions; odim++ )
+            {
+                result[ odim ] += val * this->m_DMatrix(odim,lnd);
+            }
+        }
 
-        for(unsigned int odim=0; odim < NDimensions; odim++ )
+        unsigned int d = 0;
+        while (d < NDimensions && ++cell[d] > hi[d])
         {
-            result[ odim ] += val * this->m_DMatrix(odim,lnd);
+            cell[d] = lo[d];
+            d++;
         }
-        ++sp;
+        if (d == NDimensions)
+            break;
     }
-
 }
 
 
@@ -19,6 +19,8 @@
 
 #include "itkSparseKernelTransform.h"
 
+#include <vector>
+
 namespace itk
 {
 /** \class CompactlySupportedRBFSparseKernelTransform
@@ -63,16 +65,23 @@ public:
     typedef typename Superclass::InputCovariantVectorType InputCovariantVectorType;
     typedef typename Superclass::OutputCovariantVectorType OutputCovariantVectorType;
     typedef typename Superclass::PointsIterator PointsIterator;
+    typedef typename Superclass::PointSetType PointSetType;
     //  void SetParameters( const ParametersType & parameters );
 
-    void SetSigma(double sigma){this->Sigma = sigma;}
+    void SetSigma(double sigma){this->Sigma = sigma; this->BuildLandmarkIndex();}
+
+    /** Set the source landmarks list and index them for TransformPoint. */
+    virtual void SetSourceLandmarks(PointSetType *);
+
+    /** Set the source landmarks from the fixed parameters and index them. */
+    virtual void SetFixedParameters(const ParametersType &);
 
     virtual void ComputeJacobianWithRespectToParameters(
         const InputPointType  &in, JacobianType &jacobian) const;
 
 
 protected:
-    CompactlySupportedRBFSparseKernelTransform() {this->Sigma = 1; }
+    CompactlySupportedRBFSparseKernelTransform() {this->Sigma = 1; this->m_CellSize = 1; }
     virtual ~CompactlySupportedRBFSparseKernelTransform() {}
 
     /** These (rather redundant) typedefs are needed because on SGI, typedefs
@@ -90,9 +99,26 @@ private:
     CompactlySupportedRBFSparseKernelTransform(const Self&); //purposely not implemented
     void operator=(const Self&); //purposely not implemented
 
+    /** Radius beyond which the kernel vanishes. */
+    double GetSupport() const {return 3.0 * sqrt(3.14/2.0) * this->Sigma;}
+
+    /** Bin the source landmarks into a uniform grid whose cells are at least
+      as large as the kernel support, so that a point is only influenced by
+      the landmarks in the 3^NDimensions cells around it. */
+    void BuildLandmarkIndex();
+
     // basis support
     double Sigma;
 
+    // landmark grid, the landmarks of cell c are m_CellLandmarks[m_CellStart[c]
+    // .. m_CellStart[c+1]) with their positions stored alongside in m_CellPoints
+    double m_CellSize;
+    InputPointType m_GridOrigin;
+    unsigned long m_GridSize[NDimensions];
+    std::vector<unsigned long> m_CellStart;
+    std::vector<unsigned long> m_CellLandmarks;
+    std::vector<InputPointType> m_CellPoints;
+
 };
 
 } // namespace itk
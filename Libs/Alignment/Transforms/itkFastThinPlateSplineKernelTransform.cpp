@@ -0,0 +1,616 @@
+/*=========================================================================
+
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkFastThinPlateSplineKernelTransform.cpp,v $
+
+  Copyright (c) 2020 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkFastThinPlateSplineKernelTransform_hxx
+#define _itkFastThinPlateSplineKernelTransform_hxx
+
+#include "itkFastThinPlateSplineKernelTransform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace itk
+{
+
+namespace
+{
+// landmarks per leaf of the tree
+const unsigned long fastTPSLeafSize = 16;
+
+// bound on the Taylor coefficients of order ExpansionOrder + 1 of |u + h|
+// for |u| = 1, they are below 2.91 in three dimensions
+const double fastTPSCoefficientBound = 3.0;
+
+// number of multi-indices of order up to order in the given dimension,
+// that is (order + dimensions choose dimensions)
+constexpr unsigned long fastTPSNumberOfTerms( unsigned int order, unsigned int dimensions )
+{
+  return dimensions == 0 ? 1 : fastTPSNumberOfTerms( order, dimensions - 1 ) * ( order + dimensions ) / dimensions;
+}
+}
+
+/**
+ * ******************* SetSourceLandmarks *******************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+void
+FastThinPlateSplineKernelTransform< TScalarType, NDimensions >
+::SetSourceLandmarks( PointSetType * landmarks )
+{
+  if( this->m_SourceLandmarks == landmarks )
+  {
+    return;
+  }
+  this->m_SourceLandmarks = landmarks;
+  this->Modified();
+  this->m_WMatrixComputed = false;
+
+  /** Build the tree. */
+  const unsigned long n = this->m_SourceLandmarks->GetNumberOfPoints();
+  std::vector< CoordinatesType > points;
+  points.reserve( n );
+  for( PointsIterator sp = this->m_SourceLandmarks->GetPoints()->Begin();
+    sp != this->m_SourceLandmarks->GetPoints()->End(); ++sp )
+  {
+    CoordinatesType p;
+    for( unsigned int d = 0; d < NDimensions; d++ )
+    {
+      p[ d ] = sp->Value()[ d ];
+    }
+    points.push_back( p );
+  }
+
+  if( this->m_MultiIndices.empty() )
+  {
+    this->BuildMultiIndices();
+  }
+
+  this->m_Order.resize( n );
+  for( unsigned long i = 0; i < n; i++ )
+  {
+    this->m_Order[ i ] = i;
+  }
+  this->m_Nodes.clear();
+  if( n > 0 )
+  {
+    this->BuildTree( points, 0, n );
+  }
+  this->m_Points.resize( n );
+  for( unsigned long i = 0; i < n; i++ )
+  {
+    this->m_Points[ i ] = points[ this->m_Order[ i ] ];
+  }
+
+  /** Factor the system, by the null space method when the affine part is
+   * well determined, otherwise by LU of the whole system.
+   */
+  const unsigned long m = NDimensions + 1;
+  MatrixType P( n, m );
+  for( unsigned long i = 0; i < n; i++ )
+  {
+    for( unsigned int d = 0; d < NDimensions; d++ )
+    {
+      P( i, d ) = this->m_Points[ i ][ d ];
+    }
+    P( i, NDimensions ) = 1.0;
+  }
+
+  MatrixType K;
+  this->ComputeKernelMatrix( K );
+
+  this->m_UseLU = true;
+  if( n > m )
+  {
+    this->m_AffineQR.compute( P );
+    const MatrixType & R = this->m_AffineQR.matrixQR();
+    bool fullRank = true;
+    for( unsigned long i = 0; i < m; i++ )
+    {
+      fullRank = fullRank && std::abs( R( i, i ) ) > 1e-10 * std::abs( R( 0, 0 ) );
+    }
+    if( fullRank )
+    {
+      // Q^T K Q, of which the trailing block is the kernel restricted to the
+      // complement of the affine part
+      this->m_AffineQR.householderQ().adjoint().applyThisOnTheLeft( K );
+      this->m_AffineQR.householderQ().applyThisOnTheRight( K );
+      this->m_KernelCholesky.compute( -K.bottomRightCorner( n - m, n - m ) );
+      this->m_UseLU = this->m_KernelCholesky.info() != Eigen::Success;
+      if( this->m_UseLU )
+      {
+        this->ComputeKernelMatrix( K );
+      }
+    }
+  }
+
+  if( this->m_UseLU )
+  {
+    MatrixType L = MatrixType::Zero( n + m, n + m );
+    L.topLeftCorner( n, n )  = K;
+    L.topRightCorner( n, m ) = P;
+    L.bottomLeftCorner( m, n ) = P.transpose();
+    this->m_SystemLU.compute( L );
+  }
+
+} // end SetSourceLandmarks()
+
+
+/**
+ * ******************* SetTargetLandmarks *******************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+void
+FastThinPlateSplineKernelTransform< TScalarType, NDimensions >
+::SetTargetLandmarks( PointSetType * landmarks )
+{
+  if( this->m_TargetLandmarks == landmarks )
+  {
+    return;
+  }
+  this->m_TargetLandmarks = landmarks;
+
+  /** Displacements in tree order. */
+  const unsigned long n = this->m_Points.size();
+  const unsigned long m = NDimensions + 1;
+  MatrixType Y( n, NDimensions );
+  std::vector< unsigned long > position( n );
+  for( unsigned long i = 0; i < n; i++ )
+  {
+    position[ this->m_Order[ i ] ] = i;
+  }
+  unsigned long lnd = 0;
+  for( PointsIterator tp = this->m_TargetLandmarks->GetPoints()->Begin();
+    tp != this->m_TargetLandmarks->GetPoints()->End() && lnd < n; ++tp, ++lnd )
+  {
+    for( unsigned int d = 0; d < NDimensions; d++ )
+    {
+      Y( position[ lnd ], d ) = tp->Value()[ d ] - this->m_Points[ position[ lnd ] ][ d ];
+    }
+  }
+  if( lnd != n || this->m_TargetLandmarks->GetNumberOfPoints() != n )
+  {
+    itkExceptionMacro( << "The number of source and target landmarks differ" );
+  }
+
+  MatrixType affine;
+  if( !this->m_UseLU )
+  {
+    MatrixType QtY = Y;
+    this->m_AffineQR.householderQ().adjoint().applyThisOnTheLeft( QtY );
+
+    MatrixType weights = MatrixType::Zero( n, NDimensions );
+    weights.bottomRows( n - m ) = -this->m_KernelCholesky.solve( QtY.bottomRows( n - m ) );
+    this->m_AffineQR.householderQ().applyThisOnTheLeft( weights );
+    this->m_Weights = weights;
+
+    // what the kernel leaves of the displacements lies in the range of P
+    MatrixType residual = Y;
+#pragma omp parallel for
+    for( long i = 0; i < long( n ); i++ )
+    {
+      double sum[ NDimensions ];
+      this->SumAtLandmark( i, this->m_Weights, sum );
+      for( unsigned int d = 0; d < NDimensions; d++ )
+      {
+        residual( i, d ) -= sum[ d ];
+      }
+    }
+    this->m_AffineQR.householderQ().adjoint().applyThisOnTheLeft( residual );
+    affine = this->m_AffineQR.matrixQR().topLeftCorner( m, m )
+      .template triangularView< Eigen::Upper >().solve( residual.topRows( m ) );
+  }
+  else
+  {
+    MatrixType rhs = MatrixType::Zero( n + m, NDimensions );
+    rhs.topRows( n ) = Y;
+    MatrixType solution = this->m_SystemLU.solve( rhs );
+    this->m_Weights = solution.topRows( n );
+    affine = solution.bottomRows( m );
+  }
+
+  for( unsigned int i = 0; i < NDimensions; i++ )
+  {
+    for( unsigned int j = 0; j < NDimensions; j++ )
+    {
+      this->m_AMatrix( i, j ) = affine( j, i );
+    }
+    this->m_BVector[ i ] = affine( NDimensions, i );
+  }
+
+  /** Moments of the weights for the tree evaluation. */
+  this->m_Moments.assign( this->m_Nodes.size() * NDimensions * this->m_NumberOfTerms, 0.0 );
+#pragma omp parallel for
+  for( long i = 0; i < long( this->m_Nodes.size() ); i++ )
+  {
+    this->ComputeMoments( i );
+  }
+
+  this->m_WMatrixComputed = true;
+  this->UpdateParameters();
+  this->Modified();
+
+} // end SetTargetLandmarks()
+
+
+/**
+ * ******************* BuildTree *******************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+long
+FastThinPlateSplineKernelTransform< TScalarType, NDimensions >
+::BuildTree( const std::vector< CoordinatesType > & points,
+  unsigned long begin, unsigned long end )
+{
+  const long index = this->m_Nodes.size();
+  this->m_Nodes.push_back( Node() );
+
+  double lower[ NDimensions ], upper[ NDimensions ];
+  for( unsigned int d = 0; d < NDimensions; d++ )
+  {
+    lower[ d ] = upper[ d ] = points[ this->m_Order[ begin ] ][ d ];
+  }
+  for( unsigned long i = begin; i < end; i++ )
+  {
+    for( unsigned int d = 0; d < NDimensions; d++ )
+    {
+      lower[ d ] = std::min( lower[ d ], points[ this->m_Order[ i ] ][ d ] );
+      upper[ d ] = std::max( upper[ d ], points[ this->m_Order[ i ] ][ d ] );
+    }
+  }
+
+  Node & node = this->m_Nodes[ index ];
+  node.m_Begin = begin;
+  node.m_End = end;
+  node.m_Left = node.m_Right = -1;
+  unsigned int axis = 0;
+  for( unsigned int d = 0; d < NDimensions; d++ )
+  {
+    node.m_Center[ d ] = 0.5 * ( lower[ d ] + upper[ d ] );
+    if( upper[ d ] - lower[ d ] > upper[ axis ] - lower[ axis ] )
+    {
+      axis = d;
+    }
+  }
+  node.m_Radius = 0.0;
+  for( unsigned long i = begin; i < end; i++ )
+  {
+    double r2 = 0.0;
+    for( unsigned int d = 0; d < NDimensions; d++ )
+    {
+      const double delta = points[ this->m_Order[ i ] ][ d ] - node.m_Center[ d ];
+      r2 += delta * delta;
+    }
+    node.m_Radius = std::max( node.m_Radius, std::sqrt( r2 ) );
+  }
+
+  if( end - begin > fastTPSLeafSize )
+  {
+    // split at the median of the widest axis
+    const unsigned long middle = begin + ( end - begin ) / 2;
+    std::nth_element( this->m_Order.begin() + begin, this->m_Order.begin() + middle,
+      this->m_Order.begin() + end,
+      [ &points, axis ]( unsigned long a, unsigned long b ) { return points[ a ][ axis ] < points[ b ][ axis ]; } );
+    const long left = this->BuildTree( points, begin, middle );
+    const long right = this->BuildTree( points, middle, end );
+    this->m_Nodes[ index ].m_Left = left;   // node may have moved
+    this->m_Nodes[ index ].m_Right = right;
+  }
+  return index;
+
+} // end BuildTree()
+
+
+/**
+ * ******************* BuildMultiIndices *******************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+void
+FastThinPlateSplineKernelTransform< TScalarType, NDimensions >
+::BuildMultiIndices()
+{
+  typedef std::array< unsigned int, NDimensions > AlphaType;
+  std::vector< AlphaType > alphas( 1, AlphaType() );
+  std::fill( alphas[ 0 ].begin(), alphas[ 0 ].end(), 0u );
+  std::map< AlphaType, long > position;
+  position[ alphas[ 0 ] ] = 0;
+
+  /** Order n + 1 from order n by raising one component, graded order. */
+  unsigned long first = 0;
+  for( unsigned int n = 0; n <= ExpansionOrder; n++ )
+  {
+    const unsigned long last = alphas.size();
+    if( n == ExpansionOrder )
+    {
+      this->m_NumberOfTerms = last;
+    }
+    for( unsigned long i = first; i < last; i++ )
+    {
+      for( unsigned int d = 0; d < NDimensions; d++ )
+      {
+        AlphaType alpha = alphas[ i ];
+        alpha[ d ]++;
+        if( position.find( alpha ) == position.end() )
+        {
+          position[ alpha ] = alphas.size();
+          alphas.push_back( alpha );
+        }
+      }
+    }
+    first = last;
+  }
+
+  this->m_MultiIndices.resize( alphas.size() );
+  for( unsigned long i = 0; i < alphas.size(); i++ )
+  {
+    MultiIndex & index = this->m_MultiIndices[ i ];
+    index.m_Order = 0;
+    for( unsigned int d = 0; d < NDimensions; d++ )
+    {
+      index.m_Order += alphas[ i ][ d ];
+      index.m_Minus1[ d ] = index.m_Minus2[ d ] = -1;
+      AlphaType alpha = alphas[ i ];
+      if( alpha[ d ] >= 1 )
+      {
+        alpha[ d ]--;
+        index.m_Minus1[ d ] = position[ alpha ];
+      }
+      if( alpha[ d ] >= 1 )
+      {
+        alpha[ d ]--;
+        index.m_Minus2[ d ] = position[ alpha ];
+      }
+    }
+  }
+
+} // end BuildMultiIndices()
+
+
+/**
+ * ******************* ComputeMoments *******************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+void
+FastThinPlateSplineKernelTransform< TScalarType, NDimensions >
+::ComputeMoments( unsigned long nodeIndex )
+{
+  /** M_alpha = sum_j w_j (-delta_j)^alpha, one order beyond the expansion
+   * for the error estimate.
+   */
+  Node & node = this->m_Nodes[ nodeIndex ];
+  const unsigned long numberOfIndices = this->m_MultiIndices.size();
+  std::vector< double > power( numberOfIndices );
+  std::vector< double > moments( NDimensions * numberOfIndices, 0.0 );
+  for( unsigned long i = node.m_Begin; i < node.m_End; i++ )
+  {
+    double delta[ NDimensions ];
+    for( unsigned int d = 0; d < NDimensions; d++ )
+    {
+      delta[ d ] = node.m_Center[ d ] - this->m_Points[ i ][ d ];
+    }
+    power[ 0 ] = 1.0;
+    for( unsigned long a = 1; a < numberOfIndices; a++ )
+    {
+      unsigned int d = 0;
+      while( this->m_MultiIndices[ a ].m_Minus1[ d ] < 0 )
+      {
+        d++;
+      }
+      power[ a ] = power[ this->m_MultiIndices[ a ].m_Minus1[ d ] ] * delta[ d ];
+    }
+    for( unsigned int k = 0; k < NDimensions; k++ )
+    {
+      const double w = this->m_Weights( i, k );
+      double * m = &moments[ k * numberOfIndices ];
+      for( unsigned long a = 0; a < numberOfIndices; a++ )
+      {
+        m[ a ] += w * power[ a ];
+      }
+    }
+  }
+
+  node.m_Remainder = 0.0;
+  for( unsigned int k = 0; k < NDimensions; k++ )
+  {
+    const double * m = &moments[ k * numberOfIndices ];
+    std::copy( m, m + this->m_NumberOfTerms,
+      &this->m_Moments[ ( nodeIndex * NDimensions + k ) * this->m_NumberOfTerms ] );
+    double remainder = 0.0;
+    for( unsigned long a = this->m_NumberOfTerms; a < numberOfIndices; a++ )
+    {
+      remainder += std::abs( m[ a ] );
+    }
+    node.m_Remainder = std::max( node.m_Remainder, remainder );
+  }
+
+} // end ComputeMoments()
+
+
+/**
+ * ******************* ComputeKernelMatrix *******************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+void
+FastThinPlateSplineKernelTransform< TScalarType, NDimensions >
+::ComputeKernelMatrix( MatrixType & K ) const
+{
+  const long n = this->m_Points.size();
+  K.resize( n, n );
+#pragma omp parallel for
+  for( long j = 0; j < n; j++ )
+  {
+    for( long i = 0; i < n; i++ )
+    {
+      double r2 = 0.0;
+      for( unsigned int d = 0; d < NDimensions; d++ )
+      {
+        const double delta = this->m_Points[ i ][ d ] - this->m_Points[ j ][ d ];
+        r2 += delta * delta;
+      }
+      K( i, j ) = std::sqrt( r2 );
+    }
+    K( j, j ) = this->m_Stiffness; // see ComputeReflexiveG
+  }
+
+} // end ComputeKernelMatrix()
+
+
+/**
+ * ******************* SumAtLandmark *******************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+void
+FastThinPlateSplineKernelTransform< TScalarType, NDimensions >
+::SumAtLandmark( unsigned long i, const MatrixType & weights, double * result ) const
+{
+  for( unsigned int d = 0; d < NDimensions; d++ )
+  {
+    result[ d ] = this->m_Stiffness * weights( i, d );
+  }
+  for( unsigned long j = 0; j < this->m_Points.size(); j++ )
+  {
+    if( j == i )
+    {
+      continue;
+    }
+    double r2 = 0.0;
+    for( unsigned int d = 0; d < NDimensions; d++ )
+    {
+      const double delta = this->m_Points[ i ][ d ] - this->m_Points[ j ][ d ];
+      r2 += delta * delta;
+    }
+    const double r = std::sqrt( r2 );
+    for( unsigned int d = 0; d < NDimensions; d++ )
+    {
+      result[ d ] += r * weights( j, d );
+    }
+  }
+
+} // end SumAtLandmark()
+
+
+/**
+ * ******************* ComputeDeformationContribution *******************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+void
+FastThinPlateSplineKernelTransform< TScalarType, NDimensions >
+::ComputeDeformationContribution(
+  const InputPointType & thisPoint, OutputPointType & opp ) const
+{
+  if( this->m_Nodes.empty() )
+  {
+    return;
+  }
+
+  // |x - p_j| = sum_alpha a_alpha(x - c) (c - p_j)^alpha, with the Taylor
+  // coefficients a_alpha of |y| from the recurrence, for n = |alpha|,
+  //   n |y|^2 a_alpha = (3 - 2n) sum_d y_d a_(alpha-e_d) + (3 - n) sum_d a_(alpha-2e_d)
+  // The first omitted order is at most
+  // fastTPSCoefficientBound * remainder / r^ExpansionOrder; a node takes a
+  // share of the tolerance proportional to its number of landmarks. Nodes
+  // with fewer landmarks than terms are cheaper to sum directly.
+  const double share = this->m_Tolerance / this->m_Points.size();
+  double coefficients[ fastTPSNumberOfTerms( ExpansionOrder, NDimensions ) ];
+
+  long stack[ 128 ];
+  int  top = 0;
+  stack[ top++ ] = 0;
+  while( top > 0 )
+  {
+    const long   index = stack[ --top ];
+    const Node & node = this->m_Nodes[ index ];
+
+    double v[ NDimensions ];
+    double r2 = 0.0;
+    for( unsigned int d = 0; d < NDimensions; d++ )
+    {
+      v[ d ] = thisPoint[ d ] - node.m_Center[ d ];
+      r2 += v[ d ] * v[ d ];
+    }
+    const double r = std::sqrt( r2 );
+    const double rho = node.m_Radius;
+
+    if( this->m_Tolerance > 0.0 && node.m_End - node.m_Begin >= this->m_NumberOfTerms && r > 2.0 * rho
+      && fastTPSCoefficientBound * node.m_Remainder
+      <= share * ( node.m_End - node.m_Begin ) * ( 1.0 - rho / r ) * std::pow( r, double( ExpansionOrder ) ) )
+    {
+      coefficients[ 0 ] = r;
+      for( unsigned long a = 1; a < this->m_NumberOfTerms; a++ )
+      {
+        const MultiIndex & alpha = this->m_MultiIndices[ a ];
+        double first = 0.0;
+        double second = 0.0;
+        for( unsigned int d = 0; d < NDimensions; d++ )
+        {
+          if( alpha.m_Minus1[ d ] >= 0 )
+          {
+            first += v[ d ] * coefficients[ alpha.m_Minus1[ d ] ];
+          }
+          if( alpha.m_Minus2[ d ] >= 0 )
+          {
+            second += coefficients[ alpha.m_Minus2[ d ] ];
+          }
+        }
+        const double n = alpha.m_Order;
+        coefficients[ a ] = ( ( 3.0 - 2.0 * n ) * first + ( 3.0 - n ) * second ) / ( n * r2 );
+      }
+      for( unsigned int k = 0; k < NDimensions; k++ )
+      {
+        const double * m = &this->m_Moments[ ( index * NDimensions + k ) * this->m_NumberOfTerms ];
+        double sum = 0.0;
+        for( unsigned long a = 0; a < this->m_NumberOfTerms; a++ )
+        {
+          sum += coefficients[ a ] * m[ a ];
+        }
+        opp[ k ] += sum;
+      }
+    }
+    else if( node.m_Left < 0 )
+    {
+      for( unsigned long i = node.m_Begin; i < node.m_End; i++ )
+      {
+        double p2 = 0.0;
+        for( unsigned int d = 0; d < NDimensions; d++ )
+        {
+          const double delta = thisPoint[ d ] - this->m_Points[ i ][ d ];
+          p2 += delta * delta;
+        }
+        const double p = std::sqrt( p2 );
+        for( unsigned int k = 0; k < NDimensions; k++ )
+        {
+          opp[ k ] += p * this->m_Weights( i, k );
+        }
+      }
+    }
+    else
+    {
+      stack[ top++ ] = node.m_Left;
+      stack[ top++ ] = node.m_Right;
+    }
+  }
+
+} // end ComputeDeformationContribution()
+
+
+} // namespace itk
+
+#endif
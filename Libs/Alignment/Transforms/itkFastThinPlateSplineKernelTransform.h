@@ -0,0 +1,192 @@
+/*=========================================================================
+
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkFastThinPlateSplineKernelTransform.h,v $
+
+  Copyright (c) 2020 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkFastThinPlateSplineKernelTransform_h
+#define __itkFastThinPlateSplineKernelTransform_h
+
+#include "itkThinPlateSplineKernelTransform2.h"
+
+#include <itkeigen/Eigen/Dense>
+
+#include <array>
+#include <vector>
+
+namespace itk
+{
+/** \class FastThinPlateSplineKernelTransform
+ * The same thin plate spline as ThinPlateSplineKernelTransform2, computed
+ * in a way that scales to thousands of landmarks.
+ *
+ * The TPS kernel G(x) = r(x) * I does not couple the dimensions, so instead
+ * of the NDimensions*(N+NDimensions+1) square system of KernelTransform2 a
+ * single (N+NDimensions+1) system is solved for all dimensions at once, by
+ * the null space method: with P = QR, the kernel weights are restricted to
+ * the complement of the affine part, where -K is positive definite and is
+ * factored by Cholesky. The factorization only depends on the source
+ * landmarks and is reused for every set of target landmarks.
+ *
+ * TransformPoint sums the kernel over a k-d tree of the landmarks: a node
+ * that is far enough from the point is replaced by a Taylor expansion of
+ * |x - p| about its center, of order ExpansionOrder, computed from the
+ * moments of its kernel weights. A node is expanded when the first omitted
+ * term of the expansion, which accounts for the cancellation between the
+ * weights, is within the node's share of Tolerance (in the units of the
+ * landmarks). This is an estimate, not a strict bound. A tolerance of zero
+ * gives the exact sum.
+ *
+ * The transform plugs into Reconstruction like ThinPlateSplineKernelTransform2.
+ * The Jacobian with respect to the parameters is not available.
+ *
+ * \ingroup Transforms
+ */
+template< class TScalarType,         // Data type for scalars (float or double)
+unsigned int NDimensions = 3 >
+// Number of dimensions
+class FastThinPlateSplineKernelTransform :
+  public ThinPlateSplineKernelTransform2< TScalarType, NDimensions >
+{
+public:
+
+  /** Standard class typedefs. */
+  typedef FastThinPlateSplineKernelTransform                      Self;
+  typedef ThinPlateSplineKernelTransform2< TScalarType, NDimensions > Superclass;
+  typedef SmartPointer< Self >                                    Pointer;
+  typedef SmartPointer< const Self >                              ConstPointer;
+
+  /** New macro for creation of through a Smart Pointer */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( FastThinPlateSplineKernelTransform, ThinPlateSplineKernelTransform2 );
+
+  /** Typedefs. */
+  typedef typename Superclass::ScalarType                 ScalarType;
+  typedef typename Superclass::JacobianType               JacobianType;
+  typedef typename Superclass::InputPointType             InputPointType;
+  typedef typename Superclass::OutputPointType            OutputPointType;
+  typedef typename Superclass::InputVectorType            InputVectorType;
+  typedef typename Superclass::PointSetType               PointSetType;
+  typedef typename Superclass::PointsIterator             PointsIterator;
+  typedef typename Superclass::NonZeroJacobianIndicesType NonZeroJacobianIndicesType;
+
+  /** Set the source landmarks, builds the tree and factors the system. */
+  virtual void SetSourceLandmarks( PointSetType * );
+
+  /** Set the target landmarks, solves for the spline coefficients. */
+  virtual void SetTargetLandmarks( PointSetType * );
+
+  /** Order of the expansion of the kernel about the center of a node. */
+  itkStaticConstMacro( ExpansionOrder, unsigned int, 6 );
+
+  /** Error allowed in each component of the deformation, default 1e-2. */
+  itkSetMacro( Tolerance, double );
+  itkGetConstMacro( Tolerance, double );
+
+  /** Not available for this transform. */
+  virtual void GetJacobian(
+    const InputPointType &,
+    JacobianType &,
+    NonZeroJacobianIndicesType & ) const
+  {
+    itkExceptionMacro( << "GetJacobian is not implemented for FastThinPlateSplineKernelTransform" );
+  }
+
+protected:
+
+  FastThinPlateSplineKernelTransform() :
+    m_Tolerance( 1e-2 ), m_NumberOfTerms( 0 ), m_UseLU( false ) {}
+  virtual ~FastThinPlateSplineKernelTransform() {}
+
+  /** Sum the kernel over the landmark tree. */
+  virtual void ComputeDeformationContribution(
+    const InputPointType & inputPoint, OutputPointType & result ) const;
+
+private:
+
+  FastThinPlateSplineKernelTransform( const Self & ); // purposely not implemented
+  void operator=( const Self & );                     // purposely not implemented
+
+  typedef Eigen::Matrix< double, Eigen::Dynamic, Eigen::Dynamic > MatrixType;
+
+  /** A k-d tree node; the landmarks of the node are [m_Begin, m_End) in tree
+   * order. The moments of the kernel weights about the center are set once
+   * the target landmarks are known.
+   */
+  struct Node
+  {
+    unsigned long m_Begin;
+    unsigned long m_End;
+    long          m_Left;   // -1 for a leaf
+    long          m_Right;
+    double        m_Center[ NDimensions ];
+    double        m_Radius;
+    double        m_Remainder;   // largest sum of |moments| of order ExpansionOrder + 1
+  };
+
+  /** A multi-index alpha of the expansion, with the indices of alpha - e_d
+   * and alpha - 2 e_d (-1 if negative) for the recurrences.
+   */
+  struct MultiIndex
+  {
+    unsigned int m_Order;
+    long         m_Minus1[ NDimensions ];
+    long         m_Minus2[ NDimensions ];
+  };
+
+  typedef std::array< double, NDimensions > CoordinatesType;
+
+  long BuildTree( const std::vector< CoordinatesType > & points,
+    unsigned long begin, unsigned long end );
+  void BuildMultiIndices();
+  void ComputeMoments( unsigned long nodeIndex );
+
+  /** Kernel matrix of the source landmarks in tree order. */
+  void ComputeKernelMatrix( MatrixType & K ) const;
+
+  /** Exact sum of the kernel at a landmark, used to recover the affine part. */
+  void SumAtLandmark( unsigned long i, const MatrixType & weights, double * result ) const;
+
+  double m_Tolerance;
+
+  /** Landmarks in tree order and their original indices. */
+  std::vector< CoordinatesType > m_Points;
+  std::vector< unsigned long >   m_Order;
+  std::vector< Node >            m_Nodes;
+
+  /** Multi-indices up to ExpansionOrder + 1 in graded order, and the number
+   * of those up to ExpansionOrder.
+   */
+  std::vector< MultiIndex > m_MultiIndices;
+  unsigned long             m_NumberOfTerms;
+
+  /** Moments of the kernel weights up to ExpansionOrder, m_NumberOfTerms per
+   * dimension per node.
+   */
+  std::vector< double > m_Moments;
+
+  /** Kernel weights in tree order, one row per landmark. */
+  MatrixType m_Weights;
+
+  /** Factorization of the system, see the class documentation. */
+  Eigen::HouseholderQR< MatrixType > m_AffineQR;
+  Eigen::LLT< MatrixType >           m_KernelCholesky;
+  Eigen::PartialPivLU< MatrixType >  m_SystemLU;   // fallback
+  bool                               m_UseLU;
+
+};
+
+} // namespace itk
+
+#include "itkFastThinPlateSplineKernelTransform.cpp"
+
+#endif // __itkFastThinPlateSplineKernelTransform_h
@@ -28,6 +28,9 @@
 #include <itkImageFileWriter.h>
 #include <Utils.h>
 #include <math.h>
+#include <omp.h>
+#include <algorithm>
+#include <exception>
 
 template < template < typename TCoordRep, unsigned > class TTransformType,
            template < typename ImageType, typename TCoordRep > class TInterpolatorType,
@@ -72,11 +75,30 @@ vtkSmartPointer<vtkPolyData> Reconstruction<TTransformType,TInterpolatorType, TC
                 global_pts.empty() || local_pts.size() != distance_transform.size()) {
             throw std::runtime_error("Invalid input for reconstruction!");
         }
-        this->computeDenseMean(local_pts, global_pts, distance_transform);
+        this->computeDenseMean(local_pts, global_pts, distance_transform,
+                               std::vector<std::string>());
     }
     return this->denseMean_;
 }
 
+template < template < typename TCoordRep, unsigned > class TTransformType,
+           template < typename ImageType, typename TCoordRep > class TInterpolatorType,
+           typename TCoordRep, typename PixelType, typename ImageType>
+vtkSmartPointer<vtkPolyData> Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, ImageType>::getDenseMean(
+        std::vector< PointArrayType > local_pts,
+        std::vector< PointArrayType > global_pts,
+        std::vector<std::string> distance_transform_files) {
+    this->denseDone_ = false;
+    if (local_pts.empty() || distance_transform_files.empty() ||
+            global_pts.empty() || local_pts.size() != distance_transform_files.size()) {
+        throw std::runtime_error("Invalid input for reconstruction!");
+    }
+    this->computeDenseMean(local_pts, global_pts,
+                           std::vector<typename ImageType::Pointer>(),
+                           distance_transform_files);
+    return this->denseMean_;
+}
+
 template < template < typename TCoordRep, unsigned > class TTransformType,
            template < typename ImageType, typename TCoordRep > class TInterpolatorType,
            typename TCoordRep, typename PixelType, typename ImageType>
@@ -84,6 +106,8 @@ void Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, Imag
     this->sparseDone_ = false;
     this->denseDone_ = false;
     this->goodPoints_.clear();
+    this->goodIndices_.clear();
+    this->meanLandmarks_ = NULL;
     this->denseMean_ = NULL;
     this->sparseMean_ = NULL;
 }
@@ -167,82 +191,74 @@ vtkSmartPointer<vtkPolyData> Reconstruction<TTransformType,TInterpolatorType, TC
         return vtkSmartPointer<vtkPolyData>::New();
     }
     //we have a dense mean, so lets warp to subject space
-    std::vector<int> particles_indices;
-    for (int i = 0; i < this->goodPoints_.size(); i++) {
-        if (this->goodPoints_[i]) {
-            particles_indices.push_back(i);
-        }
-    }
     vtkSmartPointer< vtkPoints > subjectPts = vtkSmartPointer<vtkPoints>::New();
     for (auto &a : local_pts) {
         subjectPts->InsertNextPoint(a[0], a[1], a[2]);
     }
     double sigma = this->computeAverageDistanceToNeighbors(subjectPts,
-                                                           particles_indices);
+                                                           this->goodIndices_);
     // (3) set up the common source points for all warps
-    PointIdType id;
     // NOTE that, since we are not resampling images, this warping is a
     // forward warping from mean space to subject space
     // Define container for source landmarks that corresponds to the mean space, this is
     // the moving mesh which will be warped to each individual subject
-    typename PointSetType::Pointer sourceLandMarks = PointSetType::New();
-    typename PointSetType::PointsContainer::Pointer sourceLandMarkContainer =
-            sourceLandMarks->GetPoints();
-    PointType ps;
-    id = itk::NumericTraits< PointIdType >::Zero;
-    int ns = 0;
-    for (unsigned int ii = 0; ii < local_pts.size(); ii++) {
-        if (std::find(particles_indices.begin(),
-                      particles_indices.end(), ii) != particles_indices.end()) {
-            double p[3];
-            this->sparseMean_->GetPoint(ii, p);
-            ps[0] = p[0];
-            ps[1] = p[1];
-            ps[2] = p[2];
-            sourceLandMarkContainer->InsertElement(id++, ps);
-            ns++;
-        }
-    }
-    typename TransformType::Pointer transform = TransformType::New();
-    transform->SetSigma(sigma); // smaller means more sparse
-    transform->SetStiffness(1e-10);
-    transform->SetSourceLandmarks(sourceLandMarks);
+    typename TransformType::Pointer transform = this->acquireMeshTransform(sigma);
     // Define container for target landmarks corresponds to the subject shape
-    typename PointSetType::Pointer targetLandMarks = PointSetType::New();
-    PointType pt;
-    typename PointSetType::PointsContainer::Pointer targetLandMarkContainer =
-            targetLandMarks->GetPoints();
-    id = itk::NumericTraits< PointIdType >::Zero;
-    int nt = 0;
-    for (unsigned int ii = 0; ii < local_pts.size(); ii++) {
-        if (std::find(particles_indices.begin(),
-                      particles_indices.end(), ii) != particles_indices.end()) {
-            double p[3];
-            subjectPts->GetPoint(ii, p);
-            pt[0] = p[0];
-            pt[1] = p[1];
-            pt[2] = p[2];
-            targetLandMarkContainer->InsertElement(id++, pt);
-            nt++;
-        }
-    }
+    typename PointSetType::Pointer targetLandMarks = this->getGoodLandmarks(subjectPts);
     transform->SetTargetLandmarks(targetLandMarks);
-    // check the mapping (inverse here)
-    // this means source points (current sample's space) should
-    //  be warped to the target (mean space)
-    vtkSmartPointer<vtkPoints> mappedCorrespondences =
-            vtkSmartPointer<vtkPoints>::New();
-    double rms;
-    double rms_wo_mapping;
-    double maxmDist;
-    this->CheckMapping(this->sparseMean_, subjectPts,
-                       transform, mappedCorrespondences, rms, rms_wo_mapping, maxmDist);
+    // the warp is not checked with CheckMapping: its rms and distances were
+    // never used, and its maximum distance is quadratic in the number of
+    // particles
     vtkSmartPointer<vtkPolyData> denseShape = vtkSmartPointer<vtkPolyData>::New();
     denseShape->DeepCopy(this->denseMean_);
     this->generateWarpedMeshes(transform, denseShape);
+    this->releaseMeshTransform(transform);
     return denseShape;
 }
 
+template < template < typename TCoordRep, unsigned > class TTransformType,
+           template < typename ImageType, typename TCoordRep > class TInterpolatorType,
+           typename TCoordRep, typename PixelType, typename ImageType>
+typename Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, ImageType>::TransformType::Pointer
+Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, ImageType>::acquireMeshTransform(double sigma) {
+    // the source landmarks are the same for every subject, so a transform that
+    // already holds the system for meanLandmarks_ only needs its target landmarks
+    // set.  getMesh may run on several threads, hence one transform per caller.
+    if (!KernelDependsOnSigma<TransformType>::value) {
+        std::lock_guard<std::mutex> lock(this->meshTransformsMutex_);
+        if (this->meshTransformsLandmarks_ != this->meanLandmarks_) {
+            this->meshTransforms_.clear();
+            this->meshTransformsLandmarks_ = this->meanLandmarks_;
+        }
+        if (!this->meshTransforms_.empty()) {
+            typename TransformType::Pointer transform = this->meshTransforms_.back();
+            this->meshTransforms_.pop_back();
+            return transform;
+        }
+    }
+    typename TransformType::Pointer transform = TransformType::New();
+    transform->SetSigma(sigma); // smaller means more sparse
+    transform->SetStiffness(1e-10);
+    transform->SetSourceLandmarks(this->meanLandmarks_);
+    return transform;
+}
+
+template < template < typename TCoordRep, unsigned > class TTransformType,
+           template < typename ImageType, typename TCoordRep > class TInterpolatorType,
+           typename TCoordRep, typename PixelType, typename ImageType>
+void Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, ImageType>::releaseMeshTransform(
+        typename TransformType::Pointer transform) {
+    // the sigma of the compactly supported kernels follows each subject, so
+    // their system cannot be shared
+    if (KernelDependsOnSigma<TransformType>::value) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(this->meshTransformsMutex_);
+    if (transform->GetSourceLandmarks() == this->meshTransformsLandmarks_.GetPointer()) {
+        this->meshTransforms_.push_back(transform);
+    }
+}
+
 template < template < typename TCoordRep, unsigned > class TTransformType,
            template < typename ImageType, typename TCoordRep > class TInterpolatorType,
            typename TCoordRep, typename PixelType, typename ImageType>
@@ -285,6 +301,7 @@ void Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, Imag
             this->goodPoints_.push_back(true);
     }
     ptsIn.close();
+    this->updateGoodIndices();
     this->sparseDone_ = true;
     this->denseDone_ = true;
 }
@@ -428,7 +445,8 @@ template < template < typename TCoordRep, unsigned > class TTransformType,
 void Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, ImageType>::computeDenseMean(
         std::vector< PointArrayType > local_pts,
         std::vector< PointArrayType > global_pts,
-        std::vector<typename ImageType::Pointer> distance_transform) {
+        std::vector<typename ImageType::Pointer> distance_transform,
+        std::vector<std::string> distance_transform_files) {
     try {
         //turn the sets of global points to one sparse global mean.
         float init[] = { 0.f,0.f,0.f };
@@ -454,14 +472,40 @@ void Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, Imag
         for (auto &a : sparseMean) {
             this->sparseMean_->InsertNextPoint(a[0], a[1], a[2]);
         }
+
+        // The parameters of the output image are taken from the input image.
+        // NOTE: all distance transforms were generated throughout shapeworks pipeline
+        // as such they have the same parameters
+        typename ImageType::SpacingType spacing;
+        typename ImageType::PointType origin;
+        typename ImageType::DirectionType direction;
+        typename ImageType::SizeType size;
+        typename ImageType::RegionType region;
         for (size_t shape = 0; shape < local_pts.size(); shape++) {
             subjectPts.push_back(vtkSmartPointer<vtkPoints>::New());
             for (auto &a : local_pts[shape]) {
                 subjectPts[shape]->InsertNextPoint(a[0], a[1], a[2]);
             }
+            // distance transforms given as files are only held while they are used
+            if (!distance_transform_files.empty()) {
+                std::string filename = distance_transform_files[shape];
+                if (filename.find(".nrrd") != std::string::npos) {
+                    itk::NrrdImageIOFactory::RegisterOneFactory();
+                } else if (filename.find(".mha") != std::string::npos) {
+                    itk::MetaImageIOFactory::RegisterOneFactory();
+                }
+            }
+            typename ImageType::Pointer dt = this->getDistanceTransform(
+                        shape, distance_transform, distance_transform_files);
+            if (shape == 0) {
+                spacing = dt->GetSpacing();
+                origin = dt->GetOrigin();
+                direction = dt->GetDirection();
+                size = dt->GetLargestPossibleRegion().GetSize();
+                region = dt->GetBufferedRegion();
+            }
             //calculate the normals from the DT
-            normals.push_back(this->computeParticlesNormals(
-                                  subjectPts[shape], distance_transform[shape]));
+            normals.push_back(this->computeParticlesNormals(subjectPts[shape], dt));
         }
 
         // now decide whether each particle is a good based on dispersion from mean
@@ -556,81 +600,19 @@ void Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, Imag
         }
 
         // decide which correspondences will be used to build the warp
-        std::vector<int> particles_indices;
-        particles_indices.clear();
-        for (unsigned int kk = 0; kk < this->goodPoints_.size(); kk++) {
-            if (this->goodPoints_[kk]) {
-                particles_indices.push_back(int(kk));
-            }
-        }
+        this->updateGoodIndices();
+        const std::vector<int>& particles_indices = this->goodIndices_;
         std::cout << "There are " << particles_indices.size() << " / " << this->goodPoints_.size() <<
                      " good points." << std::endl;
 
-        // The parameters of the output image are taken from the input image.
-        // NOTE: all distance transforms were generated throughout shapeworks pipeline
-        // as such they have the same parameters
-        const typename ImageType::SpacingType& spacing = distance_transform[0]->GetSpacing();
-        const typename ImageType::PointType& origin = distance_transform[0]->GetOrigin();
-        const typename ImageType::DirectionType& direction = distance_transform[0]->GetDirection();
-        typename ImageType::SizeType size = distance_transform[0]->GetLargestPossibleRegion().GetSize();
-        typename ImageType::RegionType region = distance_transform[0]->GetBufferedRegion();
-
-        // define the mean dense shape (mean distance transform)
-        typename ImageType::Pointer meanDistanceTransform = ImageType::New();
-        if(use_origin)
-            meanDistanceTransform->SetOrigin(origin_);
-        else
-            meanDistanceTransform->SetOrigin(origin);
-        meanDistanceTransform->SetSpacing(spacing);
-        meanDistanceTransform->SetDirection(direction);
-        meanDistanceTransform->SetLargestPossibleRegion(size);
-
-        typename ImageType::Pointer meanDistanceTransformBeforeWarp = ImageType::New();
-        if(use_origin)
-            meanDistanceTransformBeforeWarp->SetOrigin(origin_);
-        else
-            meanDistanceTransformBeforeWarp->SetOrigin(origin);
-        meanDistanceTransformBeforeWarp->SetSpacing(spacing);
-        meanDistanceTransformBeforeWarp->SetDirection(direction);
-        meanDistanceTransformBeforeWarp->SetLargestPossibleRegion(size);
-
-        typename AddImageFilterType::Pointer sumfilter = AddImageFilterType::New();
-        typename AddImageFilterType::Pointer sumfilterBeforeWarp = AddImageFilterType::New();
-
         // Define container for source landmarks that corresponds to the mean space, this is
         // fixed where the target (each individual shape) will be warped to
         // NOTE that this is inverse warping to avoid holes in the warped distance transforms
-        typename PointSetType::Pointer sourceLandMarks = PointSetType::New();
-        typename PointSetType::PointsContainer::Pointer sourceLandMarkContainer = sourceLandMarks->GetPoints();
-        PointType ps;
-        PointIdType id = itk::NumericTraits< PointIdType >::Zero;
-        int ns = 0;
-        for (unsigned int ii = 0; ii < local_pts[0].size(); ii++) {
-            if (std::find(particles_indices.begin(),
-                          particles_indices.end(), ii) != particles_indices.end()) {
-                double p[3];
-                this->sparseMean_->GetPoint(ii, p);
-                ps[0] = p[0];
-                ps[1] = p[1];
-                ps[2] = p[2];
-                sourceLandMarkContainer->InsertElement(id++, ps);
-                ns++;
-            }
-        }
-
+        typename PointSetType::Pointer sourceLandMarks = this->meanLandmarks_;
 
         double sigma = computeAverageDistanceToNeighbors(
                     this->sparseMean_, particles_indices);
 
-        // the roles of the source and target are reversed to simulate a reverse warping
-        // without explicitly invert the warp in order to avoid holes in the warping result
-        typename TransformType::Pointer transform = TransformType::New();
-        transform->SetSigma(sigma); // smaller means more sparse
-        //transform->SetStiffness(0.25*sigma);
-        transform->SetStiffness(1e-10);
-
-        transform->SetSourceLandmarks(sourceLandMarks);
-
         //////////////////////////////////////////////////////////////////
         //Praful - get the shape indices corresponding to cetroids of
         //kmeans clusters and run the following loop on only those shapes
@@ -639,114 +621,151 @@ void Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, Imag
         if (this->numClusters_ > 0 && this->numClusters_ < global_pts.size()) {
                 this->performKMeansClustering(global_pts, global_pts[0].size(), centroidIndices);
         } else {
-            this->numClusters_ = distance_transform.size();
-            centroidIndices.resize(distance_transform.size());
-            for (size_t shapeNo = 0; shapeNo < distance_transform.size(); shapeNo++) {
+            this->numClusters_ = local_pts.size();
+            centroidIndices.resize(local_pts.size());
+            for (size_t shapeNo = 0; shapeNo < local_pts.size(); shapeNo++) {
                 centroidIndices[shapeNo] = int(shapeNo);
                 std::cout << centroidIndices[shapeNo] << std::endl;
             }
         }
+
+        // The cluster representatives are warped concurrently. Each thread adds
+        // the warped (and the original) distance transforms of its shapes into
+        // its own running sums, kept in double, which are merged in thread order
+        // at the end. Shapes are dealt to the threads round robin, so the sums do
+        // not depend on scheduling. How the shapes are grouped does depend on
+        // the number of threads the runtime grants, but only at the rounding
+        // of the double sums, well below the precision of the float mean; a
+        // pixel can still differ in its last bit between thread counts.
+        //
+        // As in getMesh, the warps are not checked with CheckMapping.
+        const int numThreads = std::max(1, std::min(omp_get_max_threads(),
+                                                    int(centroidIndices.size())));
+        const int workUnits = std::max(1, omp_get_max_threads() / numThreads);
+        const size_t numPixels = region.GetNumberOfPixels();
+
+        // the roles of the source and target are reversed to simulate a reverse warping
+        // without explicitly invert the warp in order to avoid holes in the warping result
+        std::vector<typename TransformType::Pointer> transforms(numThreads);
+        for (auto &transform : transforms) {
+            transform = TransformType::New();
+            transform->SetSigma(sigma); // smaller means more sparse
+            //transform->SetStiffness(0.25*sigma);
+            transform->SetStiffness(1e-10);
+            transform->SetSourceLandmarks(sourceLandMarks);
+        }
+
+        // the runtime may grant fewer threads than requested (nested regions,
+        // thread limits, OMP_DYNAMIC); the slots of the missing ones stay empty
+        std::vector< std::vector<double> > sums(numThreads);
+        std::vector< std::vector<double> > sumsBeforeWarp(numThreads);
+        std::exception_ptr error;
+
         //////////////////////////////////////////////////////////////////
         //Praful - clustering
-        for (unsigned int cnt = 0; cnt < centroidIndices.size(); cnt++) {
-            size_t shape = size_t(centroidIndices[cnt]);
-            auto dt = distance_transform[shape];
-            typename PointSetType::Pointer targetLandMarks = PointSetType::New();
-            PointType pt;
-            typename PointSetType::PointsContainer::Pointer
-                    targetLandMarkContainer = targetLandMarks->GetPoints();
-            id = itk::NumericTraits< PointIdType >::Zero;
-
-            int nt = 0;
-            for (unsigned int ii = 0; ii < local_pts[0].size(); ii++) {
-                if (std::find(particles_indices.begin(),
-                              particles_indices.end(), ii) != particles_indices.end()) {
-                    double p[3];
-                    subjectPts[shape]->GetPoint(ii, p);
-                    pt[0] = p[0];
-                    pt[1] = p[1];
-                    pt[2] = p[2];
-                    targetLandMarkContainer->InsertElement(id++, pt);
-                    nt++;
+#pragma omp parallel for num_threads(numThreads) schedule(static, 1)
+        for (int cnt = 0; cnt < int(centroidIndices.size()); cnt++) {
+            const int tid = omp_get_thread_num();
+            try {
+                size_t shape = size_t(centroidIndices[cnt]);
+                typename ImageType::Pointer dt = this->getDistanceTransform(
+                            shape, distance_transform, distance_transform_files);
+                if (dt->GetBufferedRegion() != region) {
+                    throw std::runtime_error("Distance transforms differ in size, can not reconstruct!");
+                }
+
+                typename PointSetType::Pointer targetLandMarks =
+                        this->getGoodLandmarks(subjectPts[shape]);
+                transforms[tid]->SetTargetLandmarks(targetLandMarks);
+
+                // Set the resampler params
+                typename ResampleFilterType::Pointer   resampler = ResampleFilterType::New();
+                typename InterpolatorType::Pointer interpolator = InterpolatorType::New();
+                //interpolator->SetSplineOrder(3); // itk has a default bspline order = 3
+
+                resampler->SetInterpolator(interpolator);
+
+                resampler->SetOutputSpacing(spacing);
+                resampler->SetOutputDirection(direction);
+                if(use_origin)
+                    resampler->SetOutputOrigin(origin_);
+                else
+                    resampler->SetOutputOrigin(origin);
+                resampler->SetSize(size);
+                resampler->SetTransform(transforms[tid]);
+                resampler->SetDefaultPixelValue((PixelType)-100.0);
+                resampler->SetOutputStartIndex(region.GetIndex());
+                resampler->SetInput(dt);
+                resampler->SetNumberOfWorkUnits(workUnits);
+                resampler->Update();
+
+                if (sums[tid].empty()) {
+                    sums[tid].assign(numPixels, 0.0);
+                    sumsBeforeWarp[tid].assign(numPixels, 0.0);
+                }
+                double* sum = &sums[tid][0];
+                const PixelType* warped = resampler->GetOutput()->GetBufferPointer();
+                for (size_t i = 0; i < numPixels; i++) {
+                    sum[i] += warped[i];
+                }
+                double* sumBeforeWarp = &sumsBeforeWarp[tid][0];
+                const PixelType* original = dt->GetBufferPointer();
+                for (size_t i = 0; i < numPixels; i++) {
+                    sumBeforeWarp[i] += original[i];
+                }
+            } catch (...) {
+#pragma omp critical
+                {
+                    if (!error) {
+                        error = std::current_exception();
+                    }
                 }
             }
-            transform->SetTargetLandmarks(targetLandMarks);
-            // check the mapping (inverse here)
-            // this mean source points (mean space) should
-            // be warped to the target (current sample's space)
-            vtkSmartPointer<vtkPoints> mappedCorrespondences = vtkSmartPointer<vtkPoints>::New();
-            double rms;
-            double rms_wo_mapping;
-            double maxmDist;
-            this->CheckMapping(this->sparseMean_, subjectPts[shape], transform,
-                               mappedCorrespondences, rms, rms_wo_mapping, maxmDist);
-
-            // Set the resampler params
-            typename ResampleFilterType::Pointer   resampler = ResampleFilterType::New();
-            typename InterpolatorType::Pointer interpolator = InterpolatorType::New();
-            //interpolator->SetSplineOrder(3); // itk has a default bspline order = 3
-
-            resampler->SetInterpolator(interpolator);
-
-            resampler->SetOutputSpacing(spacing);
-            resampler->SetOutputDirection(direction);
-            if(use_origin)
-                resampler->SetOutputOrigin(origin_);
-            else
-                resampler->SetOutputOrigin(origin);
-            resampler->SetSize(size);
-            resampler->SetTransform(transform);
-            resampler->SetDefaultPixelValue((PixelType)-100.0);
-            resampler->SetOutputStartIndex(region.GetIndex());
-            resampler->SetInput(distance_transform[shape]);
-            resampler->Update();
-
-            if (cnt == 0) {
-                // after warp
-                typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
-                duplicator->SetInputImage(resampler->GetOutput());
-                duplicator->Update();
-                meanDistanceTransform = duplicator->GetOutput();
-                // before warp
-                typename DuplicatorType::Pointer duplicator2 = DuplicatorType::New();
-                duplicator2->SetInputImage(distance_transform[shape]);
-                duplicator2->Update();
-                meanDistanceTransformBeforeWarp = duplicator2->GetOutput();
-            } else {
-                // after warp
-                sumfilter->SetInput1(meanDistanceTransform);
-                sumfilter->SetInput2(resampler->GetOutput());
-                sumfilter->Update();
-
-                typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
-                duplicator->SetInputImage(sumfilter->GetOutput());
-                duplicator->Update();
-                meanDistanceTransform = duplicator->GetOutput();
-
-                // before warp
-                sumfilterBeforeWarp->SetInput1(meanDistanceTransformBeforeWarp);
-                sumfilterBeforeWarp->SetInput2(distance_transform[shape]);
-                sumfilterBeforeWarp->Update();
-
-                typename DuplicatorType::Pointer duplicator2 = DuplicatorType::New();
-                duplicator2->SetInputImage(sumfilterBeforeWarp->GetOutput());
-                duplicator2->Update();
-                meanDistanceTransformBeforeWarp = duplicator2->GetOutput();
-            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
 
+        // define the mean dense shape (mean distance transform) by merging the
+        // partial sums of all threads
+        typename ImageType::Pointer meanDistanceTransform = ImageType::New();
+        if(use_origin)
+            meanDistanceTransform->SetOrigin(origin_);
+        else
+            meanDistanceTransform->SetOrigin(origin);
+        meanDistanceTransform->SetSpacing(spacing);
+        meanDistanceTransform->SetDirection(direction);
+        meanDistanceTransform->SetRegions(region);
+        meanDistanceTransform->Allocate();
+
+        typename ImageType::Pointer meanDistanceTransformBeforeWarp = ImageType::New();
+        meanDistanceTransformBeforeWarp->SetOrigin(origin);
+        meanDistanceTransformBeforeWarp->SetSpacing(spacing);
+        meanDistanceTransformBeforeWarp->SetDirection(direction);
+        meanDistanceTransformBeforeWarp->SetRegions(region);
+        meanDistanceTransformBeforeWarp->Allocate();
+
+        PixelType* mean = meanDistanceTransform->GetBufferPointer();
+        PixelType* meanBeforeWarp = meanDistanceTransformBeforeWarp->GetBufferPointer();
+        std::vector<const double*> partialSums, partialSumsBeforeWarp;
+        for (int t = 0; t < numThreads; t++) {
+            if (!sums[t].empty()) {
+                partialSums.push_back(&sums[t][0]);
+                partialSumsBeforeWarp.push_back(&sumsBeforeWarp[t][0]);
+            }
+        }
+        const double scale = 1.0 / static_cast<double>(this->numClusters_);
+#pragma omp parallel for
+        for (long long i = 0; i < (long long)numPixels; i++) {
+            double value = 0.0;
+            double valueBeforeWarp = 0.0;
+            for (size_t t = 0; t < partialSums.size(); t++) {
+                value += partialSums[t][i];
+                valueBeforeWarp += partialSumsBeforeWarp[t][i];
+            }
+            mean[i] = static_cast<PixelType>(value * scale);
+            meanBeforeWarp[i] = static_cast<PixelType>(valueBeforeWarp * scale);
         }
-        typename MultiplyByConstantImageFilterType::Pointer multiplyImageFilter =
-                MultiplyByConstantImageFilterType::New();
-        multiplyImageFilter->SetInput(meanDistanceTransform);
-        multiplyImageFilter->SetConstant(1.0 /
-                                         static_cast<double>(this->numClusters_));
-        multiplyImageFilter->Update();
-        typename MultiplyByConstantImageFilterType::Pointer multiplyImageFilterBeforeWarp =
-                MultiplyByConstantImageFilterType::New();
-        multiplyImageFilterBeforeWarp->SetInput(meanDistanceTransformBeforeWarp);
-        multiplyImageFilterBeforeWarp->SetConstant(1.0 /
-                                                   static_cast<double>(this->numClusters_));
-        multiplyImageFilterBeforeWarp->Update();
 
         std::string meanDT_filename           = out_prefix_ + "_meanDT.nrrd" ;;
         std::string meanDTBeforeWarp_filename = out_prefix_ + "_meanDT_beforeWarp.nrrd" ;;
@@ -755,18 +774,18 @@ void Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, Imag
         {
             typename WriterType::Pointer writer = WriterType::New();
             writer->SetFileName( meanDT_filename.c_str());
-            writer->SetInput( multiplyImageFilter->GetOutput() );
+            writer->SetInput( meanDistanceTransform );
             writer->Update();
 
             writer->SetFileName( meanDTBeforeWarp_filename.c_str());
-            writer->SetInput( multiplyImageFilterBeforeWarp->GetOutput() );
+            writer->SetInput( meanDistanceTransformBeforeWarp );
             writer->Update();
         }
 
         // going to vtk to extract the template mesh (mean dense shape)
         // to be deformed for each sparse shape
         typename ITK2VTKConnectorType::Pointer itk2vtkConnector = ITK2VTKConnectorType::New();
-        itk2vtkConnector->SetInput(multiplyImageFilter->GetOutput());
+        itk2vtkConnector->SetInput(meanDistanceTransform);
         itk2vtkConnector->Update();
         this->denseMean_ =
                 this->extractIsosurface(itk2vtkConnector->GetOutput());
@@ -784,6 +803,28 @@ void Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, Imag
     this->denseDone_ = true;
 }
 
+template < template < typename TCoordRep, unsigned > class TTransformType,
+           template < typename ImageType, typename TCoordRep > class TInterpolatorType,
+           typename TCoordRep, typename PixelType, typename ImageType>
+typename ImageType::Pointer Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, ImageType>::getDistanceTransform(
+        size_t shape,
+        const std::vector<typename ImageType::Pointer>& distance_transform,
+        const std::vector<std::string>& distance_transform_files)
+{
+    if (!distance_transform.empty()) {
+        return distance_transform[shape];
+    }
+    // the image io factories are registered by the caller, as registering
+    // them is not thread safe
+    typedef itk::ImageFileReader< ImageType > ReaderType;
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName( distance_transform_files[shape].c_str() );
+    reader->Update();
+    typename ImageType::Pointer dt = reader->GetOutput();
+    dt->DisconnectPipeline();
+    return dt;
+}
+
 template < template < typename TCoordRep, unsigned > class TTransformType,
            template < typename ImageType, typename TCoordRep > class TInterpolatorType,
            typename TCoordRep, typename PixelType, typename ImageType>
@@ -965,30 +1006,79 @@ void Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, Imag
     // generate warped meshes
     vtkSmartPointer<vtkPoints> vertices = vtkSmartPointer<vtkPoints>::New();
     vertices->DeepCopy(outputMesh->GetPoints());
-    unsigned int numPointsToTransform = vertices->GetNumberOfPoints();
-    for (unsigned int i = 0; i < numPointsToTransform; i++)
-    {
-        double meshPoint[3];
-        vertices->GetPoint(i, meshPoint);
+    int numPointsToTransform = int(vertices->GetNumberOfPoints());
 
+    // vtkPoints is not safe to access concurrently, so the vertices are
+    // warped in parallel through a plain buffer
+    std::vector<double> meshPoints(3 * numPointsToTransform);
+    for (int i = 0; i < numPointsToTransform; i++) {
+        vertices->GetPoint(i, &meshPoints[3 * i]);
+    }
+#pragma omp parallel for
+    for (int i = 0; i < numPointsToTransform; i++)
+    {
         itk::Point<double, 3> pm_;
         itk::Point<double, 3> pw_;
 
-        pm_[0] = meshPoint[0]; pm_[1] = meshPoint[1]; pm_[2] = meshPoint[2];
+        pm_[0] = meshPoints[3 * i]; pm_[1] = meshPoints[3 * i + 1]; pm_[2] = meshPoints[3 * i + 2];
 
         pw_ = transform->TransformPoint(pm_);
 
-        vertices->SetPoint(i, pw_[0], pw_[1], pw_[2]);
+        meshPoints[3 * i] = pw_[0]; meshPoints[3 * i + 1] = pw_[1]; meshPoints[3 * i + 2] = pw_[2];
+    }
+    for (int i = 0; i < numPointsToTransform; i++) {
+        vertices->SetPoint(i, &meshPoints[3 * i]);
     }
     outputMesh->SetPoints(vertices);
     outputMesh->Modified();
 }
 
+template < template < typename TCoordRep, unsigned > class TTransformType,
+           template < typename ImageType, typename TCoordRep > class TInterpolatorType,
+           typename TCoordRep, typename PixelType, typename ImageType>
+void Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, ImageType>::updateGoodIndices() {
+    // computed once per good points mask and shared by every shape, so that
+    // getMesh only reads members and can run concurrently
+    this->goodIndices_.clear();
+    for (size_t i = 0; i < this->goodPoints_.size(); i++) {
+        if (this->goodPoints_[i]) {
+            this->goodIndices_.push_back(int(i));
+        }
+    }
+    this->meanLandmarks_ = NULL;
+    if (this->sparseMean_ &&
+        this->sparseMean_->GetNumberOfPoints() >= vtkIdType(this->goodPoints_.size())) {
+        this->meanLandmarks_ = this->getGoodLandmarks(this->sparseMean_);
+    }
+}
+
+template < template < typename TCoordRep, unsigned > class TTransformType,
+           template < typename ImageType, typename TCoordRep > class TInterpolatorType,
+           typename TCoordRep, typename PixelType, typename ImageType>
+typename Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, ImageType>::PointSetType::Pointer
+Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, ImageType>::getGoodLandmarks(
+        vtkSmartPointer<vtkPoints> points) const {
+    typename PointSetType::Pointer landmarks = PointSetType::New();
+    typename PointSetType::PointsContainer::Pointer container = landmarks->GetPoints();
+    container->Reserve(this->goodIndices_.size());
+    PointType pt;
+    PointIdType id = itk::NumericTraits< PointIdType >::Zero;
+    for (auto ii : this->goodIndices_) {
+        double p[3];
+        points->GetPoint(ii, p);
+        pt[0] = p[0];
+        pt[1] = p[1];
+        pt[2] = p[2];
+        container->SetElement(id++, pt);
+    }
+    return landmarks;
+}
+
 template < template < typename TCoordRep, unsigned > class TTransformType,
            template < typename ImageType, typename TCoordRep > class TInterpolatorType,
            typename TCoordRep, typename PixelType, typename ImageType>
 double Reconstruction<TTransformType,TInterpolatorType, TCoordRep, PixelType, ImageType>::computeAverageDistanceToNeighbors(
-        vtkSmartPointer<vtkPoints> points, std::vector<int> particles_indices) {
+        vtkSmartPointer<vtkPoints> points, const std::vector<int>& particles_indices) {
     int K = 6; // hexagonal ring - one jump
     vtkSmartPointer<vtkPolyData> polydata = vtkSmartPointer<vtkPolyData>::New();
     polydata->SetPoints(points);
@@ -5,6 +5,7 @@
 #include <itkeigen/Eigen/Sparse>
 
 #include "itkThinPlateSplineKernelTransform2.h"
+#include "itkFastThinPlateSplineKernelTransform.h"
 #include "itkCompactlySupportedRBFSparseKernelTransform.h"
 
 #include <itkImageToVTKImageFilter.h>
@@ -27,6 +28,8 @@
 #include <itkImageFileWriter.h>
 #include "Procrustes3D.h"
 
+#include <mutex>
+
 #ifdef assert
 #undef assert
 #define assert(a) { if (!static_cast<bool>(a)) { throw std::runtime_error("a"); } }
@@ -40,6 +43,15 @@ class ITK_TEMPLATE_EXPORT BSplineInterpolateImageFunctionWithDoubleCoefficents
 {};
 }
 
+// Whether the kernel of a transform depends on its sigma, in which case the
+// system built by SetSourceLandmarks can only be reused for the same sigma.
+template < class TTransform >
+struct KernelDependsOnSigma { static const bool value = true; };
+template < typename TCoordRep, unsigned NDimensions >
+struct KernelDependsOnSigma< itk::ThinPlateSplineKernelTransform2< TCoordRep, NDimensions > > { static const bool value = false; };
+template < typename TCoordRep, unsigned NDimensions >
+struct KernelDependsOnSigma< itk::FastThinPlateSplineKernelTransform< TCoordRep, NDimensions > > { static const bool value = false; };
+
 template < template < typename TCoordRep, unsigned > class TTransformType = itk::CompactlySupportedRBFSparseKernelTransform,
            template < typename ImageType, typename TCoordRep > class TInterpolatorType = itk::LinearInterpolateImageFunction,
            typename TCoordRep = double, typename PixelType = float, typename ImageType = itk::Image<PixelType, 3>>
@@ -86,6 +98,12 @@ public:
             std::vector< PointArrayType >(),
             std::vector<typename ImageType::Pointer> distance_transform =
             std::vector<typename ImageType::Pointer>() );
+    // same as above, but the distance transforms are read from disk as they
+    // are needed instead of all being held in memory
+    vtkSmartPointer<vtkPolyData> getDenseMean(
+            std::vector< PointArrayType > local_pts,
+            std::vector< PointArrayType > global_pts,
+            std::vector<std::string> distance_transform_files);
     void reset();
 
     void setDecimation(float dec);
@@ -136,14 +154,23 @@ private:
     void computeDenseMean(
             std::vector< PointArrayType > local_pts,
             std::vector< PointArrayType > global_pts,
-            std::vector<typename ImageType::Pointer> distance_transform);
+            std::vector<typename ImageType::Pointer> distance_transform,
+            std::vector<std::string> distance_transform_files);
+    typename ImageType::Pointer getDistanceTransform(
+            size_t shape,
+            const std::vector<typename ImageType::Pointer>& distance_transform,
+            const std::vector<std::string>& distance_transform_files);
     vnl_matrix<double> computeParticlesNormals(
             vtkSmartPointer< vtkPoints > particles,
             typename ImageType::Pointer distance_transform);
+    typename TransformType::Pointer acquireMeshTransform(double sigma);
+    void releaseMeshTransform(typename TransformType::Pointer transform);
     void generateWarpedMeshes(typename TransformType::Pointer transform,
                               vtkSmartPointer<vtkPolyData>& outputMesh);
     double computeAverageDistanceToNeighbors(vtkSmartPointer<vtkPoints> points,
-                                             std::vector<int> particles_indices);
+                                             const std::vector<int>& particles_indices);
+    void updateGoodIndices();
+    typename PointSetType::Pointer getGoodLandmarks(vtkSmartPointer<vtkPoints> points) const;
     void CheckMapping(vtkSmartPointer<vtkPoints> sourcePts,
                       vtkSmartPointer<vtkPoints> targetPts,
                       typename TransformType::Pointer transform,
@@ -180,6 +207,12 @@ private:
     vtkSmartPointer<vtkPoints> sparseMean_;
     vtkSmartPointer<vtkPolyData> denseMean_;
     std::vector<bool> goodPoints_;
+    std::vector<int> goodIndices_;                  // indices of the good points
+    typename PointSetType::Pointer meanLandmarks_;  // good points of the sparse mean
+    // idle transforms whose source landmarks are meanLandmarks_, reused by getMesh
+    std::vector<typename TransformType::Pointer> meshTransforms_;
+    typename PointSetType::Pointer meshTransformsLandmarks_;
+    std::mutex meshTransformsMutex_;
     bool sparseDone_;
     bool denseDone_;
     float decimationPercent_;
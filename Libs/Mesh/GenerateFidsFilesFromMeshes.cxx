@@ -891,18 +891,16 @@ int main(int argc, char *argv[])
             mesh->imageSpacing[1] = spacing[1];
             mesh->imageSpacing[2] = spacing[2];
 
-            std::map<int, std::vector<int> > faceIndexMap = mesh->faceIndexMap;
+            const FaceIndexTable &faceIndexTable = mesh->faceIndexTable;
 
-            int len = (int) faceIndexMap.size();
+            int len = (int) faceIndexTable.Voxels();
             std::vector<int> indices = randperm(len);
 
             for(unsigned int i = 0; i < 1; i++)
             {
                 // Voxel
                 int ind = indices[i]; //(rng.next(len));
-                std::map<int, std::vector<int> >::iterator itInit = faceIndexMap.begin();
-                std::advance(itInit, ind);
-                float voxelIndex = itInit->first;
+                float voxelIndex = faceIndexTable.Key(ind);
                 std::cout << "Viewing voxel # " << ind << std::endl;
 
                 //                itk::Point<double, 3> p = particles[2318];
@@ -910,8 +908,9 @@ int main(int argc, char *argv[])
                 //                for(int ii = 0; ii < 3; ii++) pp[ii] = (float) p[ii];
                 //                float voxelIndex = mesh->physicalPointToLinearIndex(pp);
 
-                std::vector<int> faceList = faceIndexMap[voxelIndex];
-                TriMesh::Face f = mesh->faces[ *(faceList.begin())];
+                const int *faceBegin, *faceEnd;
+                faceIndexTable.Find(voxelIndex, faceBegin, faceEnd);
+                TriMesh::Face f = mesh->faces[ *faceBegin ];
                 voxelIndex = mesh->physicalPointToLinearIndex( mesh->vertices[f.v[0]] );
 
                 // ind = x + y * size[0] + z * size[0] * size[1]
@@ -980,7 +979,9 @@ int main(int argc, char *argv[])
                 ids1->InsertNextValue( 2314 );
                 //                }
 
-                std::cout << "Number of faces : " <<  faceIndexMap[voxelIndex].size() << std::endl;
+                if(!faceIndexTable.Find(voxelIndex, faceBegin, faceEnd))
+                    faceBegin = faceEnd = 0;
+                std::cout << "Number of faces : " <<  (faceEnd - faceBegin) << std::endl;
 
                 vtkSmartPointer<vtkSelectionNode> selectionNode = vtkSmartPointer<vtkSelectionNode>::New();
                 selectionNode->SetFieldType(vtkSelectionNode::CELL);
@@ -7,6 +7,8 @@
 #include <vtkPolyDataWriter.h>
 #include <vtkPointData.h>
 
+#include <memory>
+
 //#include <vtkVersion.h>
 //#include <vtkPointData.h>
 //#include <vtkPolyDataNormals.h>
@@ -23,6 +25,16 @@ namespace shapeworks {
 
 //<ctc> TODO: mesh
 
+///////////////////////////////////////////////////////////////////////////////
+// The target surface of coverage, valid while the poly data is unchanged.
+struct Mesh::CoverageTarget
+{
+  vtkPolyData* poly_data = nullptr;
+  vtkMTimeType mtime = 0;
+  std::unique_ptr<FEMesh> surface;
+  FEAreaCoverage areaCoverage;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 bool Mesh::read(const std::string &inFilename)
 {
@@ -52,17 +64,36 @@ bool Mesh::coverage(const Mesh &other_mesh)
     return false;
   }
 
+  if (!other_mesh.poly_data_) {
+    std::cerr << "No second mesh loaded, so returning false." << std::endl;
+    return false;
+  }
+
+  std::shared_ptr<CoverageTarget> target = other_mesh.coverage_target_;
+  if (!target || target->poly_data != other_mesh.poly_data_.GetPointer() ||
+      target->mtime != other_mesh.poly_data_->GetMTime()) {
+    FEVTKimport importer;
+    std::unique_ptr<FEMesh> surf2(importer.Load(other_mesh.poly_data_));
+    if (!surf2) {
+      std::cerr << "Error reading mesh\n";
+      return false;
+    }
+    target = std::make_shared<CoverageTarget>();
+    target->poly_data = other_mesh.poly_data_.GetPointer();
+    target->mtime = other_mesh.poly_data_->GetMTime();
+    target->surface = std::move(surf2);
+    target->areaCoverage.SetTarget(*target->surface);
+    other_mesh.coverage_target_ = target;
+  }
+
   FEVTKimport importer;
-  FEMesh* surf1 = importer.Load(this->poly_data_);
-  FEMesh* surf2 = importer.Load(other_mesh.poly_data_);
-  if (surf1 == nullptr || surf2 == nullptr) {
+  std::unique_ptr<FEMesh> surf1(importer.Load(this->poly_data_));
+  if (!surf1) {
     std::cerr << "Error reading mesh\n";
     return false;
   }
 
-  FEAreaCoverage areaCoverage;
-
-  vector<double> map1 = areaCoverage.Apply(*surf1, *surf2);
+  vector<double> map1 = target->areaCoverage.Apply(*surf1);
 
   for (int i = 0; i < surf1->Nodes(); ++i) {
     surf1->Node(i).m_ndata = map1[i];
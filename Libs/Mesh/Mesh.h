@@ -2,6 +2,7 @@
 
 #include <vtkSmartPointer.h>
 #include <vtkPolyData.h>
+#include <memory>
 #include <string>
 
 namespace shapeworks {
@@ -22,6 +23,8 @@ public:
 
   /// coverage
   /// \param mesh
+  /// The ray casting structure of other_mesh is kept with it, so further
+  /// coverage calls against the same mesh reuse it.
   bool coverage(const Mesh& other_mesh);
 
   bool smooth(/*iterations, relaxation_factor, edge_smoothing, boundary_smoothing*/);
@@ -34,6 +37,9 @@ public:
   bool compare_scalars_equal(const Mesh& other_mesh);
 
 private:
+  struct CoverageTarget;
+
   vtkSmartPointer<vtkPolyData> poly_data_;
+  mutable std::shared_ptr<CoverageTarget> coverage_target_; // built by coverage against this mesh
 };
 } // shapeworks
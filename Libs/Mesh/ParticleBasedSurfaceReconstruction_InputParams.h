@@ -69,6 +69,7 @@ public:
     bool usePairwiseNormalsDifferencesForGoodBad;
 
     bool use_tps_transform;
+    bool use_fast_tps_transform; // with use_tps_transform, for many particles
     bool use_bspline_interpolation;
 
     // input files
@@ -114,6 +115,7 @@ public:
         usePairwiseNormalsDifferencesForGoodBad = false;
 
         use_tps_transform         = false;
+        use_fast_tps_transform    = false;
         use_bspline_interpolation = false;
 
         localPointsFilenames.clear();
@@ -144,6 +146,12 @@ public:
                 atoi(elem->GetText()) > 0 ? use_tps_transform = true : use_tps_transform = false;
             }
 
+            elem = docHandle.FirstChild( "use_fast_tps_transform" ).Element();
+            if (elem)
+            {
+                atoi(elem->GetText()) > 0 ? use_fast_tps_transform = true : use_fast_tps_transform = false;
+            }
+
             elem = docHandle.FirstChild( "use_bspline_interpolation" ).Element();
             if (elem)
             {
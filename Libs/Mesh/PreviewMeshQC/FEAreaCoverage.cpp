@@ -1,6 +1,29 @@
 #include "stdafx.h"
 #include "FEAreaCoverage.h"
 #include "Intersect.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+//-----------------------------------------------------------------------------
+static double component(const vec3d& v, int k) { return (k == 0 ? v.x : (k == 1 ? v.y : v.z)); }
+
+static vec3d vmin(const vec3d& a, const vec3d& b)
+{
+  return vec3d(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+}
+
+static vec3d vmax(const vec3d& a, const vec3d& b)
+{
+  return vec3d(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+}
+
+// half the surface area of a box
+static double halfArea(const vec3d& lo, const vec3d& hi)
+{
+  vec3d d = hi - lo;
+  return d.x * d.y + d.y * d.z + d.z * d.x;
+}
 
 //-----------------------------------------------------------------------------
 void FEAreaCoverage::Surface::Create(FEMesh& mesh)
@@ -74,34 +97,220 @@ void FEAreaCoverage::Surface::Create(FEMesh& mesh)
 }
 
 //-----------------------------------------------------------------------------
-FEAreaCoverage::FEAreaCoverage()
+// The box of a face holds everything faceIntersect accepts: its triangles
+// grown by the tolerance of IntersectTriangle in natural coordinates, plus a
+// little for rounding. So the hierarchy finds a hit if and only if testing
+// all faces does.
+void FEAreaCoverage::Surface::BuildBVH()
+{
+  const double tol = 0.01;    // same as IntersectTriangle
+  const int tri[2][3] = { { 0, 1, 2 }, { 2, 3, 0 } };   // same as FastIntersectQuad
+
+  int NF = Faces();
+  vector<vec3d> fmin(NF), fmax(NF), fc(NF);
+  vec3d smin, smax;
+  for (int i = 0; i < NF; ++i) {
+    FEFace& f = m_mesh->Face(m_face[i]);
+    vec3d r[4];
+    for (int j = 0; j < 4; ++j) {
+      r[j] = m_pos[m_lnode[4 * i + j]];
+    }
+
+    vec3d lo = r[0], hi = r[0];
+    int ntri = (f.Nodes() == 4 ? 2 : 1);
+    for (int t = 0; t < ntri; ++t) {
+      const vec3d& a = r[tri[t][0]];
+      vec3d e1 = r[tri[t][1]] - a;
+      vec3d e2 = r[tri[t][2]] - a;
+      vec3d p[3] = {
+        a - e1 * tol - e2 * tol,
+        a + e1 * (1.0 + 2.0 * tol) - e2 * tol,
+        a - e1 * tol + e2 * (1.0 + 2.0 * tol) };
+      for (int k = 0; k < 3; ++k) {
+        lo = vmin(lo, p[k]);
+        hi = vmax(hi, p[k]);
+      }
+    }
+    fmin[i] = lo;
+    fmax[i] = hi;
+    smin = (i == 0 ? lo : vmin(smin, lo));
+    smax = (i == 0 ? hi : vmax(smax, hi));
+  }
+
+  double eps = 1e-6 * (smax - smin).Length();
+  for (int i = 0; i < NF; ++i) {
+    fmin[i] -= vec3d(eps, eps, eps);
+    fmax[i] += vec3d(eps, eps, eps);
+    fc[i] = (fmin[i] + fmax[i]) * 0.5;
+  }
+
+  m_bvhFace.resize(NF);
+  std::iota(m_bvhFace.begin(), m_bvhFace.end(), 0);
+  m_bvh.clear();
+  if (NF == 0) { return; }
+  m_bvh.reserve(2 * NF);
+  m_bvh.resize(1);
+  BuildBVHNode(0, fmin, fmax, fc, 0, NF);
+}
+
+//-----------------------------------------------------------------------------
+// Split the faces [first, first + count) of m_bvhFace by the surface area
+// heuristic, evaluated at the bins of the face centers along each axis.
+void FEAreaCoverage::Surface::BuildBVHNode(int nodeIndex, const vector<vec3d>& fmin,
+                                           const vector<vec3d>& fmax, const vector<vec3d>& fc,
+                                           int first, int count)
+{
+  const int NBINS = 16;
+  const int MAX_LEAF = 16;        // larger nodes are always split
+  const double costBox = 1.0;     // relative to the cost of a face test
+
+  // bounds of the faces and of their centers
+  vec3d lo = fmin[m_bvhFace[first]], hi = fmax[m_bvhFace[first]];
+  vec3d clo = fc[m_bvhFace[first]], chi = clo;
+  for (int i = first + 1; i < first + count; ++i) {
+    int n = m_bvhFace[i];
+    lo = vmin(lo, fmin[n]);
+    hi = vmax(hi, fmax[n]);
+    clo = vmin(clo, fc[n]);
+    chi = vmax(chi, fc[n]);
+  }
+
+  BVHNode& node = m_bvh[nodeIndex];
+  node.m_min[0] = lo.x; node.m_min[1] = lo.y; node.m_min[2] = lo.z;
+  node.m_max[0] = hi.x; node.m_max[1] = hi.y; node.m_max[2] = hi.z;
+  node.m_first = first;
+  node.m_count = count;
+  if (count <= 2) { return; }
+
+  // find the cheapest split
+  int bestAxis = -1, bestBin = 0;
+  double bestCost = std::numeric_limits<double>::max();
+  for (int k = 0; k < 3; ++k) {
+    double c0 = component(clo, k);
+    double w = component(chi, k) - c0;
+    if (w <= 0.0) { continue; }
+
+    int binCount[NBINS] = { 0 };
+    vec3d binMin[NBINS], binMax[NBINS];
+    for (int i = first; i < first + count; ++i) {
+      int n = m_bvhFace[i];
+      int b = std::min(NBINS - 1, (int)(NBINS * (component(fc[n], k) - c0) / w));
+      binMin[b] = (binCount[b] == 0 ? fmin[n] : vmin(binMin[b], fmin[n]));
+      binMax[b] = (binCount[b] == 0 ? fmax[n] : vmax(binMax[b], fmax[n]));
+      binCount[b]++;
+    }
+
+    // areas and counts of the right side of each split
+    double rightArea[NBINS];
+    int rightCount[NBINS];
+    vec3d rlo, rhi;
+    int nr = 0;
+    for (int b = NBINS - 1; b > 0; --b) {
+      if (binCount[b] > 0) {
+        rlo = (nr == 0 ? binMin[b] : vmin(rlo, binMin[b]));
+        rhi = (nr == 0 ? binMax[b] : vmax(rhi, binMax[b]));
+        nr += binCount[b];
+      }
+      rightArea[b] = (nr > 0 ? halfArea(rlo, rhi) : 0.0);
+      rightCount[b] = nr;
+    }
+
+    // sweep the left side, splitting after bin b
+    vec3d llo, lhi;
+    int nl = 0;
+    for (int b = 0; b < NBINS - 1; ++b) {
+      if (binCount[b] > 0) {
+        llo = (nl == 0 ? binMin[b] : vmin(llo, binMin[b]));
+        lhi = (nl == 0 ? binMax[b] : vmax(lhi, binMax[b]));
+        nl += binCount[b];
+      }
+      if ((nl == 0) || (rightCount[b + 1] == 0)) { continue; }
+      double cost = halfArea(llo, lhi) * nl + rightArea[b + 1] * rightCount[b + 1];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = k;
+        bestBin = b;
+      }
+    }
+  }
+
+  // keep the leaf if splitting does not pay off
+  double leafCost = halfArea(lo, hi) * count;
+  if ((count <= MAX_LEAF) && ((bestAxis < 0) || (costBox * halfArea(lo, hi) + bestCost >= leafCost))) {
+    return;
+  }
+
+  int mid = first + count / 2;
+  if (bestAxis >= 0) {
+    double c0 = component(clo, bestAxis);
+    double w = component(chi, bestAxis) - c0;
+    int* begin = &m_bvhFace[0] + first;
+    int* split = std::partition(begin, begin + count, [&](int n) {
+      return std::min(NBINS - 1, (int)(NBINS * (component(fc[n], bestAxis) - c0) / w)) <= bestBin;
+    });
+    mid = (int)(split - &m_bvhFace[0]);
+  }
+
+  // the children are adjacent
+  int left = (int)m_bvh.size();
+  m_bvh.resize(left + 2);
+  m_bvh[nodeIndex].m_first = left;
+  m_bvh[nodeIndex].m_count = 0;
+  BuildBVHNode(left, fmin, fmax, fc, first, mid - first);
+  BuildBVHNode(left + 1, fmin, fmax, fc, mid, first + count - mid);
+}
+
+//-----------------------------------------------------------------------------
+FEAreaCoverage::FEAreaCoverage() : m_bruteForce(false)
 {}
 
+//-----------------------------------------------------------------------------
+void FEAreaCoverage::SetTarget(FEMesh& mesh2)
+{
+  m_surf2 = Surface();
+  m_surf2.m_face = m_sel2;
+  m_surf2.Create(mesh2);
+  UpdateSurface(m_surf2);
+  m_surf2.BuildBVH();
+}
+
 //-----------------------------------------------------------------------------
 vector<double> FEAreaCoverage::Apply(FEMesh& mesh1, FEMesh& mesh2)
+{
+  SetTarget(mesh2);
+  return Apply(mesh1);
+}
+
+//-----------------------------------------------------------------------------
+vector<double> FEAreaCoverage::Apply(FEMesh& mesh1)
 {
   int N1 = mesh1.Nodes();
   vector<double> val(N1, 0.0);
+  assert(m_surf2.m_mesh);
+  if (m_surf2.m_mesh == nullptr) { return val; }
 
-  // build the node lists
+  // build the node list and the normal list
+  m_surf1 = Surface();
+  m_surf1.m_face = m_sel1;
   m_surf1.Create(mesh1);
-  m_surf2.Create(mesh2);
-
-  // build the normal lists
   UpdateSurface(m_surf1);
-  UpdateSurface(m_surf2);
 
   // repeat over all nodes of surface 1
-  vector<float> a(m_surf1.Nodes(), 0.f);
-  for (int i = 0; i < m_surf1.Nodes(); ++i) {
-    int inode = m_surf1.m_node[i];
-    FENode& node = mesh1.Node(inode);
-    vec3d ri = node.r;
-    vec3d Ni = m_surf1.m_norm[i];
+  int NN = m_surf1.Nodes();
+#pragma omp parallel
+  {
+    vector<int> stack;
+#pragma omp for schedule(dynamic, 64)
+    for (int i = 0; i < NN; ++i) {
+      int inode = m_surf1.m_node[i];
+      vec3d ri = mesh1.Node(inode).r;
+      vec3d Ni = m_surf1.m_norm[i];
 
-    // see if it intersects the other surface
-    if (intersect(ri, Ni, m_surf2)) {
-      val[inode] = 1.f;
+      // see if it intersects the other surface
+      bool hit = (m_bruteForce ? intersect(ri, Ni, m_surf2) : bvhIntersect(ri, Ni, m_surf2, stack));
+      if (hit) {
+        val[inode] = 1.f;
+      }
     }
   }
 
@@ -167,6 +376,61 @@ bool FEAreaCoverage::intersect(const vec3d& r, const vec3d& N, FEAreaCoverage::S
   return false;
 }
 
+//-----------------------------------------------------------------------------
+bool FEAreaCoverage::bvhIntersect(const vec3d& r, const vec3d& N, FEAreaCoverage::Surface& surf,
+                                  vector<int>& stack)
+{
+  if (surf.m_bvh.empty()) { return false; }
+
+  // create the ray
+  Ray ray = {r, N};
+  const double o[3] = { r.x, r.y, r.z };
+  const double d[3] = { N.x, N.y, N.z };
+  double inv[3];
+  for (int k = 0; k < 3; ++k) {
+    inv[k] = (d[k] != 0.0 ? 1.0 / d[k] : 0.0);
+  }
+
+  stack.clear();
+  stack.push_back(0);
+  while (!stack.empty()) {
+    const Surface::BVHNode& node = surf.m_bvh[stack.back()];
+    stack.pop_back();
+
+    // does the ray (t >= 0) pass through the box
+    double tmin = 0.0, tmax = std::numeric_limits<double>::max();
+    bool miss = false;
+    for (int k = 0; (k < 3) && !miss; ++k) {
+      if (d[k] != 0.0) {
+        double t1 = (node.m_min[k] - o[k]) * inv[k];
+        double t2 = (node.m_max[k] - o[k]) * inv[k];
+        if (t1 > t2) { std::swap(t1, t2); }
+        tmin = std::max(tmin, t1);
+        tmax = std::min(tmax, t2);
+        miss = (tmin > tmax);
+      }
+      else {
+        miss = ((o[k] < node.m_min[k]) || (o[k] > node.m_max[k]));
+      }
+    }
+    if (miss) { continue; }
+
+    if (node.m_count > 0) {
+      for (int i = node.m_first; i < node.m_first + node.m_count; ++i) {
+        if (faceIntersect(surf, ray, surf.m_bvhFace[i])) {
+          return true;
+        }
+      }
+    }
+    else {
+      stack.push_back(node.m_first + 1);
+      stack.push_back(node.m_first);
+    }
+  }
+
+  return false;
+}
+
 //-----------------------------------------------------------------------------
 bool FEAreaCoverage::faceIntersect(FEAreaCoverage::Surface& surf, const Ray& ray, int nface)
 {
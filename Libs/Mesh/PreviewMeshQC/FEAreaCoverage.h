@@ -29,18 +29,44 @@ public:
     vector<vec3d> m_fnorm;                    // face normals
 
     vector<vector<int>> m_NLT;                // node-facet look-up table
+
+    // bounding volume hierarchy of the faces, see BuildBVH
+    struct BVHNode
+    {
+      double m_min[3];
+      double m_max[3];
+      int    m_first;                         // first face of a leaf, or first child
+      int    m_count;                         // number of faces, 0 for an interior node
+    };
+    vector<BVHNode> m_bvh;                    // nodes, the children of a node are adjacent
+    vector<int>     m_bvhFace;                // face list in leaf order
+
+    // build the hierarchy of the faces (requires UpdateSurface)
+    void BuildBVH();
+
+  protected:
+    void BuildBVHNode(int nodeIndex, const vector<vec3d>& fmin, const vector<vec3d>& fmax,
+                      const vector<vec3d>& fc, int first, int count);
   };
 
 public:
   FEAreaCoverage();
 
   // assign selections
-  void SetSelection1(vector<int>& s) { m_surf1.m_face = s; }
-  void SetSelection2(vector<int>& s) { m_surf2.m_face = s; }
+  void SetSelection1(vector<int>& s) { m_sel1 = s; }
+  void SetSelection2(vector<int>& s) { m_sel2 = s; }
+
+  // set the surface the rays are cast at and build its hierarchy,
+  // which is reused by every Apply(mesh1) until the next call
+  void SetTarget(FEMesh& mesh2);
 
   // apply the map
   // returns one value per node
   vector<double> Apply(FEMesh& mesh1, FEMesh& mesh2);
+  vector<double> Apply(FEMesh& mesh1);
+
+  // test every face of the target instead of using the hierarchy
+  void SetBruteForce(bool b) { m_bruteForce = b; }
 
 protected:
   // build node normal list
@@ -48,9 +74,14 @@ protected:
 
   // see if a ray intersects with a surface
   bool intersect(const vec3d& r, const vec3d& N, FEAreaCoverage::Surface& surf);
+  // same, using the hierarchy of the surface
+  bool bvhIntersect(const vec3d& r, const vec3d& N, FEAreaCoverage::Surface& surf, vector<int>& stack);
   bool faceIntersect(FEAreaCoverage::Surface& surf, const Ray& ray, int nface);
 
 protected:
   Surface m_surf1;
   Surface m_surf2;
+  vector<int> m_sel1;                         // selection of surface 1
+  vector<int> m_sel2;                         // selection of surface 2
+  bool m_bruteForce;
 };
@@ -57,11 +57,12 @@ int DoIt(InputParams params)
                                      params.usePairwiseNormalsDifferencesForGoodBad);
     reconstructor.reset();
 
-    // read distance transforms
-    std::vector<typename ImageType::Pointer> distance_transforms;
-    for (unsigned int shapeNo = 0; shapeNo < params.distanceTransformFilenames.size(); shapeNo++)
+    // the distance transforms are streamed from disk by the reconstructor,
+    // only the image information of the first one is read here
+    typename ImageType::PointType origin_dt;
+    if (!params.distanceTransformFilenames.empty())
     {
-        std::string filename = params.distanceTransformFilenames[shapeNo];
+        std::string filename = params.distanceTransformFilenames[0];
 
         if (filename.find(".nrrd") != std::string::npos) {
             itk::NrrdImageIOFactory::RegisterOneFactory();
@@ -69,10 +70,9 @@ int DoIt(InputParams params)
             itk::MetaImageIOFactory::RegisterOneFactory();
         }
         typename ReaderType::Pointer reader = ReaderType::New();
-        std::cout << "Reading distance transform file : " << filename << std::endl;
         reader->SetFileName( filename.c_str() );
-        reader->Update();
-        distance_transforms.push_back(reader->GetOutput());
+        reader->UpdateOutputInformation();
+        origin_dt = reader->GetOutput()->GetOrigin();
     }
 
     // read local points and world points if given
@@ -194,7 +194,6 @@ int DoIt(InputParams params)
                   << "origin_global(2) = " << origin_global[2] << std::endl;
 
         // origin of the distance transforms (assume all dts are sharing the same origin)
-        typename ImageType::PointType  origin_dt = distance_transforms[0]->GetOrigin();
 
         double offset_x = origin_dt[0] - origin_local[0];
         double offset_y = origin_dt[1] - origin_local[1];
@@ -238,7 +237,7 @@ int DoIt(InputParams params)
 
     // compute the dense shape
     std::cout << "Reconstructing dense mean mesh with number of clusters = " << params.K << std::endl;
-    vtkSmartPointer<vtkPolyData> denseMean = reconstructor.getDenseMean(local_pts, global_pts, distance_transforms);
+    vtkSmartPointer<vtkPolyData> denseMean = reconstructor.getDenseMean(local_pts, global_pts, params.distanceTransformFilenames);
 
     // write output
     reconstructor.writeMeanInfo(params.out_prefix);
@@ -345,7 +344,19 @@ int main( int argc , char* argv[] )
   //------------- end typedefs ---------------
 
   int status;
-  if(params.use_tps_transform){
+  if(params.use_tps_transform && params.use_fast_tps_transform){
+      if(params.use_bspline_interpolation){
+          status = DoIt<itk::FastThinPlateSplineKernelTransform,
+                  itk::BSplineInterpolateImageFunctionWithDoubleCoefficents,
+                  CoordinateRepType, PixelType, ImageType>(params);
+      }
+      else{
+          status = DoIt<itk::FastThinPlateSplineKernelTransform,
+                  itk::LinearInterpolateImageFunction,
+                  CoordinateRepType, PixelType, ImageType>(params);
+      }
+  }
+  else if(params.use_tps_transform){
       if(params.use_bspline_interpolation){
           status = DoIt<itk::ThinPlateSplineKernelTransform2,
                   itk::BSplineInterpolateImageFunctionWithDoubleCoefficents,
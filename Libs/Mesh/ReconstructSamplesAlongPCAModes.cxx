@@ -288,7 +288,19 @@ int main( int argc , char* argv[] )
     //------------- end typedefs ---------------
 
     int status;
-    if(params.use_tps_transform){
+    if(params.use_tps_transform && params.use_fast_tps_transform){
+        if(params.use_bspline_interpolation){
+            status = DoIt<itk::FastThinPlateSplineKernelTransform,
+                    itk::BSplineInterpolateImageFunctionWithDoubleCoefficents,
+                    CoordinateRepType, PixelType, ImageType>(params);
+        }
+        else{
+            status = DoIt<itk::FastThinPlateSplineKernelTransform,
+                    itk::LinearInterpolateImageFunction,
+                    CoordinateRepType, PixelType, ImageType>(params);
+        }
+    }
+    else if(params.use_tps_transform){
         if(params.use_bspline_interpolation){
             status = DoIt<itk::ThinPlateSplineKernelTransform2,
                     itk::BSplineInterpolateImageFunctionWithDoubleCoefficents,
@@ -3,6 +3,8 @@
 #include <math.h>
 #include <sstream>
 #include <fstream>
+#include <algorithm>
+#include <memory>
 #include <stdio.h>
 //#include <unistd.h>
 #include <sys/types.h>
@@ -67,6 +69,11 @@ typedef pair<unsigned int, float> gDistPair;
 //}  
 //
 float meshFIM::LocalSolver(index vet, TriMesh::Face triangle, index currentVert)
+{
+    return LocalSolver(vet, triangle, m_meshPtr->geodesic);
+}
+
+float meshFIM::LocalSolver(index vet, const TriMesh::Face& triangle, const float* geodesic)
 {
 
     float a,b, delta, cosA, lamda1, lamda2, TC1, TC2;
@@ -102,9 +109,9 @@ float meshFIM::LocalSolver(index vet, TriMesh::Face triangle, index currentVert)
     TB = m_meshPtr->vertMap[currentVert][triangle[B]].d;
     TC = m_meshPtr->vertMap[currentVert][triangle[C]].d;
     */
-    TA = m_meshPtr->geodesic[triangle[A]];
-    TB = m_meshPtr->geodesic[triangle[B]];
-    TC = m_meshPtr->geodesic[triangle[C]];
+    TA = geodesic[triangle[A]];
+    TB = geodesic[triangle[B]];
+    TC = geodesic[triangle[C]];
 
 
     TAB = TB - TA;
@@ -174,6 +181,17 @@ float meshFIM::Upwind(index currentVert,index vet)
     return result;
 }
 
+float meshFIM::Upwind(index vet, const float* geodesic)
+{
+    float result = LARGENUM;
+    const vector<TriMesh::Face>& neighborFaces = m_meshPtr->vertOneringFaces[vet];
+    for (size_t i = 0; i < neighborFaces.size(); i++)
+    {
+        result = MIN(result, LocalSolver(vet, neighborFaces[i], geodesic));
+    }
+    return result;
+}
+
 
 /*
 void meshFIM::GenerateData()
@@ -264,162 +282,212 @@ void meshFIM::GenerateData()
 }
 */
 
-void meshFIM::GenerateReducedData()
-{	
-    std::list<index>::iterator iter = m_ActivePoints.begin();
-    float oldT1 , newT1, oldT2, newT2;
-    index tmpIndex1, tmpIndex2;
-    vector<int>  nb;
-    NumComputation = 0;
-    double total_duration = 0;
-
-    clock_t starttime, endtime;
-    starttime = clock ();
+// The same sweeps as the list based solve: a converged vertex is dropped
+// from the active list, with the neighbors it updates put before it, so they
+// are visited in the next sweep.
+void meshFIM::SolveFromVertex(index source, Workspace& ws)
+{
+    vector<float>& geodesic = ws.geodesic;
+    vector<unsigned char>& label = ws.label;
+    const vector< vector<int> >& neighbors = m_meshPtr->neighbors;
 
-    char c;
-    int i=0;
+    geodesic[source] = 0;
+    label[source] = SeedPoint;
+    ws.touched.push_back(source);
 
-    //nonblock(NB_ENABLE);
+    ws.active.clear();
+    const vector<int>& snb = neighbors[source];
+    for (size_t i = 0; i < snb.size(); i++)
+    {
+        if (label[snb[i]] == FarPoint)
+        {
+            ws.active.push_back(snb[i]);
+            ws.touched.push_back(snb[i]);
+            label[snb[i]] = ActivePoint;
+        }
+    }
 
-    for (int currentVert= 0; currentVert< m_meshPtr->vertices.size(); currentVert++ )
+    while (!ws.active.empty())
     {
-        // if ((currentVert%100) == 0)
-//        std::cout << "vertex " << currentVert+1 << " of " << m_meshPtr->vertices.size() << " vertices ..." << std::endl;
+        ws.next.clear();
+        for (size_t k = 0; k < ws.active.size(); k++)
+        {
+            index tmpIndex1 = ws.active[k];
+            float oldT1 = geodesic[tmpIndex1];
+            float newT1 = Upwind(tmpIndex1, &geodesic[0]);
 
-        std::vector<int> seedPointList(1, currentVert);
-        SetSeedPoint(seedPointList);
+            if (fabs(oldT1 - newT1) < _EPS)    //if converges
+            {
+                if (oldT1 > newT1)
+                    geodesic[tmpIndex1] = newT1;
 
-        m_meshPtr->InitializeAttributes(currentVert, m_SeedPoints);
+                if (geodesic[tmpIndex1] < m_StopDistance)
+                {
+                    const vector<int>& nb = neighbors[tmpIndex1];
+                    for (size_t i = 0; i < nb.size(); i++)
+                    {
+                        index tmpIndex2 = nb[i];
+                        if (label[tmpIndex2] == AlivePoint || label[tmpIndex2] == FarPoint)
+                        {
+                            float oldT2 = geodesic[tmpIndex2];
+                            float newT2 = Upwind(tmpIndex2, &geodesic[0]);
+                            if (oldT2 > newT2)
+                            {
+                                geodesic[tmpIndex2] = newT2;
+                                if (label[tmpIndex2] == FarPoint)
+                                    ws.touched.push_back(tmpIndex2);
+                                ws.next.push_back(tmpIndex2);
+                                label[tmpIndex2] = ActivePoint;
+                            }
+                        }
+                    }
+                }
 
-        InitializeLabels();
-        InitializeActivePoints();
+                label[tmpIndex1] = AlivePoint;
+            }
+            else   // if not converge
+            {
+                if (newT1 < oldT1)
+                    geodesic[tmpIndex1] = newT1;
 
+                ws.next.push_back(tmpIndex1);
+            }
+        }
+        ws.active.swap(ws.next);
+    }
+}
 
-        while (!m_ActivePoints.empty())
-        {
-            //printf("Size of Activelist is: %d \n", m_ActivePoints.size());
-            iter = m_ActivePoints.begin();
+// Take the distances to the vertices before source that are within the stop
+// distance, and reset the workspace for the next source.
+void meshFIM::CollectRow(index source, Workspace& ws, vector<GeodesicCSR::Entry>& row)
+{
+    row.clear();
+    for (size_t i = 0; i < ws.touched.size(); i++)
+    {
+        index v = ws.touched[i];
+        float d = ws.geodesic[v];
+        if ((v < source) && (d <= m_StopDistance) && (d > 0))
+            row.push_back(GeodesicCSR::Entry(v, d));
 
-            while(iter != m_ActivePoints.end()) {
-                tmpIndex1 = *iter;
-                nb = m_meshPtr->neighbors[tmpIndex1];
-                //oldT1 = m_meshPtr->vertT[currentVert][tmpIndex1];
-                //oldT1 = m_meshPtr->vertMap[currentVert][tmpIndex1].d;
-                oldT1 = m_meshPtr->geodesic[tmpIndex1];
+        ws.geodesic[v] = LARGENUM;
+        ws.label[v] = FarPoint;
+    }
+    ws.touched.clear();
+    std::sort(row.begin(), row.end());
+}
 
-                newT1 = Upwind(currentVert,tmpIndex1);
+void meshFIM::GenerateReducedData()
+{
+    NumComputation = 0;
+    int nv = m_meshPtr->vertices.size();
 
-                if (abs(oldT1-newT1)<_EPS)    //if converges
-                {
-                    if (oldT1>newT1){
-                        //m_meshPtr->vertT[currentVert][tmpIndex1] = newT1;
-                        //m_meshPtr->vertMap[currentVert][tmpIndex1].d = newT1;
-                        m_meshPtr->geodesic[tmpIndex1] = newT1;
-                    }
+    // connectivity shared by the threads; the one ring faces are rebuilt as
+    // they copy the face speeds
+    m_meshPtr->need_neighbors();
+    m_meshPtr->need_adjacentfaces();
+    m_meshPtr->need_across_edge();
+    m_meshPtr->vertOneringFaces.clear();
+    m_meshPtr->need_oneringfaces();
 
-                    //if (m_meshPtr->vertT[currentVert][tmpIndex1] < m_StopDistance)
-                    //if (m_meshPtr->vertMap[currentVert][tmpIndex1].d < m_StopDistance)
-                    if(m_meshPtr->geodesic[tmpIndex1] < m_StopDistance)
-                    {
-                        for (i=0;i<nb.size();i++)
-                        {
-                            tmpIndex2 = nb[i];
-                            if (m_Label[tmpIndex2]==AlivePoint || m_Label[tmpIndex2]==FarPoint)
-                            {
-                                //oldT2 = m_meshPtr->vertT[currentVert][tmpIndex2];
-                                //oldT2 = m_meshPtr->vertMap[currentVert][tmpIndex2].d;
-                                oldT2 = m_meshPtr->geodesic[tmpIndex2];
+    std::shared_ptr<GeodesicCSR> csr = std::make_shared<GeodesicCSR>();
+    csr->Clear(m_StopDistance);
 
-                                newT2 = Upwind(currentVert,tmpIndex2);
-                                if (oldT2>newT2)
-                                {
-                                    //m_meshPtr->vertT[currentVert][tmpIndex2] = newT2;
-                                    //m_meshPtr->vertMap[currentVert][tmpIndex2].d = newT2;
-                                    m_meshPtr->geodesic[tmpIndex2] = newT2;
+    // rows are solved in blocks and appended in order
+    const int blockSize = 1024;
+    vector< vector<GeodesicCSR::Entry> > rows(std::min(blockSize, nv));
 
-                                    if (m_Label[tmpIndex2]!=ActivePoint)
-                                    {
-                                        m_ActivePoints.insert(iter, tmpIndex2);
-                                        //iter++;
-                                        m_Label[tmpIndex2] = ActivePoint;
-                                    }
-                                }
-                            }
-                        }
-                    }
+    clock_t starttime = clock();
 
-                    iter =  m_ActivePoints.erase(iter);
-                    m_Label[tmpIndex1] = AlivePoint;
+#pragma omp parallel
+    {
+        Workspace ws;
+        ws.geodesic.assign(nv, LARGENUM);
+        ws.label.assign(nv, FarPoint);
 
-                }
-                else   // if not converge
-                {
-                    if(newT1 < oldT1){
-                        //m_meshPtr->vertT[currentVert][tmpIndex1] = newT1;
-                        //m_meshPtr->vertMap[currentVert][tmpIndex1].d = newT1;
-                        m_meshPtr->geodesic[tmpIndex1] = newT1;
-                    }
+        for (int first = 0; first < nv; first += blockSize)
+        {
+            int last = std::min(nv, first + blockSize);
 
-                    iter++;
+#pragma omp for schedule(dynamic, 1)
+            for (int currentVert = first; currentVert < last; currentVert++)
+            {
+                SolveFromVertex(currentVert, ws);
+                CollectRow(currentVert, ws, rows[currentVert - first]);
+            }
 
+#pragma omp single
+            {
+                for (int currentVert = first; currentVert < last; currentVert++)
+                {
+                    csr->AppendRow(rows[currentVert - first]);
+                    vector<GeodesicCSR::Entry>().swap(rows[currentVert - first]);
                 }
             }
         }
+    }
 
-        // Loop Through And Copy Only Values < than m_StopDistance
-        int nv = m_meshPtr->vertices.size();
-        for(int v= 0; v < currentVert; v++){
-            if ((m_meshPtr->geodesic[v] <= m_StopDistance) && (m_meshPtr->geodesic[v] > 0))
-            {
-                //m_meshPtr->geoMap[currentVert][v] = m_meshPtr->geodesic[v];
-                //(*(m_meshPtr->dMap))[currentVert].push_back(m_meshPtr->geodesic[v]);
-                //(*(m_meshPtr->iMap))[currentVert].push_back(v);
-                (m_meshPtr->geodesicMap[currentVert])[v] = m_meshPtr->geodesic[v];
-            }
+    m_meshPtr->geodesicCSR = csr;
+
+    double duration = (double)(clock() - starttime) / CLOCKS_PER_SEC;
+    std::cout << "geodesics of " << nv << " vertices: " << csr->Entries() << " distances, "
+              << duration << " s cpu" << std::endl;
+}
+
+bool meshFIM::ReadGeodesicFile(TriMesh *mesh, const char *geoFileName)
+{
+    int numVert = mesh->vertices.size();
+    mesh->geodesicMap.resize(numVert);
+
+    if (GeodesicCSR::IsCSRFile(geoFileName))
+    {
+        std::shared_ptr<GeodesicCSR> csr = std::make_shared<GeodesicCSR>();
+        if (!csr->Load(geoFileName) || csr->Rows() != (unsigned int)numVert)
+        {
+            std::cerr << geoFileName << " is damaged or is not for this mesh" << std::endl;
+            return false;
         }
+        mesh->geodesicCSR = csr;
+        this->SetStopDistance(csr->StopDistance());
+        return true;
+    }
 
-        // Now Erase the duplicate data
-        m_meshPtr->CleanupAttributes(currentVert);
+    ifstream infile(geoFileName, std::ios::binary);
+    if (!infile.is_open())
+        return false;
 
+    // the map replaces any rows of an earlier file or solve
+    mesh->geodesicCSR.reset();
 
+    // legacy format: stop distance, then the size and the key and distance
+    // pairs of the map of each vertex
 
-        endtime = clock();
-        total_duration = (double)(endtime - starttime) / CLOCKS_PER_SEC;
-        float percent = (currentVert+1) / (float)m_meshPtr->vertices.size();
-
-
-        double total_time = total_duration / percent;
-        double time_left = total_time - total_duration;
-        int hours = (int)(time_left / (60*60));
-        int minutes = (int)((time_left - hours*60*60) / 60);
-        int seconds = (int)(time_left - hours*60*60 - minutes*60);
-        int count = (m_meshPtr->geodesicMap[currentVert]).size();
-
-        //printf("\r                                              \r");
-        //printf("Progress %.1f%%", 100 * percent);
-        //printf("     ETA: %dh:%dm:%ds ", hours, minutes, seconds);
-        //printf(" v: %d", count);
-        //fflush(stdout);
-
-        //i=kbhit();
-        //if (i!=0)
-        //{
-        //	c=fgetc(stdin);
-        //	if (c=='c')
-        //		i=1;
-        //    else
-        //		i=0;
-        //
-        //}
-        //
-        //// Check to see if user has canceled this
-        //if(i){
-        //	cout << endl << "User Canceled Computation" << endl << endl;
-        //	break;
-        //}
+    // read stop distance
+    float distance;
+    infile.read(reinterpret_cast<char *>(&distance), sizeof(float));
+    this->SetStopDistance(distance);
+
+    // loop over vertices
+    for (int i = 0; i < numVert; i++)
+    {
+        // read map size for vertex
+        unsigned int dLength;
+        infile.read( reinterpret_cast<char *>(&dLength), sizeof(unsigned int) );
+
+        // read key and distance pair
+        for (int j = 0; j < dLength; j++)
+        {
+            unsigned int index;
+            infile.read( reinterpret_cast<char *>(&index), sizeof(unsigned int) );
+
+            float dist;
+            infile.read( reinterpret_cast<char *>(&dist), sizeof(float) );
+
+            (mesh->geodesicMap[i])[index] = dist;
+        }
     }
 
-    //nonblock(NB_DISABLE);
+    infile.close();
+    return true;
 }
 
 // SHIREEN - modified the loading to control the generation of geo files (till we add the geo repulsion stuff)
@@ -427,94 +495,17 @@ void meshFIM::loadGeodesicFile(TriMesh *mesh, const char *geoFileName)
 {
 //    cout << "Looking for file: " << geoFileName << " ... " << flush;
 
-    ifstream infile(geoFileName, std::ios::binary);
-    if (!infile.is_open())
+    if (!this->ReadGeodesicFile(mesh, geoFileName))
     {
         if(GENERATE_GEO_FILES == 1)
         {
 //            cout << "File Not Found, will generate the geo file now ..." << endl;
 
-            int numVert = mesh->vertices.size();
-            //mesh->geoMap.resize(numVert);
-            //mesh->geoIndex.resize(numVert);
-
-            mesh->geodesicMap.resize(numVert);
-
             this->computeFIM(mesh,geoFileName);
         }
 //        else
 //            cout << "File Not Found and geo file generation is DISABLED ..." << endl;
     }
-    else
-    {
-        int numVert = mesh->vertices.size();
-        //mesh->geoMap.resize(numVert);
-        //mesh->geoIndex.resize(numVert);
-
-        mesh->geodesicMap.resize(numVert);
-
-        // read stop distance
-        float distance;
-        infile.read(reinterpret_cast<char *>(&distance), sizeof(float));
-        this->SetStopDistance(distance);
-
-        // loop over vertices
-        for (int i = 0; i < numVert; i++)
-        {
-            // read map size for vertex
-            unsigned int dLength;
-            infile.read( reinterpret_cast<char *>(&dLength), sizeof(unsigned int) );
-
-            // read key and distance pair
-            for (int j = 0; j < dLength; j++)
-            {
-                unsigned int index;
-                infile.read( reinterpret_cast<char *>(&index), sizeof(unsigned int) );
-
-                float dist;
-                infile.read( reinterpret_cast<char *>(&dist), sizeof(float) );
-
-                (mesh->geodesicMap[i])[index] = dist;
-            }
-        }
-
-        //int vertex = 0;
-        //unsigned int distance;
-        //string line;
-
-        //// First Line In File Is Stop Distance
-        //getline(infile, line);
-        //stringstream str(line);
-        //str >> distance;
-
-        //  this->SetStopDistance((float)distance/(float)s);
-        //cout << "Found it!" << endl << "Loading " << geoFileName << endl;
-        //
-        //  distance = 0;
-        //for(int i=0; i < numVert; i++)
-        //  {
-        //    line.clear();
-        //  getline(infile, line);
-        //    str.clear();
-        //    str.str(line);
-        //	str >> vertex >> distance;
-        //	while(!str.eof())
-        //    {
-        //		//mesh->geoMap[i].push_back(distance);
-        //		//mesh->geoIndex[i].push_back(vertex);
-        //      (mesh->geodesicMap[i])[vertex] = distance;
-        //		str >> vertex >> distance;
-        //	}
-
-        //	//printf("\r                                              \r");
-        //	//printf("Progress %.1f%%", (i+1.0f)/(numVert)*100);
-        //	//fflush(stdout);
-        //
-        //}
-        //cout << endl;
-        infile.close();
-    }
-
 }
 // end SHIREEN
 
@@ -606,132 +597,23 @@ void meshFIM::computeCurvFiles(TriMesh *mesh, const char *vertT_filename)
 void meshFIM::computeFIM(TriMesh *mesh, const char *vertT_filename)
 {
     cout << "Trying to load: " << vertT_filename << endl;
-    //	FILE* vertTFile = fopen(vertT_filename, "r+");
-    ifstream infile(vertT_filename, std::ios::binary);
 
     unsigned int numVert = mesh->vertices.size();
-    //(mesh->dMap)->resize(numVert);
-    //(mesh->iMap)->resize(numVert);
-
     mesh->geodesicMap.resize(numVert);
 
     this->SetMesh(mesh);
 
-    if (!infile.is_open())
-    {
-        //vertTFile = fopen(vertT_filename, "w+");
-//        ofstream outfile(vertT_filename, std::ios::binary);
-        ofstream outfile(vertT_filename, std::ofstream::out);
-        cout << "No vertT file!!!\n Writing..." << endl;
-        cout << "stop distance = " << this->GetStopDistance() << endl;
-        cout << "# vertices in mesh: " << numVert << endl;
-
-        this->GenerateReducedData();
-
-        // write stop distance
-        float dStop = this->GetStopDistance();
-//        outfile.write( reinterpret_cast<char *>(&dStop), sizeof(float) );
-
-        // loop over each vertex
-        for (int i = 0; i < numVert; i++)
-        {
-            // write map size for vertex
-            unsigned int dLength = mesh->geodesicMap[i].size();
-//            outfile.write( reinterpret_cast<char *>(&dLength), sizeof(unsigned int) );
-
-            // write key and distance pair
-            for (std::map<unsigned int,float>::iterator it= mesh->geodesicMap[i].begin(); it != mesh->geodesicMap[i].end(); it++)
-            {
-                unsigned int index = (*it).first;
-//                outfile.write( reinterpret_cast<char *>(&index), sizeof(unsigned int) );
-
-                float dist = (*it).second;
-//                outfile.write( reinterpret_cast<char *>(&dist), sizeof(float) );
-
-                outfile << i << " " << index << " " << dist << std::endl;
-            }
-        }
-
-        //// First Line In File Is Stop Distance
-        //outfile << this->GetStopDistance() * s << endl;
-
-        //// Loop Over Each Vertex
-        //for (int i = 0; i < numVert; i++)
-        //{
-        //    std::map<unsigned int,unsigned int>::iterator mIter;
-        //
-        //    for(mIter = mesh->geodesicMap[i].begin(); mIter != mesh->geodesicMap[i].end(); mIter++)
-        //    {
-        //      outfile << (*mIter).first << " " << (*mIter).second << " ";
-        //	}
+    if (this->ReadGeodesicFile(mesh, vertT_filename))
+        return;
 
-        //	outfile << endl;
-        //}
-
-        outfile.close();
-    }
-    else
-    {
-        // read stop distance
-        float distance;
-        infile.read(reinterpret_cast<char *>(&distance), sizeof(float));
-        this->SetStopDistance(distance);
-
-        // loop over vertices
-        for (int i = 0; i < numVert; i++)
-        {
-            // read map size for vertex
-            unsigned int dLength;
-            infile.read( reinterpret_cast<char *>(&dLength), sizeof(unsigned int) );
-
-            // read key and distance pair
-            for (int j = 0; j < dLength; j++)
-            {
-                unsigned int index;
-                infile.read( reinterpret_cast<char *>(&index), sizeof(unsigned int) );
+    cout << "No vertT file!!!\n Writing..." << endl;
+    cout << "stop distance = " << this->GetStopDistance() << endl;
+    cout << "# vertices in mesh: " << numVert << endl;
 
-                float dist;
-                infile.read( reinterpret_cast<char *>(&dist), sizeof(float) );
+    this->GenerateReducedData();
 
-                (mesh->geodesicMap[i])[index] = dist;
-            }
-        }
-
-        //unsigned int vertex;
-        //unsigned int distance;
-        //string line;
-
-        //// First Line In File Is Stop Distance
-        //getline(infile, line);
-        //stringstream str(line);
-        //str >> distance;
-        //
-        //this->SetStopDistance((float)distance/(float)s);
-        //  cout << "Loading " << vertT_filename << endl;
-
-        //for(int i=0; i < numVert; i++){
-        //
-        //	string line;
-        //	getline(infile, line);
-        //	stringstream str(line);
-        //
-        //	str >> vertex >> distance;
-        //	while(!str.eof())
-        //    {
-        //		//mesh->geoMap[i].push_back(distance);
-        //		//mesh->geoIndex[i].push_back(vertex);
-        //      (mesh->geodesicMap[i])[vertex] = distance;
-        //		str >> vertex >> distance;
-        //	}
-
-        //	//printf("\r                                              \r");
-        //	//printf("progress %.1f%%", (i+1.0f)/(numVert)*100);
-        //	//fflush(stdout);
-        //
-        //}
-        //cout << endl;
-        infile.close();
-    }
+    if (!mesh->geodesicCSR->Write(vertT_filename))
+        std::cerr << "Unable to write " << vertT_filename << std::endl;
 }
 
 // Praful - compute distance to landmarks based on geodesic approximation with given triangle info
@@ -741,6 +623,7 @@ void meshFIM::ComputeDistanceToLandmarksGivenTriangleInfo(TriMesh *mesh, const c
     SetStopDistance(1e7);
     int numVert = mesh->vertices.size();
     mesh->geodesicMap.resize(numVert);
+    mesh->geodesicCSR.reset(); // the rows would hide the distances written to the map
     SetMesh(mesh);
 
     std::ifstream pointsFile(infilename);
@@ -816,6 +699,7 @@ void meshFIM::ComputeDistanceToLandmark(TriMesh *mesh, point landmark, bool appl
     // initialize the geodesic map to hold the geodesics from the triangle vertices of the given landmark to all other mesh vertices
     int numVert = mesh->vertices.size();
     mesh->geodesicMap.resize(numVert);
+    mesh->geodesicCSR.reset(); // the rows would hide the distances written to the map
     SetMesh(mesh);
 
     // get which triangle the given landmark should belong to
@@ -976,6 +860,7 @@ void meshFIM::ComputeDistanceToCurve(TriMesh *mesh, std::vector< point > curvePo
     // initialize the geodesic map to hold the geodesics from the triangle vertices of the given landmark to all other mesh vertices
     int numVert = mesh->vertices.size();
     mesh->geodesicMap.resize(numVert);
+    mesh->geodesicCSR.reset(); // the rows would hide the distances written to the map
     SetMesh(mesh);
 
     // get which triangle the given landmark should belong to
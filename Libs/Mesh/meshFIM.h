@@ -17,6 +17,7 @@
 #include <queue>
 #include <list>
 #include <map>
+#include <vector>
 #include <time.h>
 
 #ifndef _EPS
@@ -44,6 +45,8 @@ public:
     void MeshReader(char * filename);
 
     float LocalSolver(index C, TriMesh::Face triangle,  index currentVert);
+    // same, with the travel times in geodesic instead of the mesh
+    float LocalSolver(index vet, const TriMesh::Face& triangle, const float* geodesic);
 
     void SetSeedPoint(std::vector<index> SeedPoints)
     {
@@ -168,6 +171,9 @@ public:
     }
 
     //void GenerateData();
+    // distances from every vertex to the vertices before it, up to the stop
+    // distance, into the geodesicCSR of the mesh; the sources are solved in
+    // parallel
     void GenerateReducedData();
 
     void loadGeodesicFile(TriMesh *mesh, const char *geoFilename);
@@ -203,6 +209,23 @@ public:
 
 protected:
 
+    // state of a solve from a single source, one per thread
+    struct Workspace
+    {
+        std::vector<float>          geodesic;
+        std::vector<unsigned char>  label;      // LabelType of each vertex
+        std::vector<index>          active;     // active list of this sweep
+        std::vector<index>          next;       // and of the next one
+        std::vector<index>          touched;    // vertices that are not FarPoint
+    };
+
+    float Upwind(index vet, const float* geodesic);   // over the cached one ring faces
+    void SolveFromVertex(index source, Workspace& ws);
+    void CollectRow(index source, Workspace& ws, std::vector<GeodesicCSR::Entry>& row);
+
+    // read a CSR or legacy binary geodesic file, false if there is none
+    bool ReadGeodesicFile(TriMesh *mesh, const char *geoFilename);
+
     std::list<index>                             m_ActivePoints;
     std::vector<index>                           m_SeedPoints;
     std::vector<LabelType>                       m_Label;
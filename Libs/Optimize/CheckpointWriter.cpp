@@ -0,0 +1,164 @@
+/*=========================================================================
+   Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+   File:      CheckpointWriter.cpp
+
+   Copyright (c) 2020 Scientific Computing and Imaging Institute.
+   See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+   =========================================================================*/
+
+#include <cstdio>
+#include <iostream>
+
+#ifdef _WIN32
+#include <io.h>
+#define fsync _commit
+#else
+#include <unistd.h>
+#endif // ifdef _WIN32
+
+#include "CheckpointWriter.h"
+
+namespace {
+//---------------------------------------------------------------------------
+void WriteAndSync(const std::string &filename, const std::string &contents, const char* mode)
+{
+  FILE* file = fopen(filename.c_str(), mode);
+  if (!file) {
+    std::cerr << "Error opening output file: " << filename << std::endl;
+    throw 1;
+  }
+  const bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size() &&
+                  fflush(file) == 0 && fsync(fileno(file)) == 0;
+  fclose(file);
+  if (!ok) {
+    std::cerr << "Error writing output file: " << filename << std::endl;
+    throw 1;
+  }
+}
+
+//---------------------------------------------------------------------------
+void ReplaceFile(const std::string &temporary, const std::string &filename)
+{
+  if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+    // Windows does not rename over an existing file
+    std::remove(filename.c_str());
+    if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+      std::cerr << "Error renaming " << temporary << " to " << filename << std::endl;
+      throw 1;
+    }
+  }
+}
+}
+
+//---------------------------------------------------------------------------
+CheckpointWriter::CheckpointWriter(size_t max_queue_depth)
+  : m_max_queue_depth(max_queue_depth > 0 ? max_queue_depth : 1)
+{
+  this->m_thread = std::thread(&CheckpointWriter::Run, this);
+}
+
+//---------------------------------------------------------------------------
+CheckpointWriter::~CheckpointWriter()
+{
+  {
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+    this->m_stop = true;
+  }
+  this->m_changed.notify_all();
+  this->m_thread.join();
+  if (this->m_error) {
+    std::cerr << "Error writing checkpoint files" << std::endl;
+  }
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::Enqueue(Job job)
+{
+  std::unique_lock<std::mutex> lock(this->m_mutex);
+  this->m_changed.wait(lock, [this] { return this->m_jobs.size() < this->m_max_queue_depth; });
+  this->RethrowError();
+  this->m_jobs.push_back(std::move(job));
+  this->m_changed.notify_all();
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::Wait()
+{
+  std::unique_lock<std::mutex> lock(this->m_mutex);
+  this->m_changed.wait(lock, [this] { return this->m_jobs.empty() && !this->m_busy; });
+  this->RethrowError();
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::RethrowError()
+{
+  if (this->m_error) {
+    std::exception_ptr error = this->m_error;
+    this->m_error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::Run()
+{
+  std::unique_lock<std::mutex> lock(this->m_mutex);
+  while (true) {
+    this->m_changed.wait(lock, [this] { return this->m_stop || !this->m_jobs.empty(); });
+    if (this->m_jobs.empty()) {
+      return;   // stopping, and everything has been written
+    }
+
+    Job job = std::move(this->m_jobs.front());
+    this->m_jobs.pop_front();
+    this->m_busy = true;
+    this->m_changed.notify_all();
+
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      job();
+    }
+    catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+
+    if (error && !this->m_error) {
+      this->m_error = error;
+    }
+    this->m_busy = false;
+    this->m_changed.notify_all();
+  }
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::WriteFile(const std::string &filename, const std::string &contents)
+{
+  const std::string temporary = filename + ".tmp";
+  WriteAndSync(temporary, contents, "wb");
+  ReplaceFile(temporary, filename);
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::AppendFile(const std::string &filename, const std::string &contents)
+{
+  WriteAndSync(filename, contents, "ab");
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::CommitFile(const std::string &temporary, const std::string &filename)
+{
+  FILE* file = fopen(temporary.c_str(), "rb+");
+  if (!file || fsync(fileno(file)) != 0) {
+    std::cerr << "Error syncing output file: " << temporary << std::endl;
+    if (file) { fclose(file); }
+    throw 1;
+  }
+  fclose(file);
+  ReplaceFile(temporary, filename);
+}
@@ -0,0 +1,81 @@
+/*=========================================================================
+   Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+   File:      CheckpointWriter.h
+
+   Copyright (c) 2020 Scientific Computing and Imaging Institute.
+   See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+   =========================================================================*/
+#pragma once
+
+// std
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * \class CheckpointWriter
+ * \ingroup Group-Optimize
+ *
+ * Runs file output jobs on a background thread.
+ *
+ * Each job owns a snapshot of the data it writes, so the optimizer can keep
+ * moving particles while the snapshot is formatted and synced to disk.  Jobs
+ * run one at a time in the order they were queued.  Besides the job being
+ * written, at most max_queue_depth jobs are pending; Enqueue blocks until one
+ * starts, so a slow disk throttles the optimizer rather than piling up
+ * snapshots.  Optimize queues all files of a checkpoint as a single job, so
+ * the depth counts checkpoints.  An
+ * exception thrown by a job is rethrown on the caller's thread by the next
+ * Enqueue or Wait.
+ */
+class CheckpointWriter
+{
+public:
+  using Job = std::function<void()>;
+
+  //! Constructor, max_queue_depth is the number of jobs that may wait
+  explicit CheckpointWriter(size_t max_queue_depth = 2);
+
+  //! Destructor, waits for pending jobs
+  ~CheckpointWriter();
+
+  //! Queue a job, blocking while the queue is full
+  void Enqueue(Job job);
+
+  //! Block until every queued job has finished
+  void Wait();
+
+  //! Write a file through a temporary file that is synced and renamed over
+  //! the target, so a reader never sees a partially written checkpoint
+  static void WriteFile(const std::string &filename, const std::string &contents);
+
+  //! Append to a file and sync it
+  static void AppendFile(const std::string &filename, const std::string &contents);
+
+  //! Sync a file written by other means and rename it to filename
+  static void CommitFile(const std::string &temporary, const std::string &filename);
+
+private:
+  CheckpointWriter(const CheckpointWriter &) = delete;
+  CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+  void Run();
+  void RethrowError();
+
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  std::deque<Job> m_jobs;
+  size_t m_max_queue_depth;
+  bool m_busy = false;
+  bool m_stop = false;
+  std::exception_ptr m_error;
+};
@@ -50,13 +50,63 @@
 #include "itkParticleImageDomainWithHessians.h"
 #include "object_reader.h"
 #include "object_writer.h"
+#include "ParticleEnsembleFile.h"
 
 #include <Optimize.h>
+#include <CheckpointWriter.h>
+#include <OptimizerState.h>
+
+namespace {
+//---------------------------------------------------------------------------
+template<class TFunction>
+void GetEntropyFunctionState(const TFunction* function, OptimizerState::EntropyFunctionState &state)
+{
+  state.minimum_variance = function->GetMinimumVariance();
+  state.minimum_variance_decay_constant = function->GetMinimumVarianceDecayConstant();
+  state.hold_minimum_variance = function->GetHoldMinimumVariance();
+  state.counter = function->GetCounter();
+  state.minimum_eigenvalue = function->GetMinimumEigenValue();
+  state.current_energy = function->GetCurrentEnergy();
+  state.points_update = function->GetPointsUpdate();
+  state.inverse_cov_factor = function->GetInverseCovFactor();
+  state.points_mean = function->GetPointsMean();
+}
+
+//---------------------------------------------------------------------------
+template<class TFunction>
+void SetEntropyFunctionState(TFunction* function, const OptimizerState::EntropyFunctionState &state)
+{
+  function->SetMinimumVariance(state.minimum_variance);
+  function->SetMinimumVarianceDecayConstant(state.minimum_variance_decay_constant);
+  function->SetHoldMinimumVariance(state.hold_minimum_variance);
+  function->SetCounter(state.counter);
+  function->SetMinimumEigenValue(state.minimum_eigenvalue);
+  function->SetCurrentEnergy(state.current_energy);
+  function->SetPointsUpdate(state.points_update);
+  function->SetInverseCovFactor(state.inverse_cov_factor);
+  function->SetPointsMean(state.points_mean);
+}
+
+//---------------------------------------------------------------------------
+// Format values as text rows of the given width, each value followed by a space.
+std::string FormatPointRows(const std::vector<double> &values, int width)
+{
+  std::ostringstream out;
+  for (size_t i = 0; i < values.size(); i++) {
+    out << values[i] << " ";
+    if ((i + 1) % width == 0) {
+      out << "\n";
+    }
+  }
+  return out.str();
+}
+}
 
 //---------------------------------------------------------------------------
 Optimize::Optimize()
 {
   this->m_sampler = itk::MaximumEntropyCorrespondenceSampler<ImageType>::New();
+  this->m_checkpoint_writer.reset(new CheckpointWriter());
 }
 
 //---------------------------------------------------------------------------
@@ -84,12 +134,24 @@ bool Optimize::Run()
 
   m_disable_procrustes = true;
   m_disable_checkpointing = true;
-  // Initialize
-  if (m_processing_mode >= 0) { this->Initialize();}
-  // Introduce adaptivity
-  if (m_processing_mode >= 1 || m_processing_mode == -1) { this->AddAdaptivity();}
-  // Optimize
-  if (m_processing_mode >= 2 || m_processing_mode == -2) { this->RunOptimize();}
+  if (m_resume_state_file != "") {
+    // Continue the optimize step from a snapshot; initialization is skipped
+    if (!this->ReadOptimizerState()) {
+      return false;
+    }
+    this->RunOptimize();
+  }
+  else {
+    // Initialize
+    if (m_processing_mode >= 0) { this->Initialize();}
+    // Introduce adaptivity
+    if (m_processing_mode >= 1 || m_processing_mode == -1) { this->AddAdaptivity();}
+    // Optimize
+    if (m_processing_mode >= 2 || m_processing_mode == -2) { this->RunOptimize();}
+  }
+
+  // Make sure every checkpoint is on disk before returning
+  this->m_checkpoint_writer->Wait();
 
   this->UpdateExportablePoints();
   return true;
@@ -286,6 +348,24 @@ void Optimize::SetOutputTransformFile(std::string output_transform_file)
   this->m_output_transform_file = output_transform_file;
 }
 
+//---------------------------------------------------------------------------
+void Optimize::SetParticleFormat(int particle_format)
+{
+  this->m_particle_format = particle_format;
+}
+
+//---------------------------------------------------------------------------
+void Optimize::SetResumeStateFile(std::string resume_state_file)
+{
+  this->m_resume_state_file = resume_state_file;
+}
+
+//---------------------------------------------------------------------------
+void Optimize::SetCheckpointModes(bool checkpoint_modes)
+{
+  this->m_checkpoint_modes = checkpoint_modes;
+}
+
 //---------------------------------------------------------------------------
 void Optimize::SetUseMeshBasedAttributes(bool use_mesh_based_attributes)
 {
@@ -407,6 +487,8 @@ void Optimize::InitializeSampler()
   float flat_cutoff = 0.3;   // 0.3 -> 0.85
 
   m_sampler->SetPairwisePotentialType(m_pairwise_potential_type);
+  m_sampler->SetNeighborhoodType(m_neighborhood_type);
+  m_sampler->SetNarrowBand(m_narrow_band);
 
   m_sampler->GetGradientFunction()->SetFlatCutoff(flat_cutoff);
   m_sampler->GetCurvatureGradientFunction()->SetFlatCutoff(flat_cutoff);
@@ -419,6 +501,10 @@ void Optimize::InitializeSampler()
   m_sampler->GetOmegaGradientFunction()->SetFlatCutoff(flat_cutoff);
   m_sampler->GetOmegaGradientFunction()->SetNeighborhoodToSigmaRatio(nbhd_to_sigma);
 
+  m_sampler->GetGradientFunction()->SetKernelMode(m_kernel_mode);
+  m_sampler->GetCurvatureGradientFunction()->SetKernelMode(m_kernel_mode);
+  m_sampler->GetOmegaGradientFunction()->SetKernelMode(m_kernel_mode);
+
   m_sampler->GetEnsembleEntropyFunction()->SetMinimumVariance(m_starting_regularization);
   m_sampler->GetEnsembleEntropyFunction()->SetRecomputeCovarianceInterval(1);
   m_sampler->GetEnsembleEntropyFunction()->SetHoldMinimumVariance(false);
@@ -444,6 +530,9 @@ void Optimize::InitializeSampler()
   else if (m_optimizer_type == 1) {
     m_sampler->GetOptimizer()->SetModeToGaussSeidel();
   }
+  else if (m_optimizer_type == 3) {
+    m_sampler->GetOptimizer()->SetModeToParallelAdaptiveJacobi();
+  }
   else {
     m_sampler->GetOptimizer()->SetModeToAdaptiveGaussSeidel();
   }
@@ -829,7 +918,8 @@ void Optimize::RunOptimize()
   m_disable_checkpointing = false;
   m_disable_procrustes = false;
 
-  if (m_procrustes_interval != 0) { // Initial registration
+  // A resumed run already has its transforms
+  if (m_procrustes_interval != 0 && !m_resume_state) { // Initial registration
     m_procrustes->RunRegistration();
     this->WritePointFiles();
     this->WriteTransformFile();
@@ -846,6 +936,9 @@ void Optimize::RunOptimize()
   else if (m_optimizer_type == 1) {
     m_sampler->GetOptimizer()->SetModeToGaussSeidel();
   }
+  else if (m_optimizer_type == 3) {
+    m_sampler->GetOptimizer()->SetModeToParallelAdaptiveJacobi();
+  }
   else {
     m_sampler->GetOptimizer()->SetModeToAdaptiveGaussSeidel();
   }
@@ -915,6 +1008,9 @@ void Optimize::RunOptimize()
   m_saturation_counter = 0;
   m_sampler->GetOptimizer()->SetNumberOfIterations(0);
   m_sampler->GetOptimizer()->SetTolerance(0.0);
+  if (m_resume_state) {
+    this->ResumeOptimizerState();
+  }
   m_sampler->Modified();
   m_sampler->Update();
 
@@ -952,6 +1048,9 @@ void Optimize::AbortOptimization()
 //---------------------------------------------------------------------------
 void Optimize::IterateCallback(itk::Object*, const itk::EventObject &)
 {
+  // Keep the grid neighborhood cells matched to the current particle spacing.
+  m_sampler->UpdateNeighborhoodCellSizes();
+
   if (m_perform_good_bad == true) {
     std::vector < std::vector < int >> tmp;
     tmp = m_good_bad->RunAssessment(m_sampler->GetParticleSystem(),
@@ -999,17 +1098,15 @@ void Optimize::IterateCallback(itk::Object*, const itk::EventObject &)
     }
   }
 
+  bool checkpointed = false;
   if (m_checkpointing_interval != 0 && m_disable_checkpointing == false) {
     m_checkpoint_counter++;
     if (m_checkpoint_counter == (int)m_checkpointing_interval) {
       m_checkpoint_counter = 0;
 
-      this->WritePointFiles();
-      this->WriteTransformFile();
-      this->WritePointFilesWithFeatures();
-      this->WriteModes();
-      this->WriteParameters();
-      this->WriteEnergyFiles();
+      this->WriteCheckpoint();
+      this->EnqueueCheckpoint();
+      checkpointed = true;
     }
   }
 
@@ -1029,31 +1126,241 @@ void Optimize::IterateCallback(itk::Object*, const itk::EventObject &)
     }
   }
 
-  static unsigned int iteration_no = 0;
   // Checkpointing after procrustes (override for optimizing step)
   if (m_checkpointing_interval != 0 && m_disable_checkpointing == false) {
 
     m_checkpoint_counter++;
 
     if (m_checkpoint_counter == (int)m_checkpointing_interval) {
-      iteration_no += m_checkpointing_interval;
+      m_checkpoint_iteration += m_checkpointing_interval;
       m_checkpoint_counter = 0;
 
-      this->WritePointFiles();
-      this->WriteTransformFile();
-      this->WritePointFilesWithFeatures();
-      this->WriteModes();
-      this->WriteParameters();
-      this->WriteEnergyFiles();
-
-      if (m_keep_checkpoints) {
-        this->WritePointFiles(iteration_no);
-        this->WritePointFilesWithFeatures(iteration_no);
-        this->WriteTransformFile(iteration_no);
-        this->WriteParameters(iteration_no);
+      this->WriteCheckpoint(m_keep_checkpoints ? m_checkpoint_iteration : -1);
+      checkpointed = true;
+    }
+  }
+
+  // Saved last, so the snapshot holds everything this iteration changed
+  if (checkpointed) {
+    this->WriteOptimizerState();
+    this->EnqueueCheckpoint();
+  }
+}
+
+//---------------------------------------------------------------------------
+void Optimize::WriteCheckpoint(int iteration_no)
+{
+  // Positions, transforms and energies are copied here and written by the
+  // checkpoint writer while the optimizer continues, once EnqueueCheckpoint
+  // is called.
+  m_checkpoint_output = true;
+  this->WritePointFiles();
+  this->WriteTransformFile();
+  this->WritePointFilesWithFeatures();
+  this->WriteEnergyFiles();
+  if (iteration_no >= 0) {
+    this->WritePointFiles(iteration_no);
+    this->WritePointFilesWithFeatures(iteration_no);
+    this->WriteTransformFile(iteration_no);
+  }
+  m_checkpoint_output = false;
+
+  if (m_checkpoint_modes) {
+    this->WriteModes();
+  }
+  this->WriteParameters();
+  if (iteration_no >= 0) {
+    this->WriteParameters(iteration_no);
+  }
+}
+
+//---------------------------------------------------------------------------
+void Optimize::RunOutputJob(std::function<void()> job) const
+{
+  if (m_checkpoint_output) {
+    m_checkpoint_jobs.push_back(job);
+  }
+  else {
+    // Finish pending checkpoints first; they may write the same files.
+    m_checkpoint_writer->Wait();
+    job();
+  }
+}
+
+//---------------------------------------------------------------------------
+void Optimize::EnqueueCheckpoint()
+{
+  if (m_checkpoint_jobs.empty()) {
+    return;
+  }
+
+  // One job per checkpoint, so the writer's queue depth counts checkpoints
+  auto jobs = std::make_shared<std::vector<std::function<void()>>>();
+  jobs->swap(m_checkpoint_jobs);
+  m_checkpoint_writer->Enqueue([jobs]() {
+    for (const auto &job : *jobs) {
+      job();
+    }
+  });
+}
+
+//---------------------------------------------------------------------------
+void Optimize::WriteOptimizerState()
+{
+  if (!this->m_file_output_enabled) {
+    return;
+  }
+
+  auto particle_system = m_sampler->GetParticleSystem();
+  const unsigned int n = particle_system->GetNumberOfDomains();
+  const auto sigma_cache = m_sampler->GetGradientFunction()->GetSpatialSigmaCache();
+  auto state = std::make_shared<OptimizerState>();
+  state->positions.resize(n);
+  state->spatial_sigmas.resize(n);
+  for (unsigned int i = 0; i < n; i++) {
+    for (unsigned int j = 0; j < particle_system->GetNumberOfParticles(i); j++) {
+      const auto &pos = particle_system->GetPosition(j, i);
+      for (unsigned int k = 0; k < 3; k++) {
+        state->positions[i].push_back(pos[k]);
       }
+      const auto sigmas = i < sigma_cache->size() ? sigma_cache->operator[](i).GetPointer() : nullptr;
+      state->spatial_sigmas[i].push_back(sigmas && sigmas->HasIndex(j) ? (*sigmas)[j] : 0.0);
+    }
+    state->transforms.push_back(particle_system->GetTransform(i));
+    state->prefix_transforms.push_back(particle_system->GetPrefixTransform(i));
+  }
+
+  const auto time_steps = m_sampler->GetOptimizer()->GetTimeStepState();
+  state->time_steps = time_steps.TimeSteps;
+  state->previous_energies = time_steps.PreviousEnergies;
+  state->maximum_time_steps = time_steps.MaximumTimeSteps;
+  state->minimum_time_steps = time_steps.MinimumTimeSteps;
+
+  state->optimization_iterations_completed = m_optimization_iterations_completed;
+  state->iterations = m_sampler->GetOptimizer()->GetNumberOfIterations();
+  state->checkpoint_counter = m_checkpoint_counter;
+  state->checkpoint_iteration = m_checkpoint_iteration;
+  state->procrustes_counter = m_procrustes_counter;
+  state->saturation_counter = m_saturation_counter;
+  if (!m_total_energy.empty()) {
+    state->sampling_energy = m_energy_a.back();
+    state->correspondence_energy = m_energy_b.back();
+    state->total_energy = m_total_energy.back();
+  }
+
+  GetEntropyFunctionState(m_sampler->GetEnsembleEntropyFunction(), state->ensemble_entropy);
+  GetEntropyFunctionState(m_sampler->GetMeshBasedGeneralEntropyGradientFunction(),
+                          state->mesh_based_entropy);
+  GetEntropyFunctionState(m_sampler->GetEnsembleRegressionEntropyFunction(),
+                          state->regression_entropy);
+  GetEntropyFunctionState(m_sampler->GetEnsembleMixedEffectsEntropyFunction(),
+                          state->mixed_effects_entropy);
+
+  const std::string filename = m_output_dir + "/optimizer.state";
+  this->PrintStartMessage("Writing " + filename + "...", 1);
+  m_checkpoint_jobs.push_back([state, filename]() {
+    if (!state->Write(filename + ".tmp")) {
+      throw 1;
+    }
+    CheckpointWriter::CommitFile(filename + ".tmp", filename);
+  });
+  this->PrintDoneMessage(1);
+}
+
+//---------------------------------------------------------------------------
+bool Optimize::ReadOptimizerState()
+{
+  std::unique_ptr<OptimizerState> state(new OptimizerState());
+  if (!state->Read(m_resume_state_file)) {
+    return false;
+  }
+
+  auto particle_system = m_sampler->GetParticleSystem();
+  const unsigned int n = particle_system->GetNumberOfDomains();
+  if (state->positions.size() != n || state->transforms.size() != n ||
+      state->prefix_transforms.size() != n || state->spatial_sigmas.size() != n) {
+    std::cerr << "Optimizer state " << m_resume_state_file << " has " << state->positions.size()
+              << " domains, expected " << n << std::endl;
+    return false;
+  }
+
+  // Particles read from point files are replaced by the saved positions
+  for (unsigned int i = 0; i < n; i++) {
+    const std::vector<double> &values = state->positions[i];
+    const unsigned int count = values.size() / 3;
+    const unsigned int existing = particle_system->GetNumberOfParticles(i);
+    if (existing != 0 && existing != count) {
+      std::cerr << "Domain " << i << " has " << existing << " particles, but the optimizer state has "
+                << count << std::endl;
+      return false;
+    }
+    for (unsigned int j = 0; j < count; j++) {
+      itk::ParticleSystem<3>::PointType pos;
+      for (unsigned int k = 0; k < 3; k++) {
+        pos[k] = values[3 * j + k];
+      }
+      if (existing == 0) {
+        particle_system->AddPosition(pos, i);
+      }
+      else {
+        particle_system->SetPosition(pos, j, i);
+      }
+    }
+    particle_system->SetTransform(i, state->transforms[i]);
+    particle_system->SetPrefixTransform(i, state->prefix_transforms[i]);
+  }
+  particle_system->SynchronizePositions();
+
+  m_optimization_iterations_completed = state->optimization_iterations_completed;
+  m_resume_state = std::move(state);
+
+  if (m_verbosity_level > 0) {
+    std::cout << "Resuming optimization from " << m_resume_state_file << " at iteration "
+              << m_resume_state->iterations << std::endl;
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void Optimize::ResumeOptimizerState()
+{
+  const OptimizerState &state = *m_resume_state;
+
+  // RunOptimize has restarted the annealing; put back the saved state
+  SetEntropyFunctionState(m_sampler->GetEnsembleEntropyFunction(), state.ensemble_entropy);
+  SetEntropyFunctionState(m_sampler->GetMeshBasedGeneralEntropyGradientFunction(),
+                          state.mesh_based_entropy);
+  SetEntropyFunctionState(m_sampler->GetEnsembleRegressionEntropyFunction(),
+                          state.regression_entropy);
+  SetEntropyFunctionState(m_sampler->GetEnsembleMixedEffectsEntropyFunction(),
+                          state.mixed_effects_entropy);
+
+  SamplerType::OptimizerType::TimeStepState time_steps;
+  time_steps.TimeSteps = state.time_steps;
+  time_steps.PreviousEnergies = state.previous_energies;
+  time_steps.MaximumTimeSteps = state.maximum_time_steps;
+  time_steps.MinimumTimeSteps = state.minimum_time_steps;
+  m_sampler->GetOptimizer()->SetTimeStepState(time_steps);
+  m_sampler->GetOptimizer()->SetNumberOfIterations(state.iterations);
+
+  // the sigma estimation of each particle starts from its last sigma
+  auto sigma_cache = m_sampler->GetGradientFunction()->GetSpatialSigmaCache();
+  for (unsigned int i = 0; i < state.spatial_sigmas.size() && i < sigma_cache->size(); i++) {
+    auto sigmas = sigma_cache->operator[](i).GetPointer();
+    for (unsigned int j = 0; j < state.spatial_sigmas[i].size(); j++) {
+      (*sigmas)[j] = state.spatial_sigmas[i][j];
     }
   }
+
+  m_checkpoint_counter = state.checkpoint_counter;
+  m_checkpoint_iteration = state.checkpoint_iteration;
+  m_procrustes_counter = state.procrustes_counter;
+  m_saturation_counter = state.saturation_counter;
+  m_energy_a.push_back(state.sampling_energy);
+  m_energy_b.push_back(state.correspondence_energy);
+  m_total_energy.push_back(state.total_energy);
+
+  m_resume_state.reset();
 }
 
 //---------------------------------------------------------------------------
@@ -1212,6 +1519,9 @@ void Optimize::PrintParamInfo()
 
   std::cout << "Output path = " << m_output_dir << std::endl;
   std::cout << "Output transform filename = " << m_output_transform_file << std::endl;
+  std::cout << "Particle format = " << (m_particle_format == 0 ? "text" :
+                                        m_particle_format == 1 ? "binary ensemble" :
+                                        "binary ensemble and text") << std::endl;
 
   std::cout << std::endl;
 
@@ -1253,6 +1563,44 @@ void Optimize::PrintParamInfo()
   else if (m_optimizer_type == 2) {
     std::cout << "adaptive gauss seidel (with bad moves)";
   }
+  else if (m_optimizer_type == 3) {
+    std::cout << "parallel adaptive jacobi";
+  }
+  else {
+    std::cerr << "Incorrect option!!";
+    throw 1;
+  }
+  std::cout << std::endl;
+
+  std::cout << "neighborhood_type = ";
+  if (m_neighborhood_type == 0) {
+    std::cout << "octree";
+  }
+  else if (m_neighborhood_type == 1) {
+    std::cout << "uniform hash grid";
+  }
+  else {
+    std::cerr << "Incorrect option!!";
+    throw 1;
+  }
+  std::cout << std::endl;
+
+  std::cout << "narrow_band = ";
+  if (m_narrow_band > 0.0) {
+    std::cout << m_narrow_band;
+  }
+  else {
+    std::cout << "off (dense images)";
+  }
+  std::cout << std::endl;
+
+  std::cout << "kernel_mode = ";
+  if (m_kernel_mode == 0) {
+    std::cout << "reference";
+  }
+  else if (m_kernel_mode == 1) {
+    std::cout << "vectorized";
+  }
   else {
     std::cerr << "Incorrect option!!";
     throw 1;
@@ -1277,6 +1625,10 @@ void Optimize::PrintParamInfo()
   std::cout << "m_save_init_splits = " << m_save_init_splits << std::endl;
   std::cout << "m_checkpointing_interval = " << m_checkpointing_interval << std::endl;
   std::cout << "m_keep_checkpoints = " << m_keep_checkpoints << std::endl;
+  std::cout << "m_checkpoint_modes = " << m_checkpoint_modes << std::endl;
+  if (m_resume_state_file.length() > 0) {
+    std::cout << "m_resume_state_file = " << m_resume_state_file << std::endl;
+  }
 
   std::cout << std::endl;
 
@@ -1329,10 +1681,13 @@ void Optimize::WriteTransformFile(std::string iter_prefix) const
 
   std::string str = "writing " + output_file + " ...";
   PrintStartMessage(str);
-  object_writer < itk::ParticleSystem < 3 > ::TransformType > writer;
-  writer.SetFileName(output_file);
-  writer.SetInput(tlist);
-  writer.Update();
+  this->RunOutputJob([output_file, tlist]() {
+    object_writer < itk::ParticleSystem < 3 > ::TransformType > writer;
+    writer.SetFileName(output_file + ".tmp");
+    writer.SetInput(tlist);
+    writer.Update();
+    CheckpointWriter::CommitFile(output_file + ".tmp", output_file);
+  });
   PrintDoneMessage();
 }
 
@@ -1373,56 +1728,109 @@ void Optimize::WritePointFiles(std::string iter_prefix)
   typedef  itk::MaximumEntropyCorrespondenceSampler < ImageType > ::PointType PointType;
   const int n = m_sampler->GetParticleSystem()->GetNumberOfDomains();
 
-  int counter;
+  // Copy the positions; the files are written from the copy.
+  auto local = std::make_shared<std::vector<std::vector<double>>>(n);
+  auto world = std::make_shared<std::vector<std::vector<double>>>(n);
   for (int i = 0; i < n; i++) {
-    counter = 0;
-
-    std::string local_file = iter_prefix + "/" + m_filenames[i] + "_local.particles";
-    std::string world_file = iter_prefix + "/" + m_filenames[i] + "_world.particles";
-
-    std::ofstream out(local_file.c_str());
-    std::ofstream outw(world_file.c_str());
-
-    std::string str = "Writing " + world_file + " and " + local_file + " files...";
-    this->PrintStartMessage(str, 1);
-    if (!out) {
-      std::cerr << "Error opening output file: " << local_file << std::endl;
-      throw 1;
-    }
-    if (!outw) {
-      std::cerr << "Error opening output file: " << world_file << std::endl;
-      throw 1;
-    }
-
     for (unsigned int j = 0; j < m_sampler->GetParticleSystem()->GetNumberOfParticles(i); j++) {
       PointType pos = m_sampler->GetParticleSystem()->GetPosition(j, i);
       PointType wpos = m_sampler->GetParticleSystem()->GetTransformedPosition(j, i);
-
-      for (unsigned int k = 0; k < 3; k++) {
-        out << pos[k] << " ";
-      }
-      out << std::endl;
-
       for (unsigned int k = 0; k < 3; k++) {
-        outw << wpos[k] << " ";
+        (*local)[i].push_back(pos[k]);
+        (*world)[i].push_back(wpos[k]);
       }
-      outw << std::endl;
+    }
+  }
 
-      counter++;
-    }      // end for points
+  if (m_particle_format != 0) {
+    this->WriteParticleEnsembles(iter_prefix, local, world);
+    if (m_particle_format == 1) {
+      this->PrintDoneMessage();
+      return;
+    }
+  }
 
-    out.close();
-    outw.close();
+  std::vector<std::string> local_files(n), world_files(n);
+  for (int i = 0; i < n; i++) {
+    local_files[i] = iter_prefix + "/" + m_filenames[i] + "_local.particles";
+    world_files[i] = iter_prefix + "/" + m_filenames[i] + "_world.particles";
 
+    std::string str = "Writing " + world_files[i] + " and " + local_files[i] + " files...";
+    this->PrintStartMessage(str, 1);
     std::stringstream st;
-    st << counter;
+    st << (*local)[i].size() / 3;
     str = "with " + st.str() + "points...";
     this->PrintStartMessage(str, 1);
     this->PrintDoneMessage(1);
-  }   // end for files
+  }
+
+  this->RunOutputJob([local, world, local_files, world_files]() {
+    for (size_t i = 0; i < local_files.size(); i++) {
+      CheckpointWriter::WriteFile(local_files[i], FormatPointRows((*local)[i], 3));
+      CheckpointWriter::WriteFile(world_files[i], FormatPointRows((*world)[i], 3));
+    }
+  });
   this->PrintDoneMessage();
 }
 
+//---------------------------------------------------------------------------
+void Optimize::WriteParticleEnsembles(std::string iter_prefix, DomainValues local,
+                                      DomainValues world)
+{
+  const int n = m_sampler->GetParticleSystem()->GetNumberOfDomains();
+  const int num_shapes = n / m_domains_per_shape;
+
+  // Every subject must have the same number of particles in each domain for
+  // the ensemble to be a single matrix.
+  std::vector<unsigned int> particles_per_domain(m_domains_per_shape);
+  int rows = 0;
+  for (unsigned int d = 0; d < m_domains_per_shape; d++) {
+    particles_per_domain[d] = m_sampler->GetParticleSystem()->GetNumberOfParticles(d);
+    rows += 3 * particles_per_domain[d];
+  }
+  for (int i = 0; i < n; i++) {
+    if (m_sampler->GetParticleSystem()->GetNumberOfParticles(i) !=
+        particles_per_domain[i % m_domains_per_shape]) {
+      std::cerr << "Error writing particle ensembles: domain " << i
+                << " has a different number of particles than domain "
+                << i % m_domains_per_shape << std::endl;
+      throw 1;
+    }
+  }
+
+  const std::vector<std::string> names(m_filenames.begin(), m_filenames.begin() + n);
+  const std::string local_file = iter_prefix + "/particles_local.ensemble";
+  const std::string world_file = iter_prefix + "/particles_world.ensemble";
+  std::string str = "Writing " + world_file + " and " + local_file + " files...";
+  this->PrintStartMessage(str, 1);
+
+  const unsigned int domains_per_shape = m_domains_per_shape;
+  this->RunOutputJob([=]() {
+    // Subject s is column s; its domains are stacked in order.
+    Eigen::MatrixXd local_matrix(rows, num_shapes);
+    Eigen::MatrixXd world_matrix(rows, num_shapes);
+    for (int i = 0; i < n; i++) {
+      int row = 0;
+      for (unsigned int d = 0; d < i % domains_per_shape; d++) {
+        row += 3 * particles_per_domain[d];
+      }
+      const int count = static_cast<int>((*local)[i].size());
+      local_matrix.col(i / domains_per_shape).segment(row, count) =
+        Eigen::Map<const Eigen::VectorXd>((*local)[i].data(), count);
+      world_matrix.col(i / domains_per_shape).segment(row, count) =
+        Eigen::Map<const Eigen::VectorXd>((*world)[i].data(), count);
+    }
+
+    if (!ParticleEnsembleFile::Write(local_file + ".tmp", local_matrix, names, particles_per_domain) ||
+        !ParticleEnsembleFile::Write(world_file + ".tmp", world_matrix, names, particles_per_domain)) {
+      throw 1;
+    }
+    CheckpointWriter::CommitFile(local_file + ".tmp", local_file);
+    CheckpointWriter::CommitFile(world_file + ".tmp", world_file);
+  });
+  this->PrintDoneMessage(1);
+}
+
 //---------------------------------------------------------------------------
 void Optimize::WritePointFilesWithFeatures(int iter)
 {
@@ -1458,15 +1866,16 @@ void Optimize::WritePointFilesWithFeatures(std::string iter_prefix)
   typedef  itk::MaximumEntropyCorrespondenceSampler < ImageType > ::PointType PointType;
   const int n = m_sampler->GetParticleSystem()->GetNumberOfDomains();
 
-  int counter;
-  for (int i = 0; i < n; i++) {
-    counter = 0;
-
-    std::string world_file = iter_prefix + "/" + m_filenames[i] + "_wptsFeatures.particles";
+  // Sample the normals and attributes here, and leave only the formatting and
+  // writing to the output job.
+  auto values = std::make_shared<std::vector<std::vector<double>>>(n);
+  std::vector<std::string> world_files(n);
+  std::vector<int> row_widths(n);
 
-    std::ofstream outw(world_file.c_str());
+  for (int i = 0; i < n; i++) {
+    world_files[i] = iter_prefix + "/" + m_filenames[i] + "_wptsFeatures.particles";
 
-    std::string str = "Writing " + world_file + "...";
+    std::string str = "Writing " + world_files[i] + "...";
     int attrNum = 3 * int(m_use_xyz[i % m_domains_per_shape]) + 3 *
                   int(m_use_normals[i % m_domains_per_shape]);
     if (m_attributes_per_domain.size() > 0) {
@@ -1477,11 +1886,6 @@ void Optimize::WritePointFilesWithFeatures(std::string iter_prefix)
     str += "with " + st.str() + " attributes per point...";
     this->PrintStartMessage(str, 1);
 
-    if (!outw) {
-      std::cerr << "Error opening output file: " << world_file << std::endl;
-      throw 1;
-    }
-
     const itk::ParticleImplicitSurfaceDomain < float, 3 >* domain
       = static_cast < const itk::ParticleImplicitSurfaceDomain < float,
                                                                  3 >* > (m_sampler->
@@ -1502,21 +1906,24 @@ void Optimize::WritePointFilesWithFeatures(std::string iter_prefix)
       }
     }
 
+    std::vector<double> &out = (*values)[i];
+    row_widths[i] = 3;
+    if (m_use_normals[i % m_domains_per_shape]) {
+      row_widths[i] += 3;
+    }
+    if (m_attributes_per_domain.size() > 0) {
+      row_widths[i] += m_attributes_per_domain[i % m_domains_per_shape];
+    }
+
     for (unsigned int j = 0; j < m_sampler->GetParticleSystem()->GetNumberOfParticles(i); j++) {
       PointType pos = m_sampler->GetParticleSystem()->GetPosition(j, i);
       PointType wpos = m_sampler->GetParticleSystem()->GetTransformedPosition(j, i);
 
       for (unsigned int k = 0; k < 3; k++) {
-        outw << wpos[k] << " ";
+        out.push_back(wpos[k]);
       }
 
       if (m_use_normals[i % m_domains_per_shape]) {
-//                if (m_Sampler->GetParticleSystem()->GetDomainFlag(i))
-//                {
-//                    outw << 0.0 << " " << 0.0 << " " << 0.0 << " ";
-//                }
-//                else
-//                {
         typename itk::ParticleImageDomainWithGradients < float,
                                                          3 > ::VnlVectorType pG =
           domainWithGrad->SampleNormalVnl(pos);
@@ -1526,19 +1933,13 @@ void Optimize::WritePointFilesWithFeatures(std::string iter_prefix)
                                                              m_sampler->GetParticleSystem()->GetTransform(
                                                                i) * m_sampler->GetParticleSystem()->GetPrefixTransform(
                                                                i));
-        outw << pN[0] << " " << pN[1] << " " << pN[2] << " ";
-//                }
+        out.push_back(pN[0]);
+        out.push_back(pN[1]);
+        out.push_back(pN[2]);
       }
 
       if (m_attributes_per_domain.size() > 0) {
         if (m_attributes_per_domain[i % m_domains_per_shape] > 0) {
-//                    if (m_Sampler->GetParticleSystem()->GetDomainFlag(i))
-//                    {
-//                        for (unsigned int k = 0; k < m_attributes_per_domain[i % m_domains_per_shape]; k++)
-//                            outw << 0.0 << " ";
-//                    }
-//                    else
-//                    {
           point pt;
           pt.clear();
           pt[0] = pos[0];
@@ -1547,20 +1948,20 @@ void Optimize::WritePointFilesWithFeatures(std::string iter_prefix)
           fVals.clear();
           ptr->GetFeatureValues(pt, fVals);
           for (unsigned int k = 0; k < m_attributes_per_domain[i % m_domains_per_shape]; k++) {
-            outw << fVals[k] << " ";
+            out.push_back(fVals[k]);
           }
-//                    }
         }
       }
-
-      outw << std::endl;
-
-      counter++;
     }      // end for points
 
-    outw.close();
     this->PrintDoneMessage(1);
   }   // end for files
+
+  this->RunOutputJob([values, world_files, row_widths]() {
+    for (size_t i = 0; i < world_files.size(); i++) {
+      CheckpointWriter::WriteFile(world_files[i], FormatPointRows((*values)[i], row_widths[i]));
+    }
+  });
   this->PrintDoneMessage();
 }
 
@@ -1578,43 +1979,28 @@ void Optimize::WriteEnergyFiles()
   std::string strA = m_output_dir + "/" + this->m_str_energy + "_samplingEnergy.txt";
   std::string strB = m_output_dir + "/" + this->m_str_energy + "_correspondenceEnergy.txt";
   std::string strTotal = m_output_dir + "/" + this->m_str_energy + "_totalEnergy.txt";
-  std::ofstream outA(strA.c_str(), std::ofstream::app);
-  std::ofstream outB(strB.c_str(), std::ofstream::app);
-  std::ofstream outTotal(strTotal.c_str(), std::ofstream::app);
-
-  if (!outA) {
-    std::cerr << "Error opening output energy file: " << strA << std::endl;
-    throw 1;
-  }
-  if (!outB) {
-    std::cerr << "Error opening output energy file: " << strB << std::endl;
-    throw 1;
-  }
-  if (!outTotal) {
-    std::cerr << "Error opening output energy file: " << strTotal << std::endl;
-    throw 1;
-  }
 
   int n = m_energy_a.size() - 1;
   n = n < 0 ? 0 : n;
 
-  std::string str = "Appending to " + strA + " ...";
-  this->PrintStartMessage(str, 1);
+  std::stringstream outA, outB, outTotal;
   outA << m_energy_a[n] << std::endl;
-  outA.close();
-  this->PrintDoneMessage(1);
-
-  str = "Appending to " + strB + " ...";
-  this->PrintStartMessage(str, 1);
   outB << m_energy_b[n] << std::endl;
-  outB.close();
-  this->PrintDoneMessage(1);
-
-  str = "Appending to " + strTotal + " ...";
-  this->PrintStartMessage(str, 1);
   outTotal << m_total_energy[n] << std::endl;
-  outTotal.close();
+
+  this->PrintStartMessage("Appending to " + strA + " ...", 1);
+  this->PrintDoneMessage(1);
+  this->PrintStartMessage("Appending to " + strB + " ...", 1);
   this->PrintDoneMessage(1);
+  this->PrintStartMessage("Appending to " + strTotal + " ...", 1);
+  this->PrintDoneMessage(1);
+
+  const std::string a = outA.str(), b = outB.str(), total = outTotal.str();
+  this->RunOutputJob([strA, strB, strTotal, a, b, total]() {
+    CheckpointWriter::AppendFile(strA, a);
+    CheckpointWriter::AppendFile(strB, b);
+    CheckpointWriter::AppendFile(strTotal, total);
+  });
 
   this->PrintDoneMessage();
 }
@@ -1919,6 +2305,18 @@ void Optimize::SetPairwisePotentialType(int pairwise_potential_type)
 void Optimize::SetOptimizerType(int optimizer_type)
 { this->m_optimizer_type = optimizer_type;}
 
+//---------------------------------------------------------------------------
+void Optimize::SetNeighborhoodType(int neighborhood_type)
+{ this->m_neighborhood_type = neighborhood_type;}
+
+//---------------------------------------------------------------------------
+void Optimize::SetNarrowBand(double narrow_band)
+{ this->m_narrow_band = narrow_band;}
+
+//---------------------------------------------------------------------------
+void Optimize::SetKernelMode(int kernel_mode)
+{ this->m_kernel_mode = kernel_mode;}
+
 //---------------------------------------------------------------------------
 void Optimize::SetTimePtsPerSubject(int time_pts_per_subject)
 { this->m_timepts_per_subject = time_pts_per_subject;}
@@ -2044,6 +2442,12 @@ void Optimize::SetPointFiles(const std::vector<std::string> &point_files)
   }
 }
 
+//---------------------------------------------------------------------------
+void Optimize::SetPointEnsembleFile(const std::string &point_ensemble_file)
+{
+  this->m_sampler->SetPointsEnsembleFile(point_ensemble_file);
+}
+
 //---------------------------------------------------------------------------
 int Optimize::GetNumShapes()
 {
@@ -2129,7 +2533,7 @@ void Optimize::SetIterationCallback()
 //---------------------------------------------------------------------------
 void Optimize::WriteModes()
 {
-  const int n = m_sampler->GetParticleSystem()->GetNumberOfDomains() % m_domains_per_shape;
+  const int n = m_sampler->GetParticleSystem()->GetNumberOfDomains() / m_domains_per_shape;
   if (n >= 5) {
     m_sampler->GetEnsembleEntropyFunction()->WriteModes(m_output_dir + "/pts", 5);
   }
@@ -16,6 +16,8 @@
 #endif
 
 // std
+#include <functional>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -30,6 +32,9 @@
 // shapeworks particle system
 #include <itkParticleSystem.h>
 
+class CheckpointWriter;
+class OptimizerState;
+
 /**
  * \class Optimize
  * \ingroup Group-Optimize
@@ -102,6 +107,15 @@ public:
   //! Set the output transform file
   void SetOutputTransformFile(std::string output_transform_file);
 
+  //! Set the particle output format (0 : text files, 1 : binary ensemble files, 2 : both)
+  void SetParticleFormat(int particle_format);
+
+  //! Set if the shape modes are written at each checkpoint, or only at the end of the run
+  void SetCheckpointModes(bool checkpoint_modes);
+
+  //! Resume the optimize step from an optimizer state snapshot (optimizer.state) saved at a checkpoint
+  void SetResumeStateFile(std::string resume_state_file);
+
   //! Set if mesh based attributes should be used
   void SetUseMeshBasedAttributes(bool use_mesh_based_attributes);
 
@@ -144,6 +158,12 @@ public:
   void SetPairwisePotentialType(int pairwise_potential_type);
   //! Set the optimizer type (TODO: details)
   void SetOptimizerType(int optimizer_type);
+  //! Set the neighborhood type (0 : octree, 1 : uniform hash grid)
+  void SetNeighborhoodType(int neighborhood_type);
+  //! Set the narrow band half width for domain derivative images (0 : dense images)
+  void SetNarrowBand(double narrow_band);
+  //! Set the kernel mode of the entropy gradient functions (0 : reference, 1 : vectorized)
+  void SetKernelMode(int kernel_mode);
   //! Set the number of time points per subject (TODO: details)
   void SetTimePtsPerSubject(int time_pts_per_subject);
   //! Get the number of time points per subject (TODO: details)
@@ -206,6 +226,9 @@ public:
   //! Set starting point files (TODO: details)
   void SetPointFiles(const std::vector <std::string> &point_files);
 
+  //! Set a binary ensemble file holding the initial points of all domains
+  void SetPointEnsembleFile(const std::string &point_ensemble_file);
+
   //! Get number of shapes
   int GetNumShapes();
   //! Set the mesh files (TODO: details)
@@ -270,9 +293,18 @@ protected:
   void WriteTransformFile(std::string iter_prefix) const;
   void WritePointFiles(int iter = -1);
   void WritePointFiles(std::string iter_prefix);
+  //! Coordinates of the particles of each domain, shared with output jobs
+  using DomainValues = std::shared_ptr<const std::vector<std::vector<double>>>;
+  void WriteParticleEnsembles(std::string iter_prefix, DomainValues local, DomainValues world);
   void WritePointFilesWithFeatures(int iter = -1);
   void WritePointFilesWithFeatures(std::string iter_prefix);
   void WriteEnergyFiles();
+  void WriteCheckpoint(int iteration_no = -1);
+  void WriteOptimizerState();
+  bool ReadOptimizerState();
+  void ResumeOptimizerState();
+  void RunOutputJob(std::function<void()> job) const;
+  void EnqueueCheckpoint();
   void WriteCuttingPlanePoints(int iter = -1);
   void WriteParameters(int iter = -1);
   void ReportBadParticles();
@@ -295,6 +327,7 @@ protected:
   std::vector<std::vector<itk::Point<double>>>  m_local_points, m_global_points;
 
   int m_checkpoint_counter = 0;
+  int m_checkpoint_iteration = 0;
   int m_procrustes_counter = 0;
   int m_saturation_counter = 0;
   bool m_disable_procrustes = true;
@@ -311,6 +344,7 @@ protected:
   std::string m_prefix_transform_file;
   std::string m_output_dir;
   std::string m_output_transform_file;
+  int m_particle_format = 0;   // 0 : text, 1 : binary ensemble, 2 : both
   bool m_mesh_based_attributes = false;
   std::vector<bool> m_use_xyz;
   std::vector<bool> m_use_normals;
@@ -323,7 +357,10 @@ protected:
   int m_adaptivity_mode = 0;
   double m_adaptivity_strength = 0.0;
   int m_pairwise_potential_type = 0;   // 0 - gaussian (Cates work), 1 - modified cotangent (Meyer),
-  int m_optimizer_type = 2;   // 0 : jacobi, 1 : gauss seidel, 2 : adaptive gauss seidel (with bad moves)
+  int m_optimizer_type = 2;   // 0 : jacobi, 1 : gauss seidel, 2 : adaptive gauss seidel (with bad moves), 3 : parallel adaptive jacobi
+  int m_neighborhood_type = 0;   // 0 : octree (PowerOfTwoPointTree), 1 : uniform hash grid
+  double m_narrow_band = 0.0;   // 0 : dense gradient/Hessian images, > 0 : band half width in DT units
+  int m_kernel_mode = 0;   // 0 : reference Parzen window sums, 1 : vectorized
   unsigned int m_timepts_per_subject = 1;
   int m_optimization_iterations = 2000;
   int m_optimization_iterations_completed = 0;
@@ -341,6 +378,10 @@ protected:
   bool m_save_init_splits = true;
   unsigned int m_checkpointing_interval = 50;
   int m_keep_checkpoints = 0;
+  bool m_checkpoint_modes = true;
+  std::string m_resume_state_file;
+  // Snapshot being resumed, held from Run until RunOptimize has applied it
+  std::unique_ptr<OptimizerState> m_resume_state;
   double m_cotan_sigma_factor = 5.0;
   std::vector <int> m_particle_flags;
   std::vector <int> m_domain_flags;
@@ -367,6 +408,11 @@ protected:
   std::vector<int> m_spheres_per_input;
 
   bool m_file_output_enabled = true;
+  // File output is collected while m_checkpoint_output is set and handed to
+  // the checkpoint writer as one job per checkpoint by EnqueueCheckpoint
+  std::unique_ptr<CheckpointWriter> m_checkpoint_writer;
+  bool m_checkpoint_output = false;
+  mutable std::vector<std::function<void()>> m_checkpoint_jobs;
   bool m_aborted = false;
   std::vector<ImageType::Pointer> m_images;
   std::vector<std::array<itk::Point<double>, 3 >> m_cut_planes;
@@ -4,6 +4,7 @@
 #include <itkImageFileReader.h>
 
 #include <tinyxml.h>
+#include <ParticleEnsembleFile.h>
 
 //---------------------------------------------------------------------------
 OptimizeParameterFile::OptimizeParameterFile()
@@ -127,6 +128,10 @@ bool OptimizeParameterFile::set_io_parameters(TiXmlHandle* docHandle, Optimize*
   if (elem) { output_transform_file = elem->GetText();}
   optimize->SetOutputTransformFile(output_transform_file);
 
+  // particle output format
+  elem = docHandle->FirstChild("particle_format").Element();
+  if (elem) { optimize->SetParticleFormat(atoi(elem->GetText()));}
+
   // mesh based attributes
   bool use_mesh_based_attributes = false;
   std::vector<bool> use_xyz;
@@ -228,6 +233,15 @@ bool OptimizeParameterFile::set_optimization_parameters(TiXmlHandle* docHandle,
   elem = docHandle->FirstChild("optimizer_type").Element();
   if (elem) { optimize->SetOptimizerType(atoi(elem->GetText()));}
 
+  elem = docHandle->FirstChild("neighborhood_type").Element();
+  if (elem) { optimize->SetNeighborhoodType(atoi(elem->GetText()));}
+
+  elem = docHandle->FirstChild("narrow_band").Element();
+  if (elem) { optimize->SetNarrowBand(atof(elem->GetText()));}
+
+  elem = docHandle->FirstChild("kernel_mode").Element();
+  if (elem) { optimize->SetKernelMode(atoi(elem->GetText()));}
+
   elem = docHandle->FirstChild("timepts_per_subject").Element();
   if (elem) { optimize->SetTimePtsPerSubject(atoi(elem->GetText()));}
 
@@ -279,6 +293,12 @@ bool OptimizeParameterFile::set_optimization_parameters(TiXmlHandle* docHandle,
   elem = docHandle->FirstChild("keep_checkpoints").Element();
   if (elem) { optimize->SetKeepCheckpoints(atoi(elem->GetText()));}
 
+  elem = docHandle->FirstChild("checkpoint_modes").Element();
+  if (elem) { optimize->SetCheckpointModes(atoi(elem->GetText()) != 0);}
+
+  elem = docHandle->FirstChild("resume_state").Element();
+  if (elem) { optimize->SetResumeStateFile(elem->GetText());}
+
   elem = docHandle->FirstChild("cotan_sigma_factor").Element();
   if (elem) { optimize->SetCotanSigmaFactor(atof(elem->GetText()));}
 
@@ -380,8 +400,21 @@ bool OptimizeParameterFile::read_inputs(TiXmlHandle* docHandle, Optimize* optimi
     inputsBuffer.clear();
     inputsBuffer.str("");
 
+    // a single binary ensemble file may hold the points of every domain
+    if (pointFiles.size() == 1 && ParticleEnsembleFile::IsEnsembleFile(pointFiles[0])) {
+      ParticleEnsembleFile ensemble;
+      if (!ensemble.Open(pointFiles[0])) {
+        return false;
+      }
+      if (ensemble.Names().size() != numShapes) {
+        std::cerr << "ERROR: particle ensemble " << pointFiles[0] << " has "
+                  << ensemble.Names().size() << " entries for " << numShapes << " inputs!" << std::endl;
+        return false;
+      }
+      optimize->SetPointEnsembleFile(pointFiles[0]);
+    }
     // read point files only if they are all present
-    if (pointFiles.size() != numShapes) {
+    else if (pointFiles.size() != numShapes) {
       std::cerr << "ERROR: incorrect number of point files!" << std::endl;
       return false;
     }
@@ -0,0 +1,301 @@
+/*=========================================================================
+   Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+   File:      OptimizerState.cpp
+
+   Copyright (c) 2020 Scientific Computing and Imaging Institute.
+   See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+   =========================================================================*/
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#include "OptimizerState.h"
+
+namespace {
+const char signature[8] = {'S', 'W', 'O', 'S', 'T', 'A', 'T', 'E'};
+const uint32_t format_version = 2;
+
+bool IsLittleEndianHost()
+{
+  const uint16_t one = 1;
+  return *reinterpret_cast<const unsigned char*>(&one) == 1;
+}
+
+//---------------------------------------------------------------------------
+class StateWriter
+{
+public:
+  explicit StateWriter(std::ostream &out) : out_(out) {}
+
+  template<class T>
+  void Value(T value)
+  { out_.write(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+  void Vector(const std::vector<double> &values)
+  {
+    this->Value<uint64_t>(values.size());
+    out_.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+  }
+
+  void Vectors(const std::vector<std::vector<double>> &values)
+  {
+    this->Value<uint64_t>(values.size());
+    for (const auto &v : values) { this->Vector(v); }
+  }
+
+  void Matrix(const vnl_matrix<double> &m)
+  {
+    this->Value<uint64_t>(m.rows());
+    this->Value<uint64_t>(m.cols());
+    out_.write(reinterpret_cast<const char*>(m.data_block()), m.size() * sizeof(double));
+  }
+
+  void Transforms(const std::vector<OptimizerState::TransformType> &transforms)
+  {
+    this->Value<uint64_t>(transforms.size());
+    for (const auto &t : transforms) {
+      out_.write(reinterpret_cast<const char*>(t.data_block()), 16 * sizeof(double));
+    }
+  }
+
+  void Entropy(const OptimizerState::EntropyFunctionState &e)
+  {
+    this->Value<double>(e.minimum_variance);
+    this->Value<double>(e.minimum_variance_decay_constant);
+    this->Value<uint8_t>(e.hold_minimum_variance ? 1 : 0);
+    this->Value<int32_t>(e.counter);
+    this->Value<double>(e.minimum_eigenvalue);
+    this->Value<double>(e.current_energy);
+    this->Matrix(e.points_update);
+    this->Matrix(e.inverse_cov_factor);
+    this->Matrix(e.points_mean);
+  }
+
+private:
+  std::ostream &out_;
+};
+
+//---------------------------------------------------------------------------
+class StateReader
+{
+public:
+  //! file_size bounds the stored sizes, so a corrupt file fails cleanly
+  //! instead of attempting a huge allocation
+  StateReader(std::istream &in, uint64_t file_size) : in_(in), file_size_(file_size) {}
+
+  bool Good() const
+  { return ok_; }
+
+  template<class T>
+  T Value()
+  {
+    T value = T();
+    ok_ = ok_ && in_.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return value;
+  }
+
+  std::vector<double> Vector()
+  {
+    std::vector<double> values(this->Size(sizeof(double)));
+    ok_ = ok_ && in_.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(double));
+    return values;
+  }
+
+  std::vector<std::vector<double>> Vectors()
+  {
+    std::vector<std::vector<double>> values(this->Size(sizeof(uint64_t)));
+    for (auto &v : values) { v = this->Vector(); }
+    return values;
+  }
+
+  vnl_matrix<double> Matrix()
+  {
+    // vnl allocates nothing for a matrix with no values, whatever its shape
+    const uint64_t rows = this->Size(0);
+    const uint64_t cols = this->Size(0);
+    const uint64_t max_dimension = std::numeric_limits<unsigned int>::max();
+    if (!ok_ || rows > max_dimension || cols > max_dimension ||
+        (cols > 0 && rows > this->Remaining() / sizeof(double) / cols)) {
+      ok_ = false;
+      return vnl_matrix<double>();
+    }
+    vnl_matrix<double> m(rows, cols);
+    ok_ = ok_ && in_.read(reinterpret_cast<char*>(m.data_block()), m.size() * sizeof(double));
+    return m;
+  }
+
+  std::vector<OptimizerState::TransformType> Transforms()
+  {
+    std::vector<OptimizerState::TransformType> transforms(this->Size(16 * sizeof(double)));
+    for (auto &t : transforms) {
+      ok_ = ok_ && in_.read(reinterpret_cast<char*>(t.data_block()), 16 * sizeof(double));
+    }
+    return transforms;
+  }
+
+  OptimizerState::EntropyFunctionState Entropy()
+  {
+    OptimizerState::EntropyFunctionState e;
+    e.minimum_variance = this->Value<double>();
+    e.minimum_variance_decay_constant = this->Value<double>();
+    e.hold_minimum_variance = this->Value<uint8_t>() != 0;
+    e.counter = this->Value<int32_t>();
+    e.minimum_eigenvalue = this->Value<double>();
+    e.current_energy = this->Value<double>();
+    e.points_update = this->Matrix();
+    e.inverse_cov_factor = this->Matrix();
+    e.points_mean = this->Matrix();
+    return e;
+  }
+
+private:
+  //! Bytes left in the file after the current position
+  uint64_t Remaining()
+  {
+    const std::streamoff position = in_.tellg();
+    if (position < 0 || uint64_t(position) > file_size_) {
+      return 0;
+    }
+    return file_size_ - uint64_t(position);
+  }
+
+  //! A stored count of elements that take at least element_bytes each
+  uint64_t Size(uint64_t element_bytes)
+  {
+    const uint64_t size = this->Value<uint64_t>();
+    if (!ok_ || (element_bytes > 0 && size > this->Remaining() / element_bytes)) {
+      ok_ = false;
+      return 0;
+    }
+    return size;
+  }
+
+  std::istream &in_;
+  uint64_t file_size_;
+  bool ok_ = true;
+};
+}
+
+//---------------------------------------------------------------------------
+bool OptimizerState::Write(const std::string &filename) const
+{
+  if (!IsLittleEndianHost()) {
+    std::cerr << "Optimizer state files are only supported on little endian hosts" << std::endl;
+    return false;
+  }
+
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  if (!out) {
+    std::cerr << "Error opening output file: " << filename << std::endl;
+    return false;
+  }
+
+  StateWriter writer(out);
+  out.write(signature, sizeof(signature));
+  writer.Value<uint32_t>(format_version);
+
+  writer.Vectors(this->positions);
+  writer.Transforms(this->transforms);
+  writer.Transforms(this->prefix_transforms);
+  writer.Vectors(this->spatial_sigmas);
+
+  writer.Vectors(this->time_steps);
+  writer.Vectors(this->previous_energies);
+  writer.Vector(this->maximum_time_steps);
+  writer.Vector(this->minimum_time_steps);
+
+  writer.Value<int32_t>(this->optimization_iterations_completed);
+  writer.Value<int32_t>(this->iterations);
+  writer.Value<int32_t>(this->checkpoint_counter);
+  writer.Value<int32_t>(this->checkpoint_iteration);
+  writer.Value<int32_t>(this->procrustes_counter);
+  writer.Value<int32_t>(this->saturation_counter);
+
+  writer.Value<double>(this->sampling_energy);
+  writer.Value<double>(this->correspondence_energy);
+  writer.Value<double>(this->total_energy);
+
+  writer.Entropy(this->ensemble_entropy);
+  writer.Entropy(this->mesh_based_entropy);
+  writer.Entropy(this->regression_entropy);
+  writer.Entropy(this->mixed_effects_entropy);
+
+  if (!out.flush()) {
+    std::cerr << "Error writing file: " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool OptimizerState::Read(const std::string &filename)
+{
+  if (!IsLittleEndianHost()) {
+    std::cerr << "Optimizer state files are only supported on little endian hosts" << std::endl;
+    return false;
+  }
+
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  if (!in) {
+    std::cerr << "Could not open optimizer state file: " << filename << std::endl;
+    return false;
+  }
+
+  in.seekg(0, std::ios::end);
+  const std::streamoff file_size = in.tellg();
+  in.seekg(0, std::ios::beg);
+  if (file_size < 0 || !in) {
+    std::cerr << "Could not read optimizer state file: " << filename << std::endl;
+    return false;
+  }
+
+  char head[sizeof(signature)];
+  StateReader reader(in, uint64_t(file_size));
+  if (!in.read(head, sizeof(head)) || std::memcmp(head, signature, sizeof(signature)) != 0 ||
+      reader.Value<uint32_t>() != format_version) {
+    std::cerr << "Not an optimizer state file (or unsupported version): " << filename << std::endl;
+    return false;
+  }
+
+  OptimizerState state;
+  state.positions = reader.Vectors();
+  state.transforms = reader.Transforms();
+  state.prefix_transforms = reader.Transforms();
+  state.spatial_sigmas = reader.Vectors();
+
+  state.time_steps = reader.Vectors();
+  state.previous_energies = reader.Vectors();
+  state.maximum_time_steps = reader.Vector();
+  state.minimum_time_steps = reader.Vector();
+
+  state.optimization_iterations_completed = reader.Value<int32_t>();
+  state.iterations = reader.Value<int32_t>();
+  state.checkpoint_counter = reader.Value<int32_t>();
+  state.checkpoint_iteration = reader.Value<int32_t>();
+  state.procrustes_counter = reader.Value<int32_t>();
+  state.saturation_counter = reader.Value<int32_t>();
+
+  state.sampling_energy = reader.Value<double>();
+  state.correspondence_energy = reader.Value<double>();
+  state.total_energy = reader.Value<double>();
+
+  state.ensemble_entropy = reader.Entropy();
+  state.mesh_based_entropy = reader.Entropy();
+  state.regression_entropy = reader.Entropy();
+  state.mixed_effects_entropy = reader.Entropy();
+
+  if (!reader.Good()) {
+    std::cerr << "Corrupt optimizer state file: " << filename << std::endl;
+    return false;
+  }
+
+  *this = state;
+  return true;
+}
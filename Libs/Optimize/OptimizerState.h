@@ -0,0 +1,96 @@
+/*=========================================================================
+   Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+   File:      OptimizerState.h
+
+   Copyright (c) 2020 Scientific Computing and Imaging Institute.
+   See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+   =========================================================================*/
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+
+// vnl
+#include "vnl/vnl_matrix.h"
+#include "vnl/vnl_matrix_fixed.h"
+
+/**
+ * \class OptimizerState
+ * \ingroup Group-Optimize
+ *
+ * Everything needed to continue an optimization exactly where it stopped:
+ * the particle positions, the Procrustes and prefix transforms, the cached
+ * Parzen window sigmas, the adaptive time steps of the solver, the iteration counters of Optimize and the
+ * annealing state and cached covariance factors of each entropy function.
+ *
+ * The state is stored in a self-contained little endian binary file:
+ *
+ *   char[8]  "SWOSTATE"
+ *   uint32   format version (2)
+ *   ...      the fields below, in declaration order.  Vectors are a uint64
+ *            length followed by their elements, matrices a uint64 row and
+ *            column count followed by the values in row major order.
+ */
+class OptimizerState
+{
+public:
+  using TransformType = vnl_matrix_fixed<double, 4, 4>;
+
+  //! Annealing state of a covariance based entropy function
+  struct EntropyFunctionState
+  {
+    double minimum_variance = 0.0;
+    double minimum_variance_decay_constant = 1.0;
+    bool hold_minimum_variance = true;
+    int counter = 0;
+    double minimum_eigenvalue = 0.0;
+    double current_energy = 0.0;
+    vnl_matrix<double> points_update;
+    vnl_matrix<double> inverse_cov_factor;
+    vnl_matrix<double> points_mean;
+  };
+
+  //! Local particle positions of each domain, three values per particle
+  std::vector<std::vector<double>> positions;
+  std::vector<TransformType> transforms;
+  std::vector<TransformType> prefix_transforms;
+
+  //! Parzen window sigma of each particle from the last iteration, which
+  //! starts the sigma estimation of the next one
+  std::vector<std::vector<double>> spatial_sigmas;
+
+  //! Adaptive time step state of the gradient descent solver
+  std::vector<std::vector<double>> time_steps;
+  std::vector<std::vector<double>> previous_energies;
+  std::vector<double> maximum_time_steps;
+  std::vector<double> minimum_time_steps;
+
+  //! Iteration counters
+  int optimization_iterations_completed = 0;
+  int iterations = 0;
+  int checkpoint_counter = 0;
+  int checkpoint_iteration = 0;
+  int procrustes_counter = 0;
+  int saturation_counter = 0;
+
+  //! Energies of the last iteration, for the early termination criterion
+  double sampling_energy = 0.0;
+  double correspondence_energy = 0.0;
+  double total_energy = 0.0;
+
+  EntropyFunctionState ensemble_entropy;
+  EntropyFunctionState mesh_based_entropy;
+  EntropyFunctionState regression_entropy;
+  EntropyFunctionState mixed_effects_entropy;
+
+  //! Write the state; returns false, printing the reason, on error
+  bool Write(const std::string &filename) const;
+
+  //! Read a state written by Write; returns false, printing the reason, on error
+  bool Read(const std::string &filename);
+};
@@ -159,6 +159,13 @@ public:
         this->SetPointsFile(0,s);
     }
 
+    /**Optionally provide a binary ensemble file holding the initial points of
+       every domain, in domain order.  Used instead of the points files. */
+    void SetPointsEnsembleFile(const std::string &s)
+    {
+        m_PointsEnsembleFile = s;
+    }
+
     /**Optionally provide a filename for a mesh with geodesic distances.*/
     void SetMeshFile(unsigned int i, const std::string &s)
     {
@@ -326,6 +333,31 @@ public:
     int GetPairwisePotentialType()
     {return m_pairwise_potential_type;}
 
+    /** Select the spatial index used by the particle neighborhoods: 0 for the
+        PowerOfTwoPointTree (default), 1 for a uniform hash grid.  Must be set
+        before the sampler is initialized. */
+    void SetNeighborhoodType(int neighborhood_type)
+    { m_neighborhood_type = neighborhood_type; }
+
+    int GetNeighborhoodType()
+    {return m_neighborhood_type;}
+
+    /** Half width, in physical units of the distance transforms, of the
+        narrow band in which the domains store gradients, Hessians and
+        curvature.  Zero (default) keeps dense images.  Must be set before
+        the sampler is initialized. */
+    void SetNarrowBand(double narrow_band)
+    { m_narrow_band = narrow_band; }
+
+    double GetNarrowBand()
+    {return m_narrow_band;}
+
+    /** Resize the cells of the grid neighborhoods to the current mean
+        neighborhood radius of each domain, as estimated from the sigma cache.
+        Does nothing for the tree neighborhood.  Should be called between
+        iterations. */
+    void UpdateNeighborhoodCellSizes();
+
     void SetVerbosity(unsigned int val)
     {
         m_verbosity = val;
@@ -398,15 +430,18 @@ protected:
     std::vector<typename ParticleImplicitSurfaceDomain<typename
     ImageType::PixelType, Dimension>::Pointer> m_DomainList;
 
-    std::vector<typename ParticleSurfaceNeighborhood<ImageType>::Pointer> m_NeighborhoodList;
+    std::vector<typename ParticleNeighborhood<Dimension>::Pointer> m_NeighborhoodList;
 
     int m_pairwise_potential_type;
+    int m_neighborhood_type;
+    double m_narrow_band;
 
 private:
     MaximumEntropySurfaceSampler(const Self&); //purposely not implemented
     void operator=(const Self&); //purposely not implemented
 
     std::vector<std::string> m_PointsFiles;
+    std::string m_PointsEnsembleFile;
     std::vector<std::string> m_MeshFiles;
     std::vector<std::string> m_FeaMeshFiles;
     std::vector<std::string> m_FeaGradFiles;
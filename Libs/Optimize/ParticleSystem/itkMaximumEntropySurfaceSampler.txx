@@ -16,6 +16,7 @@
 #define __itkMaximumEntropySurfaceSampler_txx
 
 #include "itkParticlePositionReader.h"
+#include "ParticleEnsembleFile.h"
 #include "itkImageRegionIterator.h"
 #include "itkZeroCrossingImageFilter.h"
 #include "object_reader.h"
@@ -29,6 +30,8 @@ MaximumEntropySurfaceSampler<TImage>::MaximumEntropySurfaceSampler()
 {
     m_AdaptivityMode = 0;
     m_Initializing = false;
+    m_neighborhood_type = 0;
+    m_narrow_band = 0.0;
 
     m_PrefixTransformFile = "";
     m_TransformFile = "";
@@ -95,11 +98,20 @@ MaximumEntropySurfaceSampler<TImage>::AllocateDomainsAndNeighborhoods()
         m_DomainList.push_back( ParticleImplicitSurfaceDomain<typename
                                 ImageType::PixelType, Dimension>::New() );
 
-        m_NeighborhoodList.push_back( ParticleSurfaceNeighborhood<ImageType>::New() );
+        if (m_neighborhood_type == 1)
+        {
+            m_NeighborhoodList.push_back( ParticleSurfaceNeighborhood<ImageType,
+                                          ParticleGridNeighborhood<Dimension> >::New().GetPointer() );
+        }
+        else
+        {
+            m_NeighborhoodList.push_back( ParticleSurfaceNeighborhood<ImageType>::New().GetPointer() );
+        }
 
         typename TImage::Pointer img_temp = this->m_Images[i];
 
         m_DomainList[i]->SetSigma(img_temp->GetSpacing()[0] * 2.0);
+        m_DomainList[i]->SetNarrowBand(m_narrow_band);
 
         m_DomainList[i]->SetImage(img_temp);
 
@@ -173,6 +185,36 @@ MaximumEntropySurfaceSampler<TImage>::AllocateDomainsAndNeighborhoods()
     }
 }
 
+template <class TImage>
+void
+MaximumEntropySurfaceSampler<TImage>::UpdateNeighborhoodCellSizes()
+{
+    for (unsigned int i = 0; i < m_NeighborhoodList.size(); i++)
+    {
+        ParticleGridNeighborhood<Dimension> *grid
+                = dynamic_cast<ParticleGridNeighborhood<Dimension> *>(m_NeighborhoodList[i].GetPointer());
+        if (grid == 0 || m_ParticleSystem->GetDomainFlag(i) == true) continue;
+
+        // Mean of the sigma values estimated so far.  Zero entries have not
+        // been estimated yet.
+        const ParticleContainer<double> *sigmas = m_Sigma1Cache->operator[](i);
+        double sum = 0.0;
+        unsigned int count = 0;
+        for (typename ParticleContainer<double>::ConstIterator it = sigmas->GetBegin();
+             it != sigmas->GetEnd(); ++it)
+        {
+            if (*it > 0.0)
+            {
+                sum += *it;
+                count++;
+            }
+        }
+        if (count == 0) continue;
+
+        grid->SetCellSize(sum / static_cast<double>(count) * m_GradientFunction->GetNeighborhoodToSigmaRatio());
+    }
+}
+
 template <class TImage>
 void
 MaximumEntropySurfaceSampler<TImage>::ReadPointsFiles()
@@ -190,6 +232,28 @@ MaximumEntropySurfaceSampler<TImage>::ReadPointsFiles()
         }
     }
 
+    if (m_PointsEnsembleFile != "")
+    {
+        ParticleEnsembleFile ensemble;
+        if (!ensemble.Open(m_PointsEnsembleFile))
+        {
+            itkExceptionMacro("Could not read particle ensemble file: " << m_PointsEnsembleFile);
+        }
+        const unsigned int domains = ensemble.DomainsPerSubject();
+        const unsigned int entries = ensemble.N() * domains;
+        std::vector<typename ParticlePositionReader<3>::PointType> list;
+        for (unsigned int i = 0; i < entries; i++)
+        {
+            const double *p = ensemble.DomainData(i / domains, i % domains);
+            list.resize(ensemble.ParticlesPerDomain()[i % domains]);
+            for (unsigned int j = 0; j < list.size(); j++)
+            {
+                for (unsigned int k = 0; k < 3; k++) { list[j][k] = *p++; }
+            }
+            this->GetParticleSystem()->AddPositionList(list, i);
+        }
+    }
+
     // Push position information out to all observers (necessary to correctly
     // fill out the shape matrix).
     this->GetParticleSystem()->SynchronizePositions();
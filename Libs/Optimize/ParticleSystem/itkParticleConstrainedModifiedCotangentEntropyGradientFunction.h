@@ -181,7 +181,15 @@ public:
 
     virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
     {
-        typename ParticleConstrainedModifiedCotangentEntropyGradientFunction<TGradientNumericType, VDimension>::Pointer copy = ParticleConstrainedModifiedCotangentEntropyGradientFunction<TGradientNumericType, VDimension>::New();
+        typename Self::Pointer copy = Self::New();
+        this->UpdateClone(copy);
+        return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+    }
+
+    virtual bool UpdateClone(ParticleVectorFunction<VDimension> *clone)
+    {
+        Self *copy = static_cast<Self *>(clone);
+
         copy->SetParticleSystem(this->GetParticleSystem());
         copy->m_Counter = this->m_Counter;
         copy->m_CurrentWeights = this->m_CurrentWeights;
@@ -200,7 +208,7 @@ public:
         copy->m_diagnostics_prefix = this->m_diagnostics_prefix;
         copy->m_RunStatus          = this->m_RunStatus;
 
-        return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+        return true;
     }
 
 protected:
@@ -153,7 +153,7 @@ ParticleConstrainedModifiedCotangentEntropyGradientFunction<TGradientNumericType
     }
 
     // Get the neighborhood surrounding the point "pos".
-    m_CurrentNeighborhood = system->FindNeighborhoodPoints(pos, m_CurrentWeights, neighborhood_radius, d);
+    system->FindNeighborhoodPoints(pos, m_CurrentWeights, neighborhood_radius, m_CurrentNeighborhood, d);
 
     // PRATEEP
     vnl_vector_fixed<double, VDimension> x;
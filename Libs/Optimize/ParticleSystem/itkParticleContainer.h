@@ -20,7 +20,9 @@
 #include "itkWeakPointer.h"
 #include "itkCommand.h"
 #include "itkParticleAttribute.h"
-#include <map>
+#include <vector>
+#include <algorithm>
+#include <cassert>
 
 namespace itk
 {
@@ -46,101 +48,150 @@ public:
   //  itkTypeMacro(ParticleContainer, ParticleAttribute);
   itkTypeMacro(ParticleContainer, DataObject);
   
-  /** Define a map container type.  A map is used because elements will be
-      frequently deleted and added.  Map has the property that addition and
-      deletion operations do not invalidate existing pointers. */
-  struct ltcmp
-  {
-    inline bool operator()(unsigned int a, unsigned int b) const
-    { return a < b; }
-  };
-  typedef std::map<unsigned int, T, ltcmp> MapType;  
-  
-  /** Define a const iterator type for this container.  This class is just a wrapper
-      around the stl::map iterator which provides a simpler API. */
-  class ConstIterator : public MapType::const_iterator
+  /** Particles are stored densely, addressed directly by their index.  The
+      index space is almost always contiguous (indices are handed out by a
+      counter in the ParticleSystem), so an array avoids a node allocation
+      and a tree traversal for every lookup.  Removed entries are tombstoned
+      and skipped during iteration; their slots are reused if the same index
+      is inserted again.  The array is kept in fixed size chunks that are
+      never moved, so as with the std::map used previously, references to
+      entries stay valid while others are inserted. */
+  enum { ChunkBits = 8, ChunkSize = 1 << ChunkBits, ChunkMask = ChunkSize - 1 };
+  typedef std::vector< std::vector<T> > StorageType;
+  typedef std::vector<unsigned char> ValidFlagsType;
+
+  /** Define a const iterator type for this container.  The iterator walks
+      the dense storage in index order, skipping removed entries. */
+  class ConstIterator
   {
   public:
-    typedef typename MapType::const_iterator Superclass;
-    ConstIterator( const typename MapType::const_iterator &o) : Superclass(o) {}
-    ConstIterator() : Superclass() {}
-    
+    ConstIterator(const ParticleContainer *c, unsigned long int k) : m_Container(c), m_Index(k)
+    { this->SkipInvalid(); }
+    ConstIterator() : m_Container(0), m_Index(0) {}
+
     inline const T &operator*() const
-    { return Superclass::operator*().second;  } 
+    { return m_Container->Entry(m_Index); }
+    inline const T *operator->() const
+    { return &(m_Container->Entry(m_Index)); }
     inline unsigned long int GetIndex() const
-    { return Superclass::operator*().first; }
-  }; 
+    { return m_Index; }
+
+    inline ConstIterator &operator++()
+    {
+      ++m_Index;
+      this->SkipInvalid();
+      return *this;
+    }
+    inline ConstIterator operator++(int)
+    {
+      ConstIterator tmp = *this;
+      this->operator++();
+      return tmp;
+    }
+
+    inline bool operator==(const ConstIterator &o) const
+    { return m_Index == o.m_Index && m_Container == o.m_Container; }
+    inline bool operator!=(const ConstIterator &o) const
+    { return !this->operator==(o); }
+
+  private:
+    inline void SkipInvalid()
+    {
+      const unsigned long int n = m_Container->m_Valid.size();
+      while (m_Index < n && !m_Container->m_Valid[m_Index]) { ++m_Index; }
+    }
+
+    const ParticleContainer *m_Container;
+    unsigned long int m_Index;
+  };
 
-  /** Define an iterator type for this container.  This class is just a wrapper
-      around the stl::map iterator which provides a simpler API. */
-  class Iterator : public MapType::iterator
-  {
-  public:
-    typedef typename MapType::iterator Superclass;
-    Iterator( const typename MapType::iterator &o) : Superclass(o) {}
-    Iterator() : Superclass() {}
-    
-    inline T &operator*() const
-    { return Superclass::operator*().second;  }
-    
-    inline unsigned long int GetIndex() const
-    { return Superclass::operator*().first; } 
-  }; 
-  
   /** Return iterators for container values. */
   inline ConstIterator GetBegin() const
-  { return ConstIterator( m_Map.begin()); }
+  { return ConstIterator(this, 0); }
   inline ConstIterator GetEnd() const
-  { return ConstIterator( m_Map.end()); }
-
-  //
-  // Not sure whether we want non const iterators.
-  //
-  //    inline Iterator GetBegin() 
-  //    { return Iterator( m_Map.begin()); }
-  //    inline Iterator GetEnd()
-  //    { return Iterator( m_Map.end()); }
-
-  /** Return iterators for the underlying map container.  */
-  inline typename MapType::const_iterator GetMapBegin() const
-  { return m_Map.begin(); }
-  inline typename MapType::const_iterator GetMapEnd() const
-  { return m_Map.end(); }
-  inline typename MapType::iterator GetMapBegin() 
-  { return m_Map.begin(); }
-  inline typename MapType::iterator GetMapEnd()
-  { return m_Map.end(); }
+  { return ConstIterator(this, m_Valid.size()); }
 
   /** Returns a reference to the object associated with index k.  If the index
       k does not already exist, this method inserts a new entry for k. */
-  inline T &operator[](const unsigned long int &k)  { return m_Map[k]; }
-  inline const T&operator[](const unsigned long int &k) const { return m_Map[k]; }
+  inline T &operator[](const unsigned long int &k)
+  {
+    if (k >= m_Valid.size())
+      {
+      // Grow geometrically so that sequential insertion is amortized O(1).
+      if (k >= m_Valid.capacity())
+        {
+        m_Valid.reserve(std::max<unsigned long int>(k + 1, 2 * m_Valid.capacity()));
+        }
+      m_Valid.resize(k + 1, 0);
+      while (m_Data.size() <= (k >> ChunkBits))
+        {
+        m_Data.push_back(std::vector<T>(ChunkSize));
+        }
+      }
+    T &entry = this->Entry(k);
+    if (!m_Valid[k])
+      {
+      m_Valid[k] = 1;
+      entry = T();
+      m_Size++;
+      }
+    return entry;
+  }
 
-  /** Returns true if index k is in the container and false otherwise. */
-  bool HasIndex(unsigned long int k) const
+  /** Returns a reference to the object associated with index k.  The index
+      must exist. */
+  inline const T &operator[](const unsigned long int &k) const
   {
-    if ( m_Map.find(k) != m_Map.end()) return true;
-    else return false;
+    assert(this->HasIndex(k));
+    return this->Entry(k);
   }
 
+  /** Returns true if index k is in the container and false otherwise. */
+  inline bool HasIndex(unsigned long int k) const
+  { return k < m_Valid.size() && m_Valid[k]; }
+
   /** Number of objects in the container. */
-  unsigned long int GetSize() const  { return m_Map.size(); }
+  unsigned long int GetSize() const  { return m_Size; }
+
+  /** One past the largest index that has ever been stored.  Valid indices
+      lie in [0, GetIndexRange()).  When no entries have been removed this is
+      equal to GetSize(). */
+  unsigned long int GetIndexRange() const { return m_Valid.size(); }
+
+  /** Preallocate storage for indices [0, n). */
+  void Reserve(unsigned long int n)
+  {
+    m_Data.reserve((n + ChunkMask) >> ChunkBits);
+    m_Valid.reserve(n);
+  }
 
   /**  Erase the element in the container with index k.  Return value is 1 on
        success. */
-  typename MapType::size_type Erase( const unsigned int &k )
-  { return m_Map.erase(k); }
+  unsigned long int Erase( const unsigned long int &k )
+  {
+    if (!this->HasIndex(k)) { return 0; }
+    m_Valid[k] = 0;
+    m_Size--;
+
+    // Trim trailing tombstones so that GetEnd() stays tight, and free the
+    // chunks past the last entry.
+    while (!m_Valid.empty() && !m_Valid.back())
+      {
+      m_Valid.pop_back();
+      }
+    m_Data.resize((m_Valid.size() + ChunkMask) >> ChunkBits);
+    return 1;
+  }
   
 protected:
-  ParticleContainer() { }
+  ParticleContainer() : m_Size(0) { }
   void PrintSelf(std::ostream& os, Indent indent) const
   {
     Superclass::PrintSelf(os,indent);
   
     os << indent << "ParticleContainer: " << std::endl;
-    //    for (typename MapType::const_iterator it= this->GetMapBegin();
-    //         it != this->GetMapEnd();  it++)
-    //      {      os <<  it->first << " " << it->second << std::endl;      }
+    os << indent << "Size: " << m_Size << std::endl;
+    os << indent << "IndexRange: " << m_Valid.size() << std::endl;
   }
   virtual ~ParticleContainer() {};
 
@@ -148,8 +199,15 @@ protected:
   ParticleContainer(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
 
-  MapType m_Map;
-  
+  inline T &Entry(unsigned long int k)
+  { return m_Data[k >> ChunkBits][k & ChunkMask]; }
+  inline const T &Entry(unsigned long int k) const
+  { return m_Data[k >> ChunkBits][k & ChunkMask]; }
+
+  StorageType m_Data;
+  ValidFlagsType m_Valid;
+  unsigned long int m_Size;
+
 };
 
 } // end namespace itk
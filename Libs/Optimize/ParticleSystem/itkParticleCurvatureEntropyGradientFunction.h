@@ -160,7 +160,15 @@ public:
 
   virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
   {
-    typename ParticleCurvatureEntropyGradientFunction<TGradientNumericType, VDimension>::Pointer copy = ParticleCurvatureEntropyGradientFunction<TGradientNumericType, VDimension>::New();
+    typename Self::Pointer copy = Self::New();
+    this->UpdateClone(copy);
+    return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+  }
+
+  virtual bool UpdateClone(ParticleVectorFunction<VDimension> *clone)
+  {
+    Self *copy = static_cast<Self *>(clone);
+
     copy->SetParticleSystem(this->GetParticleSystem());
     copy->m_Counter = this->m_Counter;
     copy->m_Rho = this->m_Rho;
@@ -173,6 +181,7 @@ public:
     copy->m_MaximumNeighborhoodRadius = this->m_MaximumNeighborhoodRadius;
     copy->m_FlatCutoff = this->m_FlatCutoff;
     copy->m_NeighborhoodToSigmaRatio = this->m_NeighborhoodToSigmaRatio;
+    copy->m_KernelBatch.SetMode(this->m_KernelBatch.GetMode());
 
     copy->m_SpatialSigmaCache = this->m_SpatialSigmaCache;
     copy->m_MeanCurvatureCache = this->m_MeanCurvatureCache;
@@ -180,7 +189,7 @@ public:
     copy->m_DomainNumber = this->m_DomainNumber;
     copy->m_ParticleSystem = this->m_ParticleSystem;
 
-    return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+    return true;
   }
 
 protected:
@@ -17,6 +17,7 @@
 #include "vnl/vnl_matrix_fixed.h"
 #include "vnl/vnl_vector_fixed.h"
 #include "vnl/vnl_matrix.h"
+#include <limits>
 
 namespace itk {
 
@@ -34,92 +35,26 @@ ParticleCurvatureEntropyGradientFunction<TGradientNumericType, VDimension>
                 double &avgKappa) const
 {
   //  avgKappa = this->ComputeKappa(m_MeanCurvatureCache->operator[](this->GetDomainNumber())->operator[](idx), dom);
-  avgKappa = 0.0;
-  const double min_sigma = 1.0e-4;
   const double epsilon = 1.0e-5;
-  
-  const double M = static_cast<double>(VDimension);
-  const double MM = M * M * 2.0 + M;
-  
-  double error = 1.0e6;
-  double sigma, prev_sigma;
-  sigma = initial_sigma;
-  
-  while (error > precision)
+
+  double mymc = m_MeanCurvatureCache->operator[](this->GetDomainNumber())->operator[](idx);
+
+  this->m_KernelBatch.Clear();
+  for (unsigned int i = 0; i < neighborhood.size(); i++)
     {
-    VectorType r_vec;
-    double A = 0.0;
-    double B = 0.0;
-    double C = 0.0;
-    double sigma2 = sigma * sigma;
-    double sigma22 = sigma2 * 2.0;
-    
-    double mymc = m_MeanCurvatureCache->operator[](this->GetDomainNumber())->operator[](idx);
+    double mc = m_MeanCurvatureCache->operator[](this->GetDomainNumber())->operator[](neighborhood[i].Index);
+    double Dij = (mymc + mc) * 0.5;
+    double kappa = this->ComputeKappa(Dij, dom);
 
-    for (unsigned int i = 0; i < neighborhood.size(); i++)
-      {
-      if (weights[i] < epsilon) continue;      
-      double mc = m_MeanCurvatureCache->operator[](this->GetDomainNumber())->operator[](neighborhood[i].Index);
-      double Dij = (mymc + mc) * 0.5;
-      double kappa = this->ComputeKappa(Dij, dom);
-
-      avgKappa += kappa;
-      
-      for (unsigned int n = 0; n < VDimension; n++)
-        {
-        // Note that the Neighborhood object has already filtered the
-        // neighborhood for points whose normals differ by > 90 degrees.
-        r_vec[n] = (pos[n] - neighborhood[i].Point[n]) * kappa;
-        }
-
-      double r = r_vec.magnitude();
-      double r2 = r*r;
-      double alpha = exp(-r2 / sigma22) * weights[i];
-      A += alpha;
-      B += r2 * alpha;
-      C += r2 * r2 * alpha;
-      } // end for i
-
-    avgKappa /= static_cast<double>(neighborhood.size());
-
-    prev_sigma = sigma;
-
-    if (A < epsilon)
-      {
-      err = 1;
-      avgKappa = 1.0;
-      return sigma;
-      }; // results are not meaningful
-    
-    // // First order convergence update.
-    // sigma = sqrt(( 1.0 / DIM ) * ( B / A));
-    
-    // old math
-    //  sigma -= (sigma2 * VDimension * A * A - A  * B) / (((2.0 * sigma * VDimension) * A * A -
-    //                                          (1.0/(sigma2*sigma))*(A*C-B*B)) + epsilon);
-    
-    // New math -- results are not obviously different? 
-    sigma -= (A * (B - A * sigma2 * M)) /
-      ( (-MM * A *A * sigma) - 3.0 * A * B * (1.0 / (sigma + epsilon))
-        - (A*C + B*B) * (1.0 / (sigma2 * sigma + epsilon)) + epsilon);
-    
-    error = 1.0 - fabs((sigma/prev_sigma));
-    
-    // Constrain sigma.
-    if (sigma < min_sigma)
-      {
-      sigma = min_sigma;
-      error = precision; // we are done if sigma has vanished
-      }
-    else
-      {
-      if (sigma < 0.0) sigma = min_sigma;
-      }
-    
-    } // end while (error > precision)
-  
-  err = 0;
-  return sigma;
+    // Note that the Neighborhood object has already filtered the
+    // neighborhood for points whose normals differ by > 90 degrees.
+    this->m_KernelBatch.Push(pos, neighborhood[i].Point, weights[i], kappa);
+    }
+
+  // Neighbors with weights < epsilon are skipped, and avgKappa is 1 if the
+  // estimate is not meaningful.
+  return this->m_KernelBatch.EstimateSigma(initial_sigma, precision, epsilon, err,
+                                           &avgKappa, neighborhood.size());
 }
 
 template <class TGradientNumericType, unsigned int VDimension>
@@ -168,7 +103,7 @@ ParticleCurvatureEntropyGradientFunction<TGradientNumericType, VDimension>
   
   
   // Get the neighborhood surrounding the point "pos".
-   m_CurrentNeighborhood = system->FindNeighborhoodPoints(pos, m_CurrentWeights, neighborhood_radius, d);
+   system->FindNeighborhoodPoints(pos, m_CurrentWeights, neighborhood_radius, m_CurrentNeighborhood, d);
 
    //    m_CurrentNeighborhood
    //   = system->FindNeighborhoodPoints(pos, neighborhood_radius, d);
@@ -201,8 +136,8 @@ ParticleCurvatureEntropyGradientFunction<TGradientNumericType, VDimension>
       m_CurrentSigma = neighborhood_radius / this->GetNeighborhoodToSigmaRatio();
       }
     
-    m_CurrentNeighborhood = system->FindNeighborhoodPoints(pos, m_CurrentWeights,    
-                                                               neighborhood_radius, d);
+    system->FindNeighborhoodPoints(pos, m_CurrentWeights,
+                                   neighborhood_radius, m_CurrentNeighborhood, d);
     //  m_CurrentNeighborhood = system->FindNeighborhoodPoints(pos, neighborhood_radius, d);
     //    this->ComputeAngularWeights(pos,m_CurrentNeighborhood,domain,m_CurrentWeights);
     
@@ -216,8 +151,8 @@ ParticleCurvatureEntropyGradientFunction<TGradientNumericType, VDimension>
     {
     m_CurrentSigma = this->GetMaximumNeighborhoodRadius() / this->GetNeighborhoodToSigmaRatio();
     neighborhood_radius = this->GetMaximumNeighborhoodRadius();
-        m_CurrentNeighborhood = system->FindNeighborhoodPoints(pos, m_CurrentWeights,
-                                                               neighborhood_radius, d);
+        system->FindNeighborhoodPoints(pos, m_CurrentWeights,
+                                       neighborhood_radius, m_CurrentNeighborhood, d);
         //  m_CurrentNeighborhood = system->FindNeighborhoodPoints(pos, neighborhood_radius, d);
         //      this->ComputeAngularWeights(pos,m_CurrentNeighborhood,domain,m_CurrentWeights);
     }
@@ -250,17 +185,11 @@ ParticleCurvatureEntropyGradientFunction<TGradientNumericType, VDimension>
   // Compute the gradients
   double sigma2inv = 1.0 / (2.0* m_CurrentSigma * m_CurrentSigma + epsilon);
   
-  VectorType r;
   VectorType gradE;
 
-  for (unsigned int n = 0; n < VDimension; n++)
-    {
-    gradE[n] = 0.0;
-    }
-
   double mymc = m_MeanCurvatureCache->operator[](d)->operator[](idx);
-  double A = 0.0;
 
+  this->m_KernelBatch.Clear();
   for (unsigned int i = 0; i < m_CurrentNeighborhood.size(); i++)
     {
     double mc = m_MeanCurvatureCache->operator[](d)->operator[](m_CurrentNeighborhood[i].Index);
@@ -270,25 +199,15 @@ ParticleCurvatureEntropyGradientFunction<TGradientNumericType, VDimension>
     // TEST DISTANCE TO PLANE IDEA
     //    kappa *=  (fabs(pos[0]) * 1.0);
     // END TEST
-    
 
-    for (unsigned int n = 0; n < VDimension; n++)
-      {
-      // Note that the Neighborhood object has already filtered the
-      // neighborhood for points whose normals differ by > 90 degrees.
-      r[n] = (pos[n] - m_CurrentNeighborhood[i].Point[n]) * kappa;
-      }
-
-    
-    double q = kappa * exp( -dot_product(r, r) * sigma2inv);
-    
-    A += q;
-    
-    for (unsigned int n = 0; n < VDimension; n++)
-      {
-      gradE[n] += m_CurrentWeights[i] * r[n] * q;
-      }
+    // Note that the Neighborhood object has already filtered the
+    // neighborhood for points whose normals differ by > 90 degrees.
+    this->m_KernelBatch.Push(pos, m_CurrentNeighborhood[i].Point, m_CurrentWeights[i], kappa);
     }
+
+  // all of the neighbors contribute, whatever their weights
+  double A;
+  this->m_KernelBatch.Gradient(sigma2inv, -std::numeric_limits<double>::infinity(), A, gradE.data_block());
   
   double p = 0.0;
   if (A > epsilon)
@@ -20,6 +20,7 @@
 #include "itkWeakPointer.h"
 #include "itkParticleSystem.h"
 #include "vnl/vnl_vector_fixed.h"
+#include <typeinfo>
 
 namespace itk
 {
@@ -418,7 +419,25 @@ public:
 
     virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
     {
-        typename ParticleDualVectorFunction<VDimension>::Pointer copy = ParticleDualVectorFunction<VDimension>::New();
+        typename Self::Pointer copy = Self::New();
+
+        if (this->m_FunctionA) copy->m_FunctionA = this->m_FunctionA->Clone();
+        if (this->m_FunctionB) copy->m_FunctionB = this->m_FunctionB->Clone();
+
+        this->UpdateClone(copy);
+        return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+    }
+
+    virtual bool UpdateClone(ParticleVectorFunction<VDimension> *clone)
+    {
+        Self *copy = static_cast<Self *>(clone);
+
+        // The component functions may have been swapped since the clone was
+        // made (e.g. a different correspondence function).  In that case the
+        // clone cannot be reused and must be recreated.
+        if (!UpdateComponentClone(this->m_FunctionA, copy->m_FunctionA)) return false;
+        if (!UpdateComponentClone(this->m_FunctionB, copy->m_FunctionB)) return false;
+
         copy->m_AOn = this->m_AOn;
         copy->m_BOn = this->m_BOn;
 
@@ -430,16 +449,13 @@ public:
         copy->m_AverageEnergyB = this->m_AverageEnergyB;
         copy->m_Counter = this->m_Counter;
 
-        if (this->m_FunctionA) copy->m_FunctionA = this->m_FunctionA->Clone();
-        if (this->m_FunctionB) copy->m_FunctionB = this->m_FunctionB->Clone();
-
         if (!copy->m_FunctionA) copy->m_AOn = false;
         if (!copy->m_FunctionB) copy->m_BOn = false;
 
         copy->m_DomainNumber = this->m_DomainNumber;
         copy->m_ParticleSystem = this->m_ParticleSystem;
 
-        return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+        return true;
     }
 
 protected:
@@ -451,6 +467,18 @@ protected:
     void operator=(const ParticleDualVectorFunction &);
     ParticleDualVectorFunction(const ParticleDualVectorFunction &);
 
+    static bool UpdateComponentClone(const typename ParticleVectorFunction<VDimension>::Pointer &source,
+                                     typename ParticleVectorFunction<VDimension>::Pointer &copy)
+    {
+        if (!source)
+        {
+            copy = 0;
+            return true;
+        }
+        if (!copy || typeid(*copy.GetPointer()) != typeid(*source.GetPointer())) return false;
+        return source->UpdateClone(copy);
+    }
+
     bool m_AOn;
     bool m_BOn;
     double m_RelativeGradientScaling;
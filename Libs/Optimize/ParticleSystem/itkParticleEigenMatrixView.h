@@ -0,0 +1,61 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleEigenMatrixView.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleEigenMatrixView_h
+#define __itkParticleEigenMatrixView_h
+
+#include "vnl/vnl_matrix.h"
+#include <Eigen/Core>
+#include <algorithm>
+
+namespace itk
+{
+/** Views of vnl matrices as Eigen matrices.  vnl stores a matrix row-major in
+    one contiguous block, so the view shares storage with the vnl object and
+    no data is copied.  The shape matrix attributes keep their vnl interface;
+    these views let the large products in the correspondence functions run
+    through Eigen's blocked kernels, which are multi-threaded when the build
+    uses OpenMP. */
+template <class T>
+struct ParticleEigenMatrixView
+{
+  typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> MatrixType;
+  typedef Eigen::Map<MatrixType> MapType;
+  typedef Eigen::Map<const MatrixType> ConstMapType;
+
+  static MapType View(vnl_matrix<T> &m)
+  { return MapType(m.data_block(), m.rows(), m.cols()); }
+
+  static ConstMapType ConstView(const vnl_matrix<T> &m)
+  { return ConstMapType(m.data_block(), m.rows(), m.cols()); }
+};
+
+/** Resize a matrix to rs x cs, keeping the overlapping part of its contents
+    and zeroing the rest.  Copies each old row once, where copying the matrix
+    to a temporary and back element by element copied it twice. */
+template <class T>
+void ResizeVnlMatrixPreserve(vnl_matrix<T> &m, unsigned int rs, unsigned int cs)
+{
+  if (m.rows() == rs && m.cols() == cs) return;
+
+  vnl_matrix<T> tmp(rs, cs, T(0));
+  const unsigned int r_end = std::min(rs, m.rows());
+  const unsigned int c_end = std::min(cs, m.cols());
+  for (unsigned int r = 0; r < r_end; r++)
+    {
+    std::copy(m[r], m[r] + c_end, tmp[r]);
+    }
+  m.swap(tmp);
+}
+
+} // end namespace itk
+
+#endif
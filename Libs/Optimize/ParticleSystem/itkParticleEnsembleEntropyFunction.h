@@ -16,6 +16,7 @@
 #define __itkParticleEnsembleEntropyFunction_h
 
 #include "itkParticleShapeMatrixAttribute.h"
+#include "itkParticleEigenMatrixView.h"
 #include "itkParticleVectorFunction.h"
 #include <vector>
 
@@ -129,10 +130,41 @@ public:
     m_MinimumVariance = initial_value;
     m_HoldMinimumVariance = false;
   } 
-  bool GetMinimumVarianceDecayConstant() const
+  double GetMinimumVarianceDecayConstant() const
   {
     return m_MinimumVarianceDecayConstant;
   }
+  void SetMinimumVarianceDecayConstant(double d)
+  { m_MinimumVarianceDecayConstant = d; }
+
+  /** Access the annealing counter and the factors cached by the last
+      covariance computation, which are reused until the next recompute.
+      Together with the minimum variance these let an optimizer state
+      snapshot resume the annealing exactly. */
+  int GetCounter() const
+  { return m_Counter; }
+  void SetCounter(int i)
+  { m_Counter = i; }
+  double GetMinimumEigenValue() const
+  { return m_MinimumEigenValue; }
+  void SetMinimumEigenValue(double d)
+  { m_MinimumEigenValue = d; }
+  double GetCurrentEnergy() const
+  { return m_CurrentEnergy; }
+  void SetCurrentEnergy(double d)
+  { m_CurrentEnergy = d; }
+  const vnl_matrix_type &GetPointsUpdate() const
+  { return *m_PointsUpdate; }
+  void SetPointsUpdate(const vnl_matrix_type &m)
+  { *m_PointsUpdate = m; }
+  const vnl_matrix_type &GetInverseCovFactor() const
+  { return *m_InverseCovFactor; }
+  void SetInverseCovFactor(const vnl_matrix_type &m)
+  { *m_InverseCovFactor = m; }
+  const vnl_matrix_type &GetPointsMean() const
+  { return *m_points_mean; }
+  void SetPointsMean(const vnl_matrix_type &m)
+  { *m_points_mean = m; }
   
   void PrintShapeMatrix()
   {
@@ -157,7 +189,14 @@ public:
 
   virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
   {
-    typename ParticleEnsembleEntropyFunction<VDimension>::Pointer copy = ParticleEnsembleEntropyFunction<VDimension>::New();
+    typename Self::Pointer copy = Self::New();
+    this->UpdateClone(copy);
+    return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+  }
+
+  virtual bool UpdateClone(ParticleVectorFunction<VDimension> *clone)
+  {
+    Self *copy = static_cast<Self *>(clone);
 
     copy->m_PointsUpdate = this->m_PointsUpdate;
     copy->m_MinimumVariance = this->m_MinimumVariance;
@@ -172,12 +211,11 @@ public:
     copy->m_ParticleSystem = this->m_ParticleSystem;
     copy->m_ShapeMatrix = this->m_ShapeMatrix;
 
-    copy->m_InverseCovMatrix = this->m_InverseCovMatrix;
+    copy->m_InverseCovFactor = this->m_InverseCovFactor;
     copy->m_points_mean = this->m_points_mean;
     copy->m_UseMeanEnergy = this->m_UseMeanEnergy;
 
-    return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
-
+    return true;
   }
 
 protected:
@@ -192,7 +230,7 @@ protected:
     m_Counter = 0;
     m_UseMeanEnergy = true;
     m_PointsUpdate = new vnl_matrix_type(10,10);
-    m_InverseCovMatrix = new vnl_matrix_type(10,10);
+    m_InverseCovFactor = new vnl_matrix_type(10,10);
     m_points_mean = new vnl_matrix_type(10,10);
   }
   virtual ~ParticleEnsembleEntropyFunction() {}
@@ -211,7 +249,7 @@ protected:
   int m_Counter;
   bool m_UseMeanEnergy;
 
-  vnl_matrix_type * m_InverseCovMatrix; // 3Nx3N - used for energy computation
+  vnl_matrix_type * m_InverseCovFactor; // 3NxM - inverse covariance is F*F^T, used for energy computation
   vnl_matrix_type * m_points_mean; //3NxM - used for energy computation
 
 };
@@ -101,15 +101,18 @@ ParticleEnsembleEntropyFunction<VDimension>
 
     vnl_diag_matrix<double> W;
 
-    m_InverseCovMatrix->set_size(num_dims, num_dims);
-    m_InverseCovMatrix->fill(0.0);
+    m_InverseCovFactor->set_size(num_dims, num_samples);
+    m_InverseCovFactor->fill(0.0);
     vnl_matrix_type gramMat(num_samples, num_samples, 0.0);
     vnl_matrix_type pinvMat(num_samples, num_samples, 0.0); //gramMat inverse
 
+    typedef ParticleEigenMatrixView<double> EigenView;
+    const typename EigenView::ConstMapType Y = EigenView::ConstView(points_minus_mean);
+
     if (this->m_UseMeanEnergy)
     {
         pinvMat.set_identity();
-        m_InverseCovMatrix->clear(); //set_identity();
+        m_InverseCovFactor->clear(); //set_identity();
     }
     else
     {
@@ -128,7 +131,9 @@ ParticleEnsembleEntropyFunction<VDimension>
 //        pinvMat = (V * invLambda) * V.transpose();
 //        m_InverseCovMatrix = (U * invLambda) * U.transpose();
 
-        gramMat = points_minus_mean.transpose()* points_minus_mean;
+        // The products with points_minus_mean are num_dims long and dominate
+        // the cost; they run through Eigen views of the vnl storage.
+        EigenView::View(gramMat).noalias() = Y.transpose() * Y;
 
         vnl_svd <double> svd(gramMat);
 
@@ -140,14 +145,15 @@ ParticleEnsembleEntropyFunction<VDimension>
         invLambda.set_diagonal(invLambda.get_diagonal()/(double)(num_samples-1) + m_MinimumVariance);
         invLambda.invert_in_place();
 
-        pinvMat = (UG * invLambda) * UG.transpose();
+        vnl_matrix_type UGL = UG * invLambda;
+        pinvMat = UGL * UG.transpose();
 
-        vnl_matrix_type projMat = points_minus_mean * UG;
-        vnl_matrix_type projMat2 = projMat * invLambda;
-        projMat2 = projMat2 * projMat2.transpose();
-        m_InverseCovMatrix->update(projMat2);
+        // The inverse covariance is F * F^T with F = points_minus_mean * UG *
+        // invLambda.  Only its diagonal blocks are ever needed, so F is kept
+        // rather than the num_dims x num_dims product.
+        EigenView::View(*m_InverseCovFactor).noalias() = Y * EigenView::View(UGL);
     }
-    m_PointsUpdate->update(points_minus_mean * pinvMat);
+    EigenView::View(*m_PointsUpdate).noalias() = Y * EigenView::View(pinvMat);
 
 //     std::cout << m_PointsUpdate.extract(num_dims, num_samples,0,0) << std::endl;
 
@@ -206,18 +212,24 @@ ParticleEnsembleEntropyFunction<VDimension>
     Xi(2,0) = m_ShapeMatrix->operator()(k+2, d/DomainsPerShape) - m_points_mean->get(k+2, 0);
 
 
-    vnl_matrix_type tmp1(3, 3, 0.0);
-
+    energy = 0.0;
     if (this->m_UseMeanEnergy)
-        tmp1.set_identity();
+    {
+        for (unsigned int i = 0; i < 3; i++)
+            energy += Xi(i,0) * Xi(i,0);
+    }
     else
-        tmp1 = m_InverseCovMatrix->extract(3,3,k,k);
-
-    vnl_matrix_type tmp = Xi.transpose()*tmp1;
-
-    tmp *= Xi;
-
-    energy = tmp(0,0);
+    {
+        // Xi^T (F_k F_k^T) Xi = |F_k^T Xi|^2, where F_k are the rows of the
+        // inverse covariance factor that belong to this particle.
+        for (unsigned int j = 0; j < m_InverseCovFactor->cols(); j++)
+        {
+            double s = 0.0;
+            for (unsigned int i = 0; i < 3; i++)
+                s += m_InverseCovFactor->get(k + i, j) * Xi(i,0);
+            energy += s * s;
+        }
+    }
 
     for (unsigned int i = 0; i< VDimension; i++)
     {
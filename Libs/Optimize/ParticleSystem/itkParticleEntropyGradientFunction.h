@@ -18,6 +18,7 @@
 #include "itkParticleVectorFunction.h"
 #include "itkParticleContainerArrayAttribute.h"
 #include "itkParticleImageDomainWithGradients.h"
+#include "itkParticleGaussianKernelBatch.h"
 #include <vector>
 
 namespace itk
@@ -167,6 +168,14 @@ public:
   double GetNeighborhoodToSigmaRatio() const
   { return m_NeighborhoodToSigmaRatio; }
 
+  /** How the Parzen window sums over a neighborhood are evaluated, see
+      ParticleGaussianKernelBatch.  0 (the default) is the reference
+      per-neighbor evaluation, 1 the vectorized one. */
+  void SetKernelMode(int mode)
+  { m_KernelBatch.SetMode(mode); }
+  int GetKernelMode() const
+  { return m_KernelBatch.GetMode(); }
+
   /**Access the cache of sigma values for each particle position.  This cache
      is populated by registering this object as an observer of the correct
      particle system (see SetParticleSystem).*/
@@ -191,8 +200,14 @@ public:
 
   virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
   {
-    typename ParticleEntropyGradientFunction<TGradientNumericType, VDimension>::Pointer copy =
-      ParticleEntropyGradientFunction<TGradientNumericType, VDimension>::New();
+    typename Self::Pointer copy = Self::New();
+    this->UpdateClone(copy);
+    return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+  }
+
+  virtual bool UpdateClone(ParticleVectorFunction<VDimension> *clone)
+  {
+    Self *copy = static_cast<Self *>(clone);
 
     // from itkParticleVectorFunction
     copy->m_DomainNumber = this->m_DomainNumber;
@@ -204,9 +219,9 @@ public:
     copy->m_MinimumNeighborhoodRadius = this->m_MinimumNeighborhoodRadius;
     copy->m_NeighborhoodToSigmaRatio = this->m_NeighborhoodToSigmaRatio;
     copy->m_SpatialSigmaCache =  this->m_SpatialSigmaCache;
+    copy->m_KernelBatch.SetMode(this->m_KernelBatch.GetMode());
 
-    return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
-
+    return true;
   }
 
 protected:
@@ -221,6 +236,16 @@ protected:
   double m_FlatCutoff;
   double m_NeighborhoodToSigmaRatio;
   typename SigmaCacheType::Pointer m_SpatialSigmaCache;
+
+  /** Scratch storage for the neighborhood queries made in Evaluate.  The
+      threaded optimizers give each thread its own clone of this function, so
+      these are reused from call to call instead of being allocated for every
+      particle.  They are not copied by UpdateClone. */
+  mutable typename ParticleSystemType::PointVectorType m_NeighborhoodBuffer;
+  mutable std::vector<double> m_WeightsBuffer;
+
+  /** The neighborhood packed for the Parzen window sums. */
+  mutable ParticleGaussianKernelBatch<VDimension> m_KernelBatch;
 };
 
 
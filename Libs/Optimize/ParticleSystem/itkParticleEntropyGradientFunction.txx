@@ -67,83 +67,17 @@ ParticleEntropyGradientFunction<TGradientNumericType, VDimension>
                 int &err) const
 {
   const double epsilon = 1.0e-5;
-  const double min_sigma = 1.0e-4;
-  
-  const double M = static_cast<double>(VDimension);
-  const double MM = M * M * 2.0 + M;
-  
-  double error = 1.0e6;
-  double sigma, prev_sigma;
-  sigma = initial_sigma;
-  
-  while (error > precision)
+
+  m_KernelBatch.Clear();
+  for (unsigned int i = 0; i < neighborhood.size(); i++)
     {
-    VectorType r_vec;
-    double A = 0.0;
-    double B = 0.0;
-    double C = 0.0;
-    double sigma2 = sigma * sigma;
-    double sigma22 = sigma2 * 2.0;
-    
-    for (unsigned int i = 0; i < neighborhood.size(); i++)
-      {
-      if (weights[i] < epsilon) continue;
-      
-      //    if ( neighborhood[i].Index == idx) continue;
-      for (unsigned int n = 0; n < VDimension; n++)
-        {
-        r_vec[n] = pos[n] - neighborhood[i].Point[n];
-        }
-      
-      double r = r_vec.magnitude();
-      double r2 = r*r;
-      double alpha = exp(-r2 / sigma22) * weights[i];
-      A += alpha;
-      B += r2 * alpha;
-      C += r2 * r2 * alpha;
-      } // end for i
+    //    if ( neighborhood[i].Index == idx) continue;
+    m_KernelBatch.Push(pos, neighborhood[i].Point, weights[i]);
+    }
 
-    prev_sigma = sigma;
-    
-    if (A < epsilon)
-      {
-      err = 1;
-      return sigma;
-      }; // results are not meaningful
-    
-    // First order convergence update.  This is a fixed point iteration.
-    //sigma = sqrt(( 1.0 / DIM ) * ( B / A));
-    
-    // Second order convergence update (Newton-Raphson).  This is the first
-    // derivative of the negative of the probability density estimation function squared over the
-    // second derivative.
-    
-    // old math
-    //    sigma -= (sigma2 * VDimension * A * A - A  * B) / (((2.0 * sigma * VDimension) * A * A -
-    //                                          (1.0/(sigma2*sigma))*(A*C-B*B)) + epsilon);
-    
-    // New math -- results are not obviously different? 
-    sigma -= (A * (B - A * sigma2 * M)) /
-      ( (-MM * A *A * sigma) - 3.0 * A * B * (1.0 / (sigma + epsilon))
-        - (A*C + B*B) * (1.0 / (sigma2 * sigma + epsilon)) + epsilon);
-    
-    error = 1.0 - fabs((sigma/prev_sigma));
-    
-    // Constrain sigma.
-    if (sigma < min_sigma)
-      {
-      sigma = min_sigma;
-      error = precision; // we are done if sigma has vanished
-      }
-    else
-      {
-      if (sigma < 0.0) sigma = min_sigma;
-      }
-    
-    } // end while (error > precision)
-  
-  err = 0;
-  return sigma;
+  // The Newton-Raphson iteration on the Parzen window moments, skipping the
+  // neighbors with weights < epsilon.
+  return m_KernelBatch.EstimateSigma(initial_sigma, precision, epsilon, err);
   
 } // end estimate sigma
 
@@ -179,11 +113,11 @@ ParticleEntropyGradientFunction<TGradientNumericType, VDimension>
   PointType pos = system->GetPosition(idx, d);
   
   // Get the neighborhood surrounding the point "pos".
-  typename ParticleSystemType::PointVectorType neighborhood
-    = system->FindNeighborhoodPoints(pos, neighborhood_radius, d);
+  typename ParticleSystemType::PointVectorType &neighborhood = m_NeighborhoodBuffer;
+  system->FindNeighborhoodPoints(pos, neighborhood_radius, neighborhood, d);
   
   // Compute the weights based on angle between the neighbors and the center.
-  std::vector<double> weights;
+  std::vector<double> &weights = m_WeightsBuffer;
   this->ComputeAngularWeights(pos,neighborhood,domain,weights);
   
   // Estimate the best sigma for Parzen windowing.  In some cases, such as when
@@ -209,7 +143,7 @@ ParticleEntropyGradientFunction<TGradientNumericType, VDimension>
       sigma = neighborhood_radius / this->GetNeighborhoodToSigmaRatio();
       }
     
-    neighborhood = system->FindNeighborhoodPoints(pos, neighborhood_radius, d);
+    system->FindNeighborhoodPoints(pos, neighborhood_radius, neighborhood, d);
     this->ComputeAngularWeights(pos,neighborhood,domain,weights);
     sigma = this->EstimateSigma(idx, neighborhood, weights, pos, sigma, epsilon, err);
     } // done while err
@@ -220,7 +154,7 @@ ParticleEntropyGradientFunction<TGradientNumericType, VDimension>
     {
     sigma = this->GetMaximumNeighborhoodRadius() / this->GetNeighborhoodToSigmaRatio();
     neighborhood_radius = this->GetMaximumNeighborhoodRadius();
-    neighborhood = system->FindNeighborhoodPoints(pos, neighborhood_radius, d);
+    system->FindNeighborhoodPoints(pos, neighborhood_radius, neighborhood, d);
     this->ComputeAngularWeights(pos,neighborhood,domain,weights);
     }
 
@@ -236,35 +170,19 @@ ParticleEntropyGradientFunction<TGradientNumericType, VDimension>
    // Compute the gradients.
    double sigma2inv = 1.0 / (2.0* sigma * sigma + epsilon);
 
-   VectorType r;
    VectorType gradE;
 
-   for (unsigned int n = 0; n < VDimension; n++)
-     {
-     gradE[n] = 0.0;
-     }
-   
-   double A = 0.0;
+   // Note that the Neighborhood object has already filtered the
+   // neighborhood for points whose normals differ by > 90 degrees.
+   m_KernelBatch.Clear();
    for (unsigned int i = 0; i < neighborhood.size(); i++)
      {
      //    if ( neighborhood[i].Index == idx) continue;
-     if (weights[i] < epsilon) continue;
-     
-     for (unsigned int n = 0; n < VDimension; n++)
-       {
-       // Note that the Neighborhood object has already filtered the
-       // neighborhood for points whose normals differ by > 90 degrees.
-       r[n] = pos[n] - neighborhood[i].Point[n];
-       }
-     
-     double q = exp( -dot_product(r, r) * sigma2inv);
-     A += q;
-
-     for (unsigned int n = 0; n < VDimension; n++)
-       {
-       gradE[n] += weights[i] * r[n] * q;
-       }
+     m_KernelBatch.Push(pos, neighborhood[i].Point, weights[i]);
      }
+
+   double A;
+   m_KernelBatch.Gradient(sigma2inv, epsilon, A, gradE.data_block());
    
    double p = 0.0;
    if (A > epsilon)
@@ -0,0 +1,134 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleGaussianKernelBatch.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleGaussianKernelBatch_h
+#define __itkParticleGaussianKernelBatch_h
+
+#include <cstddef>
+#include <vector>
+
+namespace itk
+{
+/** \class ParticleGaussianKernelBatch
+ *
+ * The Parzen window sums of the entropy gradient functions over one particle
+ * neighborhood.  The neighbors are packed once into structure of arrays
+ * storage (the differences to the center scaled by kappa, the weights and
+ * the kappas), and the sums for the sigma estimation, its Newton iteration
+ * and the gradient are evaluated over the packed arrays instead of over the
+ * neighborhood points.
+ *
+ * There are two modes.  Reference evaluates the sums in the same order and
+ * with the same operations as the original per-neighbor loops, so it gives
+ * bitwise the same results, and is kept for validation.  Vectorized
+ * evaluates the sums in fixed blocks of Lanes neighbors that the compiler
+ * can map to SIMD registers, with a polynomial exp (about one ulp in double)
+ * and the divisions by sigma replaced by multiplications with reciprocals.
+ * The blocks are summed in a fixed order, so its results do not depend on
+ * the number of threads.  They can depend on the compiler flags: with FMA
+ * enabled (-mfma, -march=native) the compiler may contract the multiply-adds
+ * of the polynomial and the sums into fused operations, which round
+ * differently.
+ *
+ * Each thread uses its own clone of the gradient function, and so its own
+ * batch.
+ */
+template <unsigned int VDimension>
+class ParticleGaussianKernelBatch
+{
+public:
+  enum { Reference = 0, Vectorized = 1 };
+
+  /** Number of neighbors evaluated together in the vectorized mode. */
+  enum { Lanes = 4 };
+
+  ParticleGaussianKernelBatch() : m_Mode(Reference), m_Size(0) {}
+
+  void SetMode(int mode)
+  { m_Mode = mode; }
+  int GetMode() const
+  { return m_Mode; }
+
+  /** Start a new neighborhood. */
+  void Clear()
+  { m_Size = 0; }
+
+  /** Add a neighbor at position neighbor of the particle at pos, with its
+      weight and kappa.  The difference pos - neighbor is scaled by kappa. */
+  template <class TPoint>
+  void Push(const TPoint &pos, const TPoint &neighbor, double weight, double kappa = 1.0)
+  {
+    if (m_Size % Lanes == 0)
+      {
+      this->AddBlock();
+      }
+    for (unsigned int n = 0; n < VDimension; n++)
+      {
+      m_R[n][m_Size] = (pos[n] - neighbor[n]) * kappa;
+      }
+    m_Weight[m_Size] = weight;
+    m_Kappa[m_Size] = kappa;
+    m_Size++;
+  }
+
+  std::size_t Size() const
+  { return m_Size; }
+
+  /** The moments of the Parzen window for the sigma estimation, over the
+      neighbors with a weight of at least minWeight:
+      A = sum w exp(-r^2 / 2 sigma^2), B = sum r^2 (...), C = sum r^4 (...). */
+  void SigmaMoments(double sigma, double minWeight, double &A, double &B, double &C) const;
+
+  /** Newton-Raphson estimation of the sigma that maximizes the probability
+      at the center, as in ParticleEntropyGradientFunction::EstimateSigma.
+      If avgKappa is given it receives the average kappa of the neighbors
+      (over kappaCount), updated each iteration as the curvature based
+      functions do.  err is 1 if there are too few neighbors for a
+      meaningful estimate. */
+  double EstimateSigma(double initial_sigma, double precision, double minWeight, int &err,
+                       double *avgKappa = 0, std::size_t kappaCount = 0) const;
+
+  /** The gradient sums over the neighbors with a weight of at least
+      minWeight: A = sum q, grad = sum w r q, q = kappa exp(-r^2 sigma2inv). */
+  void Gradient(double sigma2inv, double minWeight, double &A, double *grad) const;
+
+  /** exp(x) for x < 709 to about one ulp, without branches so that it can
+      be vectorized.  Values below exp(-708) are flushed to zero. */
+  static inline double Exp(double x);
+
+protected:
+  void AddBlock();
+  void ReferenceMoments(double sigma, double minWeight, double &A, double &B, double &C) const;
+  void VectorizedMoments(double sigma, double minWeight, double &A, double &B, double &C) const;
+  double KappaSum(double minWeight) const;
+
+  int m_Mode;
+  std::size_t m_Size;
+
+  // The packed neighbors, padded with zeros to a multiple of Lanes.
+  std::vector<double> m_R[VDimension];
+  std::vector<double> m_Weight;
+  std::vector<double> m_Kappa;
+};
+
+} // end namespace itk
+
+#if ITK_TEMPLATE_EXPLICIT
+# include "Templates/itkParticleGaussianKernelBatch+-.h"
+#endif
+
+#if ITK_TEMPLATE_TXX
+# include "itkParticleGaussianKernelBatch.txx"
+#endif
+
+#include "itkParticleGaussianKernelBatch.txx"
+
+#endif
@@ -0,0 +1,354 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleGaussianKernelBatch.txx,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleGaussianKernelBatch_txx
+#define __itkParticleGaussianKernelBatch_txx
+
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+namespace itk
+{
+
+template <unsigned int VDimension>
+inline double
+ParticleGaussianKernelBatch<VDimension>
+::Exp(double x)
+{
+  // exp(x) = 2^k exp(r), with k the nearest integer to x / ln 2 and
+  // |r| <= ln 2 / 2, where the Taylor polynomial of degree 13 is exact to
+  // about 4e-18.  Adding 1.5 * 2^52 rounds x / ln 2 to an integer that ends
+  // up in the low bits of the mantissa, from which 2^k is assembled.
+  const double shift = 6755399441055744.0;
+  const double flush = x < -708.0 ? 0.0 : 1.0;
+  x = x < -708.0 ? -708.0 : x;
+
+  const double t = x * 1.4426950408889634 + shift;
+  const double k = t - shift;
+  double r = x - k * 6.93147180369123816490e-01;
+  r = r - k * 1.90821492927058770002e-10;
+
+  double p = 1.0 / 6227020800.0;
+  p = p * r + 1.0 / 479001600.0;
+  p = p * r + 1.0 / 39916800.0;
+  p = p * r + 1.0 / 3628800.0;
+  p = p * r + 1.0 / 362880.0;
+  p = p * r + 1.0 / 40320.0;
+  p = p * r + 1.0 / 5040.0;
+  p = p * r + 1.0 / 720.0;
+  p = p * r + 1.0 / 120.0;
+  p = p * r + 1.0 / 24.0;
+  p = p * r + 1.0 / 6.0;
+  p = p * r + 0.5;
+  p = p * r + 1.0;
+  p = p * r + 1.0;
+
+  int64_t bits;
+  std::memcpy(&bits, &t, sizeof(bits));
+  bits = (bits - 0x4338000000000000LL + 1023) << 52;
+  double scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+
+  return p * scale * flush;
+}
+
+template <unsigned int VDimension>
+void
+ParticleGaussianKernelBatch<VDimension>
+::AddBlock()
+{
+  const std::size_t end = m_Size + Lanes;
+  if (m_Weight.size() < end)
+    {
+    for (unsigned int n = 0; n < VDimension; n++)
+      {
+      m_R[n].resize(end);
+      }
+    m_Weight.resize(end);
+    m_Kappa.resize(end);
+    }
+
+  // the padding of the last block must not contribute to the sums
+  for (std::size_t i = m_Size; i < end; i++)
+    {
+    for (unsigned int n = 0; n < VDimension; n++)
+      {
+      m_R[n][i] = 0.0;
+      }
+    m_Weight[i] = 0.0;
+    m_Kappa[i] = 0.0;
+    }
+}
+
+template <unsigned int VDimension>
+void
+ParticleGaussianKernelBatch<VDimension>
+::SigmaMoments(double sigma, double minWeight, double &A, double &B, double &C) const
+{
+  if (m_Mode == Reference)
+    {
+    this->ReferenceMoments(sigma, minWeight, A, B, C);
+    }
+  else
+    {
+    this->VectorizedMoments(sigma, minWeight, A, B, C);
+    }
+}
+
+template <unsigned int VDimension>
+void
+ParticleGaussianKernelBatch<VDimension>
+::ReferenceMoments(double sigma, double minWeight, double &A, double &B, double &C) const
+{
+  A = 0.0;
+  B = 0.0;
+  C = 0.0;
+  double sigma2 = sigma * sigma;
+  double sigma22 = sigma2 * 2.0;
+
+  for (std::size_t i = 0; i < m_Size; i++)
+    {
+    if (m_Weight[i] < minWeight) continue;
+
+    // as r_vec.magnitude() squared
+    double rr = 0.0;
+    for (unsigned int n = 0; n < VDimension; n++)
+      {
+      rr += m_R[n][i] * m_R[n][i];
+      }
+    double r = sqrt(rr);
+    double r2 = r*r;
+    double alpha = exp(-r2 / sigma22) * m_Weight[i];
+    A += alpha;
+    B += r2 * alpha;
+    C += r2 * r2 * alpha;
+    }
+}
+
+template <unsigned int VDimension>
+void
+ParticleGaussianKernelBatch<VDimension>
+::VectorizedMoments(double sigma, double minWeight, double &A, double &B, double &C) const
+{
+  const double scale = -1.0 / (sigma * sigma * 2.0);
+  const std::size_t size = (m_Size + Lanes - 1) / Lanes * Lanes;
+  const double *w = m_Weight.empty() ? 0 : &m_Weight[0];
+  const double *R[VDimension];
+  for (unsigned int n = 0; n < VDimension; n++)
+    {
+    R[n] = m_R[n].empty() ? 0 : &m_R[n][0];
+    }
+
+  double a[Lanes], b[Lanes], c[Lanes];
+  for (unsigned int l = 0; l < Lanes; l++)
+    {
+    a[l] = b[l] = c[l] = 0.0;
+    }
+
+  for (std::size_t i = 0; i < size; i += Lanes)
+    {
+    for (unsigned int l = 0; l < Lanes; l++)
+      {
+      double r2 = 0.0;
+      for (unsigned int n = 0; n < VDimension; n++)
+        {
+        r2 += R[n][i + l] * R[n][i + l];
+        }
+      double weight = w[i + l] < minWeight ? 0.0 : w[i + l];
+      double alpha = Exp(r2 * scale) * weight;
+      a[l] += alpha;
+      b[l] += r2 * alpha;
+      c[l] += r2 * r2 * alpha;
+      }
+    }
+
+  A = (a[0] + a[1]) + (a[2] + a[3]);
+  B = (b[0] + b[1]) + (b[2] + b[3]);
+  C = (c[0] + c[1]) + (c[2] + c[3]);
+}
+
+template <unsigned int VDimension>
+double
+ParticleGaussianKernelBatch<VDimension>
+::KappaSum(double minWeight) const
+{
+  double sum = 0.0;
+  for (std::size_t i = 0; i < m_Size; i++)
+    {
+    if (m_Weight[i] < minWeight) continue;
+    sum += m_Kappa[i];
+    }
+  return sum;
+}
+
+template <unsigned int VDimension>
+double
+ParticleGaussianKernelBatch<VDimension>
+::EstimateSigma(double initial_sigma, double precision, double minWeight, int &err,
+                double *avgKappa, std::size_t kappaCount) const
+{
+  const double epsilon = 1.0e-5;
+  const double min_sigma = 1.0e-4;
+
+  const double M = static_cast<double>(VDimension);
+  const double MM = M * M * 2.0 + M;
+
+  double error = 1.0e6;
+  double sigma, prev_sigma;
+  sigma = initial_sigma;
+
+  // The kappas do not change between iterations.  The reference mode still
+  // adds them one by one each iteration, as the original loops did.
+  double kappaSum = 0.0;
+  if (avgKappa)
+    {
+    *avgKappa = 0.0;
+    if (m_Mode != Reference) kappaSum = this->KappaSum(minWeight);
+    }
+
+  while (error > precision)
+    {
+    double A, B, C;
+    double sigma2 = sigma * sigma;
+    this->SigmaMoments(sigma, minWeight, A, B, C);
+
+    if (avgKappa)
+      {
+      if (m_Mode == Reference)
+        {
+        for (std::size_t i = 0; i < m_Size; i++)
+          {
+          if (m_Weight[i] < minWeight) continue;
+          *avgKappa += m_Kappa[i];
+          }
+        }
+      else
+        {
+        *avgKappa += kappaSum;
+        }
+      *avgKappa /= static_cast<double>(kappaCount);
+      }
+
+    prev_sigma = sigma;
+
+    if (A < epsilon)
+      {
+      err = 1;
+      if (avgKappa) *avgKappa = 1.0;
+      return sigma;
+      }; // results are not meaningful
+
+    // Second order convergence update (Newton-Raphson).  This is the first
+    // derivative of the negative of the probability density estimation
+    // function squared over the second derivative.
+    sigma -= (A * (B - A * sigma2 * M)) /
+      ( (-MM * A *A * sigma) - 3.0 * A * B * (1.0 / (sigma + epsilon))
+        - (A*C + B*B) * (1.0 / (sigma2 * sigma + epsilon)) + epsilon);
+
+    error = 1.0 - fabs((sigma/prev_sigma));
+
+    // Constrain sigma.
+    if (sigma < min_sigma)
+      {
+      sigma = min_sigma;
+      error = precision; // we are done if sigma has vanished
+      }
+    else
+      {
+      if (sigma < 0.0) sigma = min_sigma;
+      }
+    }
+
+  err = 0;
+  return sigma;
+}
+
+template <unsigned int VDimension>
+void
+ParticleGaussianKernelBatch<VDimension>
+::Gradient(double sigma2inv, double minWeight, double &A, double *grad) const
+{
+  A = 0.0;
+  for (unsigned int n = 0; n < VDimension; n++)
+    {
+    grad[n] = 0.0;
+    }
+
+  if (m_Mode == Reference)
+    {
+    for (std::size_t i = 0; i < m_Size; i++)
+      {
+      if (m_Weight[i] < minWeight) continue;
+
+      // as dot_product(r, r)
+      double rr = 0.0;
+      for (unsigned int n = 0; n < VDimension; n++)
+        {
+        rr += m_R[n][i] * m_R[n][i];
+        }
+      double q = m_Kappa[i] * exp( -rr * sigma2inv);
+      A += q;
+      for (unsigned int n = 0; n < VDimension; n++)
+        {
+        grad[n] += m_Weight[i] * m_R[n][i] * q;
+        }
+      }
+    return;
+    }
+
+  const std::size_t size = (m_Size + Lanes - 1) / Lanes * Lanes;
+  const double *w = m_Weight.empty() ? 0 : &m_Weight[0];
+  const double *kappa = m_Kappa.empty() ? 0 : &m_Kappa[0];
+  const double *R[VDimension];
+  for (unsigned int n = 0; n < VDimension; n++)
+    {
+    R[n] = m_R[n].empty() ? 0 : &m_R[n][0];
+    }
+
+  double a[Lanes], g[VDimension][Lanes];
+  for (unsigned int l = 0; l < Lanes; l++)
+    {
+    a[l] = 0.0;
+    for (unsigned int n = 0; n < VDimension; n++)
+      {
+      g[n][l] = 0.0;
+      }
+    }
+
+  for (std::size_t i = 0; i < size; i += Lanes)
+    {
+    for (unsigned int l = 0; l < Lanes; l++)
+      {
+      double r2 = 0.0;
+      for (unsigned int n = 0; n < VDimension; n++)
+        {
+        r2 += R[n][i + l] * R[n][i + l];
+        }
+      double q = w[i + l] < minWeight ? 0.0 : kappa[i + l] * Exp(-r2 * sigma2inv);
+      a[l] += q;
+      for (unsigned int n = 0; n < VDimension; n++)
+        {
+        g[n][l] += w[i + l] * R[n][i + l] * q;
+        }
+      }
+    }
+
+  A = (a[0] + a[1]) + (a[2] + a[3]);
+  for (unsigned int n = 0; n < VDimension; n++)
+    {
+    grad[n] = (g[n][0] + g[n][1]) + (g[n][2] + g[n][3]);
+    }
+}
+
+} // end namespace itk
+
+#endif
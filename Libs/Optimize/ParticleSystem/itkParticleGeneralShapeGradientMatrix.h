@@ -6,6 +6,7 @@
 #include "itkWeakPointer.h"
 #include "itkParticleContainer.h"
 #include "vnl/vnl_matrix.h"
+#include "itkParticleEigenMatrixView.h"
 
 #include "itkParticleImplicitSurfaceDomain.h"
 #include "itkParticleImageDomainWithGradients.h"
@@ -81,17 +82,8 @@ public:
 
     virtual void ResizeMatrix(int rs, int cs)
     {
-        vnl_matrix<T> tmp(*this); // copy existing  matrix
-
-        // Create new column (shape)
-        this->set_size(rs, cs);
-
-        // Copy old data into new matrix.
-        for (unsigned int c = 0; c < tmp.cols(); c++)
-        {
-            for (unsigned int r = 0; r < tmp.rows(); r++)
-                this->operator()(r,c) = tmp(r,c);
-        }
+        // Keep old data; new rows and columns are zero.
+        ResizeVnlMatrixPreserve<T>(*this, rs, cs);
     }
 
     void SetValues(const ParticleSystemType *ps, int idx, int d)
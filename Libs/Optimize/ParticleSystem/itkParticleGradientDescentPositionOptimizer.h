@@ -78,17 +78,29 @@ public:
   /** Start the optimization. */
   void StartOptimization()
   {
+    this->InitializeGradientFunctionPool();
     if (m_OptimizationMode == 0) { this->StartJacobiOptimization(); }
     else if (m_OptimizationMode == 2) { this->StartAdaptiveGaussSeidelOptimization();}
+    else if (m_OptimizationMode == 3) { this->StartParallelAdaptiveJacobiOptimization();}
     else { this->StartGaussSeidelOptimization(); }
   }
   void StartJacobiOptimization();
   void StartGaussSeidelOptimization();
   void StartAdaptiveGaussSeidelOptimization();
 
+  /** Adaptive time step optimization that evaluates every particle of every
+      domain in parallel against the positions of the previous iteration, then
+      applies all moves at once (Jacobi updates).  Each particle's time step
+      grows when its previous move lowered its energy and shrinks otherwise.
+      Unlike StartAdaptiveGaussSeidelOptimization, the work is distributed
+      over particles rather than domains, so runs with few domains scale with
+      the number of cores.  Results do not depend on the thread count. */
+  void StartParallelAdaptiveJacobiOptimization();
+
   /** */
   void SetModeToGaussSeidel() { this->m_OptimizationMode = 1; }
   void SetModeToAdaptiveGaussSeidel() { this->m_OptimizationMode = 2; }
+  void SetModeToParallelAdaptiveJacobi() { this->m_OptimizationMode = 3; }
   void SetModeToJacobi() { this->m_OptimizationMode = 0; }
 
   /** Stop the optimization.  This method sets a flag that aborts the
@@ -132,6 +144,25 @@ public:
   /** Get/Set the gradient function used by this optimizer. */
   itkGetObjectMacro(GradientFunction, GradientFunctionType);
   itkSetObjectMacro(GradientFunction, GradientFunctionType);
+
+  /** State of the adaptive time step solvers: the time step of every
+      particle, the bounds on the time steps of each domain and, for
+      ParallelAdaptiveJacobi, the energy of every particle at the previous
+      iteration. */
+  struct TimeStepState
+  {
+    std::vector< std::vector<double> > TimeSteps;
+    std::vector< std::vector<double> > PreviousEnergies;
+    std::vector<double> MaximumTimeSteps;
+    std::vector<double> MinimumTimeSteps;
+  };
+
+  /** Get/Set the adaptive time step state.  Every StartOptimization normally
+      restarts all time steps at 1.0.  After SetTimeStepState, the next start
+      continues from the given state instead, provided it matches the number
+      of particles in each domain.  Used to resume a run exactly. */
+  TimeStepState GetTimeStepState() const;
+  void SetTimeStepState(const TimeStepState &state);
   
 protected:
   ParticleGradientDescentPositionOptimizer();
@@ -143,6 +174,27 @@ protected:
   }
   virtual ~ParticleGradientDescentPositionOptimizer() {};
 
+  /** Create one clone of the gradient function per OpenMP thread.  The clones
+      persist across iterations and are re-bound to a domain with
+      SetDomainNumber, so the threaded solvers do not allocate a new gradient
+      function for every domain on every iteration. */
+  void InitializeGradientFunctionPool();
+
+  /** Copy the current state of m_GradientFunction into the per-thread clones.
+      Called once per iteration after BeforeIteration.  A clone is only
+      reallocated if it cannot be updated in place (e.g. the gradient function
+      was replaced); these allocations are added to
+      m_GradientFunctionAllocations, which counts the clones made since
+      InitializeGradientFunctionPool, the initial ones included. */
+  void RefreshGradientFunctionPool();
+
+  /** Returns the gradient function to be used by the calling thread. */
+  GradientFunctionType *GetThreadGradientFunction();
+
+  /** True, once, if a state given to SetTimeStepState matches the particle
+      system, in which case the solver keeps it instead of resetting. */
+  bool ResumeTimeStepState();
+
 private:
   typename ParticleSystemType::Pointer m_ParticleSystem;
   typename GradientFunctionType::Pointer m_GradientFunction;
@@ -154,6 +206,12 @@ private:
   double m_TimeStep;
   int m_OptimizationMode;
   std::vector< std::vector<double> > m_TimeSteps;
+  std::vector< std::vector<double> > m_PreviousEnergies;
+  std::vector<double> m_MaximumTimeSteps;
+  std::vector<double> m_MinimumTimeSteps;
+  bool m_ResumeTimeSteps = false;
+  std::vector< typename GradientFunctionType::Pointer > m_GradientFunctionPool;
+  unsigned int m_GradientFunctionAllocations;
   unsigned int m_verbosity;
 };
 
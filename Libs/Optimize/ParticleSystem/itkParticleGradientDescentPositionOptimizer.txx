@@ -23,6 +23,7 @@ const int global_iteration = 1;
 #endif /* SW_USE_OPENMP */
 
 #include <algorithm>
+#include <limits>
 #include <ctime>
 #include <time.h>
 #include <string>
@@ -30,6 +31,7 @@ const int global_iteration = 1;
 #include <vector>
 #include <fstream>
 #include <sstream>
+#include <typeinfo>
 namespace itk
 {
 template <class TGradientNumericType, unsigned int VDimension>
@@ -42,6 +44,102 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
     m_Tolerance = 0.0;
     m_TimeStep = 1.0;
     m_OptimizationMode = 0;
+    m_GradientFunctionAllocations = 0;
+}
+
+template <class TGradientNumericType, unsigned int VDimension>
+void
+ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
+::InitializeGradientFunctionPool()
+{
+    m_GradientFunctionPool.clear();
+    m_GradientFunctionAllocations = 0;
+#ifdef SW_USE_OPENMP
+    const int num_threads = omp_get_max_threads();
+    for (int i = 0; i < num_threads; i++)
+    {
+        m_GradientFunctionPool.push_back(m_GradientFunction->Clone());
+        m_GradientFunctionAllocations++;
+    }
+#endif /* SW_USE_OPENMP */
+}
+
+template <class TGradientNumericType, unsigned int VDimension>
+void
+ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
+::RefreshGradientFunctionPool()
+{
+    for (unsigned int i = 0; i < m_GradientFunctionPool.size(); i++)
+    {
+        typename GradientFunctionType::Pointer &clone = m_GradientFunctionPool[i];
+        if (!clone || typeid(*clone.GetPointer()) != typeid(*m_GradientFunction.GetPointer())
+                || !m_GradientFunction->UpdateClone(clone))
+        {
+            clone = m_GradientFunction->Clone();
+            m_GradientFunctionAllocations++;
+        }
+    }
+}
+
+template <class TGradientNumericType, unsigned int VDimension>
+typename ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>::GradientFunctionType *
+ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
+::GetThreadGradientFunction()
+{
+#ifdef SW_USE_OPENMP
+    const unsigned int tid = omp_get_thread_num();
+    if (tid < m_GradientFunctionPool.size())
+    {
+        return m_GradientFunctionPool[tid];
+    }
+#endif /* SW_USE_OPENMP */
+    return m_GradientFunction;
+}
+
+template <class TGradientNumericType, unsigned int VDimension>
+typename ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>::TimeStepState
+ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
+::GetTimeStepState() const
+{
+    TimeStepState state;
+    state.TimeSteps = m_TimeSteps;
+    state.PreviousEnergies = m_PreviousEnergies;
+    state.MaximumTimeSteps = m_MaximumTimeSteps;
+    state.MinimumTimeSteps = m_MinimumTimeSteps;
+    return state;
+}
+
+template <class TGradientNumericType, unsigned int VDimension>
+void
+ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
+::SetTimeStepState(const TimeStepState &state)
+{
+    m_TimeSteps = state.TimeSteps;
+    m_PreviousEnergies = state.PreviousEnergies;
+    m_MaximumTimeSteps = state.MaximumTimeSteps;
+    m_MinimumTimeSteps = state.MinimumTimeSteps;
+    m_ResumeTimeSteps = true;
+}
+
+template <class TGradientNumericType, unsigned int VDimension>
+bool
+ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
+::ResumeTimeStepState()
+{
+    if (!m_ResumeTimeSteps) return false;
+    m_ResumeTimeSteps = false;
+
+    const unsigned int numdomains = m_ParticleSystem->GetNumberOfDomains();
+    if (m_TimeSteps.size() != numdomains || m_MaximumTimeSteps.size() != numdomains
+            || m_MinimumTimeSteps.size() != numdomains)
+    {
+        return false;
+    }
+    for (unsigned int dom = 0; dom < numdomains; dom++)
+    {
+        if (m_TimeSteps[dom].size() != m_ParticleSystem->GetPositions(dom)->GetSize()) return false;
+    }
+    return true;
 }
 
 /*** ADAPTIVE GAUSS SEIDEL ***/
@@ -64,16 +162,17 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
 
     typedef typename DomainType::VnlVectorType NormalType;
 
+    const bool resume = this->ResumeTimeStepState();
     bool reset = false;
     // Make sure the time step vector is the right size
-    while (m_TimeSteps.size() != m_ParticleSystem->GetNumberOfDomains() )
+    while (!resume && m_TimeSteps.size() != m_ParticleSystem->GetNumberOfDomains() )
     {
         reset = true;
         std::vector<double> tmp;
         m_TimeSteps.push_back( tmp );
     }
 
-    for (unsigned int i = 0; i < m_ParticleSystem->GetNumberOfDomains(); i++)
+    for (unsigned int i = 0; !resume && i < m_ParticleSystem->GetNumberOfDomains(); i++)
     {
         unsigned int np = m_ParticleSystem->GetPositions(i)->GetSize();
         if (m_TimeSteps[i].size() != np)
@@ -91,16 +190,15 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
     const double pi = std::acos(-1.0);
     unsigned int numdomains = m_ParticleSystem->GetNumberOfDomains();
     std::vector<double> meantime(numdomains);
-    std::vector<double> maxtime(numdomains);
-    std::vector<double> mintime(numdomains);
+    std::vector<double> &maxtime = m_MaximumTimeSteps;
+    std::vector<double> &mintime = m_MinimumTimeSteps;
 
     unsigned int counter = 0;
 
-    for (unsigned int q = 0; q < numdomains; q++)
+    if (!resume)
     {
-        meantime[q] = 0.0;
-        maxtime[q]  = 1.0e30;
-        mintime[q]  = 1.0;
+        maxtime.assign(numdomains, 1.0e30);
+        mintime.assign(numdomains, 1.0);
     }
     time_t timerBefore, timerAfter;
 
@@ -112,6 +210,7 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
         if (counter % global_iteration == 0)
             m_GradientFunction->BeforeIteration();
         counter++;
+        this->RefreshGradientFunctionPool();
 
 #pragma omp parallel
         {
@@ -139,14 +238,7 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
 
                     const DomainType * domain = static_cast<const DomainType *>(m_ParticleSystem->GetDomain(dom));
 
-                    typename GradientFunctionType::Pointer localGradientFunction;
-
-                    localGradientFunction = m_GradientFunction;
-
-#ifdef SW_USE_OPENMP
-                    localGradientFunction = m_GradientFunction->Clone();
-#endif /* SW_USE_OPENMP */
-
+                    GradientFunctionType *localGradientFunction = this->GetThreadGradientFunction();
 
                     // Tell function which domain we are working on.
                     localGradientFunction->SetDomainNumber(dom);
@@ -250,6 +342,10 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
         if (m_verbosity > 2)
         {
             std::cout << m_NumberOfIterations << ". " << seconds << " seconds.. ";
+            if (!m_GradientFunctionPool.empty())
+            {
+                std::cout << m_GradientFunctionAllocations << " gradient function allocations.. ";
+            }
             std::cout.flush();
         }
 
@@ -268,6 +364,217 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
     } // end while stop optimization
 }
 
+/*** PARALLEL ADAPTIVE JACOBI ***/
+template <class TGradientNumericType, unsigned int VDimension>
+void
+ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
+::StartParallelAdaptiveJacobiOptimization()
+{
+  if (this->m_AbortProcessing) {
+    return;
+  }
+    const double factor = 1.1;
+
+    // NOTE: THIS METHOD WILL NOT WORK AS WRITTEN IF PARTICLES ARE
+    // ADDED TO THE SYSTEM DURING OPTIMIZATION.
+    m_StopOptimization = false;
+
+    typedef typename DomainType::VnlVectorType NormalType;
+
+    // Flatten every (domain, particle) pair into a single work list.  The
+    // gradient evaluation below is then distributed over particles instead of
+    // over domains, so a run with only a few domains still uses every core.
+    struct WorkItem
+    {
+        unsigned int dom;
+        unsigned int idx;
+        unsigned int k;
+    };
+    std::vector<WorkItem> work;
+
+    const unsigned int numdomains = m_ParticleSystem->GetNumberOfDomains();
+    bool resume = this->ResumeTimeStepState() && m_PreviousEnergies.size() == numdomains;
+    for (unsigned int dom = 0; resume && dom < numdomains; dom++)
+    {
+        resume = m_PreviousEnergies[dom].size() == m_TimeSteps[dom].size();
+    }
+    if (!resume)
+    {
+        m_TimeSteps.resize(numdomains);
+        m_PreviousEnergies.resize(numdomains);
+        m_MaximumTimeSteps.assign(numdomains, 1.0e30);
+        m_MinimumTimeSteps.assign(numdomains, 1.0);
+    }
+    for (unsigned int dom = 0; dom < numdomains; dom++)
+    {
+        const unsigned int np = m_ParticleSystem->GetPositions(dom)->GetSize();
+        if (!resume)
+        {
+            m_TimeSteps[dom].assign(np, 1.0);
+            m_PreviousEnergies[dom].assign(np, std::numeric_limits<double>::max());
+        }
+
+        // skip any flagged domains
+        if (m_ParticleSystem->GetDomainFlag(dom) == true) continue;
+
+        unsigned int k = 0;
+        typename ParticleSystemType::PointContainerType::ConstIterator endit =
+                m_ParticleSystem->GetPositions(dom)->GetEnd();
+        for (typename ParticleSystemType::PointContainerType::ConstIterator it
+             = m_ParticleSystem->GetPositions(dom)->GetBegin(); it != endit; it++, k++)
+        {
+            WorkItem item = { dom, static_cast<unsigned int>(it.GetIndex()), k };
+            work.push_back(item);
+        }
+    }
+
+    std::vector<PointType> updates(work.size());
+    std::vector<double> &maxtime = m_MaximumTimeSteps;
+    std::vector<double> &mintime = m_MinimumTimeSteps;
+
+    time_t timerBefore, timerAfter;
+
+    while (m_StopOptimization == false) // iterations loop
+    {
+        m_GradientFunction->SetParticleSystem(m_ParticleSystem);
+        timerBefore = time(NULL);
+        m_GradientFunction->BeforeIteration();
+        this->RefreshGradientFunctionPool();
+
+        double maxchange = 0.0;
+
+        // Evaluate all particles against the positions from the previous
+        // iteration.  Nothing in the particle system is modified here; each
+        // particle only writes its own slot of the time step, energy and
+        // update arrays, so the result does not depend on the thread count.
+#pragma omp parallel
+        {
+            GradientFunctionType *localGradientFunction = this->GetThreadGradientFunction();
+
+            double localmaxchange = 0.0;
+
+#pragma omp for schedule(static)
+            for (int w = 0; w < static_cast<int>(work.size()); w++)
+            {
+                const unsigned int dom = work[w].dom;
+                const unsigned int idx = work[w].idx;
+                const unsigned int k = work[w].k;
+
+                const DomainType * domain = static_cast<const DomainType *>(m_ParticleSystem->GetDomain(dom));
+
+                // Tell function which domain we are working on.
+                localGradientFunction->SetDomainNumber(dom);
+
+                double maxdt = 0.0;
+                double energy = 0.0;
+                localGradientFunction->BeforeEvaluate(idx, dom, m_ParticleSystem);
+                VectorType original_gradient = localGradientFunction->Evaluate(idx, dom, m_ParticleSystem, maxdt, energy);
+
+                // Adapt the time step based on whether the move made in the
+                // previous iteration lowered this particle's energy.
+                double &timestep = m_TimeSteps[dom][k];
+                if (energy < m_PreviousEnergies[dom][k])
+                {
+                    timestep *= factor;
+                    if (timestep > maxtime[dom]) timestep = maxtime[dom];
+                }
+                else if (timestep > mintime[dom])
+                {
+                    timestep /= factor;
+                }
+                m_PreviousEnergies[dom][k] = energy;
+
+                const PointType pt = m_ParticleSystem->GetPosition(idx, dom);
+                NormalType ptNormal = domain->SampleNormalVnl(pt);
+
+                double dotPdt = original_gradient[0]*ptNormal[0] + original_gradient[1]*ptNormal[1] + original_gradient[2]*ptNormal[2];
+                VectorType gradient;
+                gradient[0] = original_gradient[0] - dotPdt*ptNormal[0];
+                gradient[1] = original_gradient[1] - dotPdt*ptNormal[1];
+                gradient[2] = original_gradient[2] - dotPdt*ptNormal[2];
+                gradient *= timestep;
+
+                domain->ApplyVectorConstraints(gradient, pt, maxdt);
+
+                // Never move further than the function allows; shrink the
+                // time step to match.
+                double gradmag = gradient.magnitude();
+                if (gradmag > maxdt)
+                {
+                    const double scale = maxdt / gradmag;
+                    gradient *= scale;
+                    timestep *= scale;
+                    gradmag = maxdt;
+                }
+                if (gradmag > localmaxchange) localmaxchange = gradmag;
+
+                PointType newpoint;
+                for (unsigned int i = 0; i < VDimension; i++)
+                {  newpoint[i] = pt[i] - gradient[i]; }
+                domain->ApplyConstraints(newpoint);
+
+                updates[w] = newpoint;
+            } // for each particle
+
+#pragma omp critical
+            {
+                if (localmaxchange > maxchange) maxchange = localmaxchange;
+            }
+        }
+
+        // Apply the moves.  Neighborhood structures and attribute observers are
+        // not safe to update concurrently, so this is done serially and in a
+        // fixed order.
+        for (unsigned int w = 0; w < work.size(); w++)
+        {
+            m_ParticleSystem->SetPosition(updates[w], work[w].idx, work[w].dom);
+        }
+
+        // Update the time step bounds for each domain from its mean time step.
+        for (unsigned int dom = 0; dom < numdomains; dom++)
+        {
+            if (m_ParticleSystem->GetDomainFlag(dom) == true || m_TimeSteps[dom].empty()) continue;
+
+            double meantime = 0.0;
+            for (unsigned int k = 0; k < m_TimeSteps[dom].size(); k++)
+            { meantime += m_TimeSteps[dom][k]; }
+            meantime /= static_cast<double>(m_TimeSteps[dom].size());
+
+            if (meantime < 1.0) meantime = 1.0;
+            maxtime[dom] = meantime + meantime * 0.2;
+            mintime[dom] = meantime - meantime * 0.1;
+        }
+
+        m_NumberOfIterations++;
+        m_GradientFunction->AfterIteration();
+
+        timerAfter = time(NULL);
+        double seconds = difftime(timerAfter, timerBefore);
+
+        if (m_verbosity > 2)
+        {
+            std::cout << m_NumberOfIterations << ". " << seconds << " seconds.. ";
+            if (!m_GradientFunctionPool.empty())
+            {
+                std::cout << m_GradientFunctionAllocations << " gradient function allocations.. ";
+            }
+            std::cout.flush();
+        }
+
+        this->InvokeEvent(itk::IterationEvent());
+
+        // Check for convergence.  Optimization is considered to have converged if
+        // max number of iterations is reached or maximum distance moved by any
+        // particle is less than the specified precision.
+        if ((m_NumberOfIterations >= m_MaximumNumberOfIterations)
+                || (m_Tolerance > 0.0 &&  maxchange <  m_Tolerance))
+        {
+            m_StopOptimization = true;
+        }
+
+    } // end while stop optimization
+}
+
 /*** GAUSS SEIDEL ***/
 template <class TGradientNumericType, unsigned int VDimension>
 void
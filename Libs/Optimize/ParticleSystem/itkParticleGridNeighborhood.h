@@ -0,0 +1,171 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleGridNeighborhood.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleGridNeighborhood_h
+#define __itkParticleGridNeighborhood_h
+
+#include "itkParticleNeighborhood.h"
+#include <vector>
+
+namespace itk
+{
+/** \class ParticleGridNeighborhood
+ *
+ * ParticleGridNeighborhood computes neighborhoods based on distance from a
+ * point, like ParticleRegionNeighborhood, but caches points in a uniform grid
+ * of cubic cells instead of a PowerOfTwoPointTree.  Cells are addressed
+ * through a spatial hash, so memory is proportional to the number of points
+ * rather than to the size of the domain.  Each hash bucket stores its points
+ * contiguously.  Moving a point to another cell is an O(1) swap-and-pop
+ * followed by an append.
+ *
+ * A query visits only the cells overlapped by the query sphere, so the cell
+ * size should be close to the typical neighborhood radius.  SetCellSize
+ * re-bins all points and is meant to be called between iterations as the
+ * particle spacing (sigma) changes.
+ */
+template <unsigned int VDimension=3>
+class ITK_EXPORT ParticleGridNeighborhood : public ParticleNeighborhood<VDimension>
+{
+public:
+  /** Standard class typedefs */
+  typedef ParticleGridNeighborhood Self;
+  typedef ParticleNeighborhood<VDimension> Superclass;
+  typedef SmartPointer<Self>  Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+  typedef WeakPointer<const Self>  ConstWeakPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(ParticleGridNeighborhood, ParticleNeighborhood);
+
+  /** Dimensionality of the domain of the particle system. */
+  itkStaticConstMacro(Dimension, unsigned int, VDimension);
+
+  /** Inherited typedefs from parent class. */
+  typedef typename Superclass::PointType PointType;
+  typedef typename Superclass::PointContainerType PointContainerType;
+  typedef typename Superclass::DomainType DomainType;
+  typedef typename Superclass::PointVectorType PointVectorType;
+
+  /** Compile a list of points that are within a specified radius of a given
+      point. */
+  virtual PointVectorType FindNeighborhoodPoints(const PointType &, double) const;
+  virtual unsigned int FindNeighborhoodPoints(const PointType &, double, PointVectorType &) const;
+  using Superclass::FindNeighborhoodPoints;
+
+  /** Override SetDomain so that an initial cell size can be chosen from the
+      extent of the domain. */
+  virtual void SetDomain(DomainType *p);
+
+  /** Set/Get the edge length of the grid cells.  Setting a cell size that
+      differs from the current one by more than a factor of two re-bins all
+      points; smaller changes are ignored so that repeated calls with a slowly
+      varying radius do not rebuild the grid every iteration. */
+  void SetCellSize(double);
+  itkGetConstMacro(CellSize, double);
+
+  void PrintSelf(std::ostream& os, Indent indent) const
+  {
+    os << indent << "m_CellSize = " << m_CellSize << std::endl;
+    os << indent << "m_NumberOfPoints = " << m_NumberOfPoints << std::endl;
+    os << indent << "Number of buckets = " << m_Buckets.size() << std::endl;
+    Superclass::PrintSelf(os, indent);
+  }
+
+  /**  For efficiency, itkNeighborhoods are not necessarily observers of
+      itkParticleSystem, but have specific methods invoked for various events.
+      AddPosition is called by itkParticleSystem when a particle location is
+      added.  SetPosition is called when a particle location is set.
+      RemovePosition is called when a particle location is removed.*/
+  virtual void AddPosition(const PointType &p, unsigned int idx, int threadId = 0);
+  virtual void SetPosition(const PointType &p, unsigned int idx, int threadId = 0);
+  virtual void RemovePosition(unsigned int idx, int threadId = 0);
+
+protected:
+  ParticleGridNeighborhood() : m_CellSize(1.0), m_NumberOfPoints(0)
+  {
+    m_Buckets.resize(MinimumNumberOfBuckets);
+  }
+  virtual ~ParticleGridNeighborhood() {};
+
+  /** Integer coordinates of a grid cell. */
+  struct CellType
+  {
+    long c[VDimension];
+    bool operator==(const CellType &o) const
+    {
+      for (unsigned int i = 0; i < VDimension; i++)
+        {
+        if (c[i] != o.c[i]) return false;
+        }
+      return true;
+    }
+    bool operator!=(const CellType &o) const
+    { return !(*this == o); }
+  };
+
+  /** A point cached in the grid, tagged with its cell so that points of
+      different cells that share a hash bucket can be told apart. */
+  struct GridEntry
+  {
+    ParticlePointIndexPair<VDimension> Pair;
+    CellType Cell;
+  };
+  typedef std::vector<GridEntry> BucketType;
+
+  /** Location of a point in m_Buckets, indexed by point index. */
+  struct SlotType
+  {
+    unsigned int Bucket;
+    unsigned int Position;
+    bool Valid;
+  };
+
+  static const unsigned int MinimumNumberOfBuckets = 64;
+
+  CellType ComputeCell(const PointType &) const;
+  unsigned int Hash(const CellType &) const;
+
+  /** Insert or remove an entry, keeping m_Slots consistent. */
+  void InsertEntry(const GridEntry &);
+  void RemoveEntry(unsigned int idx);
+
+  /** Re-bin all points into numberOfBuckets buckets using the current cell
+      size. */
+  void Rebuild(unsigned int numberOfBuckets);
+
+  std::vector<BucketType> m_Buckets;
+  std::vector<SlotType> m_Slots;
+  double m_CellSize;
+  unsigned int m_NumberOfPoints;
+
+private:
+  ParticleGridNeighborhood(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+};
+
+} // end namespace itk
+
+
+#if ITK_TEMPLATE_EXPLICIT
+# include "Templates/itkParticleGridNeighborhood+-.h"
+#endif
+
+#if ITK_TEMPLATE_TXX
+# include "itkParticleGridNeighborhood.txx"
+#endif
+
+#include "itkParticleGridNeighborhood.txx"
+
+#endif
@@ -0,0 +1,294 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleGridNeighborhood.txx,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleGridNeighborhood_txx
+#define __itkParticleGridNeighborhood_txx
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>::SetDomain(DomainType *d)
+{
+  Superclass::SetDomain(d);
+
+  // Start with a coarse grid.  The cell size is refined with SetCellSize once
+  // the particle spacing is known.
+  double extent = 0.0;
+  for (unsigned int i = 0; i < VDimension; i++)
+    {
+    extent = std::max(extent, d->GetUpperBound()[i] - d->GetLowerBound()[i]);
+    }
+  if (extent > 0.0)
+    {
+    m_CellSize = extent / 16.0;
+    this->Rebuild(m_Buckets.size());
+    }
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>::SetCellSize(double s)
+{
+  if (s <= 0.0) return;
+
+  const double ratio = s / m_CellSize;
+  if (ratio > 0.5 && ratio < 2.0) return;
+
+  m_CellSize = s;
+  this->Rebuild(m_Buckets.size());
+}
+
+template <unsigned int VDimension>
+typename ParticleGridNeighborhood<VDimension>::CellType
+ParticleGridNeighborhood<VDimension>::ComputeCell(const PointType &p) const
+{
+  CellType cell;
+  for (unsigned int i = 0; i < VDimension; i++)
+    {
+    cell.c[i] = static_cast<long>(std::floor(p[i] / m_CellSize));
+    }
+  return cell;
+}
+
+template <unsigned int VDimension>
+unsigned int
+ParticleGridNeighborhood<VDimension>::Hash(const CellType &cell) const
+{
+  // FNV-1a over the cell coordinates.  The number of buckets is always a
+  // power of two.
+  unsigned long long h = 14695981039346656037ULL;
+  for (unsigned int i = 0; i < VDimension; i++)
+    {
+    h ^= static_cast<unsigned long long>(cell.c[i]);
+    h *= 1099511628211ULL;
+    }
+  return static_cast<unsigned int>(h ^ (h >> 32)) & (static_cast<unsigned int>(m_Buckets.size()) - 1);
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>::InsertEntry(const GridEntry &e)
+{
+  const unsigned int b = this->Hash(e.Cell);
+  m_Buckets[b].push_back(e);
+
+  const unsigned int idx = e.Pair.Index;
+  if (idx >= m_Slots.size())
+    {
+    SlotType invalid;
+    invalid.Bucket = 0;
+    invalid.Position = 0;
+    invalid.Valid = false;
+    m_Slots.resize(idx + 1, invalid);
+    }
+  m_Slots[idx].Bucket = b;
+  m_Slots[idx].Position = static_cast<unsigned int>(m_Buckets[b].size() - 1);
+  m_Slots[idx].Valid = true;
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>::RemoveEntry(unsigned int idx)
+{
+  const SlotType slot = m_Slots[idx];
+  BucketType &bucket = m_Buckets[slot.Bucket];
+
+  // Move the last entry of the bucket into the vacated position.
+  if (slot.Position != bucket.size() - 1)
+    {
+    bucket[slot.Position] = bucket.back();
+    m_Slots[bucket[slot.Position].Pair.Index].Position = slot.Position;
+    }
+  bucket.pop_back();
+  m_Slots[idx].Valid = false;
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>::Rebuild(unsigned int numberOfBuckets)
+{
+  std::vector<GridEntry> entries;
+  entries.reserve(m_NumberOfPoints);
+  for (unsigned int b = 0; b < m_Buckets.size(); b++)
+    {
+    entries.insert(entries.end(), m_Buckets[b].begin(), m_Buckets[b].end());
+    m_Buckets[b].clear();
+    }
+
+  if (numberOfBuckets != m_Buckets.size())
+    {
+    m_Buckets.clear();
+    m_Buckets.resize(numberOfBuckets);
+    }
+
+  for (unsigned int i = 0; i < entries.size(); i++)
+    {
+    entries[i].Cell = this->ComputeCell(entries[i].Pair.Point);
+    this->InsertEntry(entries[i]);
+    }
+}
+
+template <unsigned int VDimension>
+typename ParticleGridNeighborhood<VDimension>::PointVectorType
+ParticleGridNeighborhood<VDimension>
+::FindNeighborhoodPoints(const PointType &center, double radius) const
+{
+  PointVectorType ret;
+  this->FindNeighborhoodPoints(center, radius, ret);
+  return ret;
+}
+
+template <unsigned int VDimension>
+unsigned int
+ParticleGridNeighborhood<VDimension>
+::FindNeighborhoodPoints(const PointType &center, double radius,
+                         PointVectorType &ret) const
+{
+  ret.clear();
+  if (m_NumberOfPoints == 0) return 0;
+
+  const double radius2 = radius * radius;
+
+  // Range of cells overlapped by the bounding box of the query sphere.
+  CellType lo, hi;
+  double ncells = 1.0;
+  for (unsigned int i = 0; i < VDimension; i++)
+    {
+    lo.c[i] = static_cast<long>(std::floor((center[i] - radius) / m_CellSize));
+    hi.c[i] = static_cast<long>(std::floor((center[i] + radius) / m_CellSize));
+    ncells *= static_cast<double>(hi.c[i] - lo.c[i] + 1);
+    }
+
+  // If the query covers more cells than there are buckets (e.g. the maximum
+  // neighborhood radius), it is cheaper to test every point.
+  if (ncells >= static_cast<double>(m_Buckets.size()))
+    {
+    for (unsigned int b = 0; b < m_Buckets.size(); b++)
+      {
+      const BucketType &bucket = m_Buckets[b];
+      for (unsigned int k = 0; k < bucket.size(); k++)
+        {
+        double sum = 0.0;
+        for (unsigned int i = 0; i < VDimension; i++)
+          {
+          double q = center[i] - bucket[k].Pair.Point[i];
+          sum += q*q;
+          }
+        if (sum < radius2 && sum > 0.0)
+          {
+          ret.push_back(bucket[k].Pair);
+          }
+        }
+      }
+    return ret.size();
+    }
+
+  CellType cell = lo;
+  while (true)
+    {
+    const BucketType &bucket = m_Buckets[this->Hash(cell)];
+    for (unsigned int k = 0; k < bucket.size(); k++)
+      {
+      // Skip points of other cells that hash to the same bucket.
+      if (bucket[k].Cell != cell) continue;
+
+      double sum = 0.0;
+      for (unsigned int i = 0; i < VDimension; i++)
+        {
+        double q = center[i] - bucket[k].Pair.Point[i];
+        sum += q*q;
+        }
+      if (sum < radius2 && sum > 0.0)
+        {
+        ret.push_back(bucket[k].Pair);
+        }
+      }
+
+    // Advance to the next cell in the range.
+    unsigned int i = 0;
+    for (; i < VDimension; i++)
+      {
+      if (++cell.c[i] <= hi.c[i]) break;
+      cell.c[i] = lo.c[i];
+      }
+    if (i == VDimension) break;
+    }
+
+  return ret.size();
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>
+::AddPosition(const PointType &p, unsigned int idx, int)
+{
+  if (idx < m_Slots.size() && m_Slots[idx].Valid)
+    {
+    this->RemoveEntry(idx);
+    }
+  else
+    {
+    m_NumberOfPoints++;
+    }
+
+  // Keep the load factor at or below one point per bucket.
+  if (m_NumberOfPoints > m_Buckets.size())
+    {
+    this->Rebuild(m_Buckets.size() * 2);
+    }
+
+  GridEntry e;
+  e.Pair = ParticlePointIndexPair<VDimension>(p, idx);
+  e.Cell = this->ComputeCell(p);
+  this->InsertEntry(e);
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>
+::SetPosition(const PointType &p, unsigned int idx, int threadId)
+{
+  if (idx >= m_Slots.size() || !m_Slots[idx].Valid)
+    {
+    this->AddPosition(p, idx, threadId);
+    return;
+    }
+
+  const SlotType &slot = m_Slots[idx];
+  GridEntry &entry = m_Buckets[slot.Bucket][slot.Position];
+  const CellType cell = this->ComputeCell(p);
+
+  // Points that stay in their cell, or move to a cell in the same bucket, are
+  // updated in place.
+  if (cell == entry.Cell || this->Hash(cell) == slot.Bucket)
+    {
+    entry.Pair.Point = p;
+    entry.Cell = cell;
+    return;
+    }
+
+  GridEntry moved = entry;
+  moved.Pair.Point = p;
+  moved.Cell = cell;
+  this->RemoveEntry(idx);
+  this->InsertEntry(moved);
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>
+::RemovePosition(unsigned int idx, int)
+{
+  if (idx >= m_Slots.size() || !m_Slots[idx].Valid) return;
+
+  this->RemoveEntry(idx);
+  m_NumberOfPoints--;
+}
+
+}
+
+#endif
@@ -18,6 +18,8 @@
 #include "itkImage.h"
 #include "itkParticleRegionDomain.h"
 #include "itkLinearInterpolateImageFunction.h"
+#include <algorithm>
+#include <cmath>
 
 namespace itk
 {
@@ -126,9 +128,96 @@ public:
 
   /** Allow public access to the scalar interpolator. */
   itkGetObjectMacro(ScalarInterpolator, ScalarInterpolatorType);
-  
+
+  /** Set/Get the half width, in physical units of the distance transform, of
+      the narrow band in which derived images (gradients, Hessians, curvature)
+      are stored.  Zero, the default, keeps them as dense images.  Must be set
+      before SetImage. */
+  itkSetMacro(NarrowBand, double);
+  itkGetConstMacro(NarrowBand, double);
+
 protected:
-  ParticleImageDomain()
+  /** Buffer offsets and weights of the voxels that linear interpolation at a
+      point combines.  The cell is computed once and then applied to every
+      image on the same grid, instead of each interpolator repeating the index
+      computation and bounds check. */
+  struct InterpolationCellType
+  {
+    OffsetValueType Offset[1 << VDimension];
+    double Weight[1 << VDimension];
+
+    /** Continuous index relative to the start of the buffered region. */
+    double Index[VDimension];
+  };
+
+  /** Compute the interpolation cell of a point on the grid of the image.
+      Returns false if the point is outside the buffer, with the same bounds
+      as IsInsideBuffer.  Neighbors beyond the last voxel are clamped to it,
+      as in LinearInterpolateImageFunction. */
+  bool ComputeInterpolationCell(const PointType &p, InterpolationCellType &cell) const
+  {
+    ContinuousIndex<double, VDimension> cidx;
+    m_Image->TransformPhysicalPointToContinuousIndex(p, cidx);
+
+    const typename ImageType::RegionType &region = m_Image->GetBufferedRegion();
+    OffsetValueType lo[VDimension], hi[VDimension];
+    double frac[VDimension];
+    OffsetValueType stride = 1;
+    for (unsigned int i = 0; i < VDimension; i++)
+      {
+      const IndexValueType start = region.GetIndex()[i];
+      const IndexValueType end = start + static_cast<IndexValueType>(region.GetSize()[i]) - 1;
+      if (cidx[i] < start - 0.5 || cidx[i] >= end + 0.5) return false;
+
+      cell.Index[i] = cidx[i] - static_cast<double>(start);
+
+      const IndexValueType base = static_cast<IndexValueType>(std::floor(cidx[i]));
+      frac[i] = cidx[i] - static_cast<double>(base);
+      lo[i] = (std::max(base, start) - start) * stride;
+      hi[i] = (std::min(base + 1, end) - start) * stride;
+      stride *= region.GetSize()[i];
+      }
+
+    for (unsigned int c = 0; c < (1u << VDimension); c++)
+      {
+      cell.Offset[c] = 0;
+      cell.Weight[c] = 1.0;
+      for (unsigned int i = 0; i < VDimension; i++)
+        {
+        if ((c >> i) & 1)
+          {
+          cell.Offset[c] += hi[i];
+          cell.Weight[c] *= frac[i];
+          }
+        else
+          {
+          cell.Offset[c] += lo[i];
+          cell.Weight[c] *= 1.0 - frac[i];
+          }
+        }
+      }
+    return true;
+  }
+
+  /** Interpolate count interleaved components of a buffer with a precomputed
+      cell.  Each voxel holds count values of type TComponent. */
+  template <class TComponent>
+  static void InterpolateCell(const InterpolationCellType &cell, const TComponent *buffer,
+                              unsigned int count, double *out)
+  {
+    for (unsigned int k = 0; k < count; k++) out[k] = 0.0;
+    for (unsigned int c = 0; c < (1u << VDimension); c++)
+      {
+      const TComponent *v = buffer + cell.Offset[c] * count;
+      const double w = cell.Weight[c];
+      for (unsigned int k = 0; k < count; k++)
+        {
+        out[k] += w * v[k];
+        }
+      }
+  }
+
+  ParticleImageDomain() : m_NarrowBand(0.0)
   {
     m_ScalarInterpolator = ScalarInterpolatorType::New();
   }
@@ -139,6 +228,7 @@ protected:
     
     os << indent << "m_Image = " << m_Image << std::endl;
     os << indent << "m_ScalarInterpolator = " << m_ScalarInterpolator << std::endl;
+    os << indent << "m_NarrowBand = " << m_NarrowBand << std::endl;
   }
   virtual ~ParticleImageDomain() {};
   
@@ -148,6 +238,7 @@ private:
 
   typename ImageType::Pointer m_Image;
   typename ScalarInterpolatorType::Pointer m_ScalarInterpolator;
+  double m_NarrowBand;
 };
 
 } // end namespace itk
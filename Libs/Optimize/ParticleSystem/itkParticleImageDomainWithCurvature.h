@@ -49,6 +49,7 @@ public:
   typedef typename Superclass::ImageType ImageType;
   typedef typename Superclass::ScalarInterpolatorType ScalarInterpolatorType;
   typedef typename Superclass::VnlMatrixType VnlMatrixType;
+  typedef typename Superclass::NarrowBandType NarrowBandType;
   
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
@@ -100,13 +101,29 @@ public:
     
     // Release the memory in the parent hessian images.
     //this->DeletePartialDerivativeImages();
-    
-    m_CurvatureInterpolator->SetInputImage(m_CurvatureImage);
+
+    if (this->GetNarrowBand() > 0.0)
+      {
+      m_CurvatureBand.InitializeLike(this->GetFieldBand(), 1);
+      m_CurvatureBand.SetComponents(m_CurvatureImage.GetPointer(), 0, 1);
+      m_CurvatureImage = 0;
+      }
+    else
+      {
+      m_CurvatureInterpolator->SetInputImage(m_CurvatureImage);
+      }
   } // end setimage
   
   double GetCurvature(const PointType &pos) const
   {
-    return m_CurvatureInterpolator->Evaluate(pos);
+    if (this->GetNarrowBand() <= 0.0)
+      return m_CurvatureInterpolator->Evaluate(pos);
+
+    // Outside the band, use the same value as outside the region in which
+    // curvature is computed.
+    T c;
+    if (m_CurvatureBand.Sample(pos, &c)) return c;
+    return 1.0e-6;
   }
   
   typename ImageType::Pointer *GetCurvatureImage()
@@ -130,15 +147,23 @@ protected:
     // See Kindlmann paper "Curvature-Based Transfer Functions for Direct Volume
     // Rendering..." for detailss
     
-    // Get the normal vector associated with this position.
+    // Get the normal vector associated with this position, and the Hessian,
+    // from a single fused sample.
     //VnlVectorType posnormal = this->SampleNormalVnl(pos, 1.0e-10);
-    typename Superclass::VnlVectorType posnormal = this->SampleNormalVnl(pos, 1.0e-6);
+    T value;
+    typename Superclass::VnlVectorType posnormal;
+    typename Superclass::VnlMatrixType H;
+    if (!this->SampleValueGradientHessianVnl(pos, value, posnormal, H))
+      {
+      // Matches SampleNormalVnl, which rejects points outside the image.
+      posnormal = this->SampleNormalVnl(pos, 1.0e-6);
+      }
+    posnormal = posnormal.normalize();
 
-    // Sample the Hessian for this point and compute gradient of the normal.
+    // Compute gradient of the normal.
     typename Superclass::VnlMatrixType I;
     I.set_identity();
     
-    typename Superclass::VnlMatrixType H = this->SampleHessianVnl(pos);
     typename Superclass::VnlMatrixType P = I - outer_product(posnormal, posnormal);
     typename Superclass::VnlMatrixType G = P.transpose() * H * P;
   
@@ -180,6 +205,7 @@ private:
   // Curvature values are stored in an image
   typename ImageType::Pointer m_CurvatureImage;
   typename ScalarInterpolatorType::Pointer m_CurvatureInterpolator;
+  NarrowBandType m_CurvatureBand;
 };
 
 } // end namespace itk
@@ -18,6 +18,7 @@
 #include "itkImage.h"
 #include "itkImageDuplicator.h"
 #include "itkParticleImageDomain.h"
+#include "itkParticleNarrowBandBrickMap.h"
 #include "itkVectorLinearInterpolateImageFunction.h"
 #include "itkGradientImageFilter.h"
 #include "itkFixedArray.h"
@@ -57,6 +58,9 @@ public:
 
   typedef FixedArray<T, 3> VectorType;
   typedef vnl_vector_fixed<T, 3> VnlVectorType;
+
+  /** Sparse storage used for derived images when a narrow band is set. */
+  typedef ParticleNarrowBandBrickMap<T, VDimension> NarrowBandType;
   
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
@@ -79,8 +83,26 @@ public:
     filter->SetUseImageSpacingOn();
     filter->Update();
     m_GradientImage = filter->GetOutput();
-    
-    m_GradientInterpolator->SetInputImage(m_GradientImage);
+
+    if (this->GetNarrowBand() > 0.0)
+      {
+      // Keep the distance and gradient only near the surface, interleaved
+      // with the components of subclasses, and release the dense gradient.
+      m_FieldBand.Initialize(I, this->GetNarrowBand(), this->GetNumberOfFieldComponents());
+      m_FieldBand.SetComponents(I, 0, 1);
+      m_FieldBand.SetComponents(m_GradientImage.GetPointer(), 1, VDimension);
+      m_GradientImage = 0;
+      m_GradientInterpolator = 0;
+      }
+    else
+      {
+      m_FieldBand.Clear();
+      if (!m_GradientInterpolator)
+        {
+        m_GradientInterpolator = GradientInterpolatorType::New();
+        }
+      m_GradientInterpolator->SetInputImage(m_GradientImage);
+      }
   }
   itkGetObjectMacro(GradientImage, GradientImageType);
 
@@ -91,8 +113,14 @@ public:
       (itk::FixedArray). */
   inline VectorType SampleGradient(const PointType &p) const
   {
-      if(this->IsInsideBuffer(p))
-        return  m_GradientInterpolator->Evaluate(p);
+      T f[1 + VDimension];
+      typename Superclass::InterpolationCellType cell;
+      if(this->SampleField(p, 1 + VDimension, f, cell))
+        {
+        VectorType g;
+        for (unsigned int i = 0; i < VDimension; i++) { g[i] = f[1 + i]; }
+        return g;
+        }
       else {
           itkExceptionMacro("Gradient queried for a Point, " << p << ", outside the given image domain." );
          VectorType g(1.0e-5);
@@ -101,6 +129,24 @@ public:
   }
   inline VnlVectorType SampleGradientVnl(const PointType &p) const
   { return VnlVectorType( this->SampleGradient(p).GetDataPointer() ); }
+
+  /** Sample the distance value and the gradient together, computing the
+      interpolation cell once.  Returns false, setting the value to zero and
+      leaving the gradient unchanged, if the point is outside the image. */
+  inline bool SampleValueAndGradientVnl(const PointType &p, T &value, VnlVectorType &grad) const
+  {
+    T f[1 + VDimension];
+    typename Superclass::InterpolationCellType cell;
+    if (!this->SampleField(p, 1 + VDimension, f, cell))
+      {
+      value = 0.0;
+      return false;
+      }
+    value = f[0];
+    for (unsigned int i = 0; i < VDimension; i++) { grad[i] = f[1 + i]; }
+    return true;
+  }
+
   inline VnlVectorType SampleNormalVnl(const PointType &p, T epsilon = 1.0e-5) const
   {
     VnlVectorType grad = this->SampleGradientVnl(p);
@@ -146,6 +192,7 @@ public:
     Superclass::DeleteImages();
     m_GradientImage = 0;
     m_GradientInterpolator = 0;
+    m_FieldBand.Clear();
   }
   
 protected:
@@ -159,8 +206,72 @@ protected:
     Superclass::PrintSelf(os, indent);
     os << indent << "m_GradientImage = " << m_GradientImage << std::endl;
     os << indent << "m_GradientInterpolator = " << m_GradientInterpolator << std::endl;
+    os << indent << "Narrow band bricks = " << m_FieldBand.GetNumberOfActiveBricks() << std::endl;
   }
   virtual ~ParticleImageDomainWithGradients() {};
+
+  /** Number of interleaved components per voxel of the narrow band field:
+      the distance value, the gradient, and whatever subclasses append. */
+  virtual unsigned int GetNumberOfFieldComponents() const
+  { return 1 + VDimension; }
+
+  /** The narrow band field, shared with subclasses so that all quantities
+      are sampled in a single pass. */
+  NarrowBandType &GetFieldBand()
+  { return m_FieldBand; }
+  const NarrowBandType &GetFieldBand() const
+  { return m_FieldBand; }
+
+  /** Sample the first count components of the field [value, gradient, ...]
+      at a point.  In narrow band mode all components come from the band;
+      outside the band the value and gradient come from the distance
+      transform, with the gradient estimated by central differences so that
+      points that strayed from the surface can still be projected back, and
+      the remaining components are zero.  Next to the image boundary, where
+      Sample returns zero, the differences are one-sided.  In dense mode only the value and
+      gradient are filled, and subclasses interpolate their own images with
+      the returned cell.  Returns false if the point is outside the image. */
+  bool SampleField(const PointType &p, unsigned int count, T *f,
+                   typename Superclass::InterpolationCellType &cell) const
+  {
+    if (!this->ComputeInterpolationCell(p, cell)) return false;
+
+    if (this->GetNarrowBand() > 0.0)
+      {
+      const unsigned int stored = std::min(count, m_FieldBand.GetNumberOfComponents());
+      for (unsigned int k = stored; k < count; k++) { f[k] = 0.0; }
+      if (m_FieldBand.SampleAtIndex(cell.Index, f, 0, stored)) return true;
+
+      for (unsigned int k = 0; k < count; k++) { f[k] = 0.0; }
+      double v;
+      Superclass::InterpolateCell(cell, this->GetImage()->GetBufferPointer(), 1, &v);
+      f[0] = static_cast<T>(v);
+      for (unsigned int i = 0; i < VDimension; i++)
+        {
+        const double h = this->GetImage()->GetSpacing()[i];
+        PointType a = p;
+        PointType b = p;
+        a[i] -= h;
+        b[i] += h;
+        const bool insideA = this->IsInsideBuffer(a);
+        const bool insideB = this->IsInsideBuffer(b);
+        if (insideA && insideB)
+          { f[1 + i] = static_cast<T>((this->Sample(b) - this->Sample(a)) / (2.0 * h)); }
+        else if (insideB)
+          { f[1 + i] = static_cast<T>((this->Sample(b) - v) / h); }
+        else if (insideA)
+          { f[1 + i] = static_cast<T>((v - this->Sample(a)) / h); }
+        }
+      return true;
+      }
+
+    double v[1 + VDimension];
+    Superclass::InterpolateCell(cell, this->GetImage()->GetBufferPointer(), 1, v);
+    Superclass::InterpolateCell(cell, reinterpret_cast<const T *>(m_GradientImage->GetBufferPointer()),
+                                VDimension, v + 1);
+    for (unsigned int k = 0; k < 1 + VDimension; k++) { f[k] = static_cast<T>(v[k]); }
+    return true;
+  }
   
 private:
   ParticleImageDomainWithGradients(const Self&); //purposely not implemented
@@ -168,6 +279,7 @@ private:
 
   typename GradientImageType::Pointer m_GradientImage;
   typename GradientInterpolatorType::Pointer m_GradientInterpolator;
+  NarrowBandType m_FieldBand;
 };
 
 } // end namespace itk
@@ -56,6 +56,10 @@ public:
   typedef typename Superclass::ImageType ImageType;
   typedef typename Superclass::ScalarInterpolatorType ScalarInterpolatorType;
   typedef vnl_matrix_fixed<T, VDimension, VDimension> VnlMatrixType;
+  typedef typename Superclass::NarrowBandType NarrowBandType;
+
+  /** Number of distinct second partial derivatives. */
+  itkStaticConstMacro(NumberOfPartials, unsigned int, VDimension + ((VDimension * VDimension) - VDimension) / 2);
   
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
@@ -90,10 +94,7 @@ public:
       deriv->SetUseImageSpacingOn();
       deriv->Update();
 
-      m_PartialDerivatives[i] = deriv->GetOutput();
-
-      m_Interpolators[i] = ScalarInterpolatorType::New();
-      m_Interpolators[i]->SetInputImage(m_PartialDerivatives[i]);
+      this->StorePartialDerivative(i, deriv->GetOutput());
       }
 
     // Compute the cross derivatives and set up the interpolators
@@ -119,9 +120,7 @@ public:
         
         deriv2->Update();
         
-        m_PartialDerivatives[k] = deriv2->GetOutput();
-        m_Interpolators[k] = ScalarInterpolatorType::New();
-        m_Interpolators[k]->SetInputImage(m_PartialDerivatives[k]);
+        this->StorePartialDerivative(k, deriv2->GetOutput());
         }
       }
   } // end setimage
@@ -131,9 +130,48 @@ public:
       matrix of size VDimension x VDimension. */
   inline VnlMatrixType SampleHessianVnl(const PointType &p) const
   {
+    T value;
+    typename Superclass::VnlVectorType grad;
     VnlMatrixType ans;
+    if (!this->SampleValueGradientHessianVnl(p, value, grad, ans))
+      {
+      ans.fill(0.0);
+      }
+    return ans;
+  }
+
+  /** Sample the distance value, gradient and Hessian together.  The
+      interpolation cell is computed once and shared by all components; with
+      a narrow band they are read from one interleaved record per voxel, and
+      the Hessian is zero outside the band.  Returns false, leaving the
+      outputs unchanged except for a zero value, if the point is outside the
+      image. */
+  inline bool SampleValueGradientHessianVnl(const PointType &p, T &value,
+                                            typename Superclass::VnlVectorType &grad,
+                                            VnlMatrixType &hess) const
+  {
+    T f[1 + VDimension + NumberOfPartials];
+    typename Superclass::Superclass::InterpolationCellType cell;
+    if (!this->SampleField(p, 1 + VDimension + NumberOfPartials, f, cell))
+      {
+      value = 0.0;
+      return false;
+      }
+
+    T *h = f + 1 + VDimension;
+    if (this->GetNarrowBand() <= 0.0)
+      {
+      for (unsigned int k = 0; k < NumberOfPartials; k++)
+        {
+        double v;
+        Superclass::Superclass::InterpolateCell(cell, m_PartialDerivatives[k]->GetBufferPointer(), 1, &v);
+        h[k] = static_cast<T>(v);
+        }
+      }
+
+    value = f[0];
     for (unsigned int i = 0; i < VDimension; i++)
-      {      ans[i][i] = m_Interpolators[i]->Evaluate(p);      }
+      {      grad[i] = f[1 + i];      hess[i][i] = h[i];      }
     
     // Cross derivatives
     unsigned int k = VDimension;
@@ -141,10 +179,10 @@ public:
       {
       for (unsigned int j = i+1; j < VDimension; j++, k++)
         {
-        ans[i][j] = ans[j][i] = m_Interpolators[k]->Evaluate(p);
+        hess[i][j] = hess[j][i] = h[k];
         }
       }
-    return ans;
+    return true;
   }
   
   /** Set /Get the standard deviation for blurring the image prior to
@@ -156,11 +194,12 @@ public:
 
   void DeletePartialDerivativeImages()
   {
-    for (unsigned int i = 0; i < VDimension + ((VDimension * VDimension) - VDimension) / 2; i++)
+    for (unsigned int i = 0; i < NumberOfPartials; i++)
       {
       m_PartialDerivatives[i]=0;
       m_Interpolators[i]=0;
       }
+    this->GetFieldBand().SetNumberOfComponents(Superclass::GetNumberOfFieldComponents());
   }
 
   /** Used when a domain is fixed. */
@@ -188,6 +227,31 @@ protected:
   }
   virtual ~ParticleImageDomainWithHessians() {};
 
+  /** The Hessian partials follow the value and gradient in the narrow band
+      field. */
+  virtual unsigned int GetNumberOfFieldComponents() const
+  { return Superclass::GetNumberOfFieldComponents() + NumberOfPartials; }
+
+  /** Keep a partial derivative image either as a dense image with its own
+      interpolator or, when a narrow band is set, as component k of the
+      Hessian in the band field, in which case the dense image is released on
+      return. */
+  void StorePartialDerivative(unsigned int k, ImageType *image)
+  {
+    if (this->GetNarrowBand() <= 0.0)
+      {
+      m_PartialDerivatives[k] = image;
+      m_Interpolators[k] = ScalarInterpolatorType::New();
+      m_Interpolators[k]->SetInputImage(m_PartialDerivatives[k]);
+      }
+    else
+      {
+      this->GetFieldBand().SetComponents(image, Superclass::GetNumberOfFieldComponents() + k, 1);
+      m_PartialDerivatives[k] = 0;
+      m_Interpolators[k] = 0;
+      }
+  }
+
   
 private:
   double m_Sigma;
@@ -200,9 +264,9 @@ private:
   //                 1: dyy  5: dyz
   //                            2: dzz
   //
-  typename ImageType::Pointer  m_PartialDerivatives[ VDimension + ((VDimension * VDimension) - VDimension) / 2];
+  typename ImageType::Pointer  m_PartialDerivatives[NumberOfPartials];
 
-  typename ScalarInterpolatorType::Pointer m_Interpolators[VDimension + ((VDimension * VDimension) - VDimension) / 2];
+  typename ScalarInterpolatorType::Pointer m_Interpolators[NumberOfPartials];
 };
 
 } // end namespace itk
@@ -310,13 +310,18 @@ ParticleImplicitSurfaceDomain<T, VDimension>::ApplyConstraints(PointType &p) con
     double mult = 1.0;
     
     const T epsilon = m_Tolerance * 0.001;
-    T f = this->Sample(p);
+
+    // The value and gradient are sampled together at each Newton step.
+    T f;
+    vnl_vector_fixed<T, VDimension> grad;
+    bool inside = this->SampleValueAndGradientVnl(p, f, grad);
     
     T gradmag = 1.0;
     while ( fabs(f) > (m_Tolerance * mult) || gradmag < epsilon)
       //  while ( fabs(f) > m_Tolerance || gradmag < epsilon)
       {
-      vnl_vector_fixed<T, VDimension> grad = this->SampleGradientVnl(p);
+      // Outside the image there is no gradient; SampleGradientVnl reports it.
+      if (!inside) grad = this->SampleGradientVnl(p);
       
       gradmag = grad.magnitude();
       vnl_vector_fixed<T, VDimension> vec   =  grad  * ( f / (gradmag + epsilon) );
@@ -325,7 +330,7 @@ ParticleImplicitSurfaceDomain<T, VDimension>::ApplyConstraints(PointType &p) con
         p[i] -= vec[i];
         }
       
-      f = this->Sample(p);
+      inside = this->SampleValueAndGradientVnl(p, f, grad);
       
       // Raise the tolerance if we have done too many iterations.
       k++;
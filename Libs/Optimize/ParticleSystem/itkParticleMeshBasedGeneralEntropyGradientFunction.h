@@ -11,6 +11,7 @@
 #include <numeric>
 #include "itkParticleGeneralShapeMatrix.h"
 #include "itkParticleGeneralShapeGradientMatrix.h"
+#include "itkParticleEigenMatrixView.h"
 
 namespace itk
 {
@@ -121,6 +122,38 @@ public:
     double GetMinimumVariance() const
     { return m_MinimumVariance; }
 
+    double GetMinimumVarianceDecayConstant() const
+    { return m_MinimumVarianceDecayConstant; }
+    void SetMinimumVarianceDecayConstant(double d)
+    { m_MinimumVarianceDecayConstant = d; }
+
+    /** Access the annealing counter and the factors cached by the last
+        update, for optimizer state snapshots. */
+    int GetCounter() const
+    { return m_Counter; }
+    void SetCounter(int i)
+    { m_Counter = i; }
+    double GetMinimumEigenValue() const
+    { return m_MinimumEigenValue; }
+    void SetMinimumEigenValue(double d)
+    { m_MinimumEigenValue = d; }
+    double GetCurrentEnergy() const
+    { return m_CurrentEnergy; }
+    void SetCurrentEnergy(double d)
+    { m_CurrentEnergy = d; }
+    const vnl_matrix_type &GetPointsUpdate() const
+    { return *m_PointsUpdate; }
+    void SetPointsUpdate(const vnl_matrix_type &m)
+    { *m_PointsUpdate = m; }
+    const vnl_matrix_type &GetInverseCovFactor() const
+    { return *m_InverseCovFactor; }
+    void SetInverseCovFactor(const vnl_matrix_type &m)
+    { *m_InverseCovFactor = m; }
+    const vnl_matrix_type &GetPointsMean() const
+    { return *m_points_mean; }
+    void SetPointsMean(const vnl_matrix_type &m)
+    { *m_points_mean = m; }
+
     bool GetHoldMinimumVariance() const
     { return m_HoldMinimumVariance; }
     void SetHoldMinimumVariance(bool b)
@@ -180,8 +213,14 @@ public:
 
     virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
     {
-        typename ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>::Pointer copy =
-                ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>::New();
+        typename Self::Pointer copy = Self::New();
+        this->UpdateClone(copy);
+        return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+    }
+
+    virtual bool UpdateClone(ParticleVectorFunction<VDimension> *clone)
+    {
+        Self *copy = static_cast<Self *>(clone);
 
         // from itkParticleVectorFunction
         copy->m_DomainNumber = this->m_DomainNumber;
@@ -203,12 +242,12 @@ public:
         copy->m_points_mean = this->m_points_mean;
         copy->m_UseNormals = this->m_UseNormals;
         copy->m_UseXYZ = this->m_UseXYZ;
-        copy->m_InverseCovMatrix = this->m_InverseCovMatrix;
+        copy->m_InverseCovFactor = this->m_InverseCovFactor;
 
         copy->m_ShapeData = this->m_ShapeData;
         copy->m_ShapeGradient = this->m_ShapeGradient;
 
-        return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+        return true;
     }
 
 protected:
@@ -227,7 +266,7 @@ protected:
         num_dims = 0;
         num_samples = 0;
         m_PointsUpdate = new vnl_matrix_type(10,10);
-        m_InverseCovMatrix = new vnl_matrix_type(10,10);
+        m_InverseCovFactor = new vnl_matrix_type(10,10);
         m_points_mean = new vnl_matrix_type(10,10);
     }
     virtual ~ParticleMeshBasedGeneralEntropyGradientFunction() {}
@@ -255,7 +294,7 @@ protected:
     std::vector<bool> m_UseXYZ;
     std::vector<bool> m_UseNormals;
     vnl_matrix_type * m_points_mean;
-    vnl_matrix_type * m_InverseCovMatrix;
+    vnl_matrix_type * m_InverseCovFactor; // inverse covariance is F*F^T, used for energy computation
     int num_dims, num_samples;
 };
 } // end namespace
@@ -56,15 +56,18 @@ ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>
 
     vnl_diag_matrix<double> W;
 
-    m_InverseCovMatrix->set_size(num_dims, num_dims);
-    m_InverseCovMatrix->fill(0.0);
+    m_InverseCovFactor->set_size(num_dims, num_samples);
+    m_InverseCovFactor->fill(0.0);
     vnl_matrix_type gramMat(num_samples, num_samples, 0.0);
     vnl_matrix_type pinvMat(num_samples, num_samples, 0.0); //gramMat inverse
 
+    typedef ParticleEigenMatrixView<double> EigenView;
+    const typename EigenView::ConstMapType Y = EigenView::ConstView(points_minus_mean);
+
     if (this->m_UseMeanEnergy)
     {
         pinvMat.set_identity();
-        m_InverseCovMatrix->clear(); //set_identity();
+        m_InverseCovFactor->clear(); //set_identity();
     }
     else
     {
@@ -83,7 +86,9 @@ ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>
 //        pinvMat = (V * invLambda) * V.transpose();
 //        m_InverseCovMatrix = (U * invLambda) * U.transpose();
 
-        gramMat = points_minus_mean.transpose()* points_minus_mean;
+        // The products with points_minus_mean are num_dims long and dominate
+        // the cost; they run through Eigen views of the vnl storage.
+        EigenView::View(gramMat).noalias() = Y.transpose() * Y;
 
         vnl_svd <double> svd(gramMat);
 
@@ -95,15 +100,17 @@ ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>
         invLambda.set_diagonal(invLambda.get_diagonal()/(double)(num_samples-1) + m_MinimumVariance);
         invLambda.invert_in_place();
 
-        pinvMat = (UG * invLambda) * UG.transpose();
+        vnl_matrix_type UGL = UG * invLambda;
+        pinvMat = UGL * UG.transpose();
 
-        vnl_matrix_type projMat = points_minus_mean * UG;
-        vnl_matrix_type projMat2 = projMat * invLambda;
-        projMat2 = projMat2 * projMat2.transpose();
-        m_InverseCovMatrix->update(projMat2);
+        // The inverse covariance is F * F^T with F = points_minus_mean * UG *
+        // invLambda.  Only its diagonal blocks are ever needed, so F is kept
+        // rather than the num_dims x num_dims product.
+        EigenView::View(*m_InverseCovFactor).noalias() = Y * EigenView::View(UGL);
     }
 
-    vnl_matrix_type Q = points_minus_mean * pinvMat;
+    vnl_matrix_type Q(num_dims, num_samples);
+    EigenView::View(Q).noalias() = Y * EigenView::View(pinvMat);
 
 //    if (this->CheckForNans(Q))
 //        std::cout << "MGEG: 2. Nans exist!!!" << std::endl;
@@ -247,21 +254,28 @@ ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>
         num += num1 * system->GetNumberOfParticles(i);
     }
 
-    vnl_matrix_type tmp1(sz_Yidx, sz_Yidx, 0.0);
-    
-    if (this->m_UseMeanEnergy)
-        tmp1.set_identity();
-    else
-        tmp1 = m_InverseCovMatrix->extract(sz_Yidx, sz_Yidx, num, num);
-
     vnl_matrix_type Y_dom_idx(sz_Yidx, 1, 0.0);
 
     Y_dom_idx = m_ShapeData->extract(sz_Yidx, 1, num, sampNum) - m_points_mean->extract(sz_Yidx, 1, num);
 
-    vnl_matrix_type tmp = Y_dom_idx.transpose()*tmp1;
-    tmp *= Y_dom_idx;
-
-    energy = tmp(0,0);
+    energy = 0.0;
+    if (this->m_UseMeanEnergy)
+    {
+        for (int i = 0; i < sz_Yidx; i++)
+            energy += Y_dom_idx(i,0) * Y_dom_idx(i,0);
+    }
+    else
+    {
+        // Y^T (F_k F_k^T) Y = |F_k^T Y|^2, where F_k are the rows of the
+        // inverse covariance factor that belong to this particle.
+        for (unsigned int j = 0; j < m_InverseCovFactor->cols(); j++)
+        {
+            double s = 0.0;
+            for (int i = 0; i < sz_Yidx; i++)
+                s += m_InverseCovFactor->get(num + i, j) * Y_dom_idx(i,0);
+            energy += s * s;
+        }
+    }
 
 
     maxdt = m_MinimumEigenValue;
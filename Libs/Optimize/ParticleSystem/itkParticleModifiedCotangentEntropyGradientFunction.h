@@ -117,9 +117,7 @@ public:
         double r     = itk::Math::pi_over_2 * rij/m_GlobalSigma[d] ;
         double cotan = cos(r)/sin(r);
         double val   = cotan + r - itk::Math::pi_over_2;
-        double A     = -1.0 *itk::Math::pi_over_4 * m_GlobalSigma[d] - itk::Math::pi_over_4 * std::pow(epsilon, 2) / m_GlobalSigma[d] + itk::Math::pi_over_2 * epsilon;
-        A -= (m_GlobalSigma[d]/itk::Math::pi_over_2) * std::log( std::sin(epsilon * itk::Math::pi_over_2 / m_GlobalSigma[d]) );
-        val /= A;
+        val /= m_Normalization[d];
         return val;
     }
 
@@ -133,30 +131,54 @@ public:
         double r     = itk::Math::pi_over_2 * rij/m_GlobalSigma[d] ;
         double sin_2 = 1.0 / pow(sin(r),2.0);
         double val   = (itk::Math::pi_over_2 / m_GlobalSigma[d]) * (1.0 - sin_2);
-
-        double A     = -1.0 *itk::Math::pi_over_4 * m_GlobalSigma[d] - itk::Math::pi_over_4 * std::pow(epsilon, 2) / m_GlobalSigma[d] + itk::Math::pi_over_2 * epsilon;
-        A -= (m_GlobalSigma[d]/itk::Math::pi_over_2) * std::log( std::sin(epsilon * itk::Math::pi_over_2 / m_GlobalSigma[d]) );
-
-        val /= A;
+        val /= m_Normalization[d];
         return val;
     }
 
+    /** The integral of the modified cotangent over [epsilon, sigma] that
+        normalizes it, which only depends on the global sigma of the domain. */
+    static double ComputeNormalization(double sigma)
+    {
+        const double epsilon = 1.0e-6;
+        double A     = -1.0 *itk::Math::pi_over_4 * sigma - itk::Math::pi_over_4 * std::pow(epsilon, 2) / sigma + itk::Math::pi_over_2 * epsilon;
+        A -= (sigma/itk::Math::pi_over_2) * std::log( std::sin(epsilon * itk::Math::pi_over_2 / sigma) );
+        return A;
+    }
+
     void ClearGlobalSigma()
     {
         m_GlobalSigma.clear();
+        m_Normalization.clear();
     }
 
     void SetGlobalSigma(std::vector<double> i)
-    { m_GlobalSigma = i; }
+    {
+        m_GlobalSigma = i;
+        m_Normalization.resize(i.size());
+        for (unsigned int d = 0; d < i.size(); d++)
+            m_Normalization[d] = ComputeNormalization(i[d]);
+    }
 
     void SetGlobalSigma(double i)
-    { m_GlobalSigma.push_back(i); }
+    {
+        m_GlobalSigma.push_back(i);
+        m_Normalization.push_back(ComputeNormalization(i));
+    }
 
     virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
     {
-        typename ParticleModifiedCotangentEntropyGradientFunction<TGradientNumericType, VDimension>::Pointer copy = ParticleModifiedCotangentEntropyGradientFunction<TGradientNumericType, VDimension>::New();
+        typename Self::Pointer copy = Self::New();
+        this->UpdateClone(copy);
+        return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+    }
+
+    virtual bool UpdateClone(ParticleVectorFunction<VDimension> *clone)
+    {
+        Self *copy = static_cast<Self *>(clone);
+
         copy->SetParticleSystem(this->GetParticleSystem());
         copy->m_GlobalSigma = this->m_GlobalSigma;
+        copy->m_Normalization = this->m_Normalization;
 
         copy->m_MinimumNeighborhoodRadius = this->m_MinimumNeighborhoodRadius;
         copy->m_MaximumNeighborhoodRadius = this->m_MaximumNeighborhoodRadius;
@@ -166,7 +188,7 @@ public:
         copy->m_DomainNumber = this->m_DomainNumber;
         copy->m_ParticleSystem = this->m_ParticleSystem;
 
-        return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+        return true;
     }
 
 protected:
@@ -176,6 +198,13 @@ protected:
     ParticleModifiedCotangentEntropyGradientFunction(const ParticleModifiedCotangentEntropyGradientFunction &);
 
     std::vector<double> m_GlobalSigma;
+
+    /** ComputeNormalization of each global sigma, computed once when the
+        sigma is set rather than for every pair of particles. */
+    std::vector<double> m_Normalization;
+
+    /** Scratch storage for the neighborhoods of the neighbors in Evaluate. */
+    mutable typename ParticleSystemType::PointVectorType m_KNeighborhoodBuffer;
 };
 
 } //end namespace
@@ -39,7 +39,8 @@ ParticleModifiedCotangentEntropyGradientFunction<TGradientNumericType, VDimensio
     double rmag;
     energy = epsilon;
     //m_GlobalSigma - 1 per domain
-    typename ParticleSystemType::PointVectorType m_CurrentNeighborhood = system->FindNeighborhoodPoints(pos, m_GlobalSigma[d], d);
+    typename ParticleSystemType::PointVectorType &m_CurrentNeighborhood = this->m_NeighborhoodBuffer;
+    system->FindNeighborhoodPoints(pos, m_GlobalSigma[d], m_CurrentNeighborhood, d);
 
     if (m_CurrentNeighborhood.size()==0)
     {
@@ -61,7 +62,8 @@ ParticleModifiedCotangentEntropyGradientFunction<TGradientNumericType, VDimensio
     for (unsigned int k = 0; k < m_CurrentNeighborhood.size(); k++)
     {
         PointType pos_k = m_CurrentNeighborhood[k].Point;
-        typename ParticleSystemType::PointVectorType k_neighborhood = system->FindNeighborhoodPoints(pos_k, m_GlobalSigma[d], d);
+        typename ParticleSystemType::PointVectorType &k_neighborhood = m_KNeighborhoodBuffer;
+        system->FindNeighborhoodPoints(pos_k, m_GlobalSigma[d], k_neighborhood, d);
         double energy_k = epsilon;
 
         for (unsigned int j = 0; j < k_neighborhood.size(); j++)
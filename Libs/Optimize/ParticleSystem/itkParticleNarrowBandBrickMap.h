@@ -0,0 +1,152 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleNarrowBandBrickMap.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleNarrowBandBrickMap_h
+#define __itkParticleNarrowBandBrickMap_h
+
+#include "itkImage.h"
+#include "itkPoint.h"
+#include <vector>
+
+namespace itk
+{
+/** \class ParticleNarrowBandBrickMap
+ *
+ * Block-sparse storage of image samples near the zero level set of a distance
+ * transform.  The image grid is divided into bricks of BrickSize voxels per
+ * side, and only bricks that contain a voxel with |distance| <= band width are
+ * allocated.  Each brick also stores the first voxel of the next brick along
+ * every axis, so a trilinear sample never reads more than one brick.  Every
+ * voxel holds NumberOfComponents values of type T stored contiguously, so that
+ * a vector- or tensor-valued field is interpolated in a single pass.
+ *
+ * The brick layout is computed from a distance image with Initialize, or
+ * copied from another map with InitializeLike.  Values are then copied in
+ * from dense images with SetComponents, after which the dense images may be
+ * released.  Sample returns false for points whose interpolation cell lies
+ * outside the band, and callers fall back to their own default.
+ */
+template <class T, unsigned int VDimension=3>
+class ParticleNarrowBandBrickMap
+{
+public:
+  typedef ParticleNarrowBandBrickMap Self;
+  typedef Image<T, VDimension> ImageType;
+  typedef Point<double, VDimension> PointType;
+
+  /** Number of voxels along each side of a brick, not counting the shared
+      layer of the next brick. */
+  static const unsigned int BrickSize = 8;
+
+  ParticleNarrowBandBrickMap() : m_NumberOfComponents(0), m_NumberOfBricks(0),
+    m_VoxelsPerBrick(0), m_BandWidth(0.0) {}
+
+  /** Compute the brick layout from a distance image.  Bricks that contain a
+      voxel within bandWidth of the zero level set are allocated and zero
+      filled. */
+  void Initialize(const ImageType *distance, double bandWidth, unsigned int numberOfComponents);
+
+  /** Use the same layout as another map, with a different number of
+      components. */
+  void InitializeLike(const Self &other, unsigned int numberOfComponents);
+
+  /** Copy count components of each pixel of a dense image into components
+      [first, first + count) of the allocated bricks.  TImage may have a
+      scalar pixel type (count must be 1) or a pixel type with operator[]. */
+  template <class TImage>
+  void SetComponents(const TImage *image, unsigned int first, unsigned int count);
+
+  /** Trilinearly interpolate components [first, first + count) at a
+      physical point.  Returns false, leaving out untouched, if the point is
+      outside the image or its cell is outside the band. */
+  bool Sample(const PointType &p, T *out, unsigned int first, unsigned int count) const;
+  bool Sample(const PointType &p, T *out) const
+  { return this->Sample(p, out, 0, m_NumberOfComponents); }
+
+  /** As Sample, for a continuous index relative to the start of the buffered
+      region of the image the map was built from. */
+  bool SampleAtIndex(const double *ci, T *out, unsigned int first, unsigned int count) const;
+
+  /** Drop all but the first numberOfComponents components of every voxel and
+      release their memory.  Does nothing if the map already has no more
+      components than requested. */
+  void SetNumberOfComponents(unsigned int numberOfComponents);
+
+  /** Release all storage. */
+  void Clear();
+
+  bool IsEmpty() const
+  { return m_Data.empty(); }
+
+  unsigned int GetNumberOfComponents() const
+  { return m_NumberOfComponents; }
+
+  double GetBandWidth() const
+  { return m_BandWidth; }
+
+  /** Number of allocated bricks. */
+  unsigned int GetNumberOfActiveBricks() const
+  { return m_NumberOfBricks; }
+
+  /** Approximate memory held by the map in bytes. */
+  unsigned long GetMemorySize() const
+  {
+    return static_cast<unsigned long>(m_Data.capacity() * sizeof(T)
+                                      + m_BrickTable.capacity() * sizeof(int));
+  }
+
+protected:
+  /** Return the component of a pixel.  The non-template overload is chosen for
+      scalar pixels. */
+  static T PixelComponent(const T &v, unsigned int)
+  { return v; }
+  template <class TPixel>
+  static T PixelComponent(const TPixel &v, unsigned int k)
+  { return static_cast<T>(v[k]); }
+
+  /** Copy the grid geometry of an image. */
+  void SetGeometry(const ImageType *image);
+
+  /** Offset of the first component of a voxel, given its brick and the
+      coordinates of the voxel within the brick. */
+  unsigned long VoxelOffset(int brick, const long *local) const;
+
+  /** Map from physical point to continuous index: ci = M (p - origin) - start */
+  double m_PointToIndex[VDimension][VDimension];
+  double m_Origin[VDimension];
+  long m_Start[VDimension];
+  long m_Size[VDimension];
+
+  /** Number of bricks along each axis, and index of each brick in m_Data, or
+      -1 if it is not allocated. */
+  long m_BrickGrid[VDimension];
+  std::vector<int> m_BrickTable;
+
+  unsigned int m_NumberOfComponents;
+  unsigned int m_NumberOfBricks;
+  unsigned long m_VoxelsPerBrick;
+  double m_BandWidth;
+  std::vector<T> m_Data;
+};
+
+} // end namespace itk
+
+#if ITK_TEMPLATE_EXPLICIT
+# include "Templates/itkParticleNarrowBandBrickMap+-.h"
+#endif
+
+#if ITK_TEMPLATE_TXX
+# include "itkParticleNarrowBandBrickMap.txx"
+#endif
+
+#include "itkParticleNarrowBandBrickMap.txx"
+
+#endif
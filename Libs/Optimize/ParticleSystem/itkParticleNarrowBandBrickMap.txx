@@ -0,0 +1,291 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleNarrowBandBrickMap.txx,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleNarrowBandBrickMap_txx
+#define __itkParticleNarrowBandBrickMap_txx
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+template <class T, unsigned int VDimension>
+void ParticleNarrowBandBrickMap<T, VDimension>::SetGeometry(const ImageType *image)
+{
+  const typename ImageType::RegionType region = image->GetBufferedRegion();
+  const typename ImageType::DirectionType &inv = image->GetInverseDirection();
+
+  for (unsigned int i = 0; i < VDimension; i++)
+    {
+    m_Origin[i] = image->GetOrigin()[i];
+    m_Start[i] = region.GetIndex()[i];
+    m_Size[i] = region.GetSize()[i];
+
+    // Brick b holds the interpolation cells [b * BrickSize, (b+1) * BrickSize).
+    const long cells = m_Size[i] > 1 ? m_Size[i] - 1 : 1;
+    m_BrickGrid[i] = (cells + BrickSize - 1) / BrickSize;
+
+    for (unsigned int j = 0; j < VDimension; j++)
+      {
+      m_PointToIndex[i][j] = inv(i, j) / image->GetSpacing()[i];
+      }
+    }
+}
+
+template <class T, unsigned int VDimension>
+void ParticleNarrowBandBrickMap<T, VDimension>
+::Initialize(const ImageType *distance, double bandWidth, unsigned int numberOfComponents)
+{
+  this->Clear();
+  this->SetGeometry(distance);
+  m_NumberOfComponents = numberOfComponents;
+  m_BandWidth = bandWidth;
+
+  unsigned long numberOfBricks = 1;
+  m_VoxelsPerBrick = 1;
+  for (unsigned int i = 0; i < VDimension; i++)
+    {
+    numberOfBricks *= m_BrickGrid[i];
+    m_VoxelsPerBrick *= BrickSize + 1;
+    }
+  m_BrickTable.assign(numberOfBricks, -1);
+
+  // A voxel within the band marks every brick that stores it.  Voxels on a
+  // brick boundary are stored by the bricks on both sides.
+  ImageRegionConstIteratorWithIndex<ImageType> it(distance, distance->GetBufferedRegion());
+  for (; !it.IsAtEnd(); ++it)
+    {
+    if (std::fabs(static_cast<double>(it.Get())) > bandWidth) continue;
+
+    long hi[VDimension], lo[VDimension];
+    for (unsigned int i = 0; i < VDimension; i++)
+      {
+      const long v = it.GetIndex()[i] - m_Start[i];
+      hi[i] = std::min(v / static_cast<long>(BrickSize), m_BrickGrid[i] - 1);
+      lo[i] = (v % BrickSize == 0 && v > 0) ? v / BrickSize - 1 : hi[i];
+      }
+
+    for (unsigned int corner = 0; corner < (1u << VDimension); corner++)
+      {
+      unsigned long b = 0;
+      for (int i = VDimension - 1; i >= 0; i--)
+        {
+        b = b * m_BrickGrid[i] + ((corner >> i) & 1 ? hi[i] : lo[i]);
+        }
+      m_BrickTable[b] = 0;
+      }
+    }
+
+  for (unsigned long b = 0; b < m_BrickTable.size(); b++)
+    {
+    if (m_BrickTable[b] == 0) m_BrickTable[b] = m_NumberOfBricks++;
+    }
+
+  m_Data.assign(static_cast<unsigned long>(m_NumberOfBricks) * m_VoxelsPerBrick
+                * m_NumberOfComponents, T(0));
+}
+
+template <class T, unsigned int VDimension>
+void ParticleNarrowBandBrickMap<T, VDimension>
+::InitializeLike(const Self &other, unsigned int numberOfComponents)
+{
+  this->Clear();
+  for (unsigned int i = 0; i < VDimension; i++)
+    {
+    m_Origin[i] = other.m_Origin[i];
+    m_Start[i] = other.m_Start[i];
+    m_Size[i] = other.m_Size[i];
+    m_BrickGrid[i] = other.m_BrickGrid[i];
+    for (unsigned int j = 0; j < VDimension; j++)
+      {
+      m_PointToIndex[i][j] = other.m_PointToIndex[i][j];
+      }
+    }
+  m_BrickTable = other.m_BrickTable;
+  m_NumberOfBricks = other.m_NumberOfBricks;
+  m_VoxelsPerBrick = other.m_VoxelsPerBrick;
+  m_BandWidth = other.m_BandWidth;
+  m_NumberOfComponents = numberOfComponents;
+
+  m_Data.assign(static_cast<unsigned long>(m_NumberOfBricks) * m_VoxelsPerBrick
+                * m_NumberOfComponents, T(0));
+}
+
+template <class T, unsigned int VDimension>
+template <class TImage>
+void ParticleNarrowBandBrickMap<T, VDimension>
+::SetComponents(const TImage *image, unsigned int first, unsigned int count)
+{
+  long brick[VDimension];
+  for (unsigned int i = 0; i < VDimension; i++) brick[i] = 0;
+
+  for (unsigned long b = 0; b < m_BrickTable.size(); b++)
+    {
+    const int id = m_BrickTable[b];
+    if (id >= 0)
+      {
+      // Copy every voxel of the brick, including the shared layer, that lies
+      // inside the image.
+      long local[VDimension];
+      for (unsigned int i = 0; i < VDimension; i++) local[i] = 0;
+
+      for (unsigned long v = 0; v < m_VoxelsPerBrick; v++)
+        {
+        typename TImage::IndexType idx;
+        bool inside = true;
+        for (unsigned int i = 0; i < VDimension; i++)
+          {
+          const long x = brick[i] * BrickSize + local[i];
+          inside = inside && x < m_Size[i];
+          idx[i] = m_Start[i] + x;
+          }
+
+        if (inside)
+          {
+          const typename TImage::PixelType &px = image->GetPixel(idx);
+          T *dst = &m_Data[this->VoxelOffset(id, local) + first];
+          for (unsigned int c = 0; c < count; c++)
+            {
+            dst[c] = PixelComponent(px, c);
+            }
+          }
+
+        for (unsigned int i = 0; i < VDimension; i++)
+          {
+          if (++local[i] <= static_cast<long>(BrickSize)) break;
+          local[i] = 0;
+          }
+        }
+      }
+
+    for (unsigned int i = 0; i < VDimension; i++)
+      {
+      if (++brick[i] < m_BrickGrid[i]) break;
+      brick[i] = 0;
+      }
+    }
+}
+
+template <class T, unsigned int VDimension>
+unsigned long ParticleNarrowBandBrickMap<T, VDimension>
+::VoxelOffset(int brick, const long *local) const
+{
+  unsigned long v = 0;
+  for (int i = VDimension - 1; i >= 0; i--)
+    {
+    v = v * (BrickSize + 1) + local[i];
+    }
+  return (static_cast<unsigned long>(brick) * m_VoxelsPerBrick + v) * m_NumberOfComponents;
+}
+
+template <class T, unsigned int VDimension>
+bool ParticleNarrowBandBrickMap<T, VDimension>
+::Sample(const PointType &p, T *out, unsigned int first, unsigned int count) const
+{
+  double ci[VDimension];
+  for (unsigned int i = 0; i < VDimension; i++)
+    {
+    ci[i] = -static_cast<double>(m_Start[i]);
+    for (unsigned int j = 0; j < VDimension; j++)
+      {
+      ci[i] += m_PointToIndex[i][j] * (p[j] - m_Origin[j]);
+      }
+    }
+  return this->SampleAtIndex(ci, out, first, count);
+}
+
+template <class T, unsigned int VDimension>
+bool ParticleNarrowBandBrickMap<T, VDimension>
+::SampleAtIndex(const double *ci, T *out, unsigned int first, unsigned int count) const
+{
+  if (m_Data.empty()) return false;
+
+  long local[VDimension];
+  double frac[VDimension];
+  unsigned long b = 0;
+  for (int i = VDimension - 1; i >= 0; i--)
+    {
+    if (ci[i] < 0.0 || ci[i] > static_cast<double>(m_Size[i] - 1)) return false;
+
+    long c = static_cast<long>(ci[i]);
+    if (c > m_Size[i] - 2) c = m_Size[i] > 1 ? m_Size[i] - 2 : 0;
+    frac[i] = ci[i] - static_cast<double>(c);
+
+    const long brick = c / BrickSize;
+    local[i] = c - brick * BrickSize;
+    b = b * m_BrickGrid[i] + brick;
+    }
+
+  const int id = m_BrickTable[b];
+  if (id < 0) return false;
+
+  for (unsigned int k = 0; k < count; k++) out[k] = T(0);
+
+  for (unsigned int corner = 0; corner < (1u << VDimension); corner++)
+    {
+    long l[VDimension];
+    double w = 1.0;
+    for (unsigned int i = 0; i < VDimension; i++)
+      {
+      if ((corner >> i) & 1)
+        {
+        l[i] = local[i] + 1;
+        w *= frac[i];
+        }
+      else
+        {
+        l[i] = local[i];
+        w *= 1.0 - frac[i];
+        }
+      }
+    if (w == 0.0) continue;
+
+    const T *src = &m_Data[this->VoxelOffset(id, l) + first];
+    for (unsigned int k = 0; k < count; k++)
+      {
+      out[k] += static_cast<T>(w) * src[k];
+      }
+    }
+  return true;
+}
+
+template <class T, unsigned int VDimension>
+void ParticleNarrowBandBrickMap<T, VDimension>
+::SetNumberOfComponents(unsigned int numberOfComponents)
+{
+  if (numberOfComponents >= m_NumberOfComponents) return;
+
+  // Compact the leading components of each voxel in place, then release the
+  // unused tail.
+  const unsigned long numberOfVoxels = static_cast<unsigned long>(m_NumberOfBricks) * m_VoxelsPerBrick;
+  for (unsigned long v = 0; v < numberOfVoxels; v++)
+    {
+    for (unsigned int k = 0; k < numberOfComponents; k++)
+      {
+      m_Data[v * numberOfComponents + k] = m_Data[v * m_NumberOfComponents + k];
+      }
+    }
+  m_NumberOfComponents = numberOfComponents;
+  std::vector<T>(m_Data.begin(), m_Data.begin() + numberOfVoxels * numberOfComponents).swap(m_Data);
+}
+
+template <class T, unsigned int VDimension>
+void ParticleNarrowBandBrickMap<T, VDimension>::Clear()
+{
+  std::vector<T>().swap(m_Data);
+  std::vector<int>().swap(m_BrickTable);
+  m_NumberOfBricks = 0;
+}
+
+} // end namespace itk
+
+#endif
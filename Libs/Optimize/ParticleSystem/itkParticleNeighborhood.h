@@ -86,10 +86,25 @@ public:
   {
     itkExceptionMacro("No algorithm for finding neighbors has been specified.");
   }
-  virtual unsigned int  FindNeighborhoodPoints(const PointType &, double, PointVectorType &) const
+
+  /** These methods find the same neighborhood points (and weights) as the
+      methods above, but write them into caller-provided vectors instead of
+      returning a new one.  The vectors are cleared first and their storage is
+      reused, so a caller that keeps its vectors between queries (e.g. one set
+      per thread) does not allocate once they have grown to the typical
+      neighborhood size.  Returns the number of neighbors found.  The default
+      implementations copy the result of the methods above. */
+  virtual unsigned int FindNeighborhoodPoints(const PointType &p, double r,
+                                              PointVectorType &ret) const
   {
-    itkExceptionMacro("No algorithm for finding neighbors has been specified.");
-    return 0;
+    ret = this->FindNeighborhoodPoints(p, r);
+    return ret.size();
+  }
+  virtual unsigned int FindNeighborhoodPoints(const PointType &p, std::vector<double> &w,
+                                              double r, PointVectorType &ret) const
+  {
+    ret = this->FindNeighborhoodPoints(p, w, r);
+    return ret.size();
   }
 
   /** Set the Domain that this neighborhood will use.  The Domain object is
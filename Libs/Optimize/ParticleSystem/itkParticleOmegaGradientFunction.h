@@ -175,7 +175,15 @@ public:
 
   virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
   {
-    typename ParticleOmegaGradientFunction<TGradientNumericType, VDimension>::Pointer copy = ParticleOmegaGradientFunction<TGradientNumericType, VDimension>::New();
+    typename Self::Pointer copy = Self::New();
+    this->UpdateClone(copy);
+    return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+  }
+
+  virtual bool UpdateClone(ParticleVectorFunction<VDimension> *clone)
+  {
+    Self *copy = static_cast<Self *>(clone);
+
     copy->SetParticleSystem(this->GetParticleSystem());
     copy->m_Counter = this->m_Counter;
     copy->m_Rho = this->m_Rho;
@@ -188,6 +196,7 @@ public:
     copy->m_MaximumNeighborhoodRadius = this->m_MaximumNeighborhoodRadius;
     copy->m_FlatCutoff = this->m_FlatCutoff;
     copy->m_NeighborhoodToSigmaRatio = this->m_NeighborhoodToSigmaRatio;
+    copy->m_KernelBatch.SetMode(this->m_KernelBatch.GetMode());
 
     copy->m_SpatialSigmaCache = this->m_SpatialSigmaCache;
     copy->m_MeanCurvatureCache = this->m_MeanCurvatureCache;
@@ -198,7 +207,7 @@ public:
     copy->spherePts = this->spherePts;
     copy->CToP = this->CToP;
 
-    return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+    return true;
   }
 
 protected:
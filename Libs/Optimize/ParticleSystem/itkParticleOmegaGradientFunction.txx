@@ -17,6 +17,7 @@
 #include "vnl/vnl_matrix_fixed.h"
 #include "vnl/vnl_vector_fixed.h"
 #include "vnl/vnl_matrix.h"
+#include <limits>
 
 namespace itk {
 
@@ -37,17 +38,8 @@ ParticleOmegaGradientFunction<TGradientNumericType, VDimension>
     //  avgKappa =
     //
     //  this->ComputeKappa(m_MeanCurvatureCache->operator[](this->GetDomainNumber())->operator[](idx), dom);
-    avgKappa = 0.0;
-    const double min_sigma = 1.0e-4;
     const double epsilon = 1.0e-5;
 
-    const double M = static_cast<double>( VDimension );
-    const double MM = M * M * 2.0 + M;
-
-    double error = 1.0e6;
-    double sigma, prev_sigma;
-    sigma = initial_sigma;
-
     // Distance to plane is distance to last neighbor in the list
     double planeDist = 0.0;
     // AKM : Cutting Plane Disabled
@@ -59,92 +51,35 @@ ParticleOmegaGradientFunction<TGradientNumericType, VDimension>
     }
     */
 
-    while ( error > precision )
-    {
-        VectorType r_vec;
-        double A = 0.0;
-        double B = 0.0;
-        double C = 0.0;
-        double sigma2 = sigma * sigma;
-        double sigma22 = sigma2 * 2.0;
-
-        double mymc = m_MeanCurvatureCache->operator[] ( this->GetDomainNumber() )->operator[] ( idx );
-
-        for ( unsigned int i = 0; i < neighborhood.size(); i++ )
-        {
-            if (weights[i] < epsilon) continue;
-            double mc;
-            // AKM : Cutting Plane Disabled
-            if ( i >= ( neighborhood.size() - ( numspheres + numPlanes ) ) ) // special cases
-            {                                     // has no valid particle index
-                mc = mymc;
-            }
-            else
-            {
-                mc = m_MeanCurvatureCache->operator[] ( this->GetDomainNumber() )->operator[] ( neighborhood[i].Index );
-            }
-
-            // Curvature half-way between me and neighbor
-            double Dij = ( mymc + mc ) * 0.5;
-            double kappa = this->ComputeKappa(Dij, dom,sqrt(planeDist)); // Praful -- planedist not being used in the code
-
-            avgKappa += kappa;
-
-            for ( unsigned int n = 0; n < VDimension; n++ )
-            {
-                // Note that the Neighborhood object has already filtered the
-                // neighborhood for points whose normals differ by > 90 degrees.
-                r_vec[n] = ( pos[n] - neighborhood[i].Point[n] ) * kappa;
-            }
-
-            double r = r_vec.magnitude();
-            double r2 = r * r;
-            double alpha = exp( -r2 / sigma22 ) * weights[i];
-            A += alpha;
-            B += r2 * alpha;
-            C += r2 * r2 * alpha;
-        }   // end for i
-
-        avgKappa /= static_cast<double>( neighborhood.size() );
-
-        prev_sigma = sigma;
-
-        if ( A < epsilon )
-        {
-            err = 1;
-            avgKappa = 1.0;
-            return sigma;
-        }; // results are not meaningful
-
-        // // First order convergence update.
-        // sigma = sqrt(( 1.0 / DIM ) * ( B / A));
-
-        // old math
-        //  sigma -= (sigma2 * VDimension * A * A - A  * B) / (((2.0 * sigma * VDimension) * A * A -
-        //                                          (1.0/(sigma2*sigma))*(A*C-B*B)) + epsilon);
-
-        // New math -- results are not obviously different?
-        sigma -= ( A * ( B - A * sigma2 * M ) ) /
-                ( ( -MM * A * A * sigma ) - 3.0 * A * B * ( 1.0 / ( sigma + epsilon ) )
-                  - ( A * C + B * B ) * ( 1.0 / ( sigma2 * sigma + epsilon ) ) + epsilon );
+    double mymc = m_MeanCurvatureCache->operator[] ( this->GetDomainNumber() )->operator[] ( idx );
 
-        error = 1.0 - fabs( ( sigma / prev_sigma ) );
-
-        // Constrain sigma.
-        if ( sigma < min_sigma )
-        {
-            sigma = min_sigma;
-            error = precision; // we are done if sigma has vanished
+    this->m_KernelBatch.Clear();
+    for ( unsigned int i = 0; i < neighborhood.size(); i++ )
+    {
+        double mc;
+        // AKM : Cutting Plane Disabled
+        if ( i >= ( neighborhood.size() - ( numspheres + numPlanes ) ) ) // special cases
+        {                                     // has no valid particle index
+            mc = mymc;
         }
         else
         {
-            if (sigma < 0.0) sigma = min_sigma;
+            mc = m_MeanCurvatureCache->operator[] ( this->GetDomainNumber() )->operator[] ( neighborhood[i].Index );
         }
 
-    }   // end while (error > precision)
+        // Curvature half-way between me and neighbor
+        double Dij = ( mymc + mc ) * 0.5;
+        double kappa = this->ComputeKappa(Dij, dom,sqrt(planeDist)); // Praful -- planedist not being used in the code
+
+        // Note that the Neighborhood object has already filtered the
+        // neighborhood for points whose normals differ by > 90 degrees.
+        this->m_KernelBatch.Push( pos, neighborhood[i].Point, weights[i], kappa );
+    }
 
-    err = 0;
-    return sigma;
+    // Neighbors with weights < epsilon are skipped, and avgKappa is 1 if the
+    // estimate is not meaningful.
+    return this->m_KernelBatch.EstimateSigma( initial_sigma, precision, epsilon, err,
+                                              &avgKappa, neighborhood.size() );
 }
 
 template <class TGradientNumericType, unsigned int VDimension>
@@ -233,7 +168,7 @@ ParticleOmegaGradientFunction<TGradientNumericType, VDimension>
     }
 
     // Get the neighborhood surrounding the point "pos".
-    m_CurrentNeighborhood = system->FindNeighborhoodPoints(pos, m_CurrentWeights, neighborhood_radius, d);
+    system->FindNeighborhoodPoints(pos, m_CurrentWeights, neighborhood_radius, m_CurrentNeighborhood, d);
 
     // Add the closest point on the plane as another neighbor.
     // See http://mathworld.wolfram.com/Point-PlaneDistance.html, for example
@@ -300,7 +235,7 @@ ParticleOmegaGradientFunction<TGradientNumericType, VDimension>
             m_CurrentSigma = neighborhood_radius / this->GetNeighborhoodToSigmaRatio();
         }
 
-        m_CurrentNeighborhood = system->FindNeighborhoodPoints( pos, m_CurrentWeights, neighborhood_radius, d );
+        system->FindNeighborhoodPoints(pos, m_CurrentWeights, neighborhood_radius, m_CurrentNeighborhood, d);
 
         if (domain->IsCuttingPlaneDefined())
         {
@@ -347,8 +282,8 @@ ParticleOmegaGradientFunction<TGradientNumericType, VDimension>
     {
         m_CurrentSigma = this->GetMaximumNeighborhoodRadius() / this->GetNeighborhoodToSigmaRatio();
         neighborhood_radius = this->GetMaximumNeighborhoodRadius();
-        m_CurrentNeighborhood = system->FindNeighborhoodPoints( pos, m_CurrentWeights,
-                                                                neighborhood_radius, d );
+        system->FindNeighborhoodPoints(pos, m_CurrentWeights,
+                                       neighborhood_radius, m_CurrentNeighborhood, d);
 
         if (domain->IsCuttingPlaneDefined())
         {
@@ -421,17 +356,9 @@ typename ParticleOmegaGradientFunction<TGradientNumericType, VDimension>::Vector
     // Compute the gradients
     double sigma2inv = 1.0 / ( 2.0 * m_CurrentSigma * m_CurrentSigma + epsilon );
 
-    VectorType r;
     VectorType gradE;
 
-    for ( unsigned int n = 0; n < VDimension; n++ )
-    {
-        gradE[n] = 0.0;
-    }
-//    std::cout << gradE[0] << "\t" << gradE[1] << "\t" << gradE[2] << std::endl;
-
     double mymc = m_MeanCurvatureCache->operator[] ( d )->operator[] ( idx );
-    double A = 0.0;
 
     // AKM : Cutting Plane Disabled
     /**/
@@ -441,6 +368,7 @@ typename ParticleOmegaGradientFunction<TGradientNumericType, VDimension>::Vector
 
     /**/
 
+    this->m_KernelBatch.Clear();
     for ( unsigned int i = 0; i < m_CurrentNeighborhood.size(); i++ )
     {
         double mc;
@@ -461,25 +389,15 @@ typename ParticleOmegaGradientFunction<TGradientNumericType, VDimension>::Vector
         double kappa = this->ComputeKappa(Dij, d,sqrt(planeDist));
         //        double kappa = this->ComputeKappa( Dij, d, sqrt( 0.0 ) );
 
-        for ( unsigned int n = 0; n < VDimension; n++ )
-        {
-            // Note that the Neighborhood object has already filtered the
-            // neighborhood for points whose normals differ by > 90 degrees.
-            r[n] = ( pos[n] - m_CurrentNeighborhood[i].Point[n] ) * kappa;
-        }
-
-        double q = kappa * exp( -dot_product( r, r ) * sigma2inv );
-        //double q = exp( -dot_product(r, r) * sigma2inv);
-
-        A += q;
-
-        for ( unsigned int n = 0; n < VDimension; n++ )
-        {
-            gradE[n] += m_CurrentWeights[i] * r[n] * q;
-        }
-//        std::cout << gradE[0] << "\t" << gradE[1] << "\t" << gradE[2] << std::endl;
+        // Note that the Neighborhood object has already filtered the
+        // neighborhood for points whose normals differ by > 90 degrees.
+        this->m_KernelBatch.Push( pos, m_CurrentNeighborhood[i].Point, m_CurrentWeights[i], kappa );
     }
 
+    // all of the neighbors contribute, whatever their weights
+    double A;
+    this->m_KernelBatch.Gradient( sigma2inv, -std::numeric_limits<double>::infinity(), A, gradE.data_block() );
+
     double p = 0.0;
     if ( A > epsilon )
     {    p = -1.0 / ( A * m_CurrentSigma * m_CurrentSigma );    }
@@ -30,30 +30,32 @@ ParticleProcrustesRegistration<3>::RunRegistration(int d)
     // Do not run procrsutes for this domain if number of points less than 10
     if (numPoints < 10) return;
 
-    Procrustes3D::ShapeListType shapelist;
-    Procrustes3D::ShapeType     shapevector;
-    Procrustes3D::PointType     point;
+    // Gather the shapes into one contiguous 3 x numPoints x numShapes buffer,
+    // reading the particle storage directly when no index is missing.  The buffer is kept between
+    // registrations to avoid reallocating it every m_procrustes_interval.
+    m_Shapes.resize(static_cast<size_t>(3) * numPoints * numShapes);
 
-    // Read input shapes from file list
-
-    for(int i = d % m_DomainsPerShape; i < totalDomains; i+=m_DomainsPerShape)
+#pragma omp parallel for schedule(static)
+    for(int s = 0; s < numShapes; s++)
     {
-        shapevector.clear();
+        const int i = d % m_DomainsPerShape + s * m_DomainsPerShape;
+        const ParticleSystemType::PointContainerType *positions =
+            m_ParticleSystem->GetPositions(i).GetPointer();
+        double *shape = &m_Shapes[static_cast<size_t>(3) * numPoints * s];
+        const bool dense = positions->GetIndexRange() == positions->GetSize();
         for(int j = 0; j < numPoints; j++)
         {
-            point(0) = m_ParticleSystem->GetPosition(j,i)[0];
-            point(1) = m_ParticleSystem->GetPosition(j,i)[1];
-            point(2) = m_ParticleSystem->GetPosition(j,i)[2];
-
-            shapevector.push_back(point);
+            const PointType &point = dense ? (*positions)[j] : m_ParticleSystem->GetPosition(j,i);
+            shape[3 * j + 0] = point[0];
+            shape[3 * j + 1] = point[1];
+            shape[3 * j + 2] = point[2];
         }
-        shapelist.push_back(shapevector);
     }
 
     // Run alignment
     Procrustes3D::SimilarityTransformListType transforms;
     Procrustes3D procrustes;
-    procrustes.AlignShapes(transforms, shapelist);
+    procrustes.AlignShapes(transforms, m_Shapes.data(), numShapes, numPoints);
 
     // Construct transform matrices for each particle system.
     //    double avgscaleA = 1.0;
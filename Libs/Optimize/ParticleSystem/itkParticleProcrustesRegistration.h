@@ -119,6 +119,9 @@ private:
   bool m_RotationTranslation;
   bool m_ComputeTransformation;
   ParticleSystemType *m_ParticleSystem;
+
+  // Working copy of the shapes of one domain, see RunRegistration
+  std::vector<double> m_Shapes;
 };
 
 } // end namespace
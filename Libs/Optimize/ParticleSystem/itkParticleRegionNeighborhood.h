@@ -61,7 +61,8 @@ public:
       point.  This implementation uses a PowerOfTwoTree to sort points
       according to location. */
   virtual PointVectorType FindNeighborhoodPoints(const PointType &, double) const;
-  //  virtual unsigned int  FindNeighborhoodPoints(const PointType &, double, PointVectorType &) const;
+  virtual unsigned int FindNeighborhoodPoints(const PointType &, double, PointVectorType &) const;
+  using Superclass::FindNeighborhoodPoints;
 
   /** Override SetDomain so that we can grab the region extent info and
       construct our tree. */
@@ -24,55 +24,21 @@ void ParticleRegionNeighborhood<VDimension>::SetDomain(DomainType *d)
   m_Tree->ConstructTree(d->GetLowerBound(), d->GetUpperBound(), m_TreeLevels);
 }
 
-// template <unsigned int VDimension>
-// unsigned int
-// ParticleRegionNeighborhood<VDimension>
-// ::FindNeighborhoodPoints(const PointType &center, double radius,
-//                          PointVectorType &ret) const
-// {
-// // Compute bounding box of the given hypersphere.
-//   PointType l, u;
-//   for (unsigned int i = 0; i < VDimension; i++)
-//     {
-//     l[i] = center[i] - radius;
-//     u[i] = center[i] + radius;
-//     }
-
-//   // Grab the list of points in this bounding box.
-//   typename PointTreeType::PointIteratorListType pointlist = m_Tree->FindPointsInRegion(l, u);
-
-//   // Allocate return vector.  Reserve ensures no extra copies occur.
-//   //  PointVectorType ret;
-//   ret.reserve(pointlist.size());
-
-//   // Add any point whose distance from center is less than radius to the return
-//   // list.
-//   unsigned int k = 0;
-//   for (typename PointTreeType::PointIteratorListType::const_iterator it = pointlist.begin();
-//        it != pointlist.end(); it++)
-//     {
-//     //    double dist = this->GetDomain()->Distance(center, (*it)->Point);
-//     double sum = 0.0;
-//     for (unsigned int i = 0; i < VDimension; i++)
-//       {
-//       double q = center[i] - (*it)->Point[i];
-//       sum += q*q;
-//       }
-//     sum = sqrt(sum);
-//     if (sum< radius && sum >0 )
-//       {
-//       ret[k] = ( **it );
-//       k++;
-//       }
-//     }
-//   ret.resize(k); 
-//   return k;
-// }
-
 template <unsigned int VDimension>
 typename ParticleRegionNeighborhood<VDimension>::PointVectorType
 ParticleRegionNeighborhood<VDimension>
 ::FindNeighborhoodPoints(const PointType &center, double radius) const
+{
+  PointVectorType ret;
+  this->FindNeighborhoodPoints(center, radius, ret);
+  return ret;
+}
+
+template <unsigned int VDimension>
+unsigned int
+ParticleRegionNeighborhood<VDimension>
+::FindNeighborhoodPoints(const PointType &center, double radius,
+                         PointVectorType &ret) const
 {
   // Compute bounding box of the given hypersphere.
   PointType l, u;
@@ -82,11 +48,12 @@ ParticleRegionNeighborhood<VDimension>
     u[i] = center[i] + radius;
     }
 
-  // Grab the list of points in this bounding box.
-  typename PointTreeType::PointIteratorListType pointlist = m_Tree->FindPointsInRegion(l, u);
+  // Grab the list of points in this bounding box.  The candidate list is
+  // kept per thread so that its storage is reused between queries.
+  static thread_local typename PointTreeType::PointIteratorListType pointlist;
+  m_Tree->FindPointsInRegion(l, u, pointlist);
 
-  // Allocate return vector.  Reserve ensures no extra copies occur.
-  PointVectorType ret;
+  ret.clear();
   ret.reserve(pointlist.size());
   
   // Add any point whose distance from center is less than radius to the return
@@ -109,7 +76,7 @@ ParticleRegionNeighborhood<VDimension>
     }
   }
    
-  return ret;
+  return ret.size();
 }
 
 template <unsigned int VDimension>
@@ -16,6 +16,7 @@
 #define __itkParticleSurfaceNeighborhood_h
 
 #include "itkParticleRegionNeighborhood.h"
+#include "itkParticleGridNeighborhood.h"
 #include "itkParticleImplicitSurfaceDomain.h"
 #include "vnl/vnl_vector_fixed.h"
 
@@ -28,20 +29,24 @@ namespace itk
  * that provides bounds information and a distance metric.  This class uses a
  * PowerOfTwoPointTree to cache point and index values so that
  * FindNeighborhoodPoints is somewhat optimized. 
+ *
+ * The spatial search is delegated to TNeighborhood, which defaults to
+ * ParticleRegionNeighborhood.  ParticleGridNeighborhood may be used instead;
+ * this class only adds the surface normal based weighting.
  */
-template <class TImage>
-class ITK_EXPORT ParticleSurfaceNeighborhood : public ParticleRegionNeighborhood<TImage::ImageDimension>
+template <class TImage,
+          class TNeighborhood = ParticleRegionNeighborhood<TImage::ImageDimension> >
+class ITK_EXPORT ParticleSurfaceNeighborhood : public TNeighborhood
 {
 public:
   /** Standard class typedefs */
   typedef TImage ImageType;
   typedef ParticleSurfaceNeighborhood Self;
-  typedef ParticleRegionNeighborhood<TImage::ImageDimension> Superclass;
+  typedef TNeighborhood Superclass;
   typedef SmartPointer<Self>  Pointer;
   typedef SmartPointer<const Self> ConstPointer;
   typedef WeakPointer<const Self>  ConstWeakPointer;
   typedef typename ImageType::PixelType NumericType;
-  typedef typename Superclass::PointTreeType PointTreeType;
 
   typedef  vnl_vector_fixed<NumericType, TImage::ImageDimension> GradientVectorType;
   
@@ -52,7 +57,7 @@ public:
   itkNewMacro(Self);
 
   /** Run-time type information (and related methods). */
-  itkTypeMacro(ParticleSurfaceNeighborhood, ParticleRegionNeighborhood);
+  itkTypeMacro(ParticleSurfaceNeighborhood, TNeighborhood);
 
   /** Inherited typedefs from parent class. */
   typedef typename Superclass::PointType PointType;
@@ -61,10 +66,12 @@ public:
   typedef typename Superclass::PointVectorType PointVectorType;
 
   /** Compile a list of points that are within a specified radius of a given
-      point.  This implementation uses a PowerOfTwoTree to sort points
-      according to location. */
+      point, and weight each one by the angle between its surface normal and
+      the normal at the given point. */
   virtual PointVectorType FindNeighborhoodPoints(const PointType &, std::vector<double> &, double) const;
-  //  virtual unsigned int  FindNeighborhoodPoints(const PointType &, double, PointVectorType &) const;
+  virtual unsigned int FindNeighborhoodPoints(const PointType &, std::vector<double> &, double,
+                                              PointVectorType &) const;
+  using Superclass::FindNeighborhoodPoints;
 
   void PrintSelf(std::ostream& os, Indent indent) const
   {
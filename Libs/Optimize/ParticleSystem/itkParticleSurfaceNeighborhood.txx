@@ -18,87 +18,53 @@
 
 namespace itk
 {
-template <class TImage>
-typename ParticleSurfaceNeighborhood<TImage>::PointVectorType
-ParticleSurfaceNeighborhood<TImage>
+template <class TImage, class TNeighborhood>
+typename ParticleSurfaceNeighborhood<TImage, TNeighborhood>::PointVectorType
+ParticleSurfaceNeighborhood<TImage, TNeighborhood>
 ::FindNeighborhoodPoints(const PointType &center,
                          std::vector<double> &weights, double radius) const
+{
+  PointVectorType ret;
+  this->FindNeighborhoodPoints(center, weights, radius, ret);
+  return ret;
+}
+
+template <class TImage, class TNeighborhood>
+unsigned int
+ParticleSurfaceNeighborhood<TImage, TNeighborhood>
+::FindNeighborhoodPoints(const PointType &center, std::vector<double> &weights,
+                         double radius, PointVectorType &ret) const
 {
   const DomainType *domain = dynamic_cast<const DomainType *>(this->GetDomain());
   GradientVectorType posnormal = domain->SampleNormalVnl(center, 1.0e-10);
   //  double posnormalmag = posnormal.magnitude();
   weights.clear();
 
-  // Compute bounding box of the given hypersphere.
-  PointType l, u;
-  for (unsigned int i = 0; i < Dimension; i++)
-    {
-    l[i] = center[i] - radius;
-    u[i] = center[i] + radius;
-    }
-
-  // Grab the list of points in this bounding box.
-  typename PointTreeType::PointIteratorListType pointlist
-    = Superclass::m_Tree->FindPointsInRegion(l, u);
-
-  // Allocate return vector.  Reserve ensures no extra copies occur.
-  PointVectorType ret;
-  ret.reserve(pointlist.size());
-  weights.reserve(pointlist.size());
+  // Grab the points within the given radius of center.
+  Superclass::FindNeighborhoodPoints(center, radius, ret);
+  weights.reserve(ret.size());
 
-  std::vector<double> vec_dist;
-  std::vector<double> vec_cos;
-  
-  // Add any point whose distance from center is less than radius to the return
-  // list.
-  //  double vmax = radius;
-  for (typename PointTreeType::PointIteratorListType::const_iterator it = pointlist.begin();
-       it != pointlist.end(); it++)
+  for (unsigned int k = 0; k < ret.size(); k++)
     {
-    //    double dist = this->GetDomain()->Distance(center, (*it)->Point);
-    double sum = 0.0;
-    for (unsigned int i = 0; i < Dimension; i++)
+    GradientVectorType pn = domain->SampleNormalVnl(ret[k].Point, 1.0e-10);
+    double cosine   = dot_product(posnormal,pn); // normals already normalized
+    // double cosine = proj / (posnormalmag * pn.magnitude() + 1.0e-6);
+
+    if ( cosine >= m_FlatCutoff)
       {
-      double q = center[i] - (*it)->Point[i];
-      sum += q*q;
+      weights.push_back(1.0);
       }
-    sum = sqrt(sum);
-    
-    if ( sum < radius && sum > 0.0 )
+    else
       {
-      GradientVectorType pn = domain->SampleNormalVnl((*it)->Point, 1.0e-10);
-      double cosine   = dot_product(posnormal,pn); // normals already normalized
-      // double cosine = proj / (posnormalmag * pn.magnitude() + 1.0e-6);
-
-      // double dist   = 
-
-      
-      if ( cosine >= m_FlatCutoff)
-        {
-        // Determine distance to tangent plane by projecting the point onto the
-        // normal.
-        weights.push_back(1.0);
-
-        }
-      else
-        {
-        // Drop to zero influence over 90 degrees.
-        weights.push_back(cos((m_FlatCutoff - cosine) / (1.0+m_FlatCutoff) * 1.5708));
-
-        // More quickly drop to zero influence
-        // weights.push_back( exp((cosine - m_FlatCutoff) / (1.0 + m_FlatCutoff) * 4.0) );
+      // Drop to zero influence over 90 degrees.
+      weights.push_back(cos((m_FlatCutoff - cosine) / (1.0+m_FlatCutoff) * 1.5708));
 
-        //        vmax = dist;
-        }
-
-      ret.push_back( **it );
+      // More quickly drop to zero influence
+      // weights.push_back( exp((cosine - m_FlatCutoff) / (1.0 + m_FlatCutoff) * 4.0) );
       }
-
     }
 
-
-  
-  return ret;
+  return ret.size();
 }
 
 }
@@ -196,8 +196,17 @@ public:
                                                 double r, unsigned int d = 0) const
   {  return m_Neighborhoods[d]->FindNeighborhoodPoints(this->GetPosition(idx,d),w, r); }
 
-  //  inline int FindNeighborhoodPoints(const PointType &p,  double r, PointVectorType &vec, unsigned int d = 0) const
-  //  {  return m_Neighborhoods[d]->FindNeighborhoodPoints(p, r, vec); }
+
+  /** Versions of the above that fill caller-provided vectors, reusing their
+      storage, and return the number of neighbors found.  Callers that query
+      many times (e.g. the gradient functions) should keep these vectors
+      around between calls to avoid allocating on every query. */
+  inline unsigned int FindNeighborhoodPoints(const PointType &p, double r,
+                                             PointVectorType &vec, unsigned int d = 0) const
+  {  return m_Neighborhoods[d]->FindNeighborhoodPoints(p, r, vec); }
+  inline unsigned int FindNeighborhoodPoints(const PointType &p, std::vector<double> &w,
+                                             double r, PointVectorType &vec, unsigned int d = 0) const
+  {  return m_Neighborhoods[d]->FindNeighborhoodPoints(p, w, r, vec); }
   
   //   PointVectorType FindTransformedNeighborhoodPoints(const PointType &p, double r, unsigned int d = 0) const
   //   {
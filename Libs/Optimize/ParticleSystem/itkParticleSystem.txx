@@ -277,11 +277,15 @@ ParticleSystem<VDimension>
   // at an epsilon distance and random direction. Since we are going to add
   // positions to the list, we need to first copy the list.
   std::vector<PointType> list;
+  list.reserve(GetPositions(domain)->GetSize());
   typename PointContainerType::ConstIterator endIt = GetPositions(domain)->GetEnd();     
   for (typename PointContainerType::ConstIterator it = GetPositions(domain)->GetBegin();
        it != endIt; it++)
     {    list.push_back(*it);    }
 
+  // Splitting doubles the particle count, so grow the dense storage once.
+  m_Positions[domain]->Reserve(m_IndexCounters[domain] + list.size());
+
   for (typename std::vector<PointType>::const_iterator it = list.begin();
        it != list.end(); it++)
     {
@@ -102,6 +102,14 @@ public:
     return nullptr;
   }
 
+  /** Copy the current state of this function into an object of the same
+      type that was previously returned by Clone(), reusing its storage.  This
+      lets a solver keep a persistent clone per thread and refresh it each
+      iteration instead of allocating new clones.  Returns false if the clone
+      cannot be reused and a fresh Clone() is required. */
+  virtual bool UpdateClone(ParticleVectorFunction<VDimension> *)
+  { return false; }
+
 protected:
   ParticleVectorFunction() : m_ParticleSystem(0), m_DomainNumber(0) {}
   virtual ~ParticleVectorFunction() {}
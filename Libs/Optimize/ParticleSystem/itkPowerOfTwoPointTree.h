@@ -216,6 +216,10 @@ public:
       bounding box region. The bounding box is specified with two points, in
       this order: a lower bound followed by an upper bound.  */
   PointIteratorListType FindPointsInRegion(const PointType &, const PointType &) const;
+
+  /** Same as above, but the list is cleared and refilled in place so that its
+      storage can be reused across queries.  Returns the number of points
+      found. */
   unsigned int FindPointsInRegion(const PointType &, const PointType &, PointIteratorListType &) const;
 
   /** Return the node associated with the domain region that contains the given
@@ -65,6 +65,17 @@ PowerOfTwoPointTree<VDimension>::
 FindPointsInRegion(const PointType &lowerbound,  const PointType &upperbound) const
 {
   PointIteratorListType pointlist;
+  this->FindPointsInRegion(lowerbound, upperbound, pointlist);
+  return pointlist;
+}
+
+template <unsigned int VDimension>
+unsigned int
+PowerOfTwoPointTree<VDimension>::
+FindPointsInRegion(const PointType &lowerbound,  const PointType &upperbound,
+                   PointIteratorListType &pointlist) const
+{
+  pointlist.clear();
   NodePointerType it = this->m_Root;
 
   // If no overlap with the root node exists, then return an empty list...
@@ -77,7 +88,7 @@ FindPointsInRegion(const PointType &lowerbound,  const PointType &upperbound) co
       }
     }
    
-  return pointlist;
+  return pointlist.size();
 }
 
 template <unsigned int VDimension>
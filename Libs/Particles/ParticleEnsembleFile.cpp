@@ -0,0 +1,255 @@
+#include "ParticleEnsembleFile.h"
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+const char signature[8] = {'S', 'W', 'E', 'N', 'S', 'M', 'B', 'L'};
+const uint32_t formatVersion = 1;
+const uint64_t fixedHeaderSize = 32;
+const uint64_t blockAlignment = 64;
+
+bool IsLittleEndianHost()
+{
+  const uint16_t one = 1;
+  return *reinterpret_cast<const unsigned char *>(&one) == 1;
+}
+
+template<class T>
+void Append(std::vector<char> &header, T value)
+{
+  const char *bytes = reinterpret_cast<const char *>(&value);
+  header.insert(header.end(), bytes, bytes + sizeof(T));
+}
+
+template<class T>
+bool Extract(const char *data, size_t size, size_t &pos, T &value)
+{
+  if (pos + sizeof(T) > size) { return false; }
+  std::memcpy(&value, data + pos, sizeof(T));
+  pos += sizeof(T);
+  return true;
+}
+}
+
+//---------------------------------------------------------------------------
+ParticleEnsembleFile::ParticleEnsembleFile()
+{
+}
+
+//---------------------------------------------------------------------------
+ParticleEnsembleFile::~ParticleEnsembleFile()
+{
+  this->Close();
+}
+
+//---------------------------------------------------------------------------
+bool ParticleEnsembleFile::Write(const std::string &filename, const Eigen::MatrixXd &particles,
+                                 const std::vector<std::string> &names,
+                                 const std::vector<unsigned int> &particlesPerDomain,
+                                 unsigned int dimension)
+{
+  if (!IsLittleEndianHost()) {
+    std::cerr << "Particle ensemble files are only supported on little endian hosts" << std::endl;
+    return false;
+  }
+
+  uint64_t values = 0;
+  for (unsigned int n : particlesPerDomain) { values += static_cast<uint64_t>(n) * dimension; }
+  if (particlesPerDomain.empty() || values != static_cast<uint64_t>(particles.rows())
+      || names.size() != particlesPerDomain.size() * particles.cols()) {
+    std::cerr << "Inconsistent particle ensemble for " << filename << ": " << particles.rows()
+              << " x " << particles.cols() << " values, " << particlesPerDomain.size()
+              << " domains per subject and " << names.size() << " names" << std::endl;
+    return false;
+  }
+
+  std::vector<char> header(signature, signature + sizeof(signature));
+  Append<uint32_t>(header, formatVersion);
+  Append<uint32_t>(header, dimension);
+  Append<uint32_t>(header, static_cast<uint32_t>(particles.cols()));
+  Append<uint32_t>(header, static_cast<uint32_t>(particlesPerDomain.size()));
+  Append<uint64_t>(header, 0);   // filled in below
+  for (unsigned int n : particlesPerDomain) { Append<uint32_t>(header, n); }
+  for (const std::string &name : names) {
+    Append<uint32_t>(header, static_cast<uint32_t>(name.size()));
+    header.insert(header.end(), name.begin(), name.end());
+  }
+  header.resize((header.size() + blockAlignment - 1) / blockAlignment * blockAlignment, 0);
+  const uint64_t dataOffset = header.size();
+  std::memcpy(&header[24], &dataOffset, sizeof(dataOffset));
+
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  if (!out) {
+    std::cerr << "Error opening output file: " << filename << std::endl;
+    return false;
+  }
+  out.write(header.data(), header.size());
+  out.write(reinterpret_cast<const char *>(particles.data()), particles.size() * sizeof(double));
+  if (!out) {
+    std::cerr << "Error writing file: " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool ParticleEnsembleFile::IsEnsembleFile(const std::string &filename)
+{
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  char head[sizeof(signature)];
+  return in.read(head, sizeof(head)) && std::memcmp(head, signature, sizeof(signature)) == 0;
+}
+
+//---------------------------------------------------------------------------
+bool ParticleEnsembleFile::Open(const std::string &filename)
+{
+  this->Close();
+
+  if (!IsLittleEndianHost()) {
+    std::cerr << "Particle ensemble files are only supported on little endian hosts" << std::endl;
+    return false;
+  }
+
+#ifndef _WIN32
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Could not open particle ensemble file: " << filename << std::endl;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      this->data = static_cast<const char *>(map);
+      this->size = st.st_size;
+    }
+  }
+  close(fd);
+#endif
+
+  if (!this->data) {
+    std::ifstream in(filename.c_str(), std::ios::binary | std::ios::ate);
+    if (!in) {
+      std::cerr << "Could not open particle ensemble file: " << filename << std::endl;
+      return false;
+    }
+    // Doubles are read in place, so the buffer start must be suitably aligned,
+    // which operator new guarantees.
+    this->buffer.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    in.read(this->buffer.data(), this->buffer.size());
+    this->data = this->buffer.data();
+    this->size = this->buffer.size();
+  }
+
+  if (!this->ReadHeader(filename)) {
+    this->Close();
+    return false;
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool ParticleEnsembleFile::ReadHeader(const std::string &filename)
+{
+  size_t pos = sizeof(signature);
+  uint32_t version, dim, subjects, domains;
+  uint64_t dataOffset;
+  if (this->size < fixedHeaderSize || std::memcmp(this->data, signature, sizeof(signature)) != 0
+      || !Extract(this->data, this->size, pos, version) || version != formatVersion) {
+    std::cerr << "Not a particle ensemble file (or unsupported version): " << filename << std::endl;
+    return false;
+  }
+  Extract(this->data, this->size, pos, dim);
+  Extract(this->data, this->size, pos, subjects);
+  Extract(this->data, this->size, pos, domains);
+  Extract(this->data, this->size, pos, dataOffset);
+
+  bool ok = dim > 0 && domains > 0 && dataOffset % sizeof(double) == 0;
+  uint64_t values = 0;
+  for (uint32_t d = 0; ok && d < domains; d++) {
+    uint32_t n;
+    ok = Extract(this->data, this->size, pos, n);
+    this->domainOffsets.push_back(static_cast<int>(values));
+    this->particlesPerDomain.push_back(n);
+    values += static_cast<uint64_t>(n) * dim;
+    ok = ok && values <= this->size / sizeof(double);
+  }
+  for (uint64_t i = 0; ok && i < static_cast<uint64_t>(subjects) * domains; i++) {
+    uint32_t length;
+    ok = Extract(this->data, this->size, pos, length) && pos + length <= this->size;
+    if (ok) {
+      this->names.push_back(std::string(this->data + pos, length));
+      pos += length;
+    }
+  }
+  // bounded by division, a damaged header must not wrap the products around
+  ok = ok && pos <= dataOffset && dataOffset <= this->size
+    && values <= INT_MAX && subjects <= INT_MAX
+    && (subjects == 0 || values <= (this->size - dataOffset) / sizeof(double) / subjects);
+  if (!ok) {
+    std::cerr << "Corrupt particle ensemble file: " << filename << std::endl;
+    return false;
+  }
+
+  this->dimension = dim;
+  this->numberOfSubjects = subjects;
+  this->numberOfValues = static_cast<int>(values);
+  this->coordinates = reinterpret_cast<const double *>(this->data + dataOffset);
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void ParticleEnsembleFile::Close()
+{
+#ifndef _WIN32
+  if (this->data && this->buffer.empty()) {
+    munmap(const_cast<char *>(this->data), this->size);
+  }
+#endif
+  std::vector<char>().swap(this->buffer);
+  this->data = nullptr;
+  this->size = 0;
+  this->coordinates = nullptr;
+  this->dimension = 0;
+  this->numberOfSubjects = 0;
+  this->numberOfValues = 0;
+  this->particlesPerDomain.clear();
+  this->domainOffsets.clear();
+  this->names.clear();
+}
+
+//---------------------------------------------------------------------------
+bool ParticleEnsembleFile::ExportText(const std::string &prefix, const std::string &suffix) const
+{
+  const unsigned int domains = this->DomainsPerSubject();
+  for (int s = 0; s < this->N(); s++) {
+    for (unsigned int d = 0; d < domains; d++) {
+      const std::string filename = prefix + this->names[s * domains + d] + suffix;
+      std::ofstream out(filename.c_str());
+      if (!out) {
+        std::cerr << "Error opening output file: " << filename << std::endl;
+        return false;
+      }
+      const double *p = this->DomainData(s, d);
+      for (unsigned int j = 0; j < this->particlesPerDomain[d]; j++) {
+        for (unsigned int k = 0; k < this->dimension; k++) {
+          out << *p++ << " ";
+        }
+        out << "\n";
+      }
+    }
+  }
+  return true;
+}
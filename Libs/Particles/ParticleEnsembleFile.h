@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+
+/**
+ * Binary file holding the particles of a whole ensemble.
+ *
+ * The file starts with a header giving the point dimension, the number of
+ * subjects, the number of domains per subject, the number of particles in
+ * each domain and a name for every (subject, domain) entry.  It is followed,
+ * at a 64 byte aligned offset, by one contiguous block of float64
+ * coordinates: subject after subject, the particles of each domain in order,
+ * each particle as dimension values.  This is the column major layout of a
+ * D x N Eigen matrix, so an opened file is used in place through a memory
+ * mapping with no parsing.  Values are stored little endian, and files are
+ * only read on little endian hosts.
+ *
+ *   offset  0  char[8]   "SWENSMBL"
+ *   offset  8  uint32    format version (1)
+ *   offset 12  uint32    dimension
+ *   offset 16  uint32    number of subjects N
+ *   offset 20  uint32    domains per subject K
+ *   offset 24  uint64    offset of the coordinate block
+ *   offset 32  uint32[K] particles in each domain
+ *              N*K x (uint32 length, chars) entry names, subject major
+ *              zero padding
+ *              float64[N][D] coordinates
+ *
+ * A name is usually the file name, without extension, that the entry would
+ * have as a text particle file; ExportText writes those files.
+ */
+class ParticleEnsembleFile
+{
+public:
+  ParticleEnsembleFile();
+  ~ParticleEnsembleFile();
+
+  /** Write an ensemble.  particles is D x N with one subject per column, and
+      names holds N * particlesPerDomain.size() entry names.  Returns false,
+      printing the reason, on error. */
+  static bool Write(const std::string &filename, const Eigen::MatrixXd &particles,
+                    const std::vector<std::string> &names,
+                    const std::vector<unsigned int> &particlesPerDomain,
+                    unsigned int dimension = 3);
+
+  /** True if the file exists and starts with the ensemble signature. */
+  static bool IsEnsembleFile(const std::string &filename);
+
+  /** Map a file for reading.  Returns false, printing the reason, if it can
+      not be opened or is not a valid ensemble file. */
+  bool Open(const std::string &filename);
+
+  /** Release the mapping.  Views returned by Particles become invalid. */
+  void Close();
+
+  bool IsOpen() const
+  { return this->data != nullptr; }
+
+  /** The coordinate block as a D x N matrix, valid while the file is open. */
+  Eigen::Map<const Eigen::MatrixXd> Particles() const
+  { return Eigen::Map<const Eigen::MatrixXd>(this->coordinates, this->D(), this->N()); }
+
+  /** Coordinates of one domain of one subject: Dimension() values for each
+      particle of that domain. */
+  const double *DomainData(int subject, int domain) const
+  { return this->coordinates + static_cast<size_t>(subject) * this->D() + this->domainOffsets[domain]; }
+
+  int N() const
+  { return this->numberOfSubjects; }
+
+  int D() const
+  { return this->numberOfValues; }
+
+  unsigned int Dimension() const
+  { return this->dimension; }
+
+  unsigned int DomainsPerSubject() const
+  { return this->particlesPerDomain.size(); }
+
+  const std::vector<unsigned int> &ParticlesPerDomain() const
+  { return this->particlesPerDomain; }
+
+  /** Entry names, subject major. */
+  const std::vector<std::string> &Names() const
+  { return this->names; }
+
+  /** Write every entry as a text particle file named prefix + name + suffix,
+      in the format read by itk::ParticlePositionReader. */
+  bool ExportText(const std::string &prefix, const std::string &suffix) const;
+
+private:
+  ParticleEnsembleFile(const ParticleEnsembleFile &) = delete;
+  ParticleEnsembleFile &operator=(const ParticleEnsembleFile &) = delete;
+
+  bool ReadHeader(const std::string &filename);
+
+  const char *data = nullptr;
+  size_t size = 0;
+  std::vector<char> buffer;   // used where memory mapping is unavailable
+
+  const double *coordinates = nullptr;
+  unsigned int dimension = 0;
+  int numberOfSubjects = 0;
+  int numberOfValues = 0;
+  std::vector<unsigned int> particlesPerDomain;
+  std::vector<int> domainOffsets;
+  std::vector<std::string> names;
+};
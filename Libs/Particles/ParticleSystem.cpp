@@ -1,4 +1,5 @@
 #include "ParticleSystem.h"
+#include "ParticleEnsembleFile.h"
 
 ParticleSystem::ParticleSystem()
 {
@@ -13,6 +14,22 @@ bool ParticleSystem::LoadParticles(const std::vector<std::string> &_paths)
     return false;
   }
 
+  // A single binary ensemble file holds every subject; one column per subject.
+  if (_paths.size() == 1 && ParticleEnsembleFile::IsEnsembleFile(_paths[0])) {
+    ParticleEnsembleFile ensemble;
+    if (!ensemble.Open(_paths[0])) {
+      return false;
+    }
+    P = ensemble.Particles();
+    const int domains = ensemble.DomainsPerSubject();
+    this->paths.clear();
+    for (int i = 0; i < ensemble.N(); i++) {
+      this->paths.push_back(ensemble.Names()[i * domains]);
+    }
+    isLoaded = true;
+    return true;
+  }
+
   this->paths = _paths;
   const int N = paths.size();
   const int VDimension = 3; //TODO Don't hardcode VDimension
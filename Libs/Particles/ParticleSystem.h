@@ -9,6 +9,8 @@ class ParticleSystem
 public:
   ParticleSystem();
 
+  /** Load one text particle file per subject, or a single binary ensemble
+      file (see ParticleEnsembleFile). */
   bool LoadParticles(const std::vector<std::string> &paths);
 
   const Eigen::MatrixXd &Particles() const
@@ -1,8 +1,10 @@
 #include "ShapeEvaluation.h"
 #include "EvaluationUtil.h"
 
+#include <cmath>
 #include <iostream>
 #include <Eigen/Core>
+#include <Eigen/Eigenvalues>
 #include <Eigen/SVD>
 
 typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMajorMatrix;
@@ -48,31 +50,83 @@ double ShapeEvaluation<VDimension>::ComputeGeneralization(const ParticleSystem &
   const Eigen::MatrixXd &P = particleSystem.Particles();
 
   // Keep track of the reconstructions so we can visualize them later
-  std::vector<Reconstruction> reconstructions;
-
-  double totalDist = 0.0;
+  std::vector<Reconstruction> reconstructions(N);
+
+  // Each fold centers the other N-1 shapes, which removes any common offset,
+  // so the shapes are centered once on the overall mean to keep the Gram
+  // matrix well scaled. Its N x N Gram matrix is built once.
+  const Eigen::VectorXd center = P.rowwise().mean();
+  const Eigen::MatrixXd Pc = P.colwise() - center;
+  const Eigen::MatrixXd G = Pc.transpose() * Pc;
+
+  // The folds are independent. The leading left singular vectors of the
+  // centered D x (N-1) fold matrix Y are U = Y V S^-1, where V S^2 V^T is the
+  // eigendecomposition of the (N-1) x (N-1) Gram matrix Y^T Y, so only the
+  // nModes leading columns of U are formed.
+#pragma omp parallel for schedule(dynamic)
   for (int leave = 0; leave < N; leave++) {
+    const int M = N - 1;
+
+    // Indices of the shapes that are kept in this fold
+    std::vector<int> kept;
+    kept.reserve(M);
+    for (int i = 0; i < N; i++) {
+      if (i != leave) {
+        kept.push_back(i);
+      }
+    }
 
-    Eigen::MatrixXd Y(D, N - 1);
-    Y.leftCols(leave) = P.leftCols(leave);
-    Y.rightCols(N - leave - 1) = P.rightCols(N - leave - 1);
+    // Downdate the Gram matrix to the kept shapes and center it
+    Eigen::MatrixXd C(M, M);
+    for (int j = 0; j < M; j++) {
+      for (int i = 0; i < M; i++) {
+        C(i, j) = G(kept[i], kept[j]);
+      }
+    }
+    const Eigen::VectorXd rowMean = C.rowwise().mean();
+    const double totalMean = rowMean.mean();
+    C.colwise() -= rowMean;
+    C.rowwise() -= rowMean.transpose();
+    C.array() += totalMean;
+
+    // Eigenvalues are ascending, so the leading modes are the last columns.
+    // Modes at rounding level of the largest one span no data and are left
+    // out rather than amplified into noise.
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen(C);
+    const double minLambda = eigen.eigenvalues()(M - 1) * M * Eigen::NumTraits<double>::epsilon();
+    Eigen::MatrixXd coefficients(M, nModes);
+    for (int k = 0; k < nModes; k++) {
+      const double lambda = eigen.eigenvalues()(M - 1 - k);
+      coefficients.col(k) = eigen.eigenvectors().col(M - 1 - k);
+      // Centering the kept shapes is the same as centering the coefficients
+      coefficients.col(k).array() -= coefficients.col(k).mean();
+      coefficients.col(k) *= lambda > minLambda ? 1.0 / std::sqrt(lambda) : 0.0;
+    }
 
+    Eigen::MatrixXd Y(D, M);
+    for (int i = 0; i < M; i++) {
+      Y.col(i) = Pc.col(kept[i]);
+    }
     const Eigen::VectorXd mu = Y.rowwise().mean();
-    Y.colwise() -= mu;
-    const Eigen::VectorXd Ytest = P.col(leave);
+    const Eigen::MatrixXd epsi = Y * coefficients;
 
-    Eigen::JacobiSVD<Eigen::MatrixXd> svd(Y, Eigen::ComputeFullU);
-    const auto epsi = svd.matrixU().block(0, 0, D, nModes);
-    const auto betas = epsi.transpose() * (Ytest - mu);
-    const Eigen::VectorXd rec = epsi * betas + mu;
+    const Eigen::VectorXd Ytest = P.col(leave);
+    const Eigen::VectorXd centeredTest = Pc.col(leave) - mu;
+    const Eigen::VectorXd betas = epsi.transpose() * centeredTest;
+    const Eigen::VectorXd rec = epsi * betas + mu + center;
 
     const int numParticles = D / VDimension;
     const Eigen::Map<const RowMajorMatrix> Ytest_reshaped(Ytest.data(), numParticles, VDimension);
     const Eigen::Map<const RowMajorMatrix> rec_reshaped(rec.data(), numParticles, VDimension);
     const double dist = (rec_reshaped - Ytest_reshaped).rowwise().norm().sum() / numParticles;
-    totalDist += dist;
 
-    reconstructions.push_back({dist, leave, rec_reshaped});
+    reconstructions[leave] = {dist, leave, rec_reshaped};
+  }
+
+  // Sum in fold order so the result does not depend on the thread count.
+  double totalDist = 0.0;
+  for (int leave = 0; leave < N; leave++) {
+    totalDist += reconstructions[leave].dist;
   }
   const double generalization = totalDist / N;
 
@@ -14,7 +14,11 @@
 #include <igl/slice.h>
 #include <igl/viewer/Viewer.h>
 #include <itkeigen/Eigen/Sparse>
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <stdint.h>
+#include <string.h>
 
 using namespace std;
 using namespace Eigen;
@@ -66,6 +70,154 @@ vector<Eigen::MatrixXd> W_precomputation(Eigen::MatrixXd Vcontrol_static, Eigen:
     return v;
 }
 
+/*////////////////////////////////////////////////////////////////////////////////////////
+SPARSE W MATRIX FUNCTIONS
+*/////////////////////////////////////////////////////////////////////////////////////////
+
+// The dense W is vertices x handles, while the biharmonic weights of a vertex
+// are concentrated on a few nearby handles. Keeping the k largest weights of
+// each vertex turns the warp into a sparse product, and the rows are cached in
+// a binary file keyed by the template mesh and control points so that the
+// weights are only computed once.
+
+typedef Eigen::SparseMatrix<double, Eigen::RowMajor> SparseWType;
+
+struct sparseWOut {
+  SparseWType W;
+  Eigen::MatrixXd Vcontrol_static;  // the control points moved onto the mesh
+};
+
+// keep the k largest weights (in magnitude) of each row, rescaled so that the
+// row still sums to what it did and the warp still reproduces translations
+SparseWType W_sparsify(const Eigen::MatrixXd & W, int k){
+  k = std::max(1, std::min(k, (int) W.cols()));
+  std::vector<Eigen::Triplet<double> > triplets;
+  triplets.reserve((size_t) W.rows() * k);
+  std::vector<int> idx(W.cols());
+  for(int i = 0; i < W.rows(); i++){
+    for(int j = 0; j < W.cols(); j++){ idx[j] = j; }
+    std::nth_element(idx.begin(), idx.begin() + (k - 1), idx.end(),
+      [&W, i](int a, int b){ return std::abs(W(i,a)) > std::abs(W(i,b)); });
+    double rowSum = W.row(i).sum();
+    double keptSum = 0;
+    for(int j = 0; j < k; j++){ keptSum += W(i,idx[j]); }
+    double scale = std::abs(keptSum) > 1e-12 ? rowSum / keptSum : 1.0;
+    for(int j = 0; j < k; j++){
+      triplets.push_back(Eigen::Triplet<double>(i, idx[j], scale * W(i,idx[j])));
+    }
+  }
+  SparseWType Ws(W.rows(), W.cols());
+  Ws.setFromTriplets(triplets.begin(), triplets.end());
+  Ws.makeCompressed();
+  return Ws;
+}
+
+// FNV-1a of the template mesh, the control points and k
+uint64_t W_cacheKey(const Eigen::MatrixXd & Vcontrol_static, const Eigen::MatrixXd & TV,
+  const Eigen::MatrixXi & TT, const Eigen::MatrixXi & TF, int k){
+  uint64_t h = 14695981039346656037ULL;
+  auto add = [&h](const void * data, size_t size){
+    const unsigned char * p = static_cast<const unsigned char *>(data);
+    for(size_t i = 0; i < size; i++){ h = (h ^ p[i]) * 1099511628211ULL; }
+  };
+  int64_t dims[8] = {Vcontrol_static.rows(), Vcontrol_static.cols(), TV.rows(), TV.cols(),
+    TT.rows(), TT.cols(), TF.rows(), TF.cols()};
+  add(dims, sizeof(dims));
+  add(Vcontrol_static.data(), Vcontrol_static.size() * sizeof(double));
+  add(TV.data(), TV.size() * sizeof(double));
+  add(TT.data(), TT.size() * sizeof(int));
+  add(TF.data(), TF.size() * sizeof(int));
+  add(&k, sizeof(k));
+  return h;
+}
+
+// cache file: magic, key, rows, cols, non zeros, then the row offsets (int32,
+// rows + 1), the columns (int32), the weights (double) and the moved control
+// points (double, handles x 3)
+static const char W_CACHE_MAGIC[8] = {'S','W','P','W','C','S','R','1'};
+
+bool W_writeCache(const std::string & filename, uint64_t key, const sparseWOut & out){
+  std::ofstream file(filename.c_str(), std::ios::binary);
+  if(!file.is_open()){ return false; }
+  int64_t sizes[3] = {out.W.rows(), out.W.cols(), out.W.nonZeros()};
+  file.write(W_CACHE_MAGIC, sizeof(W_CACHE_MAGIC));
+  file.write(reinterpret_cast<const char *>(&key), sizeof(key));
+  file.write(reinterpret_cast<const char *>(sizes), sizeof(sizes));
+  std::vector<int32_t> outer(out.W.outerIndexPtr(), out.W.outerIndexPtr() + out.W.rows() + 1);
+  std::vector<int32_t> inner(out.W.innerIndexPtr(), out.W.innerIndexPtr() + out.W.nonZeros());
+  file.write(reinterpret_cast<const char *>(outer.data()), outer.size() * sizeof(int32_t));
+  file.write(reinterpret_cast<const char *>(inner.data()), inner.size() * sizeof(int32_t));
+  file.write(reinterpret_cast<const char *>(out.W.valuePtr()), out.W.nonZeros() * sizeof(double));
+  file.write(reinterpret_cast<const char *>(out.Vcontrol_static.data()), out.Vcontrol_static.size() * sizeof(double));
+  return file.good();
+}
+
+// false if the file is missing, for other inputs or damaged; W keeps the
+// surface vertices of the maxRows tet mesh vertices, so its sizes are checked
+// against those before anything is allocated
+bool W_readCache(const std::string & filename, uint64_t key, int64_t maxRows, int numHandles, sparseWOut & out){
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  if(!file.is_open()){ return false; }
+  char magic[sizeof(W_CACHE_MAGIC)];
+  uint64_t fileKey = 0;
+  int64_t sizes[3];
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char *>(&fileKey), sizeof(fileKey));
+  file.read(reinterpret_cast<char *>(sizes), sizeof(sizes));
+  if(!file || memcmp(magic, W_CACHE_MAGIC, sizeof(magic)) != 0 || fileKey != key ||
+     sizes[0] < 0 || sizes[0] > maxRows || sizes[1] != numHandles || sizes[2] < 0 ||
+     sizes[2] > sizes[0] * sizes[1] || sizes[2] > INT32_MAX){
+    return false;
+  }
+
+  std::vector<int32_t> outer(sizes[0] + 1), inner(sizes[2]);
+  std::vector<double> values(sizes[2]);
+  out.Vcontrol_static.resize(numHandles, 3);
+  file.read(reinterpret_cast<char *>(outer.data()), outer.size() * sizeof(int32_t));
+  file.read(reinterpret_cast<char *>(inner.data()), inner.size() * sizeof(int32_t));
+  file.read(reinterpret_cast<char *>(values.data()), values.size() * sizeof(double));
+  file.read(reinterpret_cast<char *>(out.Vcontrol_static.data()), out.Vcontrol_static.size() * sizeof(double));
+  if(!file || outer[0] != 0 || outer[sizes[0]] != sizes[2]){ return false; }
+
+  std::vector<Eigen::Triplet<double> > triplets;
+  triplets.reserve(sizes[2]);
+  for(int64_t i = 0; i < sizes[0]; i++){
+    if(outer[i] > outer[i + 1]){ return false; }
+    for(int32_t j = outer[i]; j < outer[i + 1]; j++){
+      if(inner[j] < 0 || inner[j] >= numHandles){ return false; }
+      triplets.push_back(Eigen::Triplet<double>(i, inner[j], values[j]));
+    }
+  }
+  out.W.resize(sizes[0], sizes[1]);
+  out.W.setFromTriplets(triplets.begin(), triplets.end());
+  out.W.makeCompressed();
+  return true;
+}
+
+// W_precomputation truncated to the k largest weights per vertex, read from
+// the cache file if it was written for the same inputs, otherwise computed
+// and written to it
+sparseWOut W_precomputation_sparse(Eigen::MatrixXd Vcontrol_static, Eigen::MatrixXd TV,
+  Eigen::MatrixXi TT, Eigen::MatrixXi TF, int k, std::string cacheFile){
+
+  sparseWOut out;
+  uint64_t key = W_cacheKey(Vcontrol_static, TV, TT, TF, k);
+  if(cacheFile.length() != 0 && W_readCache(cacheFile, key, TV.rows(), Vcontrol_static.rows(), out)){
+    std::cout << "Read the weights from " << cacheFile << std::endl;
+    return out;
+  }
+
+  vector<Eigen::MatrixXd> v = W_precomputation(Vcontrol_static, TV, TT, TF);
+  out.W = W_sparsify(v[0], k);
+  out.Vcontrol_static = v[1];
+  std::cout << "Kept " << out.W.nonZeros() << " of " << v[0].size() << " weights" << std::endl;
+  if(cacheFile.length() != 0){
+    if(W_writeCache(cacheFile, key, out)){ std::cout << "Wrote the weights to " << cacheFile << std::endl; }
+    else{ std::cerr << "Could not write the weights to " << cacheFile << std::endl; }
+  }
+  return out;
+}
+
 
 
 
@@ -43,6 +43,8 @@ Eigen::MatrixXi TF;
 
 Eigen::MatrixXd W;//(17352, 1024);
 vector<Eigen::MatrixXd> Wvec;
+SparseWType Wsparse;  // used instead of W when weights_top_k is set
+bool sparse_weights = false;
 Eigen::MatrixXd V;
 
 Eigen::MatrixXd Vref;
@@ -71,6 +73,12 @@ int data_val = 0;
 
 
 
+// the template mesh vertices for the given control points
+Eigen::MatrixXd warp(const Eigen::MatrixXd & points){
+  if(sparse_weights){ return Wsparse * (points.rowwise() + RowVector3d(1,0,0)); }
+  return W * (points.rowwise() + RowVector3d(1,0,0));
+}
+
 /*////////////////////////////////////////////////////////////////////////////////////////
 MAIN ROUTINE
 */////////////////////////////////////////////////////////////////////////////////////////
@@ -98,6 +106,8 @@ int main(int argc, char * argv[])
   int numParticles;
   int meshDecimationFlag = 0;
   float meshDecimationPercentage = 1.00;
+  int weightsTopK = 0;
+  std::string weightsCachePath ("TemplateMeshWeights.bin");
   if(loadOkay){
 
     elem = docHandle.FirstChild("point_files").Element();
@@ -176,6 +186,19 @@ int main(int argc, char * argv[])
     else{
       meshDecimationPercentage = atof(elem->GetText());
     }
+
+    elem = docHandle.FirstChild("weights_top_k").Element();
+    if (elem){
+      weightsTopK = atoi(elem->GetText());
+    }
+
+    elem = docHandle.FirstChild("weights_cache").Element();
+    if (elem){
+      inputsBuffer.str(elem->GetText());
+      inputsBuffer >> weightsCachePath;
+      inputsBuffer.clear();
+      inputsBuffer.str("");
+    }
   }
   
   if(repMeshpath.length() == 0 && repDTpath.length() == 0){
@@ -248,9 +271,17 @@ int main(int argc, char * argv[])
 
   // pre-computation of the W matrix
   std::cout << "[2] W matrix one time computation" << std::endl;
-  Wvec = W_precomputation(Vcontrol_static, TV, TT, TF);
-  W = Wvec[0];
-  Vcontrol_static = Wvec[1];
+  if(weightsTopK > 0){
+    sparse_weights = true;
+    sparseWOut newSparseWOut = W_precomputation_sparse(Vcontrol_static, TV, TT, TF, weightsTopK, weightsCachePath);
+    Wsparse = newSparseWOut.W;
+    Vcontrol_static = newSparseWOut.Vcontrol_static;
+  }
+  else{
+    Wvec = W_precomputation(Vcontrol_static, TV, TT, TF);
+    W = Wvec[0];
+    Vcontrol_static = Wvec[1];
+  }
 
   std::cout << "[3] Compute PCA for the data" << std::endl;
   eigenOut newEigenOut = findPCAModes(pointPaths, numParticles);
@@ -266,7 +297,7 @@ int main(int argc, char * argv[])
   */////////////////////////////////////////////////////////////////////////////////////////
   std::cout << "[4] Starting visualization! " <<std::endl;
   Eigen::VectorXi b;
-  Vtemp = W * (Vmean_space.rowwise() + RowVector3d(1,0,0));
+  Vtemp = warp(Vmean_space);
   igl::viewer::Viewer viewer;
   viewer.data.set_mesh(TV, TF);
   viewer.data.set_vertices(Vtemp);
@@ -380,7 +411,7 @@ int main(int argc, char * argv[])
           Vpca_mode *= Eigen::AngleAxisd(-90*3.14/180,
           Eigen::Vector3d(-1,0,-0)).toRotationMatrix(); 
           V = mode_variation(Vpca_mode, Vmean_space, eigenvalues(pca_mode_number), sig);
-          Vtemp = W * (V.rowwise() + RowVector3d(1,0,0));
+          Vtemp = warp(V);
           // std::cout << "All get fixed " <<std::endl;
           viewer.data.set_vertices(Vtemp);
 
@@ -584,7 +615,7 @@ int main(int argc, char * argv[])
         // find the point interpolation
         Vshape *= Eigen::AngleAxisd(-90*3.14/180,
           Eigen::Vector3d(-1,0,-0)).toRotationMatrix(); 
-        Vtemp = W * (Vshape.rowwise() + RowVector3d(1,0,0));
+        Vtemp = warp(Vshape);
         viewer.data.set_mesh(TV, TF);
         viewer.data.set_vertices(Vtemp);
         if(points_flag){
@@ -616,7 +647,7 @@ int main(int argc, char * argv[])
           Eigen::Vector3d(-1,0,-0)).toRotationMatrix(); 
             // find the point interpolation
             V = mode_variation(Vpca_mode, Vmean_space, eigenvalues(pca_mode_number), sig);
-            Vtemp = W * (V.rowwise() + RowVector3d(1,0,0));
+            Vtemp = warp(V);
             viewer.data.set_vertices(Vtemp);
 
             // display the overlay control points if the flag is true
@@ -24,22 +24,27 @@
 #endif // ifndef __APPLE__
 #endif // ifdef _WIN32
 
+#include <cmath>
+#include <functional>
+
 #include <Data/MeshCache.h>
 
 #include <vtkPolyData.h>
 
-bool vnl_vector_compare::operator()( const vnl_vector<double> &a, const vnl_vector<double> &b) const
+MeshCacheKey::MeshCacheKey(const vnl_vector<double>& shape, double epsilon)
 {
-  if ( a.size() < b.size() )
-    return true;
-  double eps = MeshCache::pref_ref_->get_preference("cache_epsilon", 1e-3f);
-  for ( unsigned i = 0; i < a.size(); i++ ) {
-	if ( (a[i] < b[i]) && ((b[i] - a[i]) > eps))
-		return true;
-	else if ( b[i] < a[i] && ((a[i] - b[i]) > eps))
-		return false;
+  // hash_combine from boost
+  this->values.resize(shape.size());
+  this->hash = shape.size();
+  for (unsigned i = 0; i < shape.size(); i++) {
+    this->values[i] = std::llround(shape[i] / epsilon);
+    this->hash ^= std::hash<long long>()(this->values[i]) + 0x9e3779b9 + (this->hash << 6) + (this->hash >> 2);
   }
-  return false;
+}
+
+bool MeshCacheKey::operator==(const MeshCacheKey& other) const
+{
+  return this->hash == other.hash && this->values == other.values;
 }
 
 long long MeshCache::getTotalPhysicalMemory()
@@ -89,32 +94,43 @@ long long MeshCache::getTotalAddressiblePhysicalMemory()
   if ( physical > addressable ) {return addressable; } else {return physical; }
 }
 
-Preferences *  MeshCache::pref_ref_ = 0;
-
 MeshCache::MeshCache(Preferences& prefs) : preferences_(prefs)
 {
   this->maxMemory = MeshCache::getTotalAddressiblePhysicalMemory();
   this->memorySize = 0;
-  this->pref_ref_ = &this->preferences_;
 }
 
-vtkSmartPointer<vtkPolyData> MeshCache::getMesh( const vnl_vector<double>& shape )
+MeshCacheKey MeshCache::makeKey( const vnl_vector<double>& shape )
 {
-  QMutexLocker locker( &mutex );
+  double epsilon = preferences_.get_preference("cache_epsilon", 1e-3f);
+  if ( !( epsilon > 0 ) )
+  {
+    epsilon = 1e-12;
+  }
+  return MeshCacheKey( shape, epsilon );
+}
 
+vtkSmartPointer<vtkPolyData> MeshCache::getMesh( const vnl_vector<double>& shape )
+{
   if (!preferences_.get_preference("cache_enabled", true))
   {
     return NULL;
   }
 
+  MeshCacheKey key = this->makeKey( shape );
+
+  QMutexLocker locker( &mutex );
+
   // search the cache for this shape
-  CacheMap::iterator it = this->meshCache.find( shape );
+  CacheMap::iterator it = this->meshCache.find( key );
   if ( it == this->meshCache.end() )
   {
     return NULL;
   }
 
-  return meshCache[shape];
+  // most recently used
+  this->cacheList.splice( this->cacheList.begin(), this->cacheList, it->second );
+  return it->second->mesh;
 }
 
 void MeshCache::insertMesh( const vnl_vector<double>& shape, vtkSmartPointer<vtkPolyData> mesh )
@@ -124,24 +140,30 @@ void MeshCache::insertMesh( const vnl_vector<double>& shape, vtkSmartPointer<vtk
     return;
   }
 
+  MeshCacheKey key = this->makeKey( shape );
+
   QMutexLocker locker( &mutex );
 
   // compute the memory size of this shape
-  size_t shapeSize = shape.size() * sizeof( double );
+  size_t shapeSize = key.values.size() * sizeof( long long );
   size_t meshSize = mesh->GetActualMemorySize() * 1024; // given in kb
-  size_t combinedSize = ( shapeSize * 2 ) + meshSize;
+  size_t combinedSize = shapeSize + meshSize;
+
+  // replace an existing entry
+  CacheMap::iterator it = this->meshCache.find( key );
+  if ( it != this->meshCache.end() )
+  {
+    this->memorySize -= it->second->memorySize;
+    this->cacheList.erase( it->second );
+    this->meshCache.erase( it );
+  }
 
   this->freeSpaceForAmount( combinedSize );
 
-  this->meshCache[shape] = mesh;
+  CacheListItem item = { key, mesh, combinedSize };
+  this->cacheList.push_front( item );
+  this->meshCache[key] = this->cacheList.begin();
   this->memorySize += combinedSize;
-  //std::cerr << "Cache now holds " << this->meshCache.size() << " items\n";
-
-  // add to LRC list
-  CacheListItem item;
-  item.key = shape;
-  item.memorySize = combinedSize;
-  this->cacheList.push_back( item );
 }
 
 void MeshCache::clear()
@@ -149,6 +171,7 @@ void MeshCache::clear()
   QMutexLocker locker( &mutex );
 
   this->meshCache.clear();
+  this->cacheList.clear();
   this->memorySize = 0;
 }
 
@@ -156,12 +179,13 @@ void MeshCache::freeSpaceForAmount( size_t allocation )
 {
   size_t memoryLimit = ( preferences_.get_preference("cache_memory", 25) / 100.0 ) * this->maxMemory;
 
+  // evict the least recently used
   while ( !this->cacheList.empty() && this->memorySize + allocation > memoryLimit )
   {
-    CacheListItem item = this->cacheList.back();
+    const CacheListItem& item = this->cacheList.back();
     this->memorySize -= item.memorySize;
-    this->cacheList.pop_back();
     std::cerr << "erasing item for " << item.memorySize / 1024 << " kb savings\n";
     this->meshCache.erase( item.key );
+    this->cacheList.pop_back();
   }
 }
@@ -6,15 +6,17 @@
  * @file MeshCache.h
  * @brief Thread safe cache for meshes index by shape
  *
- * The MeshCache implements a std::map keyed by shape (list of points) with vtkPolyData values.
- * It is thread-safe and can be used from any thread.
+ * The MeshCache implements a least recently used cache of vtkPolyData keyed by shape
+ * (list of points). Shapes are quantized by the cache_epsilon preference, so shapes that
+ * differ by less than that share an entry. It is thread-safe and can be used from any thread.
  */
 
 #ifndef MESH_CACHE_H
 #define MESH_CACHE_H
 
 #include <list>
-#include <map>
+#include <unordered_map>
+#include <vector>
 
 #include <QMutex>
 
@@ -24,30 +26,40 @@
 
 #include "Data/Preferences.h"
 
-//#include "itkParticleShapeStatistics.h"
-
 class vtkPolyData;
 
-class CacheListItem
+// a shape quantized to the cache epsilon, with its hash
+class MeshCacheKey
 {
 public:
-  vnl_vector<double> key;
-  size_t memorySize;
+  MeshCacheKey(const vnl_vector<double>& shape, double epsilon);
+
+  bool operator==(const MeshCacheKey& other) const;
+
+  std::vector<long long> values;
+  size_t hash;
 };
 
-// comparison class for vnl_vectors (for cache)
-class vnl_vector_compare
+class MeshCacheKeyHash
 {
 public:
-  bool operator()( const vnl_vector<double> &a, const vnl_vector<double> &b) const;
+  size_t operator()(const MeshCacheKey& key) const { return key.hash; }
 };
 
-// mesh cache type
-typedef std::map< const vnl_vector<double>, vtkSmartPointer<vtkPolyData>, vnl_vector_compare > CacheMap;
+class CacheListItem
+{
+public:
+  MeshCacheKey key;
+  vtkSmartPointer<vtkPolyData> mesh;
+  size_t memorySize;
+};
 
-// LRC list
+// LRU list, most recently used first
 typedef std::list< CacheListItem > CacheList;
 
+// mesh cache type
+typedef std::unordered_map< MeshCacheKey, CacheList::iterator, MeshCacheKeyHash > CacheMap;
+
 class MeshCache
 {
 
@@ -61,10 +73,10 @@ public:
 
   void clear();
 
-  static Preferences * pref_ref_;
-
 private:
 
+  MeshCacheKey makeKey( const vnl_vector<double>& shape );
+
   void freeSpaceForAmount( size_t allocation );
 
   static long long getTotalPhysicalMemory();
@@ -75,7 +87,7 @@ private:
   // mesh cache
   CacheMap meshCache;
 
-  // lrc list
+  // lru list
   CacheList cacheList;
 
   // size of memory in use by the cache
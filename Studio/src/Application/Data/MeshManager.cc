@@ -2,6 +2,8 @@
  * Shapeworks license
  */
 
+#include <algorithm>
+
 // qt
 #include <QThread>
 
@@ -17,17 +19,23 @@ MeshManager::MeshManager(Preferences& prefs) :
   meshGenerator_(prefs),
   surfaceReconstructor_(new SurfaceReconstructor())
 {
-  this->thread_count_ = 0;
-
   this->meshGenerator_.set_surface_reconstructor(this->surfaceReconstructor_);
 }
 
 //---------------------------------------------------------------------------
-MeshManager::~MeshManager() {}
+MeshManager::~MeshManager()
+{
+  // the workers use the queue and the cache
+  this->workQueue_.clear();
+  this->thread_pool_.clear();
+  this->thread_pool_.waitForDone();
+}
 
 //---------------------------------------------------------------------------
 void MeshManager::clear_cache()
 {
+  this->workQueue_.clear();
+  this->thread_pool_.clear();
   this->meshCache_.clear();
 }
 
@@ -35,29 +43,18 @@ void MeshManager::clear_cache()
 void MeshManager::generateMesh(const vnl_vector<double>& shape)
 {
   // check cache first
-  if (!this->meshCache_.getMesh(shape)
-      && !this->workQueue_.isInside(shape)) {
-    this->workQueue_.push(shape);
-    //todo
-    QThread* thread = new QThread;
-    MeshWorker* worker = new MeshWorker(this->prefs_, shape,
-                                        &this->workQueue_, &this->meshCache_);
-    worker->getMeshGenerator()->set_surface_reconstructor(this->surfaceReconstructor_);
+  if (!this->meshCache_.getMesh(shape) && this->workQueue_.push(shape)) {
+    int num_threads = this->prefs_.get_preference("num_threads", QThread::idealThreadCount());
+    this->thread_pool_.setMaxThreadCount(std::max(num_threads, 1));
+    this->workQueue_.setMaxWaiting(4 * this->thread_pool_.maxThreadCount());
 
-    worker->moveToThread(thread);
-    connect(thread, SIGNAL(started()), worker, SLOT(process()));
-    connect(worker, SIGNAL(result_ready()), this, SLOT(handle_thread_complete()));
-    connect(worker, SIGNAL(finished()), thread, SLOT(quit()));
-    connect(worker, SIGNAL(finished()), worker, SLOT(deleteLater()));
-    connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
-    size_t tmp_max = this->prefs_.get_preference("num_threads", QThread::idealThreadCount());
-    if (this->thread_count_ < tmp_max) {
-      thread->start();
-      this->thread_count_++;
-    }
-    else {
-      this->threads_.push_back(thread);
-    }
+    // each worker builds the newest shape waiting when it starts
+    MeshWorker* worker = new MeshWorker(this->prefs_, &this->workQueue_, &this->meshCache_);
+    worker->getMeshGenerator()->set_surface_reconstructor(this->surfaceReconstructor_);
+    worker->setAutoDelete(true);
+    connect(worker, SIGNAL(result_ready()), this, SLOT(handle_thread_complete()),
+            Qt::QueuedConnection);
+    this->thread_pool_.start(worker);
   }
 }
 
@@ -91,14 +88,6 @@ vtkSmartPointer<vtkPolyData> MeshManager::getMesh(const vnl_vector<double>& shap
 //---------------------------------------------------------------------------
 void MeshManager::handle_thread_complete()
 {
-  this->thread_count_--;
-  size_t tmp_max = this->prefs_.get_preference("num_threads", QThread::idealThreadCount());
-  while (!this->threads_.empty() && this->thread_count_ < tmp_max) {
-    QThread* thread = this->threads_.back();
-    this->threads_.pop_back();
-    thread->start();
-    this->thread_count_++;
-  }
   emit new_mesh();
 }
 
@@ -7,7 +7,7 @@
  * @brief Class to manage meshes
  *
  * The MeshManager handles all aspects of mesh generation and caching.
- * It houses the cache and manages threads to work on mesh generation
+ * It houses the cache and a thread pool to work on mesh generation
  * in the background.
  */
 
@@ -16,7 +16,7 @@
 
 #include <vtkSmartPointer.h>
 
-#include <QWaitCondition>
+#include <QThreadPool>
 
 #include <Data/MeshCache.h>
 #include <Data/MeshGenerator.h>
@@ -65,9 +65,7 @@ private:
   MeshWorkQueue workQueue_;
 
   // the workers
-  std::vector<QThread*> threads_;
-
-  size_t thread_count_;
+  QThreadPool thread_pool_;
 
   QSharedPointer<SurfaceReconstructor> surfaceReconstructor_;
 };
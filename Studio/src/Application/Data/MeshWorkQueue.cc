@@ -2,54 +2,66 @@
  * Shapeworks license
  */
 
+#include <algorithm>
+
 #include <Data/MeshWorkQueue.h>
 
-MeshWorkQueue::MeshWorkQueue()
+MeshWorkQueue::MeshWorkQueue() : maxWaiting( 64 )
 {}
 
 MeshWorkQueue::~MeshWorkQueue()
 {}
 
-void MeshWorkQueue::push( const vnl_vector<double> &item )
+bool MeshWorkQueue::push( const vnl_vector<double> &item )
 {
   QMutexLocker locker( &this->mutex );
+
+  if ( std::find( this->workList.begin(), this->workList.end(), item ) != this->workList.end() ||
+       std::find( this->processingList.begin(), this->processingList.end(), item ) != this->processingList.end() )
+  {
+    return false;
+  }
+
   this->workList.push_back( item );
+  while ( this->workList.size() > this->maxWaiting )
+  {
+    this->workList.pop_front();
+  }
+  return true;
 }
 
-MeshWorkItem* MeshWorkQueue::pop()
+bool MeshWorkQueue::pop( vnl_vector<double> &item )
 {
   QMutexLocker locker( &this->mutex );
-  MeshWorkItem* item = new MeshWorkItem;
 
   if ( this->workList.empty() )
   {
-    return NULL;
+    return false;
   }
 
-  item->shape = this->workList.front();
-  this->workList.pop_front();
-  return item;
+  item = this->workList.back();
+  this->workList.pop_back();
+  this->processingList.push_back( item );
+  return true;
 }
 
 bool MeshWorkQueue::isInside( const vnl_vector<double> &item )
 {
   QMutexLocker locker( &this->mutex );
 
-  for ( WorkList::iterator it = this->workList.begin(); it != this->workList.end(); ++it )
-  {
-    if ( *it == item )
-    {
-      return true;
-    }
-  }
-  return false;
+  return std::find( this->workList.begin(), this->workList.end(), item ) != this->workList.end() ||
+         std::find( this->processingList.begin(), this->processingList.end(), item ) != this->processingList.end();
 }
 
 void MeshWorkQueue::remove( const vnl_vector<double> &item )
 {
   QMutexLocker locker( &this->mutex );
 
-  this->workList.remove( item );
+  WorkList::iterator it = std::find( this->processingList.begin(), this->processingList.end(), item );
+  if ( it != this->processingList.end() )
+  {
+    this->processingList.erase( it );
+  }
 }
 
 bool MeshWorkQueue::isEmpty()
@@ -57,3 +69,19 @@ bool MeshWorkQueue::isEmpty()
   QMutexLocker locker( &this->mutex );
   return this->workList.empty();
 }
+
+void MeshWorkQueue::clear()
+{
+  QMutexLocker locker( &this->mutex );
+  this->workList.clear();
+}
+
+void MeshWorkQueue::setMaxWaiting( size_t max_waiting )
+{
+  QMutexLocker locker( &this->mutex );
+  this->maxWaiting = std::max( max_waiting, size_t( 1 ) );
+  while ( this->workList.size() > this->maxWaiting )
+  {
+    this->workList.pop_front();
+  }
+}
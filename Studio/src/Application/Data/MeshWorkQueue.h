@@ -6,6 +6,9 @@
  * @file MeshWorkQueue.h
  * @brief Provides concurrent access to a list of shapes to work needing reconstruction
  *
+ * Shapes are handed out newest first. Only a limited number of shapes wait at a time;
+ * beyond that the oldest are dropped, so requests that went stale (e.g. while dragging
+ * a PCA slider) are not built. A shape that is still wanted is requested again.
  */
 
 #ifndef MESH_WORK_QUEUE_H
@@ -20,12 +23,6 @@
 // vnl
 #include "vnl/vnl_vector.h"
 
-class MeshWorkItem
-{
-public:
-  vnl_vector<double> shape;
-};
-
 class MeshWorkQueue
 {
 
@@ -33,16 +30,24 @@ public:
   MeshWorkQueue();
   ~MeshWorkQueue();
 
-  void push( const vnl_vector<double> &item );
+  //! add a shape, returns false if it is already waiting or being built
+  bool push( const vnl_vector<double> &item );
 
-  MeshWorkItem* pop();
+  //! take the newest waiting shape to build, returns false if there is none
+  bool pop( vnl_vector<double> &item );
 
   bool isInside( const vnl_vector<double> &item );
 
+  //! a shape taken with pop is done
   void remove( const vnl_vector<double> &item );
 
   bool isEmpty();
 
+  //! drop all waiting shapes
+  void clear();
+
+  void setMaxWaiting( size_t max_waiting );
+
 private:
 
   // for concurrent access
@@ -51,6 +56,9 @@ private:
   typedef std::list< vnl_vector<double> > WorkList;
 
   WorkList workList;
+  WorkList processingList;
+
+  size_t maxWaiting;
 };
 
 #endif // ifndef MESH_WORK_QUEUE_H
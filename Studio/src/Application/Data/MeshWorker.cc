@@ -9,24 +9,28 @@
 
 //---------------------------------------------------------------------------
 MeshWorker::MeshWorker(Preferences& prefs,
-                       const vnl_vector<double> shape,
                        MeshWorkQueue* queue,
                        MeshCache* cache)
   : prefs_(prefs), meshGenerator_(prefs),
-  shape_(shape), queue_(queue), cache_(cache) {}
+  queue_(queue), cache_(cache) {}
 
 //---------------------------------------------------------------------------
 MeshWorker::~MeshWorker() {}
 
 //---------------------------------------------------------------------------
-void MeshWorker::process()
+void MeshWorker::run()
 {
+  // nothing to do if the shapes waiting were dropped as stale
+  vnl_vector<double> shape;
+  if (!this->queue_->pop(shape)) {
+    return;
+  }
+
   // build the mesh using our MeshGenerator
-  vtkSmartPointer<vtkPolyData> mesh = this->meshGenerator_.buildMesh(this->shape_);
-  this->queue_->remove(this->shape_);
-  this->cache_->insertMesh(this->shape_, mesh);
+  vtkSmartPointer<vtkPolyData> mesh = this->meshGenerator_.buildMesh(shape);
+  this->cache_->insertMesh(shape, mesh);
+  this->queue_->remove(shape);
   emit result_ready();
-  emit finished();
 }
 
 //---------------------------------------------------------------------------
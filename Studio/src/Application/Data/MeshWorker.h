@@ -6,42 +6,39 @@
  * @file MeshWorker.h
  * @brief Worker class for parallel mesh reconstruction
  *
- * The MeshWorker implements each thread's mesh construction management
+ * The MeshWorker is a task of the MeshManager's thread pool, it builds the newest
+ * shape waiting in the work queue
  */
 
 #ifndef MESH_WORKER_H
 #define MESH_WORKER_H
 
 #include <QObject>
-#include <QWaitCondition>
+#include <QRunnable>
 
 #include <Data/MeshWorkQueue.h>
 #include <Data/MeshCache.h>
 #include <Data/MeshGenerator.h>
 
-class MeshWorker : public QObject
+class MeshWorker : public QObject, public QRunnable
 {
   Q_OBJECT
 
 public:
   MeshWorker(Preferences& prefs,
-             const vnl_vector<double> shape,
              MeshWorkQueue* queue,
              MeshCache* cache);
   ~MeshWorker();
   MeshGenerator* getMeshGenerator();
 
-public Q_SLOTS:
-  void process();
+  void run() override;
 
 Q_SIGNALS:
   void result_ready();
-  void finished();
 
 private:
   Preferences& prefs_;
   MeshGenerator meshGenerator_;
-  vnl_vector<double> shape_;
   MeshWorkQueue* queue_;
   MeshCache* cache_;
 };
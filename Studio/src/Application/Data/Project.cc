@@ -17,6 +17,7 @@
 #include <QProgressDialog>
 
 #include <tinyxml.h>
+#include <ParticleEnsembleFile.h>
 #include <vtkPolyDataWriter.h>
 #include <vtkPolyDataReader.h>
 
@@ -453,7 +454,7 @@ bool Project::load_light_project(QString filename, string &planesFile)
   }
 
   this->reconstructed_present_ = local_point_files.size() == global_point_files.size() &&
-                                 global_point_files.size() > 1;
+                                 Project::count_point_sets(global_point_files) > 1;
 
   //this->calculate_reconstructed_samples();
 
@@ -549,7 +550,7 @@ void Project::load_groomed_images(std::vector<ImageType::Pointer> images, double
 }
 
 //---------------------------------------------------------------------------
-void Project::load_groomed_files(std::vector<std::string> file_names, double iso)
+void Project::load_groomed_files(std::vector<std::string> file_names, double iso, bool notify)
 {
   QProgressDialog progress("Loading groomed images...", "Abort", 0,
                            file_names.size(), this->parent_);
@@ -574,7 +575,9 @@ void Project::load_groomed_files(std::vector<std::string> file_names, double iso
 
   if (file_names.size() > 0) {
     this->groomed_present_ = true;
-    //emit data_changed();
+    if (notify) {
+      emit data_changed();
+    }
   }
 }
 
@@ -619,9 +622,46 @@ bool Project::get_groomed_present()
   return this->groomed_present_;
 }
 
+//---------------------------------------------------------------------------
+size_t Project::count_point_sets(const std::vector<std::string> &list)
+{
+  if (list.size() == 1 && ParticleEnsembleFile::IsEnsembleFile(list[0])) {
+    ParticleEnsembleFile ensemble;
+    return ensemble.Open(list[0]) ? ensemble.N() : 0;
+  }
+  return list.size();
+}
+
+//---------------------------------------------------------------------------
+bool Project::load_point_ensemble(std::string filename, bool local)
+{
+  ParticleEnsembleFile ensemble;
+  if (!ensemble.Open(filename)) {
+    QMessageBox::critical(0, "Error", "Unable to open file:" + QString::fromStdString(filename));
+    return false;
+  }
+  for (int i = 0; i < ensemble.N(); i++) {
+    QSharedPointer<Shape> shape;
+    if (this->shapes_.size() > i) {
+      shape = this->shapes_[i];
+    }
+    else {
+      shape = QSharedPointer<Shape>(new Shape);
+      this->shapes_.push_back(shape);
+    }
+    shape->import_points(ensemble.Particles().col(i).data(), ensemble.D() / 3, local);
+  }
+  return true;
+}
+
 //---------------------------------------------------------------------------
 bool Project::load_point_files(std::vector<std::string> list, bool local)
 {
+  // a single binary ensemble file holds the points of every shape
+  if (list.size() == 1 && ParticleEnsembleFile::IsEnsembleFile(list[0])) {
+    return this->load_point_ensemble(list[0], local);
+  }
+
   QProgressDialog progress("Loading point files...", "Abort", 0, list.size(), this->parent_);
   progress.setWindowModality(Qt::WindowModal);
   //progress.show();
@@ -50,11 +50,14 @@ public:
     void load_original_files( std::vector<std::string> file_names );
 
   /// load groomed files
-  void load_groomed_files(std::vector<std::string> file_names, double iso);
+  void load_groomed_files(std::vector<std::string> file_names, double iso,
+                          bool notify = false);
   void load_groomed_images(std::vector<ImageType::Pointer> images, double iso);
 
   /// load point files
   bool load_point_files(std::vector<std::string> file_names, bool local);
+  /// load all shapes' points from one binary particle ensemble file
+  bool load_point_ensemble(std::string filename, bool local);
   bool update_points(std::vector<std::vector<itk::Point<double> > > points, bool local);
 
   void set_reconstructed_present(bool b);
@@ -112,6 +115,9 @@ private:
 
   void renumber_shapes();
 
+  /// number of point sets in a point file list, expanding an ensemble file
+  static size_t count_point_sets(const std::vector<std::string> &list);
+
   QWidget* parent_;
 
   /// project filename
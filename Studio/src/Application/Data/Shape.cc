@@ -117,6 +117,16 @@ bool Shape::import_points(std::vector<itk::Point<double>> points, bool local)
   return true;
 }
 
+//---------------------------------------------------------------------------
+bool Shape::import_points(const double* coordinates, size_t num_points, bool local)
+{
+  auto & point_list = local ? this->local_correspondence_points_ :
+                      this->global_correspondence_points_;
+  point_list.set_size(num_points * 3);
+  point_list.copy_in(coordinates);
+  return true;
+}
+
 //---------------------------------------------------------------------------
 bool Shape::import_local_point_file(QString filename)
 {
@@ -47,6 +47,8 @@ public:
   bool import_local_point_file(QString filename);
   /// Import local correspondence point data
   bool import_points(std::vector<itk::Point<double>> points, bool local);
+  /// Import local or global correspondence points from x,y,z triples
+  bool import_points(const double* coordinates, size_t num_points, bool local);
 
   /// Retrieve the reconstructed mesh
   QSharedPointer<Mesh> get_reconstructed_mesh();
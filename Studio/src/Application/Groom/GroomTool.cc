@@ -146,15 +146,34 @@ void GroomTool::on_run_groom_button_clicked()
   emit message("Please wait: running groom step...");
   emit progress(5);
   auto shapes = this->project_->get_shapes();
-  std::vector<ImageType::Pointer> imgs;
+
+  // groom from the original files when they are all known, writing the
+  // groomed images next to them, so that only the images being worked on are
+  // in memory; otherwise groom copies of the loaded images
+  std::vector<std::string> inputs;
+  this->groomed_files_.clear();
   for (auto s : shapes) {
-    imgs.push_back(s->get_original_image());
+    auto name = s->get_original_filename_with_path().toStdString();
+    if (name.empty()) {
+      inputs.clear();
+      this->groomed_files_.clear();
+      break;
+    }
+    inputs.push_back(name);
+    this->groomed_files_.push_back(name.substr(0, name.find_last_of(".")) + "_DT.nrrd");
+  }
+  std::vector<ImageType::Pointer> imgs;
+  if (inputs.empty()) {
+    for (auto s : shapes) {
+      imgs.push_back(s->get_original_image());
+    }
   }
   this->groom_ = new QGroom(this, imgs, 0., 1.,
                             this->ui_->blur_sigma->value(),
                             this->ui_->padding_amount->value(),
                             this->ui_->antialias_iterations->value(),
                             true);
+  this->groom_->setFiles(inputs, this->groomed_files_);
 
   emit progress(15);
   if (this->ui_->center_checkbox->isChecked()) {
@@ -197,8 +216,13 @@ void GroomTool::on_run_groom_button_clicked()
 void GroomTool::handle_thread_complete()
 {
   emit progress(95);
-  this->project_->load_groomed_images(this->groom_->getImages(),
-                                      this->ui_->fastmarching_checkbox->isChecked() ? 0. : 0.5);
+  double iso = this->ui_->fastmarching_checkbox->isChecked() ? 0. : 0.5;
+  if (this->groomed_files_.empty()) {
+    this->project_->load_groomed_images(this->groom_->getImages(), iso);
+  }
+  else {
+    this->project_->load_groomed_files(this->groomed_files_, iso, true);
+  }
   emit progress(100);
   emit message("Groom Complete");
   emit groom_complete();
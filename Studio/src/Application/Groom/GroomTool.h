@@ -60,6 +60,7 @@ private:
   Preferences& preferences_;
   std::vector<std::string>& files_;
   QGroom* groom_;
+  std::vector<std::string> groomed_files_;  // written by a streaming groom
 };
 
 #endif /* STUDIO_GROOM_GROOMTOOL_H */
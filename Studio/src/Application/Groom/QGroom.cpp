@@ -1,5 +1,9 @@
 #include "QGroom.h"
 
+#include <itkNrrdImageIOFactory.h>
+#include <itkMetaImageIOFactory.h>
+#include <itkOrientImageFilter.h>
+
 QGroom::QGroom(QObject * parent,
   std::vector<ImageType::Pointer> inputs,
   double background, double foreground,
@@ -9,49 +13,41 @@ QGroom::QGroom(QObject * parent,
     background, foreground, sigma,
      padding, iterations, verbose) {}
 
+void QGroom::setFiles(const std::vector<std::string>& inputs,
+                      const std::vector<std::string>& outputs) {
+  this->inputs_ = inputs;
+  this->outputs_ = outputs;
+}
+
 void QGroom::run() {
-  this->seed_.Fill(0);
-  size_t ran = 0, total = this->runTools_.size() * this->images_.size();
-  if (this->runTools_.count("center")) {
-    for (size_t i = 0; i < this->images_.size(); i++) {
-      this->center(static_cast<int>(i));
-      emit progress(++ran * 100 / total);
-    }
-  }
-  if (this->runTools_.count("isolate")) {
-    for (size_t i = 0; i < this->images_.size(); i++) {
-      this->isolate(static_cast<int>(i));
-      emit progress(++ran * 100 / total);
-    }
-  }
-  if (this->runTools_.count("hole_fill")) {
-    for (size_t i = 0; i < this->images_.size(); i++) {
-      this->hole_fill(static_cast<int>(i));
-      emit progress(++ran * 100 / total);
-    }
-  }
-  if (this->runTools_.count("auto_pad")) {
-    for (size_t i = 0; i < this->images_.size(); i++) {
-      this->auto_pad(static_cast<int>(i));
-      emit progress(++ran * 100 / total);
-    }
+  // the images are groomed concurrently, each through all of the tools
+  this->done_ = 0;
+  if (this->inputs_.empty()) {
+    this->runParallel();
+    return;
   }
-  if (this->runTools_.count("antialias")) {
-    for (size_t i = 0; i < this->images_.size(); i++) {
-      this->antialias(static_cast<int>(i));
-      emit progress(++ran * 100 / total);
-    }
-  }
-  if (this->runTools_.count("fastmarching")) {
-    for (size_t i = 0; i < this->images_.size(); i++) {
-      this->fastmarching(static_cast<int>(i));
-      emit progress(++ran * 100 / total);
-    }
-  }
-  if (this->runTools_.count("blur")) {
-    for (size_t i = 0; i < this->images_.size(); i++) {
-      this->blur(static_cast<int>(i));
-      emit progress(++ran * 100 / total);
-    }
+  // registered here, not by the workers
+  itk::NrrdImageIOFactory::RegisterOneFactory();
+  itk::MetaImageIOFactory::RegisterOneFactory();
+  this->runStreaming(this->inputs_, this->outputs_);
+}
+
+ImageType::Pointer QGroom::readImage(const std::string& filename, bool informationOnly) {
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(filename);
+  itk::OrientImageFilter<ImageType, ImageType>::Pointer orienter =
+    itk::OrientImageFilter<ImageType, ImageType>::New();
+  orienter->UseImageDirectionOn();
+  orienter->SetDesiredCoordinateOrientation(itk::SpatialOrientation::ITK_COORDINATE_ORIENTATION_RAI);
+  orienter->SetInput(reader->GetOutput());
+  if (informationOnly) {
+    orienter->UpdateOutputInformation();
+  } else {
+    orienter->Update();
   }
+  return orienter->GetOutput();
+}
+
+void QGroom::imageDone(size_t which) {
+  emit progress(static_cast<int>(++this->done_ * 100 / this->images_.size()));
 }
@@ -3,6 +3,10 @@
 #include <Groom/ShapeWorksGroom.h>
 #include <QObject>
 
+#include <atomic>
+#include <string>
+#include <vector>
+
 class QGroom : public QObject, public ShapeWorksGroom {
   Q_OBJECT;
 public:
@@ -14,5 +18,16 @@ public:
 signals:
   void progress(int);
 public:
+  // groom the files instead of the images given to the constructor, with
+  // only the images being worked on in memory
+  void setFiles(const std::vector<std::string>& inputs,
+                const std::vector<std::string>& outputs);
   virtual void run();
+protected:
+  virtual void imageDone(size_t which);
+  // read as Studio does, oriented to RAI
+  virtual ImageType::Pointer readImage(const std::string& filename, bool informationOnly);
+private:
+  std::atomic<size_t> done_;
+  std::vector<std::string> inputs_, outputs_;
 };
@@ -6,6 +6,9 @@
 #include <vector>
 #include <map>
 #include <stdexcept>
+#include <exception>
+#include <thread>
+#include <algorithm>
 
 #include "vnl/vnl_vector.h"
 #include "bounding_box.h"
@@ -71,6 +74,144 @@ void ShapeWorksGroom::run() {
   }
 }
 
+void ShapeWorksGroom::runImage(size_t which) {
+  auto i = static_cast<int>(which);
+  if (this->runTools_.count("center")) {
+    this->center(i);
+  }
+  if (this->runTools_.count("isolate")) {
+    this->isolate(i);
+  }
+  if (this->runTools_.count("hole_fill")) {
+    this->hole_fill(i);
+  }
+  if (this->runTools_.count("auto_pad")) {
+    this->auto_pad(i);
+  }
+  if (this->runTools_.count("antialias")) {
+    this->antialias(i);
+  }
+  if (this->runTools_.count("fastmarching")) {
+    this->fastmarching(i);
+  }
+  if (this->runTools_.count("blur")) {
+    this->blur(i);
+  }
+}
+
+void ShapeWorksGroom::runParallel(size_t workers) {
+  this->seed_.Fill(0);
+  // the only step across images, done up front so the images are independent
+  if (this->runTools_.count("auto_pad") && !this->paddingInit_) {
+    this->computeBoundingBox();
+  }
+  auto numWorkers = static_cast<int>(workers > 0 ? workers : std::thread::hardware_concurrency());
+  std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic, 1) num_threads(std::max(numWorkers, 1))
+  for (int i = 0; i < static_cast<int>(this->images_.size()); i++) {
+    try {
+      this->runImage(i);
+      this->imageDone(i);
+    } catch (...) {
+#pragma omp critical
+      {
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void ShapeWorksGroom::runStreaming(const std::vector<std::string>& inputs,
+                                   const std::vector<std::string>& outputs,
+                                   size_t workers) {
+  if (inputs.size() != outputs.size()) {
+    throw std::invalid_argument("The number of groom inputs and outputs differ");
+  }
+  this->seed_.Fill(0);
+  // auto_pad only needs the regions, which are in the headers
+  if (this->runTools_.count("auto_pad") && !this->paddingInit_) {
+    this->computeBoundingBox(inputs);
+  }
+  this->images_.assign(inputs.size(), ImageType::Pointer());
+  auto numWorkers = static_cast<int>(workers > 0 ? workers : std::thread::hardware_concurrency());
+  std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic, 1) num_threads(std::max(numWorkers, 1))
+  for (int i = 0; i < static_cast<int>(inputs.size()); i++) {
+    try {
+      this->images_[i] = this->readImage(inputs[i], false);
+      this->runImage(i);
+      WriterType::Pointer writer = WriterType::New();
+      writer->SetFileName(outputs[i]);
+      writer->SetInput(this->images_[i]);
+      writer->SetUseCompression(true);
+      writer->Update();
+      this->images_[i] = ImageType::Pointer();
+      this->imageDone(i);
+    } catch (...) {
+      this->images_[i] = ImageType::Pointer();
+#pragma omp critical
+      {
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+ImageType::Pointer ShapeWorksGroom::readImage(const std::string& filename, bool informationOnly) {
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(filename);
+  if (informationOnly) {
+    reader->UpdateOutputInformation();
+  } else {
+    reader->Update();
+  }
+  return reader->GetOutput();
+}
+
+void ShapeWorksGroom::computeBoundingBox() {
+  for (size_t i = 0; i < this->images_.size(); i++) {
+    auto region = this->images_[i]->GetLargestPossibleRegion();
+    ImageType::IndexType lowerTmp = region.GetIndex();
+    ImageType::IndexType upperTmp = lowerTmp + region.GetSize();
+    for (unsigned int d = 0; d < 3; d++) {
+      if (i == 0 || lowerTmp[d] < this->lower_[d]) {
+        this->lower_[d] = lowerTmp[d];
+      }
+      if (i == 0 || upperTmp[d] > this->upper_[d]) {
+        this->upper_[d] = upperTmp[d];
+      }
+    }
+  }
+  this->paddingInit_ = true;
+}
+
+void ShapeWorksGroom::computeBoundingBox(const std::vector<std::string>& files) {
+  for (size_t i = 0; i < files.size(); i++) {
+    auto region = this->readImage(files[i], true)->GetLargestPossibleRegion();
+    ImageType::IndexType lowerTmp = region.GetIndex();
+    ImageType::IndexType upperTmp = lowerTmp + region.GetSize();
+    for (unsigned int d = 0; d < 3; d++) {
+      if (i == 0 || lowerTmp[d] < this->lower_[d]) {
+        this->lower_[d] = lowerTmp[d];
+      }
+      if (i == 0 || upperTmp[d] > this->upper_[d]) {
+        this->upper_[d] = upperTmp[d];
+      }
+    }
+  }
+  this->paddingInit_ = true;
+}
+
 std::map<std::string, bool> ShapeWorksGroom::tools() {
   return this->runTools_;
 }
@@ -237,33 +378,10 @@ void ShapeWorksGroom::auto_pad(int which) {
     std::cout << "*** RUNNING TOOL: auto_pad on " <<
       (which == -1 ? "all" : std::to_string(which)) << std::endl;
   }
-  bool first = true;
   auto start = (which == -1 ? 0 : which);
   auto end = (which == -1 ? this->images_.size() : which + 1);
   if (!this->paddingInit_) {
-    for (size_t i = 0; i < this->images_.size(); i++) {
-      auto img = this->images_[i];
-      if (first == true) {
-        first = false;
-        this->lower_ = img->GetLargestPossibleRegion().GetIndex();
-        this->upper_ = lower_ + img->GetLargestPossibleRegion().GetSize();
-      } else {
-        // Keep the largest bounding box.
-        ImageType::RegionType::IndexType lowerTmp
-          = img->GetLargestPossibleRegion().GetIndex();
-        ImageType::RegionType::IndexType upperTmp
-          = lowerTmp + img->GetLargestPossibleRegion().GetSize();
-        for (unsigned int i = 0; i < 3; i++) {
-          if (lowerTmp[i] < this->lower_[i]) { 
-            this->lower_[i] = lowerTmp[i];
-          }
-          if (upperTmp[i] > this->upper_[i]){
-            this->upper_[i] = upperTmp[i];
-          }
-        }
-      }
-    }
-    this->paddingInit_ = true;
+    this->computeBoundingBox();
   }
   if (this->verbose_) {
     std::cout << "Lower bound = " << this->lower_[0] << " " << this->lower_[1]
@@ -29,11 +29,29 @@ public:
                   size_t padding = 0, size_t iterations = 100,
                   bool verbose = false);
   virtual void run();
+  // runs the queued tools one image at a time, all tools in turn on each
+  // image, with up to 'workers' images concurrently (0 for the default)
+  void runParallel(size_t workers = 0);
+  // reads, grooms and writes each image in turn, with up to 'workers' images
+  // concurrently, so that at most 'workers' volumes are in memory
+  void runStreaming(const std::vector<std::string>& inputs,
+                    const std::vector<std::string>& outputs, size_t workers = 0);
   void queueTool(std::string tool);
   std::vector<ImageType::Pointer> getImages();
   double foreground();
   std::map<std::string, bool> tools();
 protected:
+  // the queued tools on one image, in the order of run()
+  void runImage(size_t which);
+  // called when an image is done by runParallel or runStreaming, from the
+  // worker thread
+  virtual void imageDone(size_t which) {}
+  // reads an image for runStreaming, only its header if informationOnly
+  virtual ImageType::Pointer readImage(const std::string& filename, bool informationOnly);
+  // the largest region of the images, for auto_pad
+  void computeBoundingBox();
+  // the same from the headers of the files, without reading the voxels
+  void computeBoundingBox(const std::vector<std::string>& files);
   void isolate(int which = -1);
   void hole_fill(int which = -1);
   void center(int which = -1);
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+
+#include <itkImageRegionConstIterator.h>
+#include <itkNrrdImageIOFactory.h>
+
+#include <ShapeWorksGroom.h>
+
+#include <cstdio>
+
+#include "TestConfiguration.h"
+
+//---------------------------------------------------------------------------
+static std::vector<std::string> sphere_files()
+{
+  std::string test_location = std::string(TEST_DATA_DIR) + std::string("/sphere/");
+  std::vector<std::string> files;
+  for (auto name : {"sphere10.nrrd", "sphere20.nrrd", "sphere30.nrrd"}) {
+    files.push_back(test_location + name);
+  }
+  return files;
+}
+
+//---------------------------------------------------------------------------
+static ImageType::Pointer read_image(const std::string &filename)
+{
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(filename);
+  reader->Update();
+  return reader->GetOutput();
+}
+
+//---------------------------------------------------------------------------
+static std::vector<ImageType::Pointer> read_spheres()
+{
+  std::vector<ImageType::Pointer> images;
+  for (auto file : sphere_files()) {
+    images.push_back(read_image(file));
+  }
+  return images;
+}
+
+//---------------------------------------------------------------------------
+static void expect_same_image(ImageType::Pointer image, ImageType::Pointer expected)
+{
+  ASSERT_EQ(image->GetLargestPossibleRegion(), expected->GetLargestPossibleRegion());
+  ASSERT_EQ(image->GetOrigin(), expected->GetOrigin());
+  ASSERT_EQ(image->GetSpacing(), expected->GetSpacing());
+  itk::ImageRegionConstIterator<ImageType> it(image, image->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<ImageType> jt(expected, expected->GetLargestPossibleRegion());
+  for (; !it.IsAtEnd(); ++it, ++jt) {
+    ASSERT_EQ(it.Get(), jt.Get());
+  }
+}
+
+//---------------------------------------------------------------------------
+static void queue_tools(ShapeWorksGroom &groom)
+{
+  for (auto tool : {"center", "isolate", "hole_fill", "auto_pad", "antialias", "blur"}) {
+    groom.queueTool(tool);
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(GroomTests, parallel_test) {
+
+  itk::NrrdImageIOFactory::RegisterOneFactory();
+
+  // the tools change the images they are given, so each run reads its own
+  ShapeWorksGroom serial(read_spheres(), 0., 1., 1.0, 5, 10);
+  queue_tools(serial);
+  serial.run();
+
+  ShapeWorksGroom parallel(read_spheres(), 0., 1., 1.0, 5, 10);
+  queue_tools(parallel);
+  parallel.runParallel(2);
+
+  // streamed from and to files, with the auto_pad bounds from the headers
+  std::vector<std::string> outputs;
+  for (size_t i = 0; i < sphere_files().size(); i++) {
+    outputs.push_back("groom_streaming_test_" + std::to_string(i) + ".nrrd");
+  }
+  ShapeWorksGroom streaming(std::vector<ImageType::Pointer>(), 0., 1., 1.0, 5, 10);
+  queue_tools(streaming);
+  streaming.runStreaming(sphere_files(), outputs, 2);
+  for (auto image : streaming.getImages()) {
+    ASSERT_TRUE(image.IsNull());  // freed once written
+  }
+
+  // one image at a time through all the tools gives the same images as
+  // each tool over all the images
+  auto expected = serial.getImages();
+  auto images = parallel.getImages();
+  ASSERT_EQ(images.size(), expected.size());
+  for (size_t i = 0; i < images.size(); i++) {
+    expect_same_image(images[i], expected[i]);
+    expect_same_image(read_image(outputs[i]), expected[i]);
+    std::remove(outputs[i].c_str());
+  }
+}
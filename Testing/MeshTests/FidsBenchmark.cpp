@@ -0,0 +1,228 @@
+// Times reading a .fids file and TriMesh::GetFeatureValues with its face
+// index map.
+//
+// usage: FidsBenchmark mesh.ply file.fids dt.nrrd [numQueries]
+//
+// The fids file may be in the text or in the binary format; it is converted
+// to the other one in the working directory to time both readers. The queries
+// are the mesh vertices moved by a fraction of a voxel, so they fall in the
+// narrow band; those that miss it are dropped. GetTriangleInfoForPoint and
+// GetFeatureValues are timed against copies of the way they were before, over
+// a std::map of the same face index map, and must give the same results.
+
+#include "TriMesh.h"
+
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef itk::Image<float, 3> ImageType;
+typedef std::chrono::steady_clock Clock;
+typedef std::map<TriMesh::VoxelIndexType, std::vector<int> > FaceIndexMap;
+
+//---------------------------------------------------------------------------
+static double Seconds(const Clock::time_point &start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+//---------------------------------------------------------------------------
+// TriMesh::GetTriangleInfoForPoint as it was with the std::map, including the
+// second lookup and the copy of the face list; -1 if the voxel is not in the
+// map, where it fell back to the nearest vertex.
+static int MapTriangleInfo(TriMesh *mesh, FaceIndexMap &faceIndexMap, point x,
+                           TriMesh::Face &triangleX, float &alphaX, float &betaX, float &gammaX)
+{
+  TriMesh::VoxelIndexType linearIndX = mesh->physicalPointToLinearIndex(x);
+  FaceIndexMap::iterator it = faceIndexMap.find(linearIndX);
+  if (it == faceIndexMap.end()) {
+    return -1;
+  }
+  std::vector<int> faceList = faceIndexMap[linearIndX];
+
+  double minDist = LARGENUM;
+  int winnerIndex;
+  for (std::vector<int>::iterator it = faceList.begin(); it != faceList.end(); ++it) {
+    triangleX = mesh->faces[(*it)];
+    point projPoint;
+    double dist = mesh->pointTriangleDistance(x, triangleX, projPoint);
+    if (dist < minDist) {
+      minDist = dist;
+      winnerIndex = (*it);
+    }
+  }
+
+  triangleX = mesh->faces[winnerIndex];
+  point projPoint;
+  mesh->pointTriangleDistance(x, triangleX, projPoint);
+  vec barycentric = mesh->ComputeBarycentricCoordinates(projPoint, triangleX);
+  alphaX = barycentric[0];
+  betaX = barycentric[1];
+  gammaX = barycentric[2];
+  return winnerIndex;
+}
+
+//---------------------------------------------------------------------------
+// TriMesh::GetFeatureValues over MapTriangleInfo.
+static void MapFeatureValues(TriMesh *mesh, FaceIndexMap &faceIndexMap, point x,
+                             std::vector<float> &vals)
+{
+  float alphaX, betaX, gammaX;
+  TriMesh::Face triangleX;
+  MapTriangleInfo(mesh, faceIndexMap, x, triangleX, alphaX, betaX, gammaX);
+  if (alphaX < 0.000001f)
+    alphaX = 0.000001f;
+  if (betaX < 0.000001f)
+    betaX = 0.000001f;
+  if (gammaX < 0.000001f)
+    gammaX = 0.000001f;
+
+  alphaX /= (alphaX + betaX + gammaX);
+  betaX /= (alphaX + betaX + gammaX);
+  gammaX /= (alphaX + betaX + gammaX);
+
+  vals.resize(mesh->GetNumberOfFeatures());
+  for (unsigned int i = 0; i < mesh->GetNumberOfFeatures(); i++) {
+    float f0 = mesh->features[i][triangleX.v[0]];
+    float f1 = mesh->features[i][triangleX.v[1]];
+    float f2 = mesh->features[i][triangleX.v[2]];
+    vals[i] = (alphaX * f0) + (betaX * f1) + (gammaX * f2);
+  }
+}
+
+//---------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  if (argc < 4) {
+    std::cerr << "usage: " << argv[0] << " mesh.ply file.fids dt.nrrd [numQueries]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const int numQueries = argc > 4 ? std::atoi(argv[4]) : 1000000;
+
+  itk::ImageFileReader<ImageType>::Pointer reader = itk::ImageFileReader<ImageType>::New();
+  reader->SetFileName(argv[3]);
+  reader->UpdateOutputInformation();
+  const ImageType *dt = reader->GetOutput();
+
+  TriMesh *mesh = TriMesh::read(argv[1]);
+  if (!mesh) {
+    return EXIT_FAILURE;
+  }
+  orient(mesh);
+  for (int i = 0; i < 3; i++) {
+    mesh->imageOrigin[i] = dt->GetOrigin()[i];
+    mesh->imageSpacing[i] = dt->GetSpacing()[i];
+    mesh->imageSize[i] = dt->GetLargestPossibleRegion().GetSize()[i];
+  }
+  mesh->need_adjacentfaces();
+
+  // one feature, the height of each vertex
+  mesh->features.resize(1);
+  for (size_t v = 0; v < mesh->vertices.size(); v++) {
+    mesh->features[0].push_back(mesh->vertices[v][2]);
+  }
+
+  // the file in both formats
+  const bool binary = FaceIndexTable::IsBinaryFile(argv[2]);
+  mesh->ReadFaceIndexMap(argv[2]);
+  if (mesh->faceIndexTable.Empty()) {
+    std::cerr << "no face indices in " << argv[2] << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string other = binary ? "fids_benchmark_text.fids" : "fids_benchmark_binary.fids";
+  mesh->WriteFaceIndexMap(other.c_str(), !binary);
+  const char *textFile = binary ? other.c_str() : argv[2];
+  const char *binaryFile = binary ? argv[2] : other.c_str();
+
+  Clock::time_point start = Clock::now();
+  mesh->ReadFaceIndexMap(textFile);
+  std::printf("read text    %.4f s\n", Seconds(start));
+
+  start = Clock::now();
+  mesh->ReadFaceIndexMap(binaryFile);
+  std::printf("read binary  %.4f s\n", Seconds(start));
+  std::printf("%zu voxels, %zu faces\n", mesh->faceIndexTable.Voxels(), mesh->faceIndexTable.Faces());
+
+  FaceIndexMap faceIndexMap;
+  for (size_t i = 0; i < mesh->faceIndexTable.Voxels(); i++) {
+    const int *begin, *end;
+    const TriMesh::VoxelIndexType key = mesh->faceIndexTable.Key(i);
+    mesh->faceIndexTable.Find(key, begin, end);
+    faceIndexMap[key].assign(begin, end);
+  }
+
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> offset(-0.25f, 0.25f);
+  std::uniform_int_distribution<int> vertex(0, int(mesh->vertices.size()) - 1);
+  std::vector<point> queries;
+  for (int q = 0; q < numQueries; q++) {
+    point x = mesh->vertices[vertex(rng)];
+    for (int i = 0; i < 3; i++) {
+      x[i] += offset(rng) * mesh->imageSpacing[i];
+    }
+    TriMesh::Face triangle;
+    float alpha, beta, gamma;
+    const int face = MapTriangleInfo(mesh, faceIndexMap, x, triangle, alpha, beta, gamma);
+    if (face < 0) {
+      continue;
+    }
+    std::vector<float> mapVals, vals;
+    MapFeatureValues(mesh, faceIndexMap, x, mapVals);
+    mesh->GetFeatureValues(x, vals);
+    if (mesh->GetTriangleInfoForPoint(x, triangle, alpha, beta, gamma) != face || vals != mapVals) {
+      std::cerr << "query " << q << ": the table and the map give different results" << std::endl;
+      return EXIT_FAILURE;
+    }
+    queries.push_back(x);
+  }
+  std::printf("%zu of %d queries in the narrow band\n", queries.size(), numQueries);
+  if (queries.empty()) {
+    return EXIT_FAILURE;
+  }
+
+  TriMesh::Face triangle;
+  float alpha, beta, gamma;
+  start = Clock::now();
+  long long checksum = 0;
+  for (size_t q = 0; q < queries.size(); q++) {
+    checksum += MapTriangleInfo(mesh, faceIndexMap, queries[q], triangle, alpha, beta, gamma);
+  }
+  const double mapSeconds = Seconds(start);
+
+  start = Clock::now();
+  for (size_t q = 0; q < queries.size(); q++) {
+    checksum -= mesh->GetTriangleInfoForPoint(queries[q], triangle, alpha, beta, gamma);
+  }
+  const double tableSeconds = Seconds(start);
+
+  std::vector<float> vals;
+  start = Clock::now();
+  double mapSum = 0;
+  for (size_t q = 0; q < queries.size(); q++) {
+    MapFeatureValues(mesh, faceIndexMap, queries[q], vals);
+    mapSum += vals[0];
+  }
+  const double mapFeatureSeconds = Seconds(start);
+
+  start = Clock::now();
+  double sum = 0;
+  for (size_t q = 0; q < queries.size(); q++) {
+    mesh->GetFeatureValues(queries[q], vals);
+    sum += vals[0];
+  }
+  const double featureSeconds = Seconds(start);
+
+  std::printf("GetTriangleInfoForPoint, std::map  %.1f queries/s\n", queries.size() / mapSeconds);
+  std::printf("GetTriangleInfoForPoint, table     %.1f queries/s (%lld)\n", queries.size() / tableSeconds, checksum);
+  std::printf("GetFeatureValues, std::map         %.1f queries/s (%g)\n", queries.size() / mapFeatureSeconds, mapSum);
+  std::printf("GetFeatureValues, table            %.1f queries/s (%g)\n", queries.size() / featureSeconds, sum);
+  return EXIT_SUCCESS;
+}
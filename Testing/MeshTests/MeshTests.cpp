@@ -1,6 +1,20 @@
 #include <gtest/gtest.h>
 
 #include <Libs/Mesh/Mesh.h>
+#include <Libs/Mesh/meshFIM.h>
+#include "GeodesicCSR.h"
+
+#include <itkPointSet.h>
+#include "itkThinPlateSplineKernelTransform2.h"
+#include "itkFastThinPlateSplineKernelTransform.h"
+#include "itkCompactlySupportedRBFSparseKernelTransform.h"
+#include "Procrustes3D.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
 
 #include "TestConfiguration.h"
 
@@ -26,6 +40,429 @@ TEST(MeshTests, coverage_test) {
   ASSERT_TRUE(pelvis.compare_scalars_equal(baseline));
 }
 
+//---------------------------------------------------------------------------
+TEST(MeshTests, coverage_reuse_test) {
+
+  std::string test_location = std::string(TEST_DATA_DIR) + std::string("/coverage/");
+
+  // the second call reuses the ray casting structure of the femur
+  Mesh femur(test_location + "femur.vtk");
+  Mesh baseline(test_location + "baseline.vtk");
+  for (int i = 0; i < 2; i++) {
+    Mesh pelvis(test_location + "pelvis.vtk");
+    ASSERT_TRUE(pelvis.coverage(femur));
+    ASSERT_TRUE(pelvis.compare_points_equal(baseline));
+    ASSERT_TRUE(pelvis.compare_scalars_equal(baseline));
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(MeshTests, fast_thin_plate_spline_test) {
+
+  typedef itk::ThinPlateSplineKernelTransform2<double, 3> TransformType;
+  typedef itk::FastThinPlateSplineKernelTransform<double, 3> FastTransformType;
+  typedef TransformType::PointSetType PointSetType;
+
+  // landmarks on a noisy sphere, displaced by a smooth field and some noise
+  std::mt19937 generator(42);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  std::uniform_real_distribution<double> uniform(-80.0, 80.0);
+  PointSetType::Pointer source = PointSetType::New();
+  PointSetType::Pointer target = PointSetType::New();
+  for (unsigned int i = 0; i < 600; i++) {
+    PointSetType::PointType p, q;
+    double x[3] = {normal(generator), normal(generator), normal(generator)};
+    double norm = std::sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+    for (unsigned int d = 0; d < 3; d++) {
+      p[d] = 40.0 * x[d] / norm + normal(generator);
+    }
+    q[0] = p[0] + 2.0 * std::sin(p[1] / 20.0) + 0.1 * normal(generator);
+    q[1] = p[1] + 2.0 * std::cos(p[2] / 20.0) + 0.1 * normal(generator);
+    q[2] = 1.1 * p[2] + 0.1 * normal(generator);
+    source->SetPoint(i, p);
+    target->SetPoint(i, q);
+  }
+
+  TransformType::Pointer reference = TransformType::New();
+  reference->SetMatrixInversionMethod("QR");
+  reference->SetSourceLandmarks(source);
+  reference->SetTargetLandmarks(target);
+
+  // the exact sum, and the expansion within its tolerance
+  FastTransformType::Pointer exact = FastTransformType::New();
+  exact->SetTolerance(0.0);
+  exact->SetSourceLandmarks(source);
+  exact->SetTargetLandmarks(target);
+  FastTransformType::Pointer fast = FastTransformType::New();
+  fast->SetSourceLandmarks(source);
+  fast->SetTargetLandmarks(target);
+
+  // at the landmarks and at points inside and around the sphere
+  double exactDeviation = 0.0;
+  double fastDeviation = 0.0;
+  for (unsigned int i = 0; i < 2000; i++) {
+    TransformType::InputPointType p;
+    if (i < source->GetNumberOfPoints()) {
+      source->GetPoint(i, &p);
+    }
+    else {
+      for (unsigned int d = 0; d < 3; d++) {
+        p[d] = uniform(generator);
+      }
+    }
+    TransformType::OutputPointType q = reference->TransformPoint(p);
+    TransformType::OutputPointType qExact = exact->TransformPoint(p);
+    TransformType::OutputPointType qFast = fast->TransformPoint(p);
+    for (unsigned int d = 0; d < 3; d++) {
+      exactDeviation = std::max(exactDeviation, std::fabs(qExact[d] - q[d]));
+      fastDeviation = std::max(fastDeviation, std::fabs(qFast[d] - q[d]));
+    }
+  }
+
+  ASSERT_LT(exactDeviation, 1e-6);
+  ASSERT_LT(fastDeviation, fast->GetTolerance());
+}
+
+// the single source solve of the geodesic rows is protected
+class GeodesicRowsFIM : public meshFIM
+{
+public:
+  using meshFIM::Workspace;
+  using meshFIM::SolveFromVertex;
+  using meshFIM::CollectRow;
+};
+
+//---------------------------------------------------------------------------
+TEST(MeshTests, geodesic_rows_test) {
+
+  // a bumpy grid, small enough to solve from every vertex both ways
+  const int n = 12;
+  TriMesh mesh;
+  for (int j = 0; j < n; j++) {
+    for (int i = 0; i < n; i++) {
+      mesh.vertices.push_back(point(i, j, 0.5f * std::sin(0.7f * i) * std::cos(0.5f * j)));
+    }
+  }
+  for (int j = 0; j + 1 < n; j++) {
+    for (int i = 0; i + 1 < n; i++) {
+      int v = j * n + i;
+      mesh.faces.push_back(TriMesh::Face(v, v + 1, v + n + 1));
+      mesh.faces.push_back(TriMesh::Face(v, v + n + 1, v + n));
+    }
+  }
+  int nv = mesh.vertices.size();
+
+  GeodesicRowsFIM fim;
+  fim.SetMesh(&mesh);
+  fim.SetStopDistance(LARGENUM);
+  mesh.vertOneringFaces.clear();
+  mesh.need_oneringfaces();
+
+  GeodesicRowsFIM::Workspace ws;
+  ws.geodesic.assign(nv, LARGENUM);
+  ws.label.assign(nv, meshFIM::FarPoint);
+  std::vector<GeodesicCSR::Entry> row;
+
+  GeodesicCSR csr;
+  csr.Clear(LARGENUM);
+  for (int source = 0; source < nv; source++) {
+
+    // the list based solve writes the distances to the vertices before the
+    // source to its map
+    mesh.geodesicMap.assign(nv, std::map<unsigned int, float>());
+    fim.UpdateGeodesicMapWithDistancesFromVertices(std::vector<int>(1, source));
+    const std::map<unsigned int, float>& expected = mesh.geodesicMap[source];
+
+    fim.SolveFromVertex(source, ws);
+    fim.CollectRow(source, ws, row);
+    csr.AppendRow(row);
+
+    ASSERT_EQ(row.size(), expected.size());
+    std::map<unsigned int, float>::const_iterator it = expected.begin();
+    for (size_t k = 0; k < row.size(); k++, it++) {
+      ASSERT_EQ(row[k].first, it->first);
+      ASSERT_NEAR(row[k].second, it->second, 1e-4 * it->second);
+    }
+  }
+  ASSERT_EQ(csr.Entries(), (unsigned long long) nv * (nv - 1) / 2);
+
+  // and the rows read back from a file
+  const char* filename = "geodesic_rows_test.csr";
+  ASSERT_TRUE(csr.Write(filename));
+  ASSERT_TRUE(GeodesicCSR::IsCSRFile(filename));
+  {
+    GeodesicCSR loaded;
+    ASSERT_TRUE(loaded.Load(filename));
+    ASSERT_EQ(loaded.Rows(), csr.Rows());
+    ASSERT_EQ(loaded.Entries(), csr.Entries());
+    ASSERT_EQ(loaded.StopDistance(), csr.StopDistance());
+    for (int v = 0; v < nv; v++) {
+      float d, e;
+      for (int key = 0; key < v; key++) {
+        ASSERT_TRUE(csr.Find(v, key, d));
+        ASSERT_TRUE(loaded.Find(v, key, e));
+        ASSERT_EQ(d, e);
+      }
+      ASSERT_FALSE(loaded.Find(v, v, e));
+    }
+  }
+  std::remove(filename);
+}
+
+//---------------------------------------------------------------------------
+// Aligns copies of a shape under random similarity transforms with both
+// Procrustes3D::AlignShapes overloads and compares the results.
+static void CompareProcrustesOverloads(const std::vector<Procrustes3D::PointType> &base,
+                                       bool reflect, bool compareTransforms)
+{
+  const int numShapes = 8;
+  const int numPoints = static_cast<int>(base.size());
+  std::mt19937 generator(7);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+  Procrustes3D::ShapeListType shapes(numShapes);
+  std::vector<double> points(3 * numPoints * numShapes);
+  for (int s = 0; s < numShapes; s++) {
+    // a random unit quaternion, scale and translation
+    double q[4] = {normal(generator), normal(generator), normal(generator), normal(generator)};
+    const double norm = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    const double w = q[0] / norm, x = q[1] / norm, y = q[2] / norm, z = q[3] / norm;
+    const double rotation[3][3] = {
+      {1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y)},
+      {2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x)},
+      {2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y)}};
+    const double scale = 0.5 + 1.5 * uniform(generator);
+    const double translation[3] = {20 * uniform(generator) - 10, 20 * uniform(generator) - 10,
+                                   20 * uniform(generator) - 10};
+
+    for (int j = 0; j < numPoints; j++) {
+      Procrustes3D::PointType p = base[j];
+      // the last shape is mirrored, which no rotation undoes
+      if (reflect && s == numShapes - 1) {
+        p[0] = -p[0];
+      }
+      Procrustes3D::PointType r;
+      for (int a = 0; a < 3; a++) {
+        r[a] = scale * (rotation[a][0] * p[0] + rotation[a][1] * p[1] + rotation[a][2] * p[2]) +
+               translation[a] + 0.01 * normal(generator);
+        points[3 * (s * numPoints + j) + a] = r[a];
+      }
+      shapes[s].push_back(r);
+    }
+  }
+
+  Procrustes3D procrustes;
+  Procrustes3D::SimilarityTransformListType listTransforms, bufferTransforms;
+  procrustes.AlignShapes(listTransforms, shapes);
+  procrustes.AlignShapes(bufferTransforms, points.data(), numShapes, numPoints);
+
+  ASSERT_EQ(listTransforms.size(), static_cast<size_t>(numShapes));
+  ASSERT_EQ(bufferTransforms.size(), static_cast<size_t>(numShapes));
+  const double tolerance = 1e-6;
+  for (int s = 0; s < numShapes; s++) {
+    for (int j = 0; j < numPoints; j++) {
+      for (int a = 0; a < 3; a++) {
+        ASSERT_NEAR(points[3 * (s * numPoints + j) + a], shapes[s][j][a], tolerance);
+      }
+    }
+
+    // both are proper rotations, also for the mirrored shape
+    const SimilarityTransform3D *transforms[2] = {&listTransforms[s], &bufferTransforms[s]};
+    for (int t = 0; t < 2; t++) {
+      const vnl_matrix_fixed<double, 3, 3> &r = transforms[t]->rotation;
+      const double det = r(0, 0) * (r(1, 1) * r(2, 2) - r(1, 2) * r(2, 1)) -
+                         r(0, 1) * (r(1, 0) * r(2, 2) - r(1, 2) * r(2, 0)) +
+                         r(0, 2) * (r(1, 0) * r(2, 1) - r(1, 1) * r(2, 0));
+      ASSERT_NEAR(det, 1.0, tolerance);
+    }
+
+    // collinear shapes can turn freely about their line
+    if (compareTransforms) {
+      ASSERT_NEAR(bufferTransforms[s].scale, listTransforms[s].scale, tolerance);
+      for (int a = 0; a < 3; a++) {
+        ASSERT_NEAR(bufferTransforms[s].translation[a], listTransforms[s].translation[a], tolerance);
+        for (int b = 0; b < 3; b++) {
+          ASSERT_NEAR(bufferTransforms[s].rotation(a, b), listTransforms[s].rotation(a, b), tolerance);
+        }
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(MeshTests, procrustes_overloads_test) {
+
+  std::mt19937 generator(3);
+  std::uniform_real_distribution<double> uniform(-5.0, 5.0);
+  const int numPoints = 60;
+
+  // points in general position, on a plane and on a line
+  std::vector<Procrustes3D::PointType> general, planar, collinear;
+  for (int j = 0; j < numPoints; j++) {
+    const double x = uniform(generator), y = uniform(generator), z = uniform(generator);
+    general.push_back(Procrustes3D::PointType(x, y, z));
+    planar.push_back(Procrustes3D::PointType(x, y, 0.0));
+    collinear.push_back(Procrustes3D::PointType(x, 0.5 * x, -x));
+  }
+
+  CompareProcrustesOverloads(general, false, true);
+  CompareProcrustesOverloads(general, true, true);
+  CompareProcrustesOverloads(planar, false, true);
+  CompareProcrustesOverloads(planar, true, true);
+  CompareProcrustesOverloads(collinear, false, false);
+}
+
+//---------------------------------------------------------------------------
+// Exposes the deformation of the compactly supported kernel both from the
+// landmark grid and from the sum over all landmarks it replaced.
+class CompactlySupportedRBFContributions :
+  public itk::CompactlySupportedRBFSparseKernelTransform<double, 3>
+{
+public:
+  typedef CompactlySupportedRBFContributions Self;
+  typedef itk::CompactlySupportedRBFSparseKernelTransform<double, 3> Superclass;
+  typedef Superclass::Superclass SparseKernelTransformType;
+  typedef itk::SmartPointer<Self> Pointer;
+
+  itkNewMacro(Self);
+
+  OutputPointType FromGrid(const InputPointType &p) const
+  {
+    OutputPointType result;
+    result.Fill(0.0);
+    this->ComputeDeformationContribution(p, result);
+    return result;
+  }
+
+  OutputPointType FromAllLandmarks(const InputPointType &p) const
+  {
+    OutputPointType result;
+    result.Fill(0.0);
+    this->SparseKernelTransformType::ComputeDeformationContribution(p, result);
+    return result;
+  }
+
+protected:
+  CompactlySupportedRBFContributions() {}
+};
+
+//---------------------------------------------------------------------------
+// Largest difference between the two, over the landmarks, points at exactly
+// the support radius from them, and points around the grid.
+static double CompareCompactlySupportedRBFContributions(CompactlySupportedRBFContributions *transform,
+                                                        double support, std::mt19937 &generator)
+{
+  typedef CompactlySupportedRBFContributions::InputPointType PointType;
+  typedef CompactlySupportedRBFContributions::PointSetType PointSetType;
+
+  PointSetType *source = transform->GetSourceLandmarks();
+
+  std::vector<PointType> points;
+  PointType lower, upper;
+  source->GetPoint(0, &lower);
+  upper = lower;
+  for (unsigned long i = 0; i < source->GetNumberOfPoints(); i++) {
+    PointType p;
+    source->GetPoint(i, &p);
+    points.push_back(p);
+    for (unsigned int d = 0; d < 3; d++) {
+      lower[d] = std::min(lower[d], p[d]);
+      upper[d] = std::max(upper[d], p[d]);
+      PointType q = p;
+      q[d] = p[d] + support;
+      points.push_back(q);
+      q[d] = p[d] - support;
+      points.push_back(q);
+    }
+  }
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  for (unsigned int i = 0; i < 2000; i++) {
+    PointType p;
+    for (unsigned int d = 0; d < 3; d++) {
+      p[d] = lower[d] - 2.0 * support + (upper[d] - lower[d] + 4.0 * support) * uniform(generator);
+    }
+    points.push_back(p);
+  }
+
+  double deviation = 0.0;
+  for (const PointType &p : points) {
+    const PointType grid = transform->FromGrid(p);
+    const PointType all = transform->FromAllLandmarks(p);
+    for (unsigned int d = 0; d < 3; d++) {
+      deviation = std::max(deviation, std::fabs(grid[d] - all[d]));
+    }
+  }
+  return deviation;
+}
+
+//---------------------------------------------------------------------------
+TEST(MeshTests, compactly_supported_rbf_grid_test) {
+
+  typedef CompactlySupportedRBFContributions TransformType;
+  typedef TransformType::PointSetType PointSetType;
+  typedef TransformType::ParametersType ParametersType;
+
+  // landmarks on a lattice whose spacing is the support, so that they lie on
+  // the cell boundaries of the grid, and random landmarks between them
+  // the kernel vanishes beyond this radius
+  const double support = 3.0 * std::sqrt(3.14 / 2.0);
+  TransformType::Pointer transform = TransformType::New();
+  transform->SetSigma(1.0);
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<double> uniform(0.0, 5.0 * support);
+  PointSetType::Pointer source = PointSetType::New();
+  PointSetType::Pointer target = PointSetType::New();
+  unsigned long n = 0;
+  for (int i = 0; i < 6; i++) {
+    for (int j = 0; j < 6; j++) {
+      for (int k = 0; k < 6; k++, n++) {
+        PointSetType::PointType p;
+        p[0] = i * support;
+        p[1] = j * support;
+        p[2] = k * support;
+        source->SetPoint(n, p);
+      }
+    }
+  }
+  for (int i = 0; i < 200; i++, n++) {
+    PointSetType::PointType p;
+    for (unsigned int d = 0; d < 3; d++) {
+      p[d] = uniform(generator);
+    }
+    source->SetPoint(n, p);
+  }
+  for (unsigned long i = 0; i < n; i++) {
+    PointSetType::PointType p, q;
+    source->GetPoint(i, &p);
+    q[0] = p[0] + 0.5 * std::sin(p[1]);
+    q[1] = p[1] + 0.5 * std::cos(p[2]);
+    q[2] = 1.1 * p[2];
+    target->SetPoint(i, q);
+  }
+  transform->SetSourceLandmarks(source);
+  transform->SetTargetLandmarks(target);
+  ASSERT_LT(CompareCompactlySupportedRBFContributions(transform, support, generator), 1e-10);
+
+  // the grid is rebuilt when the fixed parameters move the source landmarks,
+  // here to a lattice of twice the spacing that is still on cell boundaries
+  ParametersType parameters(3 * n);
+  for (unsigned long i = 0; i < n; i++) {
+    PointSetType::PointType p;
+    source->GetPoint(i, &p);
+    for (unsigned int d = 0; d < 3; d++) {
+      parameters[3 * i + d] = 2.0 * p[d] - 20.0 + d;
+    }
+  }
+  transform->SetFixedParameters(parameters);
+  transform->ComputeWMatrix();
+  ASSERT_LT(CompareCompactlySupportedRBFContributions(transform, support, generator), 1e-10);
+
+  // and, with the same weights, when a small support grows the cells beyond it
+  transform->SetSigma(0.01);
+  ASSERT_LT(CompareCompactlySupportedRBFContributions(transform, 0.01 * support, generator), 1e-10);
+}
+
 //TEST(MeshTests, next_test) {
 
 // ...
@@ -0,0 +1,115 @@
+// Times Reconstruction::getMesh, the warp of the dense mean to a subject.
+//
+// usage: ReconstructionBenchmark [numSubjects] [numParticles] [denseResolution]
+//
+// A sphere is written to the working directory as the dense and sparse mean,
+// with every tenth particle marked bad. Each subject is a random ellipsoid
+// with the same particles, warped from the mean with the compactly supported
+// and the fast thin plate spline transforms.
+
+#include <Libs/Analyze/Reconstruction.h>
+
+#include <vtkPolyDataWriter.h>
+#include <vtkSphereSource.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef itk::Point<double, 3> PointType;
+typedef std::vector<PointType> PointArrayType;
+
+//---------------------------------------------------------------------------
+// Points of a Fibonacci sphere, stretched to the ellipsoid.
+static PointArrayType Ellipsoid(int numParticles, double a, double b, double c)
+{
+  PointArrayType points(numParticles);
+  for (int i = 0; i < numParticles; i++) {
+    const double z = 1.0 - 2.0 * (i + 0.5) / numParticles;
+    const double r = std::sqrt(1.0 - z * z);
+    const double phi = 2.399963229728653 * i;
+    points[i][0] = a * r * std::cos(phi);
+    points[i][1] = b * r * std::sin(phi);
+    points[i][2] = c * z;
+  }
+  return points;
+}
+
+//---------------------------------------------------------------------------
+template<class ReconstructionType>
+static bool Run(const char *name, const std::vector<PointArrayType> &subjects, vtkIdType numDensePoints)
+{
+  ReconstructionType reconstruction;
+  reconstruction.setOutputEnabled(false);
+  reconstruction.readMeanInfo("reconstruction_benchmark_dense.vtk",
+                              "reconstruction_benchmark_sparse.particles",
+                              "reconstruction_benchmark_goodPoints.txt");
+
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point start = Clock::now();
+  for (const PointArrayType &subject : subjects) {
+    vtkSmartPointer<vtkPolyData> mesh = reconstruction.getMesh(subject);
+    if (mesh->GetNumberOfPoints() != numDensePoints) {
+      std::cerr << name << ": the warped mesh has " << mesh->GetNumberOfPoints()
+                << " points instead of " << numDensePoints << std::endl;
+      return false;
+    }
+  }
+  const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  std::printf("%-6s %.4f s per subject\n", name, seconds / subjects.size());
+  return true;
+}
+
+//---------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  const int numSubjects = argc > 1 ? std::atoi(argv[1]) : 20;
+  const int numParticles = argc > 2 ? std::atoi(argv[2]) : 2048;
+  const int denseResolution = argc > 3 ? std::atoi(argv[3]) : 200;
+
+  const double radius = 10.0;
+  vtkSmartPointer<vtkSphereSource> sphere = vtkSmartPointer<vtkSphereSource>::New();
+  sphere->SetRadius(radius);
+  sphere->SetThetaResolution(denseResolution);
+  sphere->SetPhiResolution(denseResolution);
+  sphere->Update();
+  vtkSmartPointer<vtkPolyDataWriter> writer = vtkSmartPointer<vtkPolyDataWriter>::New();
+  writer->SetFileName("reconstruction_benchmark_dense.vtk");
+  writer->SetInputData(sphere->GetOutput());
+  writer->Update();
+
+  const PointArrayType mean = Ellipsoid(numParticles, radius, radius, radius);
+  std::ofstream sparse("reconstruction_benchmark_sparse.particles");
+  std::ofstream good("reconstruction_benchmark_goodPoints.txt");
+  for (int i = 0; i < numParticles; i++) {
+    sparse << mean[i][0] << " " << mean[i][1] << " " << mean[i][2] << "\n";
+    good << (i % 10 != 0) << "\n";
+  }
+  sparse.close();
+  good.close();
+
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<> axis(8.0, 12.0);
+  std::vector<PointArrayType> subjects;
+  for (int s = 0; s < numSubjects; s++) {
+    const double a = axis(gen), b = axis(gen), c = axis(gen);
+    subjects.push_back(Ellipsoid(numParticles, a, b, c));
+  }
+
+  std::printf("%d subjects, %d particles, %lld dense points\n", numSubjects, numParticles,
+              static_cast<long long>(sphere->GetOutput()->GetNumberOfPoints()));
+  const vtkIdType numDensePoints = sphere->GetOutput()->GetNumberOfPoints();
+  bool ok = Run<Reconstruction<itk::CompactlySupportedRBFSparseKernelTransform>>("CSRBF", subjects, numDensePoints);
+  ok = ok && Run<Reconstruction<itk::FastThinPlateSplineKernelTransform>>("TPS", subjects, numDensePoints);
+
+  std::remove("reconstruction_benchmark_dense.vtk");
+  std::remove("reconstruction_benchmark_sparse.particles");
+  std::remove("reconstruction_benchmark_goodPoints.txt");
+  return ok ? 0 : 1;
+}
@@ -1,16 +1,33 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
 
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
+#include <itkImageRegionIteratorWithIndex.h>
 #include <itkReinitializeLevelSetImageFilter.h> // for distance transform computation
 
 #include "TestConfiguration.h"
 
 #include "Optimize.h"
 #include "OptimizeParameterFile.h"
+#include "CheckpointWriter.h"
+#include "OptimizerState.h"
 #include "itkParticleShapeStatistics.h"
+#include "itkParticleGaussianKernelBatch.h"
+#include "itkParticleContainer.h"
+#include "itkParticleSurfaceNeighborhood.h"
+#include "itkParticleGridNeighborhood.h"
+#include "vnl/vnl_vector_fixed.h"
 
 //---------------------------------------------------------------------------
 // until we have a "groom" library we can call
@@ -86,3 +103,492 @@ TEST(OptimizeTests, sample_test) {
   double value = values[values.size() - 1];
   ASSERT_LT(value, 100);
 }
+
+//---------------------------------------------------------------------------
+// The sigma estimation of ParticleCurvatureEntropyGradientFunction as it was
+// before ParticleGaussianKernelBatch; with all kappas 1 it is the one of
+// ParticleEntropyGradientFunction.
+static double original_estimate_sigma(const vnl_vector_fixed<double, 3> &pos,
+                                      const std::vector<vnl_vector_fixed<double, 3>> &neighborhood,
+                                      const std::vector<double> &weights,
+                                      const std::vector<double> &kappas,
+                                      double initial_sigma, double precision, int &err,
+                                      double &avgKappa)
+{
+  avgKappa = 0.0;
+  const double min_sigma = 1.0e-4;
+  const double epsilon = 1.0e-5;
+
+  const double M = 3.0;
+  const double MM = M * M * 2.0 + M;
+
+  double error = 1.0e6;
+  double sigma, prev_sigma;
+  sigma = initial_sigma;
+
+  while (error > precision) {
+    vnl_vector_fixed<double, 3> r_vec;
+    double A = 0.0;
+    double B = 0.0;
+    double C = 0.0;
+    double sigma2 = sigma * sigma;
+    double sigma22 = sigma2 * 2.0;
+
+    for (unsigned int i = 0; i < neighborhood.size(); i++) {
+      if (weights[i] < epsilon) continue;
+      double kappa = kappas[i];
+      avgKappa += kappa;
+      for (unsigned int n = 0; n < 3; n++) {
+        r_vec[n] = (pos[n] - neighborhood[i][n]) * kappa;
+      }
+      double r = r_vec.magnitude();
+      double r2 = r * r;
+      double alpha = exp(-r2 / sigma22) * weights[i];
+      A += alpha;
+      B += r2 * alpha;
+      C += r2 * r2 * alpha;
+    }
+
+    avgKappa /= static_cast<double>(neighborhood.size());
+
+    prev_sigma = sigma;
+
+    if (A < epsilon) {
+      err = 1;
+      avgKappa = 1.0;
+      return sigma;
+    }
+
+    sigma -= (A * (B - A * sigma2 * M)) /
+             ((-MM * A * A * sigma) - 3.0 * A * B * (1.0 / (sigma + epsilon))
+              - (A * C + B * B) * (1.0 / (sigma2 * sigma + epsilon)) + epsilon);
+
+    error = 1.0 - fabs((sigma / prev_sigma));
+
+    if (sigma < min_sigma) {
+      sigma = min_sigma;
+      error = precision;
+    }
+    else {
+      if (sigma < 0.0) sigma = min_sigma;
+    }
+  }
+
+  err = 0;
+  return sigma;
+}
+
+//---------------------------------------------------------------------------
+// The gradient sums of ParticleCurvatureEntropyGradientFunction::Evaluate as
+// they were before ParticleGaussianKernelBatch; with all kappas 1 and a
+// weight cutoff they are those of ParticleEntropyGradientFunction::Evaluate.
+static void original_gradient(const vnl_vector_fixed<double, 3> &pos,
+                              const std::vector<vnl_vector_fixed<double, 3>> &neighborhood,
+                              const std::vector<double> &weights,
+                              const std::vector<double> &kappas,
+                              double sigma2inv, double minWeight, double &A,
+                              vnl_vector_fixed<double, 3> &gradE)
+{
+  vnl_vector_fixed<double, 3> r;
+  for (unsigned int n = 0; n < 3; n++) {
+    gradE[n] = 0.0;
+  }
+
+  A = 0.0;
+  for (unsigned int i = 0; i < neighborhood.size(); i++) {
+    if (weights[i] < minWeight) continue;
+    double kappa = kappas[i];
+    for (unsigned int n = 0; n < 3; n++) {
+      r[n] = (pos[n] - neighborhood[i][n]) * kappa;
+    }
+    double q = kappa * exp(-dot_product(r, r) * sigma2inv);
+    A += q;
+    for (unsigned int n = 0; n < 3; n++) {
+      gradE[n] += weights[i] * r[n] * q;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, gaussian_kernel_modes) {
+
+  // a neighborhood that does not fill the last block, with some neighbors
+  // below the weight cutoff
+  typedef itk::ParticleGaussianKernelBatch<3> BatchType;
+  vnl_vector_fixed<double, 3> pos(0.1, -0.2, 0.3);
+  std::vector<vnl_vector_fixed<double, 3>> neighborhood;
+  std::vector<double> weights, kappas, unit(23, 1.0);
+  for (int i = 0; i < 23; i++) {
+    neighborhood.push_back(vnl_vector_fixed<double, 3>(0.1 + 0.05 * (i % 5), -0.2 + 0.03 * (i % 7),
+                                                       0.3 - 0.04 * (i % 3)));
+    weights.push_back((i % 6) ? 0.5 + 0.02 * i : 0.0);
+    kappas.push_back(1.0 + 0.01 * i);
+  }
+
+  // the reference mode gives bitwise the results of the original loops, for
+  // the entropy function (no kappa, weight cutoff in the gradient) and the
+  // curvature function (kappa, no cutoff)
+  for (int curvature = 0; curvature < 2; curvature++) {
+    const std::vector<double> &k = curvature ? kappas : unit;
+    const double minWeight = curvature ? -std::numeric_limits<double>::infinity() : 1.0e-6;
+    BatchType reference;
+    reference.SetMode(BatchType::Reference);
+    for (unsigned int i = 0; i < neighborhood.size(); i++) {
+      reference.Push(pos, neighborhood[i], weights[i], k[i]);
+    }
+
+    int err, originalErr;
+    double kappa, originalKappa;
+    double sigma = reference.EstimateSigma(0.1, 1.0e-5, 1.0e-5, err, &kappa, reference.Size());
+    double originalSigma = original_estimate_sigma(pos, neighborhood, weights, k, 0.1, 1.0e-5,
+                                                   originalErr, originalKappa);
+    ASSERT_EQ(err, originalErr);
+    ASSERT_EQ(sigma, originalSigma);
+    ASSERT_EQ(kappa, originalKappa);
+
+    double A, originalA, grad[3];
+    vnl_vector_fixed<double, 3> originalGrad;
+    const double sigma2inv = 1.0 / (2.0 * sigma * sigma + 1.0e-6);
+    reference.Gradient(sigma2inv, minWeight, A, grad);
+    original_gradient(pos, neighborhood, weights, k, sigma2inv, minWeight, originalA, originalGrad);
+    ASSERT_EQ(A, originalA);
+    for (int n = 0; n < 3; n++) {
+      ASSERT_EQ(grad[n], originalGrad[n]);
+    }
+  }
+
+  // the vectorized mode agrees with the reference to within rounding
+  BatchType batch;
+  for (unsigned int i = 0; i < neighborhood.size(); i++) {
+    batch.Push(pos, neighborhood[i], weights[i], kappas[i]);
+  }
+
+  double sigma[2], kappa[2], A[2], grad[2][3];
+  for (int mode = 0; mode < 2; mode++) {
+    batch.SetMode(mode);
+    int err;
+    sigma[mode] = batch.EstimateSigma(0.1, 1.0e-5, 1.0e-5, err, &kappa[mode], batch.Size());
+    ASSERT_EQ(err, 0);
+    batch.Gradient(1.0 / (2.0 * sigma[mode] * sigma[mode]), 1.0e-6, A[mode], grad[mode]);
+  }
+
+  ASSERT_NEAR(sigma[1], sigma[0], 1.0e-12 * sigma[0]);
+  ASSERT_NEAR(kappa[1], kappa[0], 1.0e-12 * kappa[0]);
+  ASSERT_NEAR(A[1], A[0], 1.0e-12 * A[0]);
+  for (int n = 0; n < 3; n++) {
+    ASSERT_NEAR(grad[1][n], grad[0][n], 1.0e-12 * std::fabs(A[0]));
+  }
+
+  for (double x = -700.0; x <= 0.0; x += 0.37) {
+    ASSERT_NEAR(BatchType::Exp(x), std::exp(x), 1.0e-15 * std::exp(x));
+  }
+  ASSERT_EQ(BatchType::Exp(-800.0), 0.0);
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, particle_container_test) {
+
+  typedef itk::ParticleContainer<double> ContainerType;
+  ContainerType::Pointer container = ContainerType::New();
+
+  // references stay valid while entries are added, as with the std::map
+  // the container replaced
+  double &first = (*container)[0];
+  first = -1.0;
+  for (unsigned long int k = 1; k < 10 * ContainerType::ChunkSize; k++) {
+    (*container)[k] = k;
+  }
+  ASSERT_EQ(&first, &(*container)[0]);
+  ASSERT_EQ(first, -1.0);
+
+  // removed entries are skipped, and the range shrinks with the last one
+  for (unsigned long int k = 1; k < container->GetIndexRange(); k += 2) {
+    ASSERT_EQ(container->Erase(k), 1u);
+  }
+  ASSERT_EQ(container->GetSize(), 5u * ContainerType::ChunkSize);
+  ASSERT_EQ(container->GetIndexRange(), 10u * ContainerType::ChunkSize - 1);
+  unsigned long int count = 0;
+  for (ContainerType::ConstIterator it = container->GetBegin(); it != container->GetEnd(); ++it, count++) {
+    ASSERT_EQ(it.GetIndex(), 2 * count);
+    ASSERT_EQ(*it, count == 0 ? -1.0 : 2.0 * count);
+  }
+  ASSERT_EQ(count, container->GetSize());
+
+  // a removed index that is inserted again starts from a new value
+  ASSERT_FALSE(container->HasIndex(3));
+  ASSERT_EQ((*container)[3], 0.0);
+  ASSERT_EQ(container->GetSize(), 5u * ContainerType::ChunkSize + 1);
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, grid_neighborhood_test) {
+
+  typedef itk::Image<float, 3> ImageType;
+  typedef itk::ParticleImplicitSurfaceDomain<float, 3> DomainType;
+  typedef itk::ParticleSurfaceNeighborhood<ImageType> RegionNeighborhoodType;
+  typedef itk::ParticleSurfaceNeighborhood<ImageType, itk::ParticleGridNeighborhood<3> > GridNeighborhoodType;
+  typedef RegionNeighborhoodType::PointType PointType;
+  typedef RegionNeighborhoodType::PointContainerType PointContainerType;
+  typedef RegionNeighborhoodType::PointVectorType PointVectorType;
+
+  // signed distance to a sphere of radius 10
+  ImageType::Pointer image = ImageType::New();
+  ImageType::RegionType region;
+  region.SetSize(0, 32);
+  region.SetSize(1, 32);
+  region.SetSize(2, 32);
+  image->SetRegions(region);
+  double origin[3] = {-15.5, -15.5, -15.5};
+  image->SetOrigin(origin);
+  image->Allocate();
+  itk::ImageRegionIteratorWithIndex<ImageType> it(image, region);
+  for (it.GoToBegin(); !it.IsAtEnd(); ++it) {
+    ImageType::PointType x;
+    image->TransformIndexToPhysicalPoint(it.GetIndex(), x);
+    it.Set(std::sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]) - 10.0);
+  }
+  DomainType::Pointer domain = DomainType::New();
+  domain->SetImage(image);
+
+  // points spread over the sphere, half of them moved after they are added
+  const unsigned int numPoints = 400;
+  PointContainerType::Pointer points = PointContainerType::New();
+  RegionNeighborhoodType::Pointer regionNeighborhood = RegionNeighborhoodType::New();
+  GridNeighborhoodType::Pointer gridNeighborhood = GridNeighborhoodType::New();
+  regionNeighborhood->SetPointContainer(points);
+  regionNeighborhood->SetDomain(domain);
+  gridNeighborhood->SetPointContainer(points);
+  gridNeighborhood->SetDomain(domain);
+  for (int pass = 0; pass < 2; pass++) {
+    for (unsigned int k = 0; k < numPoints; k++) {
+      if (pass == 1 && k % 2 == 0) continue;
+      double z = 1.0 - (2.0 * k + 1.0) / numPoints;
+      double phi = 2.399963 * k + pass * 0.3;
+      double r = std::sqrt(1.0 - z * z);
+      PointType p;
+      p[0] = 10.0 * r * std::cos(phi);
+      p[1] = 10.0 * r * std::sin(phi);
+      p[2] = 10.0 * z;
+      (*points)[k] = p;
+      if (pass == 0) {
+        regionNeighborhood->AddPosition(p, k);
+        gridNeighborhood->AddPosition(p, k);
+      }
+      else {
+        regionNeighborhood->SetPosition(p, k);
+        gridNeighborhood->SetPosition(p, k);
+      }
+    }
+  }
+
+  // the same neighbors with the same weights, in any order
+  std::vector<double> regionWeights, gridWeights;
+  PointVectorType regionPoints, gridPoints;
+  for (unsigned int k = 0; k < numPoints; k++) {
+    regionNeighborhood->FindNeighborhoodPoints((*points)[k], regionWeights, 3.0, regionPoints);
+    gridNeighborhood->FindNeighborhoodPoints((*points)[k], gridWeights, 3.0, gridPoints);
+    ASSERT_GT(regionPoints.size(), 1u);
+    ASSERT_EQ(gridPoints.size(), regionPoints.size());
+
+    std::vector<std::pair<unsigned int, double> > expected, found;
+    for (unsigned int i = 0; i < regionPoints.size(); i++) {
+      expected.push_back(std::make_pair(regionPoints[i].Index, regionWeights[i]));
+      found.push_back(std::make_pair(gridPoints[i].Index, gridWeights[i]));
+    }
+    std::sort(expected.begin(), expected.end());
+    std::sort(found.begin(), found.end());
+    ASSERT_TRUE(found == expected);
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, checkpoint_writer_test) {
+
+  const size_t depth = 2;
+  const std::chrono::milliseconds timeout(5000), pause(100);
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::promise<void> started;
+  std::vector<int> order;
+
+  {
+    CheckpointWriter writer(depth);
+
+    // the first checkpoint is being written and holds up the others
+    writer.Enqueue([&]() {
+      started.set_value();
+      released.wait();
+      order.push_back(0);
+    });
+    EXPECT_EQ(started.get_future().wait_for(timeout), std::future_status::ready);
+
+    // fewer than depth checkpoints are pending, so queueing does not block;
+    // the futures are kept until the first checkpoint is released, so a
+    // failure here does not hang the test
+    std::vector<std::future<void> > queued;
+    for (int k = 1; k <= int(depth); k++) {
+      queued.push_back(std::async(std::launch::async, [&, k]() {
+        writer.Enqueue([&, k]() { order.push_back(k); });
+      }));
+      EXPECT_EQ(queued.back().wait_for(timeout), std::future_status::ready);
+    }
+
+    // with depth checkpoints pending, the next one waits for a free slot
+    queued.push_back(std::async(std::launch::async, [&]() {
+      writer.Enqueue([&]() { order.push_back(int(depth) + 1); });
+    }));
+    EXPECT_EQ(queued.back().wait_for(pause), std::future_status::timeout);
+
+    release.set_value();
+    for (auto &future : queued) {
+      future.get();
+    }
+    writer.Wait();
+  }
+
+  // checkpoints are written in the order they were queued
+  ASSERT_EQ(order.size(), depth + 2);
+  for (size_t k = 0; k < order.size(); k++) {
+    ASSERT_EQ(order[k], int(k));
+  }
+}
+
+//---------------------------------------------------------------------------
+// Fills a matrix with distinct values starting at first.
+static void FillStateMatrix(vnl_matrix<double> &m, unsigned int rows, unsigned int cols, double first)
+{
+  m = vnl_matrix<double>(rows, cols);
+  for (size_t i = 0; i < m.size(); i++) {
+    m.data_block()[i] = first + 0.25 * i;
+  }
+}
+
+//---------------------------------------------------------------------------
+static void FillEntropyState(OptimizerState::EntropyFunctionState &e, double first)
+{
+  e.minimum_variance = first;
+  e.minimum_variance_decay_constant = first + 1.5;
+  e.hold_minimum_variance = false;
+  e.counter = int(first) + 3;
+  e.minimum_eigenvalue = first + 4.25;
+  e.current_energy = -first;
+  FillStateMatrix(e.points_update, 6, 2, first + 10.0);
+  FillStateMatrix(e.inverse_cov_factor, 2, 3, first + 20.0);
+  FillStateMatrix(e.points_mean, 6, 1, first + 30.0);
+}
+
+//---------------------------------------------------------------------------
+static void ExpectSameMatrix(const vnl_matrix<double> &a, const vnl_matrix<double> &b)
+{
+  ASSERT_EQ(a.rows(), b.rows());
+  ASSERT_EQ(a.cols(), b.cols());
+  for (size_t i = 0; i < a.size(); i++) {
+    ASSERT_EQ(a.data_block()[i], b.data_block()[i]);
+  }
+}
+
+//---------------------------------------------------------------------------
+static void ExpectSameEntropyState(const OptimizerState::EntropyFunctionState &a,
+                                   const OptimizerState::EntropyFunctionState &b)
+{
+  ASSERT_EQ(a.minimum_variance, b.minimum_variance);
+  ASSERT_EQ(a.minimum_variance_decay_constant, b.minimum_variance_decay_constant);
+  ASSERT_EQ(a.hold_minimum_variance, b.hold_minimum_variance);
+  ASSERT_EQ(a.counter, b.counter);
+  ASSERT_EQ(a.minimum_eigenvalue, b.minimum_eigenvalue);
+  ASSERT_EQ(a.current_energy, b.current_energy);
+  ExpectSameMatrix(a.points_update, b.points_update);
+  ExpectSameMatrix(a.inverse_cov_factor, b.inverse_cov_factor);
+  ExpectSameMatrix(a.points_mean, b.points_mean);
+}
+
+//---------------------------------------------------------------------------
+static void ExpectSameTransforms(const std::vector<OptimizerState::TransformType> &a,
+                                 const std::vector<OptimizerState::TransformType> &b)
+{
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t t = 0; t < a.size(); t++) {
+    for (unsigned int i = 0; i < 16; i++) {
+      ASSERT_EQ(a[t].data_block()[i], b[t].data_block()[i]);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, optimizer_state_test) {
+
+  // every field set, with two domains of different sizes
+  OptimizerState state;
+  state.positions = {{1.0, 2.0, 3.0, 4.0, 5.0, 6.0}, {-1.5, 0.0, 7.125}};
+  state.spatial_sigmas = {{0.5, 0.75}, {1.25}};
+  for (unsigned int d = 0; d < 2; d++) {
+    OptimizerState::TransformType transform, prefix;
+    for (unsigned int i = 0; i < 16; i++) {
+      transform.data_block()[i] = 100.0 * d + i;
+      prefix.data_block()[i] = -100.0 * d - i - 0.5;
+    }
+    state.transforms.push_back(transform);
+    state.prefix_transforms.push_back(prefix);
+  }
+  state.time_steps = {{0.1, 0.2}, {0.3}};
+  state.previous_energies = {{1e-3, 2e-3}, {3e-3}};
+  state.maximum_time_steps = {10.0, 20.0};
+  state.minimum_time_steps = {1e-5, 2e-5};
+  state.optimization_iterations_completed = 1234;
+  state.iterations = 56;
+  state.checkpoint_counter = 7;
+  state.checkpoint_iteration = 800;
+  state.procrustes_counter = 9;
+  state.saturation_counter = 11;
+  state.sampling_energy = 0.125;
+  state.correspondence_energy = -2.5;
+  state.total_energy = 3.75;
+  FillEntropyState(state.ensemble_entropy, 1.0);
+  FillEntropyState(state.mesh_based_entropy, 2.0);
+  FillEntropyState(state.regression_entropy, 3.0);
+  FillEntropyState(state.mixed_effects_entropy, 4.0);
+
+  const std::string filename = "optimizer_state_test.state";
+  ASSERT_TRUE(state.Write(filename));
+
+  OptimizerState read;
+  ASSERT_TRUE(read.Read(filename));
+  ASSERT_TRUE(read.positions == state.positions);
+  ExpectSameTransforms(read.transforms, state.transforms);
+  ExpectSameTransforms(read.prefix_transforms, state.prefix_transforms);
+  ASSERT_TRUE(read.spatial_sigmas == state.spatial_sigmas);
+  ASSERT_TRUE(read.time_steps == state.time_steps);
+  ASSERT_TRUE(read.previous_energies == state.previous_energies);
+  ASSERT_TRUE(read.maximum_time_steps == state.maximum_time_steps);
+  ASSERT_TRUE(read.minimum_time_steps == state.minimum_time_steps);
+  ASSERT_EQ(read.optimization_iterations_completed, state.optimization_iterations_completed);
+  ASSERT_EQ(read.iterations, state.iterations);
+  ASSERT_EQ(read.checkpoint_counter, state.checkpoint_counter);
+  ASSERT_EQ(read.checkpoint_iteration, state.checkpoint_iteration);
+  ASSERT_EQ(read.procrustes_counter, state.procrustes_counter);
+  ASSERT_EQ(read.saturation_counter, state.saturation_counter);
+  ASSERT_EQ(read.sampling_energy, state.sampling_energy);
+  ASSERT_EQ(read.correspondence_energy, state.correspondence_energy);
+  ASSERT_EQ(read.total_energy, state.total_energy);
+  ExpectSameEntropyState(read.ensemble_entropy, state.ensemble_entropy);
+  ExpectSameEntropyState(read.mesh_based_entropy, state.mesh_based_entropy);
+  ExpectSameEntropyState(read.regression_entropy, state.regression_entropy);
+  ExpectSameEntropyState(read.mixed_effects_entropy, state.mixed_effects_entropy);
+
+  // a file cut short anywhere is rejected, and leaves the state as it was
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  const std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  in.close();
+  const std::string truncated = "optimizer_state_test_truncated.state";
+  for (size_t length = 0; length < contents.size(); length++) {
+    std::ofstream out(truncated.c_str(), std::ios::binary);
+    out.write(contents.data(), length);
+    out.close();
+    ASSERT_FALSE(read.Read(truncated)) << "read " << length << " of " << contents.size() << " bytes";
+  }
+  ASSERT_TRUE(read.positions == state.positions);
+  ASSERT_EQ(read.total_energy, state.total_energy);
+
+  std::remove(filename.c_str());
+  std::remove(truncated.c_str());
+}
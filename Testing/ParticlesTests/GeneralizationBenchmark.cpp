@@ -0,0 +1,129 @@
+// Compares ShapeEvaluation::ComputeGeneralization with the previous
+// implementation, which computed a full U with an SVD for every leave-one-out
+// fold.
+//
+// usage: GeneralizationBenchmark [numShapes] [numParticles] [nModes]
+//
+// A synthetic particle system is written to the working directory, loaded,
+// and evaluated with both implementations. ComputeGeneralization lifts the
+// leading modes from the eigendecomposition of each fold's Gram matrix, which
+// agrees with the SVD only up to rounding, so the results must match to a
+// relative tolerance.
+
+#include <Libs/Particles/ParticleSystem.h>
+#include <Libs/Particles/ShapeEvaluation.h>
+
+#include <Eigen/Core>
+#include <Eigen/SVD>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace shapeworks;
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMajorMatrix;
+
+//---------------------------------------------------------------------------
+static double ReferenceGeneralization(const ParticleSystem &particleSystem, const int nModes)
+{
+  const int VDimension = 3;
+  const int N = particleSystem.N();
+  const int D = particleSystem.D();
+  const Eigen::MatrixXd &P = particleSystem.Particles();
+
+  double totalDist = 0.0;
+  for (int leave = 0; leave < N; leave++) {
+
+    Eigen::MatrixXd Y(D, N - 1);
+    Y.leftCols(leave) = P.leftCols(leave);
+    Y.rightCols(N - leave - 1) = P.rightCols(N - leave - 1);
+
+    const Eigen::VectorXd mu = Y.rowwise().mean();
+    Y.colwise() -= mu;
+    const Eigen::VectorXd Ytest = P.col(leave);
+
+    Eigen::JacobiSVD<Eigen::MatrixXd> svd(Y, Eigen::ComputeFullU);
+    const auto epsi = svd.matrixU().block(0, 0, D, nModes);
+    const auto betas = epsi.transpose() * (Ytest - mu);
+    const Eigen::VectorXd rec = epsi * betas + mu;
+
+    const int numParticles = D / VDimension;
+    const Eigen::Map<const RowMajorMatrix> Ytest_reshaped(Ytest.data(), numParticles, VDimension);
+    const Eigen::Map<const RowMajorMatrix> rec_reshaped(rec.data(), numParticles, VDimension);
+    totalDist += (rec_reshaped - Ytest_reshaped).rowwise().norm().sum() / numParticles;
+  }
+  return totalDist / N;
+}
+
+//---------------------------------------------------------------------------
+// Writes ellipsoids with random axis lengths and noise, one file per shape.
+static std::vector<std::string> WriteSyntheticShapes(int numShapes, int numParticles)
+{
+  std::mt19937 gen(1);
+  std::normal_distribution<> noise(0.0, 0.1);
+  std::uniform_real_distribution<> axis(8.0, 12.0);
+
+  std::vector<std::string> paths;
+  for (int s = 0; s < numShapes; s++) {
+    const double a = axis(gen), b = axis(gen), c = axis(gen);
+    const std::string path = "generalization_benchmark_" + std::to_string(s) + ".particles";
+    std::ofstream out(path);
+    for (int i = 0; i < numParticles; i++) {
+      // Points of a Fibonacci sphere, stretched to the ellipsoid.
+      const double z = 1.0 - 2.0 * (i + 0.5) / numParticles;
+      const double r = std::sqrt(1.0 - z * z);
+      const double phi = 2.399963229728653 * i;
+      out << a * r * std::cos(phi) + noise(gen) << " "
+          << b * r * std::sin(phi) + noise(gen) << " "
+          << c * z + noise(gen) << "\n";
+    }
+    paths.push_back(path);
+  }
+  return paths;
+}
+
+//---------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  const int numShapes = argc > 1 ? std::atoi(argv[1]) : 100;
+  const int numParticles = argc > 2 ? std::atoi(argv[2]) : 1024;
+  const int nModes = argc > 3 ? std::atoi(argv[3]) : 3;
+
+  const std::vector<std::string> paths = WriteSyntheticShapes(numShapes, numParticles);
+  ParticleSystem particleSystem;
+  if (!particleSystem.LoadParticles(paths)) {
+    return 1;
+  }
+
+  typedef std::chrono::steady_clock Clock;
+
+  Clock::time_point start = Clock::now();
+  const double current = ShapeEvaluation<3>::ComputeGeneralization(particleSystem, nModes);
+  const double currentSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  start = Clock::now();
+  const double reference = ReferenceGeneralization(particleSystem, nModes);
+  const double referenceSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  for (const std::string &path : paths) {
+    std::remove(path.c_str());
+  }
+
+  std::printf("%d shapes, %d particles, %d modes\n", numShapes, numParticles, nModes);
+  std::printf("SVD per fold:          %.17g  %.3f s\n", reference, referenceSeconds);
+  std::printf("ComputeGeneralization: %.17g  %.3f s\n", current, currentSeconds);
+
+  const double tolerance = 1e-12;
+  if (std::fabs(current - reference) > tolerance * std::fabs(reference)) {
+    std::cerr << "Results differ" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -1,10 +1,16 @@
 #include <gtest/gtest.h>
 
 #include <Libs/Particles/ParticleSystem.h>
+#include <Libs/Particles/ParticleEnsembleFile.h>
 #include <Libs/Particles/ShapeEvaluation.h>
 #include "TestConfiguration.h"
 #include <vector>
 #include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 
 using namespace shapeworks;
 
@@ -56,3 +62,47 @@ TEST(ParticlesTests, specificity_test)
   const double specificity = ShapeEvaluation<3>::ComputeSpecificity(particleSystem, 1);
   ASSERT_NEAR(specificity, 0.262809, 1e-1f);
 }
+
+//---------------------------------------------------------------------------
+TEST(ParticlesTests, ensemble_file_test)
+{
+  auto particleSystem = ParticleSystem();
+  ASSERT_TRUE(particleSystem.LoadParticles(filenames));
+
+  const std::string ensemblePath = "ensemble_file_test.ensemble";
+  std::vector<std::string> names;
+  for (const std::string &path : filenames) {
+    names.push_back(path.substr(test_dir.size()));
+  }
+  const unsigned int numParticles = particleSystem.D() / 3;
+  ASSERT_TRUE(ParticleEnsembleFile::Write(ensemblePath, particleSystem.Particles(), names, {numParticles}));
+
+  auto ensembleSystem = ParticleSystem();
+  ASSERT_TRUE(ensembleSystem.LoadParticles({ensemblePath}));
+
+  ASSERT_TRUE(ensembleSystem.Particles() == particleSystem.Particles());
+  ASSERT_TRUE(ensembleSystem.Paths() == names);
+
+  // a data offset past the end of the file whose sum with the data size
+  // wraps around to the real offset
+  std::vector<char> bytes;
+  {
+    std::ifstream in(ensemblePath.c_str(), std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  std::remove(ensemblePath.c_str());
+  ASSERT_GT(bytes.size(), 32u);
+  uint64_t dataOffset;
+  std::memcpy(&dataOffset, &bytes[24], sizeof(dataOffset));
+  dataOffset -= static_cast<uint64_t>(particleSystem.Particles().size()) * sizeof(double);
+  std::memcpy(&bytes[24], &dataOffset, sizeof(dataOffset));
+
+  const std::string damagedPath = "ensemble_file_test_damaged.ensemble";
+  {
+    std::ofstream out(damagedPath.c_str(), std::ios::binary);
+    out.write(bytes.data(), bytes.size());
+  }
+  ParticleEnsembleFile damaged;
+  ASSERT_FALSE(damaged.Open(damagedPath));
+  std::remove(damagedPath.c_str());
+}